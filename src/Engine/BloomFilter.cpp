@@ -0,0 +1,102 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "BloomFilter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace McBopomofo {
+
+namespace {
+
+constexpr size_t kBitsPerBlock = 512;
+constexpr size_t kMaxHashCount = 16;
+
+// Derives the second hash from the first one (a 64-bit finalizer from
+// MurmurHash3) for double hashing.
+uint64_t Remix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+}  // namespace
+
+void BloomFilter::reset(size_t keyCount, size_t bitsPerKey) {
+  size_t bits = std::max<size_t>(keyCount, 1) * std::max<size_t>(bitsPerKey, 1);
+  blocks_.assign((bits + kBitsPerBlock - 1) / kBitsPerBlock, Block{});
+
+  // The optimal number of hash functions is ln 2 * bits per key.
+  hashCount_ = std::clamp<size_t>(
+      static_cast<size_t>(std::lround(0.69 * static_cast<double>(bitsPerKey))),
+      1, kMaxHashCount);
+}
+
+void BloomFilter::clear() {
+  blocks_.clear();
+  blocks_.shrink_to_fit();
+  hashCount_ = 0;
+}
+
+void BloomFilter::add(std::string_view key) {
+  if (blocks_.empty()) {
+    return;
+  }
+  uint64_t h = std::hash<std::string_view>()(key);
+  Block& block = blocks_[h % blocks_.size()];
+  uint64_t h2 = Remix(h);
+  uint32_t a = static_cast<uint32_t>(h2);
+  uint32_t b = static_cast<uint32_t>(h2 >> 32) | 1;
+  for (size_t i = 0; i < hashCount_; ++i) {
+    uint32_t bit = (a + static_cast<uint32_t>(i) * b) % kBitsPerBlock;
+    block.words[bit / 64] |= static_cast<uint64_t>(1) << (bit % 64);
+  }
+}
+
+bool BloomFilter::mayContain(std::string_view key) const {
+  if (blocks_.empty()) {
+    return true;
+  }
+  ++stats_.queries;
+  uint64_t h = std::hash<std::string_view>()(key);
+  const Block& block = blocks_[h % blocks_.size()];
+  uint64_t h2 = Remix(h);
+  uint32_t a = static_cast<uint32_t>(h2);
+  uint32_t b = static_cast<uint32_t>(h2 >> 32) | 1;
+  for (size_t i = 0; i < hashCount_; ++i) {
+    uint32_t bit = (a + static_cast<uint32_t>(i) * b) % kBitsPerBlock;
+    if ((block.words[bit / 64] & (static_cast<uint64_t>(1) << (bit % 64))) ==
+        0) {
+      ++stats_.rejections;
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace McBopomofo
@@ -0,0 +1,93 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_BLOOMFILTER_H_
+#define SRC_ENGINE_BLOOMFILTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace McBopomofo {
+
+// A cache-blocked Bloom filter over string keys. It answers "definitely
+// absent" for most keys that were never added, which lets a model skip a
+// lookup. Each key sets all its bits in one 64-byte block, so a query touches
+// at most one cache line.
+//
+// An empty filter (one that has not been reset to a size) lets every key
+// through without counting, so a model can consult the filter regardless of
+// whether it is enabled.
+//
+// The counters are not synchronized. Like the models that own them, a filter
+// must not be queried from more than one thread at a time.
+class BloomFilter {
+ public:
+  static constexpr size_t kDefaultBitsPerKey = 10;
+
+  struct Stats {
+    // Number of queries made to a non-empty filter.
+    uint64_t queries = 0;
+    // Queries answered with "definitely absent"; each one is a saved lookup.
+    uint64_t rejections = 0;
+    // Queries that passed the filter but whose lookup found nothing, as
+    // reported by the owner with recordFalsePositive().
+    uint64_t falsePositives = 0;
+  };
+
+  // Clears the filter and sizes it for the given number of keys. With the
+  // default 10 bits per key, the false positive rate is about 1%. The stats
+  // are kept.
+  void reset(size_t keyCount, size_t bitsPerKey = kDefaultBitsPerKey);
+
+  // Releases the memory. The filter becomes empty. The stats are kept.
+  void clear();
+
+  void add(std::string_view key);
+
+  // Returns false if the key was definitely never added.
+  [[nodiscard]] bool mayContain(std::string_view key) const;
+
+  [[nodiscard]] bool empty() const { return blocks_.empty(); }
+  [[nodiscard]] size_t sizeInBytes() const {
+    return blocks_.size() * sizeof(Block);
+  }
+
+  void recordFalsePositive() const { ++stats_.falsePositives; }
+  [[nodiscard]] const Stats& stats() const { return stats_; }
+  void resetStats() { stats_ = Stats(); }
+
+ private:
+  struct alignas(64) Block {
+    uint64_t words[8];
+  };
+
+  std::vector<Block> blocks_;
+  size_t hashCount_ = 0;
+  mutable Stats stats_;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_ENGINE_BLOOMFILTER_H_
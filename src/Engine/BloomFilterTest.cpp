@@ -0,0 +1,97 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "BloomFilter.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+TEST(BloomFilterTest, EmptyFilterLetsEverythingThrough) {
+  BloomFilter filter;
+  EXPECT_TRUE(filter.empty());
+  EXPECT_TRUE(filter.mayContain("a"));
+  EXPECT_TRUE(filter.mayContain(""));
+  EXPECT_EQ(filter.stats().queries, 0);
+
+  // Adding to an empty filter is a no-op.
+  filter.add("a");
+  EXPECT_TRUE(filter.empty());
+}
+
+TEST(BloomFilterTest, NoFalseNegatives) {
+  BloomFilter filter;
+  filter.reset(1000);
+  EXPECT_FALSE(filter.empty());
+  for (int i = 0; i < 1000; i++) {
+    filter.add("key" + std::to_string(i));
+  }
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_TRUE(filter.mayContain("key" + std::to_string(i)));
+  }
+  EXPECT_EQ(filter.stats().queries, 1000);
+  EXPECT_EQ(filter.stats().rejections, 0);
+}
+
+TEST(BloomFilterTest, MostAbsentKeysAreRejected) {
+  BloomFilter filter;
+  filter.reset(10000);
+  for (int i = 0; i < 10000; i++) {
+    filter.add("key" + std::to_string(i));
+  }
+
+  size_t passed = 0;
+  for (int i = 0; i < 10000; i++) {
+    if (filter.mayContain("absent" + std::to_string(i))) {
+      ++passed;
+    }
+  }
+  // About 1% with the default 10 bits per key; allow some slack.
+  EXPECT_LT(passed, 300);
+  EXPECT_EQ(filter.stats().queries, 10000);
+  EXPECT_EQ(filter.stats().rejections, 10000 - passed);
+}
+
+TEST(BloomFilterTest, StatsAreKeptAcrossResets) {
+  BloomFilter filter;
+  filter.reset(10);
+  filter.add("a");
+  EXPECT_TRUE(filter.mayContain("a"));
+  filter.recordFalsePositive();
+  EXPECT_EQ(filter.stats().falsePositives, 1);
+
+  filter.reset(10);
+  EXPECT_EQ(filter.stats().queries, 1);
+  filter.clear();
+  EXPECT_TRUE(filter.empty());
+  EXPECT_EQ(filter.sizeInBytes(), 0);
+  EXPECT_EQ(filter.stats().queries, 1);
+
+  filter.resetStats();
+  EXPECT_EQ(filter.stats().queries, 0);
+  EXPECT_EQ(filter.stats().falsePositives, 0);
+}
+
+}  // namespace McBopomofo
@@ -43,6 +43,8 @@
 
 #include "ByteBlockBackedDictionary.h"
 
+#include <functional>
+
 namespace McBopomofo {
 
 namespace {
@@ -467,7 +469,10 @@ const char* NEON_FindFirstNULL(const char* ptr, const char* end,
 }  // namespace
 
 void ByteBlockBackedDictionary::clear() {
-  dict_.clear();
+  slots_.clear();
+  entries_.clear();
+  values_.clear();
+  rows_.clear();
   issues_.clear();
 }
 
@@ -602,7 +607,7 @@ bool ByteBlockBackedDictionary::parse(const char* block, size_t size,
 
       std::string_view key(keyStart, keyEnd - keyStart);
       std::string_view value(valueStart, valueEnd - valueStart);
-      dict_[key].emplace_back(value);
+      addRow(key, value);
     }
   } else {
     while (ptr != end) {
@@ -682,24 +687,108 @@ bool ByteBlockBackedDictionary::parse(const char* block, size_t size,
 
       std::string_view key(maybeKeyStart, maybeKeyEnd - maybeKeyStart);
       std::string_view value(valueStart, valueEnd - valueStart);
-      dict_[key].emplace_back(value);
+      addRow(key, value);
     }
   }
 
+  finishRows();
   return true;
 }
 
 bool ByteBlockBackedDictionary::hasKey(const std::string_view& key) const {
-  return dict_.find(key) != dict_.end();
+  return findEntry(key) != nullptr;
 }
 
 std::vector<std::string_view> ByteBlockBackedDictionary::getValues(
     const std::string_view& key) const {
-  const auto it = dict_.find(key);
-  if (it == dict_.cend()) {
+  std::span<const std::string_view> values = findValues(key);
+  return {values.begin(), values.end()};
+}
+
+std::span<const std::string_view> ByteBlockBackedDictionary::findValues(
+    const std::string_view& key) const {
+  const Entry* entry = findEntry(key);
+  if (entry == nullptr) {
     return {};
   }
-  return it->second;
+  return {values_.data() + entry->begin, entry->count};
+}
+
+void ByteBlockBackedDictionary::addRow(std::string_view key,
+                                       std::string_view value) {
+  if ((entries_.size() + 1) * 2 > slots_.size()) {
+    growSlots();
+  }
+
+  size_t hash = std::hash<std::string_view>()(key);
+  size_t mask = slots_.size() - 1;
+  size_t i = hash & mask;
+  while (slots_[i] != 0) {
+    Entry& entry = entries_[slots_[i] - 1];
+    if (entry.hash == hash && entry.key == key) {
+      ++entry.count;
+      rows_.push_back({slots_[i] - 1, value});
+      return;
+    }
+    i = (i + 1) & mask;
+  }
+
+  auto index = static_cast<uint32_t>(entries_.size());
+  entries_.push_back({key, hash, 0, 1});
+  slots_[i] = index + 1;
+  rows_.push_back({index, value});
+}
+
+void ByteBlockBackedDictionary::finishRows() {
+  // Lay out each key's values next to each other, in the order they appear
+  // in the text.
+  uint32_t begin = 0;
+  for (Entry& entry : entries_) {
+    entry.begin = begin;
+    begin += entry.count;
+    entry.count = 0;
+  }
+
+  values_.resize(rows_.size());
+  for (const Row& row : rows_) {
+    Entry& entry = entries_[row.entry];
+    values_[entry.begin + entry.count] = row.value;
+    ++entry.count;
+  }
+
+  // The rows are as large as the values; don't hold on to them.
+  rows_ = {};
+}
+
+const ByteBlockBackedDictionary::Entry* ByteBlockBackedDictionary::findEntry(
+    std::string_view key) const {
+  if (slots_.empty()) {
+    return nullptr;
+  }
+
+  size_t hash = std::hash<std::string_view>()(key);
+  size_t mask = slots_.size() - 1;
+  for (size_t i = hash & mask; slots_[i] != 0; i = (i + 1) & mask) {
+    const Entry& entry = entries_[slots_[i] - 1];
+    if (entry.hash == hash && entry.key == key) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+void ByteBlockBackedDictionary::growSlots() {
+  size_t size = slots_.empty() ? MIN_SLOT_COUNT : slots_.size() * 2;
+  slots_.assign(size, 0);
+
+  size_t mask = size - 1;
+  for (size_t e = 0, count = entries_.size(); e < count; ++e) {
+    size_t i = entries_[e].hash & mask;
+    while (slots_[i] != 0) {
+      i = (i + 1) & mask;
+    }
+    slots_[i] = static_cast<uint32_t>(e + 1);
+  }
 }
 
 }  // namespace McBopomofo
@@ -24,8 +24,9 @@
 #ifndef SRC_ENGINE_BYTEBLOCKBACKEDDICTIONARY_H_
 #define SRC_ENGINE_BYTEBLOCKBACKEDDICTIONARY_H_
 
+#include <cstdint>
+#include <span>
 #include <string_view>
-#include <unordered_map>
 #include <vector>
 
 namespace McBopomofo {
@@ -64,6 +65,12 @@ namespace McBopomofo {
 // uses std::string_view instead of copying key and value strings out of the
 // text. Therefore, the dictionary must not be used if the block of bytes is
 // gone! You can call clear() to clear all such dangling references to the text.
+//
+// The keys are kept in an open-addressing hash table with linear probing. Each
+// key records its hash and a [begin, begin + count) range into one contiguous
+// array of values, so a parse only makes a handful of allocations no matter
+// how many keys there are, and a lookup touches at most a couple of cache
+// lines before comparing the key.
 class ByteBlockBackedDictionary {
  public:
   struct Issue {
@@ -93,13 +100,53 @@ class ByteBlockBackedDictionary {
   [[nodiscard]] std::vector<std::string_view> getValues(
       const std::string_view& key) const;
 
+  // Same as getValues(), but without copying. The span is valid until the
+  // next parse() or clear().
+  [[nodiscard]] std::span<const std::string_view> findValues(
+      const std::string_view& key) const;
+
+  [[nodiscard]] size_t keyCount() const { return entries_.size(); }
+
+  // Calls visitor(std::string_view) with each key, in no particular order.
+  template <typename Visitor>
+  void forEachKey(Visitor&& visitor) const {
+    for (const auto& entry : entries_) {
+      visitor(entry.key);
+    }
+  }
+
   const std::vector<Issue>& issues() const { return issues_; }
 
  private:
   static constexpr size_t MAX_ISSUES = 100;
+  static constexpr size_t MIN_SLOT_COUNT = 16;
+
+  struct Entry {
+    std::string_view key;
+    size_t hash;
+    uint32_t begin;
+    uint32_t count;
+  };
+
+  // A parsed line, waiting to be moved into values_ once all lines are read.
+  struct Row {
+    uint32_t entry;
+    std::string_view value;
+  };
+
+  void addRow(std::string_view key, std::string_view value);
+  void finishRows();
+  [[nodiscard]] const Entry* findEntry(std::string_view key) const;
+  void growSlots();
 
   std::vector<Issue> issues_;
-  std::unordered_map<std::string_view, std::vector<std::string_view>> dict_;
+
+  // Indices into entries_ plus one; 0 marks an empty slot. The size is always
+  // a power of two and the table is kept at most half full.
+  std::vector<uint32_t> slots_;
+  std::vector<Entry> entries_;
+  std::vector<std::string_view> values_;
+  std::vector<Row> rows_;
 };
 
 }  // namespace McBopomofo
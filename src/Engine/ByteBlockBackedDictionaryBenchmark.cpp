@@ -23,8 +23,12 @@
 
 #include <benchmark/benchmark.h>
 
+#include <cstdint>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #include "ByteBlockBackedDictionary.h"
 
@@ -57,6 +61,38 @@ const std::string& GetTestData() {
   return data;
 }
 
+// Shaped like a user phrase file: many keys with only a value or two each.
+const std::string& GetManyKeysTestData() {
+  static const std::string data = []() {
+    std::stringstream sst;
+
+    constexpr int keys = 65536;
+    for (int k = 0; k < keys; ++k) {
+      sst << "key_" << k << " value_" << k << "\n";
+      if ((k % 4) == 0) {
+        sst << "key_" << k << " alt_value_" << k << "\n";
+      }
+    }
+    return sst.str();
+  }();
+  return data;
+}
+
+// The keys of GetManyKeysTestData(), or strings just like them that are not
+// keys, in a scrambled order so that lookups don't walk the table in order.
+std::vector<std::string> GetLookupKeys(bool hits) {
+  constexpr uint32_t keys = 65536;
+  std::vector<std::string> lookupKeys;
+  lookupKeys.reserve(keys);
+  for (uint32_t k = 0; k < keys; ++k) {
+    // An odd multiplier visits every key exactly once.
+    uint32_t scrambled = (k * 40503) % keys;
+    lookupKeys.push_back((hits ? "key_" : "nokey_") +
+                         std::to_string(scrambled));
+  }
+  return lookupKeys;
+}
+
 void BM_ByteBlockBackedDictionaryParseTest(benchmark::State& state) {
   const std::string& testData = GetTestData();
 
@@ -80,6 +116,90 @@ void BM_ByteBlockBackedDictionaryValueColumnFirstParseTest(
 }
 BENCHMARK(BM_ByteBlockBackedDictionaryValueColumnFirstParseTest);
 
+void BM_ByteBlockBackedDictionaryManyKeysParseTest(benchmark::State& state) {
+  const std::string& testData = GetManyKeysTestData();
+
+  for (auto _ : state) {
+    McBopomofo::ByteBlockBackedDictionary dictionary;
+    dictionary.parse(testData.c_str(), testData.size());
+  }
+}
+BENCHMARK(BM_ByteBlockBackedDictionaryManyKeysParseTest);
+
+void BM_ByteBlockBackedDictionaryHasKeyTest(benchmark::State& state) {
+  const std::string& testData = GetManyKeysTestData();
+  McBopomofo::ByteBlockBackedDictionary dictionary;
+  dictionary.parse(testData.c_str(), testData.size());
+  const std::vector<std::string> keys = GetLookupKeys(state.range(0) != 0);
+
+  for (auto _ : state) {
+    size_t found = 0;
+    for (const auto& key : keys) {
+      found += dictionary.hasKey(key) ? 1 : 0;
+    }
+    benchmark::DoNotOptimize(found);
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_ByteBlockBackedDictionaryHasKeyTest)->Arg(1)->Arg(0);
+
+void BM_ByteBlockBackedDictionaryFindValuesTest(benchmark::State& state) {
+  const std::string& testData = GetManyKeysTestData();
+  McBopomofo::ByteBlockBackedDictionary dictionary;
+  dictionary.parse(testData.c_str(), testData.size());
+  const std::vector<std::string> keys = GetLookupKeys(true);
+
+  for (auto _ : state) {
+    size_t values = 0;
+    for (const auto& key : keys) {
+      values += dictionary.findValues(key).size();
+    }
+    benchmark::DoNotOptimize(values);
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_ByteBlockBackedDictionaryFindValuesTest);
+
+void BM_ByteBlockBackedDictionaryGetValuesTest(benchmark::State& state) {
+  const std::string& testData = GetManyKeysTestData();
+  McBopomofo::ByteBlockBackedDictionary dictionary;
+  dictionary.parse(testData.c_str(), testData.size());
+  const std::vector<std::string> keys = GetLookupKeys(true);
+
+  for (auto _ : state) {
+    size_t values = 0;
+    for (const auto& key : keys) {
+      values += dictionary.getValues(key).size();
+    }
+    benchmark::DoNotOptimize(values);
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_ByteBlockBackedDictionaryGetValuesTest);
+
+// The same lookups against the node-based map the dictionary used to be
+// built on, for comparison.
+void BM_UnorderedMapHasKeyBaseline(benchmark::State& state) {
+  const std::string& testData = GetManyKeysTestData();
+  McBopomofo::ByteBlockBackedDictionary dictionary;
+  dictionary.parse(testData.c_str(), testData.size());
+  std::unordered_map<std::string_view, std::vector<std::string_view>> map;
+  dictionary.forEachKey([&](std::string_view key) {
+    map[key] = dictionary.getValues(key);
+  });
+  const std::vector<std::string> keys = GetLookupKeys(state.range(0) != 0);
+
+  for (auto _ : state) {
+    size_t found = 0;
+    for (const auto& key : keys) {
+      found += map.find(key) != map.end() ? 1 : 0;
+    }
+    benchmark::DoNotOptimize(found);
+  }
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_UnorderedMapHasKeyBaseline)->Arg(1)->Arg(0);
+
 };  // namespace
 
 BENCHMARK_MAIN();
@@ -21,6 +21,8 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 // OTHER DEALINGS IN THE SOFTWARE.
 
+#include <string>
+
 #include "ByteBlockBackedDictionary.h"
 #include "gtest/gtest.h"
 
@@ -282,4 +284,58 @@ TEST(ByteBlockBackedDictionaryTest, ComplexEntriesValueThenKey) {
   ASSERT_EQ(dict.getValues("comment").at(0), "value1 \t key1  #");
 }
 
+TEST(ByteBlockBackedDictionaryTest, ManyKeys) {
+  // Enough keys to grow the table several times, with every other key
+  // appearing twice, far apart.
+  constexpr int kKeys = 5000;
+  std::string data;
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int k = pass; k < kKeys; k += pass + 1) {
+      data += "key" + std::to_string(k) + " value" + std::to_string(k) + "_" +
+              std::to_string(pass) + "\n";
+    }
+  }
+
+  ByteBlockBackedDictionary dict;
+  ASSERT_TRUE(dict.parse(data.c_str(), data.size()));
+  ASSERT_EQ(dict.keyCount(), kKeys);
+
+  size_t visited = 0;
+  dict.forEachKey([&visited](std::string_view) { ++visited; });
+  ASSERT_EQ(visited, kKeys);
+
+  for (int k = 0; k < kKeys; ++k) {
+    std::string key = "key" + std::to_string(k);
+    std::string value = "value" + std::to_string(k);
+    auto values = dict.findValues(key);
+    ASSERT_EQ(values.size(), (k % 2 == 1) ? 2 : 1) << key;
+    ASSERT_EQ(values[0], value + "_0");
+    if (values.size() == 2) {
+      ASSERT_EQ(values[1], value + "_1");
+    }
+  }
+  ASSERT_FALSE(dict.hasKey("key" + std::to_string(kKeys)));
+  ASSERT_TRUE(dict.findValues("value0_0").empty());
+}
+
+TEST(ByteBlockBackedDictionaryTest, ReparseReplacesEntries) {
+  constexpr char data1[] = "key1 value1\nkey2 value2\nkey1 value3";
+  constexpr char data2[] = "key2 value4";
+  ByteBlockBackedDictionary dict;
+  ASSERT_TRUE(dict.parse(data1, sizeof(data1)));
+  ASSERT_EQ(dict.keyCount(), 2);
+  ASSERT_EQ(dict.getValues("key1").size(), 2);
+
+  ASSERT_TRUE(dict.parse(data2, sizeof(data2)));
+  ASSERT_EQ(dict.keyCount(), 1);
+  ASSERT_FALSE(dict.hasKey("key1"));
+  ASSERT_EQ(dict.getValues("key2").size(), 1);
+  ASSERT_EQ(dict.getValues("key2").at(0), "value4");
+
+  dict.clear();
+  ASSERT_EQ(dict.keyCount(), 0);
+  ASSERT_FALSE(dict.hasKey("key2"));
+  ASSERT_TRUE(dict.findValues("key2").empty());
+}
+
 }  // namespace McBopomofo
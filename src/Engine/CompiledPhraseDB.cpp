@@ -0,0 +1,463 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "CompiledPhraseDB.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <charconv>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "ParselessPhraseDB.h"
+
+namespace McBopomofo {
+
+namespace {
+
+static_assert(std::endian::native == std::endian::little,
+              "CompiledPhraseDB assumes a little-endian host");
+
+// Field offsets of the header.
+constexpr size_t kMagicOffset = 0;
+constexpr size_t kVersionOffset = 8;
+constexpr size_t kChecksumOffset = 12;
+constexpr size_t kKeyCountOffset = 16;
+constexpr size_t kRowCountOffset = 20;
+constexpr size_t kPoolLengthOffset = 24;
+constexpr size_t kHeaderSize = 32;
+
+constexpr size_t kKeyEntrySize = 12;
+constexpr size_t kRowEntrySize = 12;
+
+// The checksum covers everything after the checksum field itself.
+constexpr size_t kChecksumStart = kChecksumOffset + sizeof(uint32_t);
+
+uint32_t ReadU32(const char* ptr) {
+  uint32_t value;
+  memcpy(&value, ptr, sizeof(value));
+  return value;
+}
+
+float ReadF32(const char* ptr) {
+  float value;
+  memcpy(&value, ptr, sizeof(value));
+  return value;
+}
+
+void AppendU32(std::string* output, uint32_t value) {
+  output->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendF32(std::string* output, float value) {
+  output->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void WriteU32(std::string* output, size_t offset, uint32_t value) {
+  memcpy(output->data() + offset, &value, sizeof(value));
+}
+
+struct CompilingRow {
+  uint32_t valueOffset;
+  uint32_t valueLength;
+  float score;
+};
+
+struct CompilingKey {
+  std::string_view key;
+  uint32_t firstRow;
+};
+
+// Checks that every key and value lies within the string pool, and that the
+// key table partitions the rows in order. Assumes a valid header.
+bool ValidateTables(const char* buf) {
+  uint64_t keyCount = ReadU32(buf + kKeyCountOffset);
+  uint64_t rowCount = ReadU32(buf + kRowCountOffset);
+  uint64_t poolLength = ReadU32(buf + kPoolLengthOffset);
+  const char* keyTable = buf + kHeaderSize;
+  const char* rowTable = keyTable + (keyCount + 1) * kKeyEntrySize;
+
+  auto inPool = [poolLength](const char* entry) {
+    uint64_t offset = ReadU32(entry);
+    uint64_t length = ReadU32(entry + 4);
+    return offset + length <= poolLength;
+  };
+
+  uint32_t previousFirstRow = 0;
+  for (size_t i = 0; i <= keyCount; ++i) {
+    const char* entry = keyTable + i * kKeyEntrySize;
+    uint32_t firstRow = ReadU32(entry + 8);
+    if (firstRow < previousFirstRow || firstRow > rowCount) {
+      return false;
+    }
+    if (i < keyCount && !inPool(entry)) {
+      return false;
+    }
+    previousFirstRow = firstRow;
+  }
+
+  for (size_t i = 0; i < rowCount; ++i) {
+    if (!inPool(rowTable + i * kRowEntrySize)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+CompiledPhraseDB::CompiledPhraseDB(const char* buf, size_t length)
+    : base_(buf), length_(length) {
+  assert(buf != nullptr);
+  assert(length >= kHeaderSize);
+  keyCount_ = ReadU32(buf + kKeyCountOffset);
+  rowCount_ = ReadU32(buf + kRowCountOffset);
+  keyTable_ = buf + kHeaderSize;
+  rowTable_ = keyTable_ + (keyCount_ + 1) * kKeyEntrySize;
+  pool_ = rowTable_ + rowCount_ * kRowEntrySize;
+}
+
+size_t CompiledPhraseDB::findKey(const std::string_view& key) const {
+  size_t low = 0;
+  size_t high = keyCount_;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    int cmp = keyAt(mid).compare(key);
+    if (cmp == 0) {
+      return mid;
+    }
+    if (cmp < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return keyCount_;
+}
+
+std::string_view CompiledPhraseDB::keyAt(size_t keyIndex) const {
+  assert(keyIndex < keyCount_);
+  const char* entry = keyTable_ + keyIndex * kKeyEntrySize;
+  return {pool_ + ReadU32(entry), ReadU32(entry + 4)};
+}
+
+CompiledPhraseDB::KeyRange CompiledPhraseDB::narrow(
+    const KeyRange& range, const std::string_view& text) const {
+  // Compares the part of the key past the shared prefix with the text,
+  // truncated to the length of the text.
+  auto part = [&](size_t keyIndex) {
+    std::string_view key = keyAt(keyIndex);
+    return key.substr(std::min(range.prefixLength, key.length()),
+                      text.length());
+  };
+
+  size_t lo = range.begin;
+  size_t hi = range.end;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (part(mid) < text) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  size_t begin = lo;
+  hi = range.end;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (part(mid) <= text) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return {begin, lo, range.prefixLength + text.length()};
+}
+
+size_t CompiledPhraseDB::firstRowOf(size_t keyIndex) const {
+  assert(keyIndex <= keyCount_);
+  return ReadU32(keyTable_ + keyIndex * kKeyEntrySize + 8);
+}
+
+size_t CompiledPhraseDB::keyIndexOfRow(size_t row) const {
+  assert(row < rowCount_);
+  // Finds the last key whose first row is not after the row.
+  size_t low = 0;
+  size_t high = keyCount_;
+  while (high - low > 1) {
+    size_t mid = low + (high - low) / 2;
+    if (firstRowOf(mid) <= row) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+std::string_view CompiledPhraseDB::valueAt(size_t row) const {
+  assert(row < rowCount_);
+  const char* entry = rowTable_ + row * kRowEntrySize;
+  return {pool_ + ReadU32(entry), ReadU32(entry + 4)};
+}
+
+float CompiledPhraseDB::scoreAt(size_t row) const {
+  assert(row < rowCount_);
+  return ReadF32(rowTable_ + row * kRowEntrySize + 8);
+}
+
+bool CompiledPhraseDB::verifyChecksum() const {
+  return Checksum(base_ + kChecksumStart, length_ - kChecksumStart) ==
+         ReadU32(base_ + kChecksumOffset);
+}
+
+bool CompiledPhraseDB::HasMagic(const char* buf, size_t length) {
+  if (buf == nullptr || length < COMPILED_DB_MAGIC.length()) {
+    return false;
+  }
+  return std::string_view(buf + kMagicOffset, COMPILED_DB_MAGIC.length()) ==
+         COMPILED_DB_MAGIC;
+}
+
+bool CompiledPhraseDB::ValidateHeader(const char* buf, size_t length) {
+  if (length < kHeaderSize || !HasMagic(buf, length)) {
+    return false;
+  }
+  if (ReadU32(buf + kVersionOffset) != kVersion) {
+    return false;
+  }
+
+  // Use 64-bit arithmetic so that a corrupt header cannot overflow.
+  uint64_t keyCount = ReadU32(buf + kKeyCountOffset);
+  uint64_t rowCount = ReadU32(buf + kRowCountOffset);
+  uint64_t poolLength = ReadU32(buf + kPoolLengthOffset);
+  uint64_t expected = kHeaderSize + (keyCount + 1) * kKeyEntrySize +
+                      rowCount * kRowEntrySize + poolLength;
+  if (expected != length) {
+    return false;
+  }
+
+  // The sentinel must close the row table.
+  const char* keyTable = buf + kHeaderSize;
+  return ReadU32(keyTable + keyCount * kKeyEntrySize + 8) == rowCount;
+}
+
+std::unique_ptr<CompiledPhraseDB> CompiledPhraseDB::CreateValidatedDB(
+    const char* buf, size_t length) {
+  if (buf == nullptr || length == 0) {
+    return nullptr;
+  }
+
+  if (!ValidateHeader(buf, length) || !ValidateTables(buf)) {
+    return nullptr;
+  }
+
+  // The tables are only used from here on, so a corrupt block must not get
+  // past this point. One pass over the block is cheap next to parsing the
+  // text database it replaces.
+  auto db = std::make_unique<CompiledPhraseDB>(buf, length);
+  if (!db->verifyChecksum()) {
+    return nullptr;
+  }
+  return db;
+}
+
+bool CompiledPhraseDB::Compile(const char* buf, size_t length,
+                               std::string* output, RowLayout layout,
+                               std::vector<Issue>* issues) {
+  const char* ptr = buf;
+  const char* end = buf + length;
+  size_t lineNumber = 0;
+  if (ParselessPhraseDB::ValidatePragma(buf, length)) {
+    ptr += SORTED_PRAGMA_HEADER.length();
+    ++lineNumber;
+  }
+
+  std::string pool;
+  std::unordered_map<std::string_view, uint32_t> internedValues;
+  std::vector<CompilingKey> keys;
+  std::vector<CompilingRow> rows;
+  size_t issueCount = 0;
+
+  auto addIssue = [&](Issue::Type type) {
+    if (issues != nullptr && issues->size() < MAX_ISSUES) {
+      issues->emplace_back(type, lineNumber);
+    }
+    ++issueCount;
+  };
+
+  // Values are interned so that a value shared by many keys (which is common
+  // for single characters) is stored only once. The map keys point into the
+  // source buffer, which outlives this function call.
+  auto intern = [&](std::string_view value) -> uint32_t {
+    auto it = internedValues.find(value);
+    if (it != internedValues.end()) {
+      return it->second;
+    }
+    auto offset = static_cast<uint32_t>(pool.size());
+    pool.append(value);
+    internedValues.emplace(value, offset);
+    return offset;
+  };
+
+  size_t expectedColumns = layout == RowLayout::KEY_VALUE_SCORE ? 3 : 2;
+  while (ptr < end) {
+    const char* eol = static_cast<const char*>(memchr(ptr, '\n', end - ptr));
+    if (eol == nullptr) {
+      eol = end;
+    }
+    std::string_view line(ptr, eol - ptr);
+    ptr = eol + 1;
+    ++lineNumber;
+
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    // Split the line by single spaces. Note that the value column may be
+    // empty; the shipped data does have such rows.
+    std::string_view columns[3];
+    size_t columnCount = 0;
+    bool malformed = false;
+    while (true) {
+      if (columnCount == expectedColumns) {
+        malformed = true;
+        break;
+      }
+      size_t sep = line.find(' ');
+      columns[columnCount++] = line.substr(0, sep);
+      if (sep == std::string_view::npos) {
+        break;
+      }
+      line.remove_prefix(sep + 1);
+    }
+    if (malformed || columnCount != expectedColumns || columns[0].empty() ||
+        columns[expectedColumns - 1].empty()) {
+      addIssue(Issue::Type::MALFORMED_ROW);
+      continue;
+    }
+
+    std::string_view key = columns[0];
+    std::string_view value;
+    std::string_view scoreStr;
+    switch (layout) {
+      case RowLayout::KEY_VALUE_SCORE:
+        value = columns[1];
+        scoreStr = columns[2];
+        break;
+      case RowLayout::KEY_SCORE:
+        scoreStr = columns[1];
+        break;
+      case RowLayout::KEY_VALUE:
+        value = columns[1];
+        break;
+    }
+
+    float score = 0;
+    if (!scoreStr.empty()) {
+      const char* scoreEnd = scoreStr.data() + scoreStr.size();
+      auto [p, ec] = std::from_chars(scoreStr.data(), scoreEnd, score);
+      if (ec != std::errc() || p != scoreEnd) {
+        addIssue(Issue::Type::INVALID_SCORE);
+        continue;
+      }
+    }
+
+    if (keys.empty() || keys.back().key != key) {
+      if (!keys.empty() && key < keys.back().key) {
+        addIssue(Issue::Type::KEY_OUT_OF_ORDER);
+        continue;
+      }
+      keys.push_back({key, static_cast<uint32_t>(rows.size())});
+    }
+    rows.push_back({intern(value), static_cast<uint32_t>(value.size()), score});
+  }
+
+  if (issueCount > 0) {
+    return false;
+  }
+
+  // Keys are not interned; each distinct key occurs once anyway.
+  std::vector<uint32_t> keyOffsets;
+  keyOffsets.reserve(keys.size());
+  for (const auto& k : keys) {
+    keyOffsets.push_back(static_cast<uint32_t>(pool.size()));
+    pool.append(k.key);
+  }
+
+  // Pad the pool so that the total length stays 4-byte aligned.
+  while (pool.size() % 4 != 0) {
+    pool.push_back('\0');
+  }
+
+  std::string image;
+  image.reserve(kHeaderSize + (keys.size() + 1) * kKeyEntrySize +
+                rows.size() * kRowEntrySize + pool.size());
+  image.append(COMPILED_DB_MAGIC);
+  AppendU32(&image, kVersion);
+  AppendU32(&image, 0);  // Checksum, filled in below.
+  AppendU32(&image, static_cast<uint32_t>(keys.size()));
+  AppendU32(&image, static_cast<uint32_t>(rows.size()));
+  AppendU32(&image, static_cast<uint32_t>(pool.size()));
+  AppendU32(&image, 0);  // Reserved.
+  assert(image.size() == kHeaderSize);
+
+  for (size_t i = 0; i < keys.size(); ++i) {
+    AppendU32(&image, keyOffsets[i]);
+    AppendU32(&image, static_cast<uint32_t>(keys[i].key.size()));
+    AppendU32(&image, keys[i].firstRow);
+  }
+  AppendU32(&image, 0);
+  AppendU32(&image, 0);
+  AppendU32(&image, static_cast<uint32_t>(rows.size()));
+
+  for (const auto& row : rows) {
+    AppendU32(&image, row.valueOffset);
+    AppendU32(&image, row.valueLength);
+    AppendF32(&image, row.score);
+  }
+  image.append(pool);
+
+  WriteU32(&image, kChecksumOffset,
+           Checksum(image.data() + kChecksumStart,
+                    image.size() - kChecksumStart));
+  *output = std::move(image);
+  return true;
+}
+
+uint32_t CompiledPhraseDB::Checksum(const char* buf, size_t length) {
+  uint32_t hash = 2166136261U;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= static_cast<uint8_t>(buf[i]);
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+}  // namespace McBopomofo
@@ -0,0 +1,175 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_COMPILEDPHRASEDB_H_
+#define SRC_ENGINE_COMPILEDPHRASEDB_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace McBopomofo {
+
+constexpr std::string_view COMPILED_DB_MAGIC = "McBpmfDB";
+
+// A read-only, binary counterpart of ParselessPhraseDB. The rows are the same
+// (key, value, score) rows of a sorted text database, but compiled ahead of
+// time so that nothing has to be parsed at lookup time. The layout is:
+//
+//   header       magic, version, checksum, key count, row count, pool size
+//   key table    (key count + 1) entries of {offset, length, first row}
+//   row table    (row count) entries of {value offset, value length, score}
+//   string pool  the key bytes and the interned (deduplicated) value bytes
+//
+// Keys are stored in the same byte order as the text database, and each key
+// points to the contiguous rows that share it, in their original order. The
+// last key table entry is a sentinel whose first row is the row count. Scores
+// are stored as pre-parsed floats. All integers are 32-bit little-endian, and
+// all tables are 4-byte aligned, which allows the data to be used directly
+// from a memory-mapped file.
+//
+// Like ParselessPhraseDB, this class does not own the data. The caller must
+// keep the block alive during the lifetime of the instance.
+class CompiledPhraseDB {
+ public:
+  static constexpr uint32_t kVersion = 1;
+
+  // The columns of the rows in a text database to be compiled. Rows of the
+  // KEY_SCORE layout are compiled with an empty value, and rows of the
+  // KEY_VALUE layout are compiled with a score of 0.
+  enum class RowLayout {
+    KEY_VALUE_SCORE,
+    KEY_SCORE,
+    KEY_VALUE,
+  };
+
+  struct Issue {
+    enum class Type {
+      MALFORMED_ROW,
+      INVALID_SCORE,
+      KEY_OUT_OF_ORDER,
+    };
+
+    const Type type;
+
+    // Note these are 1-based number for usability.
+    const size_t lineNumber;
+
+    Issue(Type t, size_t n) : type(t), lineNumber(n) {}
+  };
+
+  // Use CreateValidatedDB() unless the block is known to be valid.
+  CompiledPhraseDB(const char* buf, size_t length);
+
+  CompiledPhraseDB(const CompiledPhraseDB&) = delete;
+  CompiledPhraseDB(CompiledPhraseDB&&) = delete;
+  CompiledPhraseDB& operator=(const CompiledPhraseDB&) = delete;
+  CompiledPhraseDB& operator=(CompiledPhraseDB&&) = delete;
+
+  [[nodiscard]] size_t keyCount() const { return keyCount_; }
+  [[nodiscard]] size_t rowCount() const { return rowCount_; }
+
+  // Returns the index of the key that exactly matches, or keyCount() if the
+  // key is not found.
+  [[nodiscard]] size_t findKey(const std::string_view& key) const;
+
+  [[nodiscard]] std::string_view keyAt(size_t keyIndex) const;
+
+  // A [begin, end) range of key indices whose keys share the first
+  // prefixLength bytes. See ParselessPhraseDB::PrefixCursor.
+  struct KeyRange {
+    size_t begin = 0;
+    size_t end = 0;
+    size_t prefixLength = 0;
+
+    [[nodiscard]] bool empty() const { return begin == end; }
+  };
+
+  [[nodiscard]] KeyRange allKeys() const { return {0, keyCount_, 0}; }
+
+  // Narrows the range to the keys that continue with the text after the
+  // shared prefix. If the result is not empty, and the key at its begin is
+  // exactly as long as the new prefix, that key is an exact match.
+  [[nodiscard]] KeyRange narrow(const KeyRange& range,
+                                const std::string_view& text) const;
+
+  // The rows of a key are [firstRowOf(keyIndex), firstRowOf(keyIndex + 1)).
+  [[nodiscard]] size_t firstRowOf(size_t keyIndex) const;
+
+  // Returns the index of the key that the row belongs to.
+  [[nodiscard]] size_t keyIndexOfRow(size_t row) const;
+
+  [[nodiscard]] std::string_view valueAt(size_t row) const;
+  [[nodiscard]] float scoreAt(size_t row) const;
+
+  // Recomputes the checksum of the block and compares it with the one stored
+  // in the header. This reads the entire block; CreateValidatedDB() does it
+  // once.
+  [[nodiscard]] bool verifyChecksum() const;
+
+  // Returns true if the block starts with the magic of a compiled database.
+  // This only checks the magic; use ValidateHeader() to check the layout.
+  static bool HasMagic(const char* buf, size_t length);
+
+  // Checks the magic, the version, and that all tables fit in the block.
+  static bool ValidateHeader(const char* buf, size_t length);
+
+  // Convenient function for validating and returning a DB instance. Besides
+  // the header, this checks that every key and value lies within the string
+  // pool, that the rows of the keys are in order, and the checksum. nullptr if
+  // the block is empty or is not valid.
+  static std::unique_ptr<CompiledPhraseDB> CreateValidatedDB(const char* buf,
+                                                             size_t length);
+
+  // Compiles a sorted text database (with or without the sorted pragma
+  // header) into a binary image. The columns of each row are separated by a
+  // single space and must match the layout. Comment lines and empty lines are
+  // skipped. The keys must be sorted by their byte values, which is what
+  // ParselessPhraseDB relies on. Returns false if any issue is found, in which
+  // case output is left untouched; if issues is not null, the first
+  // MAX_ISSUES issues are reported there.
+  static bool Compile(const char* buf, size_t length, std::string* output,
+                      RowLayout layout = RowLayout::KEY_VALUE_SCORE,
+                      std::vector<Issue>* issues = nullptr);
+
+  static constexpr size_t MAX_ISSUES = 100;
+
+  // FNV-1a, the checksum used in the header.
+  static uint32_t Checksum(const char* buf, size_t length);
+
+ private:
+  const char* base_;
+  size_t keyCount_;
+  size_t rowCount_;
+  const char* keyTable_;
+  const char* rowTable_;
+  const char* pool_;
+  size_t length_;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_ENGINE_COMPILEDPHRASEDB_H_
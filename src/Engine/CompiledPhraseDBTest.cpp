@@ -0,0 +1,301 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "CompiledPhraseDB.h"
+#include "MemoryMappedFile.h"
+#include "ParselessPhraseDB.h"
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+TEST(CompiledPhraseDBTest, CompileAndLookUp) {
+  std::string data =
+      "# format org.openvanilla.mcbopomofo.sorted\n"
+      "a 1 -1.5\n"
+      "a 2 -2.5\n"
+      "a-b 12 -3\n"
+      "b 2 0\n"
+      "c 1 -4\n";
+  std::string image;
+  ASSERT_TRUE(CompiledPhraseDB::Compile(data.data(), data.size(), &image));
+
+  auto db = CompiledPhraseDB::CreateValidatedDB(image.data(), image.size());
+  ASSERT_NE(db, nullptr);
+  EXPECT_TRUE(db->verifyChecksum());
+  EXPECT_EQ(db->keyCount(), 4);
+  EXPECT_EQ(db->rowCount(), 5);
+
+  size_t a = db->findKey("a");
+  ASSERT_NE(a, db->keyCount());
+  EXPECT_EQ(db->keyAt(a), "a");
+  ASSERT_EQ(db->firstRowOf(a + 1) - db->firstRowOf(a), 2);
+  EXPECT_EQ(db->valueAt(db->firstRowOf(a)), "1");
+  EXPECT_FLOAT_EQ(db->scoreAt(db->firstRowOf(a)), -1.5);
+  EXPECT_EQ(db->valueAt(db->firstRowOf(a) + 1), "2");
+  EXPECT_FLOAT_EQ(db->scoreAt(db->firstRowOf(a) + 1), -2.5);
+
+  size_t b = db->findKey("b");
+  ASSERT_NE(b, db->keyCount());
+  EXPECT_EQ(db->valueAt(db->firstRowOf(b)), "2");
+  EXPECT_FLOAT_EQ(db->scoreAt(db->firstRowOf(b)), 0);
+
+  EXPECT_NE(db->findKey("a-b"), db->keyCount());
+  EXPECT_NE(db->findKey("c"), db->keyCount());
+
+  // Exact match only.
+  EXPECT_EQ(db->findKey("a-"), db->keyCount());
+  EXPECT_EQ(db->findKey(""), db->keyCount());
+  EXPECT_EQ(db->findKey("d"), db->keyCount());
+}
+
+TEST(CompiledPhraseDBTest, NarrowKeyRange) {
+  std::string data = "a 1 0\na-b 2 0\na-b-c 3 0\na-c 4 0\nab 5 0\nb 6 0\n";
+  std::string image;
+  ASSERT_TRUE(CompiledPhraseDB::Compile(data.data(), data.size(), &image));
+  auto db = CompiledPhraseDB::CreateValidatedDB(image.data(), image.size());
+  ASSERT_NE(db, nullptr);
+
+  auto range = db->narrow(db->allKeys(), "a");
+  EXPECT_EQ(range.begin, 0);
+  EXPECT_EQ(range.end, 5);
+  EXPECT_EQ(range.prefixLength, 1);
+  EXPECT_EQ(db->keyAt(range.begin), "a");
+
+  range = db->narrow(range, "-b");
+  EXPECT_EQ(range.begin, 1);
+  EXPECT_EQ(range.end, 3);
+  EXPECT_EQ(db->keyAt(range.begin), "a-b");
+
+  range = db->narrow(range, "-");
+  EXPECT_EQ(range.begin, 2);
+  EXPECT_EQ(range.end, 3);
+  EXPECT_NE(db->keyAt(range.begin).size(), range.prefixLength);
+
+  EXPECT_TRUE(db->narrow(range, "d").empty());
+  EXPECT_TRUE(db->narrow(db->allKeys(), "c").empty());
+  EXPECT_TRUE(db->narrow(db->allKeys(), "0").empty());
+}
+
+TEST(CompiledPhraseDBTest, EmptyInput) {
+  std::string image;
+  ASSERT_TRUE(CompiledPhraseDB::Compile("", 0, &image));
+  auto db = CompiledPhraseDB::CreateValidatedDB(image.data(), image.size());
+  ASSERT_NE(db, nullptr);
+  EXPECT_EQ(db->keyCount(), 0);
+  EXPECT_EQ(db->findKey("a"), 0);
+}
+
+TEST(CompiledPhraseDBTest, UnsortedInputIsRejected) {
+  std::string data = "b 1 -1\na 1 -1\n";
+  std::string image = "unchanged";
+  EXPECT_FALSE(CompiledPhraseDB::Compile(data.data(), data.size(), &image));
+  EXPECT_EQ(image, "unchanged");
+
+  // A key that reappears after another key is out of order as well.
+  data = "a 1 -1\nb 1 -1\na 2 -2\n";
+  EXPECT_FALSE(CompiledPhraseDB::Compile(data.data(), data.size(), &image));
+}
+
+TEST(CompiledPhraseDBTest, IssuesAreReportedWithLineNumbers) {
+  using Issue = CompiledPhraseDB::Issue;
+  std::string data =
+      "# format org.openvanilla.mcbopomofo.sorted\n"
+      "a 1 -1\n"
+      "a 2\n"
+      "b 1 x\n"
+      "b  1 -1\n"
+      "c 1 -1 extra\n"
+      "\n"
+      "# comment\n"
+      "d 1 -1\n"
+      "c 1 -1\n";
+  std::string image;
+  std::vector<Issue> issues;
+  EXPECT_FALSE(CompiledPhraseDB::Compile(
+      data.data(), data.size(), &image,
+      CompiledPhraseDB::RowLayout::KEY_VALUE_SCORE, &issues));
+  EXPECT_TRUE(image.empty());
+  ASSERT_EQ(issues.size(), 5);
+  EXPECT_EQ(issues[0].type, Issue::Type::MALFORMED_ROW);
+  EXPECT_EQ(issues[0].lineNumber, 3);
+  EXPECT_EQ(issues[1].type, Issue::Type::INVALID_SCORE);
+  EXPECT_EQ(issues[1].lineNumber, 4);
+  EXPECT_EQ(issues[2].type, Issue::Type::MALFORMED_ROW);
+  EXPECT_EQ(issues[2].lineNumber, 5);
+  EXPECT_EQ(issues[3].type, Issue::Type::MALFORMED_ROW);
+  EXPECT_EQ(issues[3].lineNumber, 6);
+  EXPECT_EQ(issues[4].type, Issue::Type::KEY_OUT_OF_ORDER);
+  EXPECT_EQ(issues[4].lineNumber, 10);
+}
+
+TEST(CompiledPhraseDBTest, OtherLayouts) {
+  using RowLayout = CompiledPhraseDB::RowLayout;
+  std::string data = "a -1.5\nb -2\n";
+  std::string image;
+  ASSERT_TRUE(CompiledPhraseDB::Compile(data.data(), data.size(), &image,
+                                        RowLayout::KEY_SCORE));
+  auto db = CompiledPhraseDB::CreateValidatedDB(image.data(), image.size());
+  ASSERT_NE(db, nullptr);
+  ASSERT_EQ(db->rowCount(), 2);
+  EXPECT_EQ(db->valueAt(0), "");
+  EXPECT_FLOAT_EQ(db->scoreAt(0), -1.5);
+
+  data = "a x\na y\nb z\n";
+  ASSERT_TRUE(CompiledPhraseDB::Compile(data.data(), data.size(), &image,
+                                        RowLayout::KEY_VALUE));
+  db = CompiledPhraseDB::CreateValidatedDB(image.data(), image.size());
+  ASSERT_NE(db, nullptr);
+  ASSERT_EQ(db->keyCount(), 2);
+  ASSERT_EQ(db->rowCount(), 3);
+  EXPECT_EQ(db->valueAt(1), "y");
+  EXPECT_FLOAT_EQ(db->scoreAt(1), 0);
+
+  // A score column is malformed in the key-value layout.
+  data = "a x -1\n";
+  EXPECT_FALSE(CompiledPhraseDB::Compile(data.data(), data.size(), &image,
+                                         RowLayout::KEY_VALUE));
+}
+
+TEST(CompiledPhraseDBTest, ValuesAreInterned) {
+  std::string data = "a xyzxyzxyz -1\nb xyzxyzxyz -1\n";
+  std::string image;
+  ASSERT_TRUE(CompiledPhraseDB::Compile(data.data(), data.size(), &image));
+  auto db = CompiledPhraseDB::CreateValidatedDB(image.data(), image.size());
+  ASSERT_NE(db, nullptr);
+  EXPECT_EQ(db->valueAt(0).data(), db->valueAt(1).data());
+}
+
+TEST(CompiledPhraseDBTest, InvalidImagesAreRejected) {
+  std::string data = "a 1 -1\nb 2 -2\n";
+  std::string image;
+  ASSERT_TRUE(CompiledPhraseDB::Compile(data.data(), data.size(), &image));
+
+  EXPECT_TRUE(CompiledPhraseDB::HasMagic(image.data(), image.size()));
+  EXPECT_FALSE(CompiledPhraseDB::HasMagic(data.data(), data.size()));
+  EXPECT_EQ(CompiledPhraseDB::CreateValidatedDB(data.data(), data.size()),
+            nullptr);
+
+  // Truncated.
+  EXPECT_EQ(CompiledPhraseDB::CreateValidatedDB(image.data(), image.size() - 4),
+            nullptr);
+
+  // Wrong version.
+  std::string badVersion = image;
+  badVersion[8] = 42;
+  EXPECT_EQ(
+      CompiledPhraseDB::CreateValidatedDB(badVersion.data(), badVersion.size()),
+      nullptr);
+
+  // Corrupted payload: the header is still valid, but the checksum is not.
+  std::string corrupted = image;
+  corrupted.back() ^= 0x01;
+  EXPECT_EQ(
+      CompiledPhraseDB::CreateValidatedDB(corrupted.data(), corrupted.size()),
+      nullptr);
+  CompiledPhraseDB unchecked(corrupted.data(), corrupted.size());
+  EXPECT_FALSE(unchecked.verifyChecksum());
+}
+
+namespace {
+
+// Overwrites a 32-bit field and fixes up the checksum, so that only the
+// table checks can catch the damage.
+std::string CorruptField(const std::string& image, size_t offset,
+                         uint32_t value) {
+  std::string corrupted = image;
+  memcpy(corrupted.data() + offset, &value, sizeof(value));
+  uint32_t checksum =
+      CompiledPhraseDB::Checksum(corrupted.data() + 16, corrupted.size() - 16);
+  memcpy(corrupted.data() + 12, &checksum, sizeof(checksum));
+  return corrupted;
+}
+
+}  // namespace
+
+TEST(CompiledPhraseDBTest, CorruptTablesAreRejected) {
+  std::string data = "a 1 -1\nb 2 -2\nb 3 -3\n";
+  std::string image;
+  ASSERT_TRUE(CompiledPhraseDB::Compile(data.data(), data.size(), &image));
+  ASSERT_NE(CompiledPhraseDB::CreateValidatedDB(image.data(), image.size()),
+            nullptr);
+
+  // Two keys plus the sentinel, then three rows, of 12 bytes each.
+  constexpr size_t kKeyTable = 32;
+  constexpr size_t kRowTable = kKeyTable + 3 * 12;
+  const std::vector<std::pair<size_t, uint32_t>> damages = {
+      {kKeyTable, 0x10000},          // key offset past the pool
+      {kKeyTable + 4, 0x10000},      // key length past the pool
+      {kKeyTable + 12 + 8, 4},       // rows past the row table
+      {kKeyTable + 8, 2},            // first key starts after the second
+      {kRowTable + 12, 0xfffffff0},  // value offset past the pool
+      {kRowTable + 24 + 4, 0x100},   // value length past the pool
+  };
+  for (const auto& [offset, value] : damages) {
+    std::string corrupted = CorruptField(image, offset, value);
+    CompiledPhraseDB unchecked(corrupted.data(), corrupted.size());
+    EXPECT_TRUE(unchecked.verifyChecksum()) << offset;
+    EXPECT_EQ(CompiledPhraseDB::CreateValidatedDB(corrupted.data(),
+                                                  corrupted.size()),
+              nullptr)
+        << offset;
+  }
+}
+
+TEST(CompiledPhraseDBTest, MatchesTextDatabase) {
+  constexpr const char* data_path = "data.txt";
+  if (!std::filesystem::exists(data_path)) {
+    GTEST_SKIP();
+  }
+
+  MemoryMappedFile mf;
+  ASSERT_TRUE(mf.open(data_path));
+  std::string image;
+  ASSERT_TRUE(CompiledPhraseDB::Compile(mf.data(), mf.length(), &image));
+  auto db = CompiledPhraseDB::CreateValidatedDB(image.data(), image.size());
+  ASSERT_NE(db, nullptr);
+  EXPECT_TRUE(db->verifyChecksum());
+
+  // Every key must yield the same rows as the text database.
+  ParselessPhraseDB textDb(mf.data(), mf.length(), /*validate_pragma=*/true);
+  for (size_t keyIndex = 0; keyIndex < db->keyCount(); ++keyIndex) {
+    std::string key(db->keyAt(keyIndex));
+    auto rows = textDb.findRows(key + " ");
+    size_t first = db->firstRowOf(keyIndex);
+    ASSERT_EQ(db->firstRowOf(keyIndex + 1) - first, rows.size()) << key;
+    for (size_t i = 0; i < rows.size(); ++i) {
+      std::string_view row = rows[i];
+      row.remove_prefix(key.length() + 1);
+      EXPECT_EQ(row.substr(0, row.find(' ')), db->valueAt(first + i)) << key;
+    }
+  }
+}
+
+}  // namespace McBopomofo
@@ -0,0 +1,266 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "LatencyTracer.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
+namespace McBopomofo {
+
+void LatencyHistogram::record(uint64_t value) {
+  sum_ += static_cast<double>(value);
+  value = std::min(value, kMaxValue);
+  ++counts_[BucketOf(value)];
+  ++count_;
+  min_ = std::min(min_, value);
+  max_ = std::max(max_, value);
+}
+
+void LatencyHistogram::clear() { *this = LatencyHistogram(); }
+
+double LatencyHistogram::mean() const {
+  return count_ ? sum_ / static_cast<double>(count_) : 0;
+}
+
+uint64_t LatencyHistogram::valueAtPercentile(double percentile) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  percentile = std::clamp(percentile, 0.0, 100.0);
+  auto target = static_cast<uint64_t>(
+      std::ceil(percentile / 100.0 * static_cast<double>(count_)));
+  target = std::max(target, uint64_t{1});
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    seen += counts_[i];
+    if (seen >= target) {
+      return std::min(HighestValueOf(i), max_);
+    }
+  }
+  return max_;
+}
+
+// A value v at or above kSubBucketCount has a bit width of kSubBucketBits + e
+// for some e >= 1, and its top kSubBucketBits bits, v >> e, are in
+// [kSubBucketCount / 2, kSubBucketCount). Each e therefore has
+// kSubBucketCount / 2 buckets, each as wide as 2^e.
+size_t LatencyHistogram::BucketOf(uint64_t value) {
+  value = std::min(value, kMaxValue);
+  if (value < kSubBucketCount) {
+    return value;
+  }
+  size_t e = std::bit_width(value) - kSubBucketBits;
+  size_t sub = value >> e;
+  return kSubBucketCount + (e - 1) * (kSubBucketCount / 2) +
+         (sub - kSubBucketCount / 2);
+}
+
+uint64_t LatencyHistogram::LowestValueOf(size_t bucket) {
+  if (bucket < kSubBucketCount) {
+    return bucket;
+  }
+  size_t k = bucket - kSubBucketCount;
+  size_t e = k / (kSubBucketCount / 2) + 1;
+  uint64_t sub = k % (kSubBucketCount / 2) + kSubBucketCount / 2;
+  return sub << e;
+}
+
+uint64_t LatencyHistogram::HighestValueOf(size_t bucket) {
+  if (bucket < kSubBucketCount) {
+    return bucket;
+  }
+  size_t k = bucket - kSubBucketCount;
+  size_t e = k / (kSubBucketCount / 2) + 1;
+  uint64_t sub = k % (kSubBucketCount / 2) + kSubBucketCount / 2;
+  return ((sub + 1) << e) - 1;
+}
+
+const char* LatencyTracer::StageName(Stage stage) {
+  switch (stage) {
+    case Stage::kKeyEvent:
+      return "key_event";
+    case Stage::kDispatch:
+      return "dispatch";
+    case Stage::kKeyHandlerHandle:
+      return "key_handler_handle";
+    case Stage::kGridUpdate:
+      return "grid_update";
+    case Stage::kWalk:
+      return "walk";
+    case Stage::kGetComposedString:
+      return "get_composed_string";
+    case Stage::kCandidateList:
+      return "candidate_list";
+  }
+  return "unknown";
+}
+
+void LatencyTracer::record(Stage stage,
+                           std::chrono::steady_clock::duration elapsed) {
+  auto ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  histograms_[static_cast<size_t>(stage)].record(
+      static_cast<uint64_t>(std::max(ns, decltype(ns){0})));
+}
+
+void LatencyTracer::clear() {
+  for (LatencyHistogram& histogram : histograms_) {
+    histogram.clear();
+  }
+  lookups_.clear();
+  cacheHits_.clear();
+  cacheMisses_.clear();
+  cacheTotals_ = CacheCounts();
+}
+
+void LatencyTracer::recordCacheCounts(const CacheCounts& counts) {
+  cacheHits_.record(counts.hits);
+  cacheMisses_.record(counts.misses);
+  cacheTotals_.hits += counts.hits;
+  cacheTotals_.misses += counts.misses;
+}
+
+double LatencyTracer::cacheHitRate() const {
+  uint64_t total = cacheTotals_.hits + cacheTotals_.misses;
+  return total ? static_cast<double>(cacheTotals_.hits) /
+                     static_cast<double>(total)
+               : 0;
+}
+
+namespace {
+
+// The histograms of the stages are in nanoseconds, and are written in
+// microseconds.
+void DumpSummary(std::ostream& out, const char* name,
+                 const LatencyHistogram& histogram, double unit) {
+  out << name << '\t' << histogram.count();
+  for (double value :
+       {static_cast<double>(histogram.min()), histogram.mean(),
+        static_cast<double>(histogram.valueAtPercentile(50)),
+        static_cast<double>(histogram.valueAtPercentile(90)),
+        static_cast<double>(histogram.valueAtPercentile(99)),
+        static_cast<double>(histogram.valueAtPercentile(99.9)),
+        static_cast<double>(histogram.max())}) {
+    out << '\t' << value / unit;
+  }
+  out << '\n';
+}
+
+void DumpBuckets(std::ostream& out, const char* name,
+                 const LatencyHistogram& histogram, double unit) {
+  for (size_t i = 0; i < LatencyHistogram::kBucketCount; ++i) {
+    if (histogram.countAt(i) == 0) {
+      continue;
+    }
+    out << name << '\t'
+        << static_cast<double>(LatencyHistogram::LowestValueOf(i)) / unit
+        << '\t'
+        << static_cast<double>(LatencyHistogram::HighestValueOf(i)) / unit
+        << '\t' << histogram.countAt(i) << '\n';
+  }
+}
+
+constexpr double kNanosecondsPerMicrosecond = 1000;
+constexpr char kLookupsName[] = "lm_lookups";
+constexpr char kCacheHitsName[] = "unigram_cache_hits";
+constexpr char kCacheMissesName[] = "unigram_cache_misses";
+
+}  // namespace
+
+void LatencyTracer::dump(std::ostream& out) const {
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out << std::fixed << std::setprecision(3);
+
+  out << "# stage\tcount\tmin\tmean\tp50\tp90\tp99\tp99.9\tmax\n";
+  for (size_t i = 0; i < kStageCount; ++i) {
+    DumpSummary(out, StageName(static_cast<Stage>(i)), histograms_[i],
+                kNanosecondsPerMicrosecond);
+  }
+  DumpSummary(out, kLookupsName, lookups_, 1);
+  DumpSummary(out, kCacheHitsName, cacheHits_, 1);
+  DumpSummary(out, kCacheMissesName, cacheMisses_, 1);
+
+  out << "# stage\tlow\thigh\tcount\n";
+  for (size_t i = 0; i < kStageCount; ++i) {
+    DumpBuckets(out, StageName(static_cast<Stage>(i)), histograms_[i],
+                kNanosecondsPerMicrosecond);
+  }
+  DumpBuckets(out, kLookupsName, lookups_, 1);
+  DumpBuckets(out, kCacheHitsName, cacheHits_, 1);
+  DumpBuckets(out, kCacheMissesName, cacheMisses_, 1);
+
+  out << "# unigram_cache_hit_rate\t" << cacheHitRate() << '\n';
+
+  out.flags(flags);
+  out.precision(precision);
+}
+
+bool LatencyTracer::dumpToFile(const std::string& path) const {
+  std::ofstream out(path, std::ios::trunc);
+  if (!out) {
+    return false;
+  }
+  dump(out);
+  out.close();
+  return !out.fail();
+}
+
+LatencyTracer::KeystrokeScope::KeystrokeScope(LatencyTracer* tracer)
+    : scope_(tracer, Stage::kKeyEvent),
+      tracer_(tracer != nullptr && tracer->enabled() ? tracer : nullptr) {
+  if (tracer_ == nullptr) {
+    return;
+  }
+  if (tracer_->lookupCounter_ != nullptr) {
+    startLookups_ = tracer_->lookupCounter_();
+  }
+  if (tracer_->cacheCounter_ != nullptr) {
+    startCacheCounts_ = tracer_->cacheCounter_();
+  }
+}
+
+LatencyTracer::KeystrokeScope::~KeystrokeScope() {
+  if (tracer_ == nullptr) {
+    return;
+  }
+  // The counters may go back if the language model is replaced.
+  auto delta = [](uint64_t end, uint64_t start) {
+    return end >= start ? end - start : 0;
+  };
+  if (tracer_->lookupCounter_ != nullptr) {
+    tracer_->recordLookups(delta(tracer_->lookupCounter_(), startLookups_));
+  }
+  if (tracer_->cacheCounter_ != nullptr) {
+    CacheCounts counts = tracer_->cacheCounter_();
+    tracer_->recordCacheCounts(
+        CacheCounts{delta(counts.hits, startCacheCounts_.hits),
+                    delta(counts.misses, startCacheCounts_.misses)});
+  }
+}
+
+}  // namespace McBopomofo
@@ -0,0 +1,212 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_LATENCYTRACER_H_
+#define SRC_ENGINE_LATENCYTRACER_H_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+
+namespace McBopomofo {
+
+// A histogram of non-negative integers with a bounded relative error, in the
+// spirit of HdrHistogram. Values below kSubBucketCount are counted exactly.
+// Above that, each power-of-two range is split into kSubBucketCount / 2
+// equal buckets, so a value is reported within about 3% of itself. The
+// memory used is fixed, no matter how many values are recorded. Values
+// larger than kMaxValue are recorded as kMaxValue.
+class LatencyHistogram {
+ public:
+  static constexpr size_t kSubBucketBits = 6;
+  static constexpr size_t kSubBucketCount = 1 << kSubBucketBits;
+  static constexpr size_t kValueBits = 40;
+  static constexpr uint64_t kMaxValue = (uint64_t{1} << kValueBits) - 1;
+  static constexpr size_t kBucketCount =
+      kSubBucketCount + (kValueBits - kSubBucketBits) * (kSubBucketCount / 2);
+
+  void record(uint64_t value);
+  void clear();
+
+  [[nodiscard]] uint64_t count() const { return count_; }
+  [[nodiscard]] uint64_t min() const { return count_ ? min_ : 0; }
+  [[nodiscard]] uint64_t max() const { return max_; }
+  [[nodiscard]] double mean() const;
+
+  // Returns the highest value of the bucket where the given percentile (0 to
+  // 100) of the recorded values falls, or 0 if the histogram is empty.
+  [[nodiscard]] uint64_t valueAtPercentile(double percentile) const;
+
+  [[nodiscard]] uint64_t countAt(size_t bucket) const {
+    return counts_[bucket];
+  }
+
+  // The range of the values counted in a bucket, inclusive.
+  static uint64_t LowestValueOf(size_t bucket);
+  static uint64_t HighestValueOf(size_t bucket);
+  static size_t BucketOf(uint64_t value);
+
+ private:
+  std::array<uint64_t, kBucketCount> counts_{};
+  uint64_t count_ = 0;
+  uint64_t min_ = kMaxValue;
+  uint64_t max_ = 0;
+  // Not capped, for the mean.
+  double sum_ = 0;
+};
+
+// Collects the time spent on each stage of handling a keystroke, and the
+// number of language model lookups and unigram cache hits and misses made by
+// the keystroke, into histograms that can be written to a file. Tracing is
+// off by default, in which case the scopes below do not even read the clock.
+// The stages nest: for example, the time of KeyHandler::handle() includes
+// the walks it makes. The tracer is not synchronized; it is meant to be used
+// from the input method's thread.
+class LatencyTracer {
+ public:
+  enum class Stage {
+    // The whole McBopomofoEngine::keyEvent().
+    kKeyEvent,
+    // Finding out which kind of state is current, by dynamic_cast.
+    kDispatch,
+    kKeyHandlerHandle,
+    // Inserting or deleting readings in the grid.
+    kGridUpdate,
+    kWalk,
+    kGetComposedString,
+    // Building the candidate panel's list from a state.
+    kCandidateList,
+  };
+  static constexpr size_t kStageCount = 7;
+
+  static const char* StageName(Stage stage);
+
+  void setEnabled(bool enabled) { enabled_ = enabled; }
+  [[nodiscard]] bool enabled() const { return enabled_; }
+
+  // The running total of the language model lookups, sampled at the start
+  // and the end of each keystroke.
+  void setLookupCounter(std::function<uint64_t()> counter) {
+    lookupCounter_ = std::move(counter);
+  }
+
+  struct CacheCounts {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+
+  // The running totals of the unigram cache, sampled like the lookups.
+  void setCacheCounter(std::function<CacheCounts()> counter) {
+    cacheCounter_ = std::move(counter);
+  }
+
+  void record(Stage stage, std::chrono::steady_clock::duration elapsed);
+  void recordLookups(uint64_t lookups) { lookups_.record(lookups); }
+  void recordCacheCounts(const CacheCounts& counts);
+
+  [[nodiscard]] const LatencyHistogram& histogram(Stage stage) const {
+    return histograms_[static_cast<size_t>(stage)];
+  }
+  [[nodiscard]] const LatencyHistogram& lookups() const { return lookups_; }
+  [[nodiscard]] const LatencyHistogram& cacheHits() const {
+    return cacheHits_;
+  }
+  [[nodiscard]] const LatencyHistogram& cacheMisses() const {
+    return cacheMisses_;
+  }
+
+  // The share of the cache queries that hit over all recorded keystrokes, or
+  // 0 if there were none.
+  [[nodiscard]] double cacheHitRate() const;
+
+  void clear();
+
+  // Writes a summary line for each stage, followed by the non-empty buckets
+  // of each histogram, as tab-separated text. Times are in microseconds. The
+  // overall cache hit rate is written last.
+  void dump(std::ostream& out) const;
+
+  // Same as above, but to a file, which is replaced. Returns false if the
+  // file cannot be written.
+  bool dumpToFile(const std::string& path) const;
+
+  // Records the time from its construction to its destruction into a stage,
+  // if the tracer is not null and is enabled.
+  class Scope {
+   public:
+    Scope(LatencyTracer* tracer, Stage stage)
+        : tracer_(tracer != nullptr && tracer->enabled() ? tracer : nullptr),
+          stage_(stage) {
+      if (tracer_ != nullptr) {
+        start_ = std::chrono::steady_clock::now();
+      }
+    }
+    ~Scope() {
+      if (tracer_ != nullptr) {
+        tracer_->record(stage_, std::chrono::steady_clock::now() - start_);
+      }
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    LatencyTracer* tracer_;
+    Stage stage_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  // A Scope for Stage::kKeyEvent that also records the lookups made by the
+  // keystroke.
+  class KeystrokeScope {
+   public:
+    explicit KeystrokeScope(LatencyTracer* tracer);
+    ~KeystrokeScope();
+    KeystrokeScope(const KeystrokeScope&) = delete;
+    KeystrokeScope& operator=(const KeystrokeScope&) = delete;
+
+   private:
+    Scope scope_;
+    LatencyTracer* tracer_;
+    uint64_t startLookups_ = 0;
+    CacheCounts startCacheCounts_;
+  };
+
+ private:
+  bool enabled_ = false;
+  std::function<uint64_t()> lookupCounter_;
+  std::function<CacheCounts()> cacheCounter_;
+  std::array<LatencyHistogram, kStageCount> histograms_;
+  LatencyHistogram lookups_;
+  LatencyHistogram cacheHits_;
+  LatencyHistogram cacheMisses_;
+  CacheCounts cacheTotals_;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_ENGINE_LATENCYTRACER_H_
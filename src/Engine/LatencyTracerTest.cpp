@@ -0,0 +1,160 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "LatencyTracer.h"
+
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+TEST(LatencyHistogramTest, BucketsCoverAllValuesInOrder) {
+  EXPECT_EQ(LatencyHistogram::LowestValueOf(0), 0);
+  for (size_t i = 1; i < LatencyHistogram::kBucketCount; ++i) {
+    ASSERT_EQ(LatencyHistogram::LowestValueOf(i),
+              LatencyHistogram::HighestValueOf(i - 1) + 1);
+  }
+  EXPECT_EQ(
+      LatencyHistogram::HighestValueOf(LatencyHistogram::kBucketCount - 1),
+      LatencyHistogram::kMaxValue);
+
+  for (uint64_t value : {uint64_t{0}, uint64_t{63}, uint64_t{64},
+                         uint64_t{65}, uint64_t{1000}, uint64_t{123456789},
+                         LatencyHistogram::kMaxValue}) {
+    size_t bucket = LatencyHistogram::BucketOf(value);
+    EXPECT_LE(LatencyHistogram::LowestValueOf(bucket), value);
+    EXPECT_GE(LatencyHistogram::HighestValueOf(bucket), value);
+  }
+  EXPECT_EQ(LatencyHistogram::BucketOf(LatencyHistogram::kMaxValue + 1),
+            LatencyHistogram::kBucketCount - 1);
+}
+
+TEST(LatencyHistogramTest, Percentiles) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(histogram.valueAtPercentile(50), 0);
+  for (uint64_t i = 1; i <= 10000; ++i) {
+    histogram.record(i);
+  }
+  EXPECT_EQ(histogram.count(), 10000);
+  EXPECT_EQ(histogram.min(), 1);
+  EXPECT_EQ(histogram.max(), 10000);
+  EXPECT_DOUBLE_EQ(histogram.mean(), 5000.5);
+
+  // Within the relative error of a bucket.
+  for (double percentile : {1.0, 50.0, 90.0, 99.0, 99.9}) {
+    auto expected = static_cast<double>(percentile * 100);
+    auto actual = static_cast<double>(histogram.valueAtPercentile(percentile));
+    EXPECT_GE(actual, expected);
+    EXPECT_LE(actual, expected * 1.04);
+  }
+  EXPECT_EQ(histogram.valueAtPercentile(100), 10000);
+
+  histogram.clear();
+  EXPECT_EQ(histogram.count(), 0);
+  EXPECT_EQ(histogram.max(), 0);
+}
+
+TEST(LatencyTracerTest, ScopesOnlyRecordWhenEnabled) {
+  LatencyTracer tracer;
+  uint64_t lookups = 0;
+  tracer.setLookupCounter([&lookups]() { return lookups; });
+  {
+    LatencyTracer::KeystrokeScope keystroke(&tracer);
+    LatencyTracer::Scope walk(&tracer, LatencyTracer::Stage::kWalk);
+    lookups += 3;
+  }
+  EXPECT_EQ(tracer.histogram(LatencyTracer::Stage::kKeyEvent).count(), 0);
+  EXPECT_EQ(tracer.lookups().count(), 0);
+
+  tracer.setEnabled(true);
+  {
+    LatencyTracer::KeystrokeScope keystroke(&tracer);
+    LatencyTracer::Scope walk(&tracer, LatencyTracer::Stage::kWalk);
+    lookups += 5;
+  }
+  EXPECT_EQ(tracer.histogram(LatencyTracer::Stage::kKeyEvent).count(), 1);
+  EXPECT_EQ(tracer.histogram(LatencyTracer::Stage::kWalk).count(), 1);
+  EXPECT_EQ(tracer.histogram(LatencyTracer::Stage::kDispatch).count(), 0);
+  EXPECT_EQ(tracer.lookups().count(), 1);
+  EXPECT_EQ(tracer.lookups().max(), 5);
+
+  // A null tracer is allowed, so that callers need not check.
+  LatencyTracer::Scope scope(nullptr, LatencyTracer::Stage::kWalk);
+}
+
+TEST(LatencyTracerTest, CacheCounts) {
+  LatencyTracer tracer;
+  tracer.setEnabled(true);
+  LatencyTracer::CacheCounts counts;
+  tracer.setCacheCounter([&counts]() { return counts; });
+  {
+    LatencyTracer::KeystrokeScope keystroke(&tracer);
+    counts.hits += 3;
+    counts.misses += 1;
+  }
+  {
+    LatencyTracer::KeystrokeScope keystroke(&tracer);
+    counts.hits += 4;
+  }
+  EXPECT_EQ(tracer.cacheHits().count(), 2);
+  EXPECT_EQ(tracer.cacheHits().max(), 4);
+  EXPECT_EQ(tracer.cacheMisses().max(), 1);
+  EXPECT_DOUBLE_EQ(tracer.cacheHitRate(), 7.0 / 8.0);
+  // Without a lookup counter, no lookups are recorded.
+  EXPECT_EQ(tracer.lookups().count(), 0);
+
+  std::stringstream out;
+  tracer.dump(out);
+  EXPECT_NE(out.str().find("# unigram_cache_hit_rate\t0.875\n"),
+            std::string::npos);
+
+  tracer.clear();
+  EXPECT_EQ(tracer.cacheHitRate(), 0);
+}
+
+TEST(LatencyTracerTest, Dump) {
+  LatencyTracer tracer;
+  tracer.setEnabled(true);
+  tracer.record(LatencyTracer::Stage::kWalk, std::chrono::microseconds(20));
+  tracer.record(LatencyTracer::Stage::kWalk, std::chrono::microseconds(2000));
+  tracer.recordLookups(4);
+
+  std::stringstream out;
+  tracer.dump(out);
+  std::string dumped = out.str();
+  EXPECT_NE(dumped.find("walk\t2\t20.000\t1010.000\t"), std::string::npos);
+  EXPECT_NE(dumped.find("dispatch\t0\t"), std::string::npos);
+  EXPECT_NE(dumped.find("lm_lookups\t1\t4.000\t"), std::string::npos);
+  // The bucket of 20 microseconds.
+  EXPECT_NE(dumped.find("walk\t19.968\t20.479\t1\n"), std::string::npos);
+
+  tracer.clear();
+  EXPECT_EQ(tracer.histogram(LatencyTracer::Stage::kWalk).count(), 0);
+  EXPECT_EQ(tracer.lookups().count(), 0);
+}
+
+}  // namespace McBopomofo
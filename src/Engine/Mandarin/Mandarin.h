@@ -59,6 +59,9 @@ class BopomofoSyllable {
 
   bool isEmpty() const { return !syllable_; }
 
+  // The packed 16-bit value, which the explicit constructor takes back.
+  Component value() const { return syllable_; }
+
   bool hasConsonant() const { return !!(syllable_ & ConsonantMask); }
 
   bool hasMiddleVowel() const { return !!(syllable_ & MiddleVowelMask); }
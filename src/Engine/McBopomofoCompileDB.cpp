@@ -0,0 +1,157 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+// mcbopomofo-compile-db: compiles a sorted text database into the binary
+// format read by CompiledPhraseDB.
+//
+// Usage: mcbopomofo-compile-db [--layout=LAYOUT] INPUT OUTPUT
+//
+// LAYOUT is one of:
+//   key-value-score  data.txt, data-plain-bpmf.txt (the default)
+//   key-score        associated-phrases-v2.txt
+//   key-value        bpmfvs-pua.txt, bpmfvs-variants.txt
+//
+// The tool fails if any row is malformed or out of order, reporting the line
+// numbers of the offending rows.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "CompiledPhraseDB.h"
+#include "MemoryMappedFile.h"
+
+namespace {
+
+using McBopomofo::CompiledPhraseDB;
+
+constexpr std::string_view kLayoutFlag = "--layout=";
+
+void PrintUsage(const char* name) {
+  std::cerr << "usage: " << name << " [--layout=LAYOUT] INPUT OUTPUT\n"
+            << "  LAYOUT: key-value-score (default), key-score, key-value\n";
+}
+
+bool ParseLayout(std::string_view name, CompiledPhraseDB::RowLayout* layout) {
+  if (name == "key-value-score") {
+    *layout = CompiledPhraseDB::RowLayout::KEY_VALUE_SCORE;
+  } else if (name == "key-score") {
+    *layout = CompiledPhraseDB::RowLayout::KEY_SCORE;
+  } else if (name == "key-value") {
+    *layout = CompiledPhraseDB::RowLayout::KEY_VALUE;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char* IssueDescription(CompiledPhraseDB::Issue::Type type) {
+  switch (type) {
+    case CompiledPhraseDB::Issue::Type::MALFORMED_ROW:
+      return "malformed row";
+    case CompiledPhraseDB::Issue::Type::INVALID_SCORE:
+      return "invalid score";
+    case CompiledPhraseDB::Issue::Type::KEY_OUT_OF_ORDER:
+      return "key out of order";
+  }
+  return "unknown issue";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  CompiledPhraseDB::RowLayout layout =
+      CompiledPhraseDB::RowLayout::KEY_VALUE_SCORE;
+  std::vector<const char*> paths;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg(argv[i]);
+    if (arg.substr(0, kLayoutFlag.length()) == kLayoutFlag) {
+      if (!ParseLayout(arg.substr(kLayoutFlag.length()), &layout)) {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (paths.size() != 2) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+  const char* inputPath = paths[0];
+  const char* outputPath = paths[1];
+
+  McBopomofo::MemoryMappedFile input;
+  if (!input.open(inputPath)) {
+    std::cerr << inputPath << ": cannot open\n";
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::string image;
+  std::vector<CompiledPhraseDB::Issue> issues;
+  bool success = CompiledPhraseDB::Compile(input.data(), input.length(),
+                                           &image, layout, &issues);
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  if (!success) {
+    for (const auto& issue : issues) {
+      std::cerr << inputPath << ":" << issue.lineNumber << ": "
+                << IssueDescription(issue.type) << "\n";
+    }
+    if (issues.size() == CompiledPhraseDB::MAX_ISSUES) {
+      std::cerr << inputPath << ": too many issues, stopped reporting\n";
+    }
+    return 1;
+  }
+
+  // Write to a temporary file first so that a failed write never leaves a
+  // truncated image in place.
+  std::string tempPath = std::string(outputPath) + ".tmp";
+  {
+    std::ofstream output(tempPath, std::ios::binary | std::ios::trunc);
+    output.write(image.data(), static_cast<std::streamsize>(image.size()));
+    if (!output) {
+      std::cerr << tempPath << ": cannot write\n";
+      return 1;
+    }
+  }
+  if (std::rename(tempPath.c_str(), outputPath) != 0) {
+    std::cerr << outputPath << ": cannot write\n";
+    std::remove(tempPath.c_str());
+    return 1;
+  }
+
+  auto db = CompiledPhraseDB::CreateValidatedDB(image.data(), image.size());
+  std::cout << inputPath << " -> " << outputPath << ": " << db->keyCount()
+            << " keys, " << db->rowCount() << " rows, " << input.length()
+            << " -> " << image.size() << " bytes, built in " << elapsed
+            << " us\n";
+  return 0;
+}
@@ -24,10 +24,14 @@
 #include "McBopomofoLM.h"
 
 #include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
 #include <limits>
 #include <memory>
 #include <string>
-#include <unordered_set>
+#include <string_view>
+#include <system_error>
 #include <utility>
 #include <vector>
 
@@ -38,15 +42,110 @@ namespace McBopomofo {
 static constexpr std::string_view kMacroPrefix = "MACRO@";
 static constexpr double kMacroScore = -8.0;
 
+McBopomofoLM::McBopomofoLM() {
+  residentLanguageModels_.push_back(
+      ResidentLanguageModel{{}, {}, std::make_unique<ParselessLM>()});
+  languageModel_ = residentLanguageModels_.front().model.get();
+}
+
 void McBopomofoLM::loadLanguageModel(const char* languageModelDataPath) {
-  if (languageModelDataPath) {
-    languageModel_.close();
-    languageModel_.open(languageModelDataPath);
+  if (languageModelDataPath == nullptr) {
+    return;
   }
+
+  size_t slot = residentSlotFor(languageModelDataPath, /*keepActive=*/false);
+  if (slot != 0) {
+    // Move it to the front, keeping the rest in the order of use.
+    std::rotate(residentLanguageModels_.begin(),
+                residentLanguageModels_.begin() + static_cast<ptrdiff_t>(slot),
+                residentLanguageModels_.begin() +
+                    static_cast<ptrdiff_t>(slot + 1));
+  }
+  languageModel_ = residentLanguageModels_.front().model.get();
+  invalidateUnigramCache();
+}
+
+void McBopomofoLM::preloadLanguageModel(const char* languageModelDataPath) {
+  if (languageModelDataPath == nullptr) {
+    return;
+  }
+  size_t slot = residentSlotFor(languageModelDataPath, /*keepActive=*/true);
+  if (slot > 1 && slot < residentLanguageModels_.size()) {
+    // Make it the next one to be replaced last.
+    std::rotate(residentLanguageModels_.begin() + 1,
+                residentLanguageModels_.begin() + static_cast<ptrdiff_t>(slot),
+                residentLanguageModels_.begin() +
+                    static_cast<ptrdiff_t>(slot + 1));
+  }
+}
+
+size_t McBopomofoLM::residentLanguageModelCount() const {
+  return static_cast<size_t>(
+      std::count_if(residentLanguageModels_.begin(),
+                    residentLanguageModels_.end(),
+                    [](const ResidentLanguageModel& resident) {
+                      return resident.model->isLoaded();
+                    }));
+}
+
+size_t McBopomofoLM::residentSlotFor(const char* path, bool keepActive) {
+  std::error_code err;
+  std::filesystem::file_time_type modifiedTime =
+      std::filesystem::last_write_time(path, err);
+
+  size_t slot = residentLanguageModels_.size();
+  for (size_t i = 0; i < residentLanguageModels_.size(); ++i) {
+    const ResidentLanguageModel& resident = residentLanguageModels_[i];
+    if (resident.path == path && resident.model->isLoaded()) {
+      if (!err && resident.modifiedTime == modifiedTime) {
+        return i;
+      }
+      // The file has been replaced, for example by an upgrade. Reopen it.
+      slot = i;
+      break;
+    }
+  }
+
+  size_t first = keepActive ? 1 : 0;
+  if (slot == residentLanguageModels_.size()) {
+    // Prefer a slot that is not in use.
+    for (size_t i = first; i < residentLanguageModels_.size(); ++i) {
+      if (!residentLanguageModels_[i].model->isLoaded()) {
+        slot = i;
+        break;
+      }
+    }
+  }
+  if (slot == residentLanguageModels_.size()) {
+    if (residentLanguageModels_.size() < kMaxResidentLanguageModels) {
+      residentLanguageModels_.push_back(
+          ResidentLanguageModel{{}, {}, std::make_unique<ParselessLM>()});
+    } else if (residentLanguageModels_.size() <= first) {
+      return residentLanguageModels_.size();
+    } else {
+      slot = residentLanguageModels_.size() - 1;
+    }
+  }
+
+  ResidentLanguageModel& resident = residentLanguageModels_[slot];
+  resident.model->close();
+  resident.model->setKeyFilterEnabled(keyFiltersEnabled_);
+  if (resident.model->open(path)) {
+    resident.path = path;
+    resident.modifiedTime = modifiedTime;
+    resident.model->warmUp();
+  } else {
+    resident.path.clear();
+  }
+  if (slot == 0) {
+    // The active model has been reopened, even if only preloaded.
+    invalidateUnigramCache();
+  }
+  return slot;
 }
 
 bool McBopomofoLM::isDataModelLoaded() const {
-  return languageModel_.isLoaded();
+  return languageModel_->isLoaded();
 }
 
 void McBopomofoLM::loadAssociatedPhrasesV2(const char* associatedPhrasesPath) {
@@ -74,6 +173,7 @@ void McBopomofoLM::loadUserPhrases(const char* userPhrasesDataPath,
   } else {
     excludedPhrasesDataPath_.reset();
   }
+  rebuildOverlay();
 }
 
 bool McBopomofoLM::isAssociatedPhrasesV2Loaded() const {
@@ -89,6 +189,7 @@ void McBopomofoLM::loadPhraseReplacementMap(const char* phraseReplacementPath) {
   } else {
     phraseReplacementPath_.reset();
   }
+  rebuildOverlay();
 }
 
 static McBopomofoLM::IssueType TranslateIssue(
@@ -137,41 +238,78 @@ std::vector<McBopomofoLM::UserFileIssue> McBopomofoLM::getUserFileIssues()
 
 std::vector<Formosa::Gramambular2::LanguageModel::Unigram>
 McBopomofoLM::getUnigrams(const std::string& key) {
+  return *getSharedUnigrams(key);
+}
+
+std::shared_ptr<
+    const std::vector<Formosa::Gramambular2::LanguageModel::Unigram>>
+McBopomofoLM::getSharedUnigrams(const std::string& key) {
+  using Unigrams = std::vector<Formosa::Gramambular2::LanguageModel::Unigram>;
+  ++lookupCount_;
   if (key == " ") {
-    std::vector<Formosa::Gramambular2::LanguageModel::Unigram> spaceUnigrams;
-    spaceUnigrams.emplace_back(" ", 0);
-    return spaceUnigrams;
+    static const auto kSpaceUnigrams = std::make_shared<const Unigrams>(
+        1, Formosa::Gramambular2::LanguageModel::Unigram(" ", 0));
+    return kSpaceUnigrams;
   }
 
-  std::vector<Formosa::Gramambular2::LanguageModel::Unigram> allUnigrams;
-  std::vector<Formosa::Gramambular2::LanguageModel::Unigram> userUnigrams;
-
-  std::unordered_set<std::string> excludedValues;
-  std::unordered_set<std::string> insertedValues;
-
-  if (excludedPhrases_.hasUnigrams(key)) {
-    std::vector<Formosa::Gramambular2::LanguageModel::Unigram>
-        excludedUnigrams = excludedPhrases_.getUnigrams(key);
-    std::transform(excludedUnigrams.begin(), excludedUnigrams.end(),
-                   std::inserter(excludedValues, excludedValues.end()),
-                   [](const Formosa::Gramambular2::LanguageModel::Unigram& u) {
-                     return u.value();
-                   });
+  if (CacheEntry* entry = findCached(key);
+      entry != nullptr && entry->unigramsKnown) {
+    ++unigramCacheStats_.hits;
+    return entry->unigrams;
   }
-
-  if (userPhrases_.hasUnigrams(key)) {
-    std::vector<Formosa::Gramambular2::LanguageModel::Unigram> rawUserUnigrams =
-        userPhrases_.getUnigrams(key);
-    userUnigrams = filterAndTransformUnigrams(rawUserUnigrams, excludedValues,
-                                              insertedValues);
+  ++unigramCacheStats_.misses;
+
+  auto unigrams =
+      std::make_shared<const Unigrams>(collectUnigrams(key, findOverlay(key)));
+  if (CacheEntry* entry = seenMacro_ ? nullptr : cacheEntryFor(key)) {
+    entry->hasUnigrams = !unigrams->empty();
+    entry->unigramsKnown = true;
+    entry->unigrams = unigrams;
   }
+  return unigrams;
+}
 
-  if (languageModel_.hasUnigrams(key)) {
-    std::vector<Formosa::Gramambular2::LanguageModel::Unigram>
-        rawGlobalUnigrams = languageModel_.getUnigrams(key);
-    allUnigrams = filterAndTransformUnigrams(rawGlobalUnigrams, excludedValues,
-                                             insertedValues);
+std::vector<Formosa::Gramambular2::LanguageModel::Unigram>
+McBopomofoLM::collectUnigrams(const std::string& key,
+                              const OverlayEntry* overlay) {
+  std::vector<Formosa::Gramambular2::LanguageModel::Unigram> allUnigrams;
+  resetSeenValues();
+  seenMacro_ = false;
+
+  // The user unigrams go first so that they win over the same values from
+  // the LM. The overlay has already dropped the excluded ones and applied
+  // the replacements.
+  if (overlay != nullptr) {
+    for (const auto& unigram : overlay->userUnigrams) {
+      appendConverted(unigram.value, unigram.rawValue,
+                      UserPhrasesLM::kUserUnigramScore, allUnigrams);
+    }
   }
+  size_t userCount = allUnigrams.size();
+
+  bool replacing = phraseReplacementEnabled_ && !replacements_.empty();
+
+  // Visit the LM rows in place instead of copying them out first.
+  languageModel_->forEachUnigram(
+      key, [&](const ParselessLM::UnigramView& unigram) {
+        // The exclusions apply to the original value.
+        if (overlay != nullptr &&
+            std::binary_search(overlay->excludedValues.begin(),
+                               overlay->excludedValues.end(), unigram.value,
+                               std::less<>())) {
+          return;
+        }
+        if (replacing) {
+          auto it = replacements_.find(unigram.value);
+          if (it != replacements_.end()) {
+            appendConverted(it->second, unigram.value, unigram.score,
+                            allUnigrams);
+            return;
+          }
+        }
+        appendConverted(std::string(unigram.value), unigram.value,
+                        unigram.score, allUnigrams);
+      });
 
   // This relies on the fact that we always use the default separator.
   bool isKeyMultiSyllable =
@@ -179,9 +317,9 @@ McBopomofoLM::getUnigrams(const std::string& key) {
       std::string::npos;
 
   // If key is multi-syllabic (for example, ㄉㄨㄥˋ-ㄈㄢˋ), we just
-  // insert all collected userUnigrams on top of the unigrams fetched from
+  // keep all collected user unigrams on top of the unigrams fetched from
   // the database. If key is mono-syllabic (for example, ㄉㄨㄥˋ), then
-  // we'll have to rewrite the collected userUnigrams.
+  // we'll have to rewrite the collected user unigrams.
   //
   // This is because, by default, user unigrams have a score of 0, which
   // guarantees that grid walks will choose them. This is problematic,
@@ -192,47 +330,103 @@ McBopomofoLM::getUnigrams(const std::string& key) {
   // be able to compete with it. Without the rewrite, ㄉㄨㄥˋ-ㄗㄨㄛˋ
   // would always result in "丼" + "作" instead of "動作" because the
   // node for "丼" would dominate the walk.
-  if (isKeyMultiSyllable || allUnigrams.empty()) {
-    allUnigrams.insert(allUnigrams.begin(), userUnigrams.begin(),
-                       userUnigrams.end());
-  } else if (!userUnigrams.empty()) {
-    // Find the highest score from the existing allUnigrams.
-    double topScore = std::numeric_limits<double>::lowest();
-    for (const auto& unigram : allUnigrams) {
-      topScore = std::max(topScore, unigram.score());
-    }
-
-    // Boost by a very small number. This is the score for user phrases.
-    constexpr double epsilon = 0.000000001;
-    double boostedScore = topScore + epsilon;
+  if (isKeyMultiSyllable || userCount == 0 ||
+      allUnigrams.size() == userCount) {
+    return allUnigrams;
+  }
 
-    std::vector<Formosa::Gramambular2::LanguageModel::Unigram>
-        rewrittenUserUnigrams;
-    for (const auto& unigram : userUnigrams) {
-      rewrittenUserUnigrams.emplace_back(unigram.value(), boostedScore);
-    }
-    allUnigrams.insert(allUnigrams.begin(), rewrittenUserUnigrams.begin(),
-                       rewrittenUserUnigrams.end());
+  // Find the highest score from the unigrams of the LM.
+  double topScore = std::numeric_limits<double>::lowest();
+  for (size_t i = userCount; i < allUnigrams.size(); ++i) {
+    topScore = std::max(topScore, allUnigrams[i].score());
   }
 
+  // Boost by a very small number. This is the score for user phrases.
+  constexpr double epsilon = 0.000000001;
+  double boostedScore = topScore + epsilon;
+  for (size_t i = 0; i < userCount; ++i) {
+    allUnigrams[i] = Formosa::Gramambular2::LanguageModel::Unigram(
+        allUnigrams[i].value(), boostedScore);
+  }
   return allUnigrams;
 }
 
 bool McBopomofoLM::hasUnigrams(const std::string& key) {
+  ++lookupCount_;
   if (key == " ") {
     return true;
   }
 
-  if (!excludedPhrases_.hasUnigrams(key)) {
-    return userPhrases_.hasUnigrams(key) || languageModel_.hasUnigrams(key);
+  if (CacheEntry* entry = findCached(key)) {
+    ++unigramCacheStats_.hits;
+    return entry->hasUnigrams;
+  }
+  ++unigramCacheStats_.misses;
+
+  const OverlayEntry* overlay = findOverlay(key);
+  if (overlay != nullptr && overlay->userUnigrams.empty()) {
+    // Everything may have been excluded. Since the unigrams are at hand, keep
+    // them for the getUnigrams() that usually follows.
+    auto unigrams = std::make_shared<
+        const std::vector<Formosa::Gramambular2::LanguageModel::Unigram>>(
+        collectUnigrams(key, overlay));
+    if (CacheEntry* entry = seenMacro_ ? nullptr : cacheEntryFor(key)) {
+      entry->hasUnigrams = !unigrams->empty();
+      entry->unigramsKnown = true;
+      entry->unigrams = std::move(unigrams);
+      return entry->hasUnigrams;
+    }
+    return !unigrams->empty();
   }
 
-  return !getUnigrams(key).empty();
+  bool result = overlay != nullptr || languageModel_->hasUnigrams(key);
+  if (CacheEntry* entry = cacheEntryFor(key)) {
+    entry->hasUnigrams = result;
+  }
+  return result;
+}
+
+uint32_t McBopomofoLM::hasUnigramsForPrefixes(
+    std::span<const std::string> readings, const std::string& separator) {
+  ++lookupCount_;
+  // The built-in LM does the bulk of the work with its prefix walk. The
+  // overlay is a hash map, so it is checked one key at a time, and this
+  // follows the same rules as hasUnigrams().
+  uint32_t result =
+      languageModel_->hasUnigramsForPrefixes(readings, separator);
+  if (readings.empty()) {
+    return result;
+  }
+
+  std::string key;
+  size_t count = std::min<size_t>(readings.size(), 32);
+  for (size_t n = 1; n <= count; ++n) {
+    if (n > 1) {
+      key += separator;
+    }
+    key += readings[n - 1];
+    uint32_t bit = static_cast<uint32_t>(1) << (n - 1);
+    if (key == " ") {
+      result |= bit;
+      continue;
+    }
+    const OverlayEntry* overlay = findOverlay(key);
+    if (overlay == nullptr) {
+      continue;
+    }
+    if (!overlay->userUnigrams.empty() ||
+        !collectUnigrams(key, overlay).empty()) {
+      result |= bit;
+    } else {
+      result &= ~bit;
+    }
+  }
+  return result;
 }
 
 std::string McBopomofoLM::getReading(const std::string& value) const {
   std::vector<ParselessLM::FoundReading> foundReadings =
-      languageModel_.getReadings(value);
+      languageModel_->getReadings(value);
   double topScore = std::numeric_limits<double>::lowest();
   std::string topValue;
   for (const auto& foundReading : foundReadings) {
@@ -251,7 +445,19 @@ std::vector<AssociatedPhrasesV2::Phrase> McBopomofoLM::findAssociatedPhrasesV2(
 }
 
 void McBopomofoLM::setPhraseReplacementEnabled(bool enabled) {
+  if (phraseReplacementEnabled_ == enabled) {
+    return;
+  }
   phraseReplacementEnabled_ = enabled;
+  rebuildOverlay();
+}
+
+void McBopomofoLM::setUnigramCacheCapacity(size_t capacity) {
+  unigramCacheCapacity_ = capacity;
+  while (cacheEntries_.size() > unigramCacheCapacity_) {
+    cacheIndex_.erase(cacheEntries_.back().key);
+    cacheEntries_.pop_back();
+  }
 }
 
 bool McBopomofoLM::phraseReplacementEnabled() const {
@@ -260,6 +466,7 @@ bool McBopomofoLM::phraseReplacementEnabled() const {
 
 void McBopomofoLM::setExternalConverterEnabled(bool enabled) {
   externalConverterEnabled_ = enabled;
+  invalidateUnigramCache();
 }
 
 bool McBopomofoLM::externalConverterEnabled() const {
@@ -269,11 +476,26 @@ bool McBopomofoLM::externalConverterEnabled() const {
 void McBopomofoLM::setExternalConverter(
     std::function<std::string(const std::string&)> externalConverter) {
   externalConverter_ = std::move(externalConverter);
+  invalidateUnigramCache();
 }
 
 void McBopomofoLM::setMacroConverter(
     std::function<std::string(const std::string&)> macroConverter) {
   macroConverter_ = std::move(macroConverter);
+  invalidateUnigramCache();
+}
+
+void McBopomofoLM::setKeyFiltersEnabled(bool enabled) {
+  for (ResidentLanguageModel& resident : residentLanguageModels_) {
+    resident.model->setKeyFilterEnabled(enabled);
+  }
+  keyFiltersEnabled_ = enabled;
+  rebuildOverlay();
+}
+
+McBopomofoLM::KeyFilterStats McBopomofoLM::keyFilterStats() const {
+  return KeyFilterStats{languageModel_->keyFilterStats(),
+                        overlayFilter_.stats()};
 }
 
 std::string McBopomofoLM::convertMacro(const std::string& input) const {
@@ -283,60 +505,275 @@ std::string McBopomofoLM::convertMacro(const std::string& input) const {
   return input;
 }
 
-std::vector<Formosa::Gramambular2::LanguageModel::Unigram>
-McBopomofoLM::filterAndTransformUnigrams(
-    const std::vector<Formosa::Gramambular2::LanguageModel::Unigram>& unigrams,
-    const std::unordered_set<std::string>& excludedValues,
-    std::unordered_set<std::string>& insertedValues) const {
-  std::vector<Formosa::Gramambular2::LanguageModel::Unigram> results;
-
-  for (auto&& unigram : unigrams) {
-    // excludedValues filters out the unigrams with the original value.
-    // insertedValues filters out the ones with the converted value
-    const std::string& rawValue = unigram.value();
-    if (excludedValues.find(rawValue) != excludedValues.end()) {
-      continue;
+void McBopomofoLM::rebuildOverlay() {
+  invalidateUnigramCache();
+  overlay_.clear();
+  replacements_.clear();
+  overlayFilter_.clear();
+
+  phraseReplacement_.forEachKey([this](std::string_view key) {
+    std::string value = phraseReplacement_.valueForKey(std::string(key));
+    if (!value.empty()) {
+      replacements_.emplace(key, std::move(value));
     }
+  });
 
-    std::string value = rawValue;
-    if (phraseReplacementEnabled_) {
-      std::string replacement = phraseReplacement_.valueForKey(value);
-      if (!replacement.empty()) {
-        if (value != replacement) {
-          value = replacement;
+  excludedPhrases_.forEachKey([this](std::string_view key) {
+    std::string keyString(key);
+    OverlayEntry& entry = overlay_[keyString];
+    for (const auto& unigram : excludedPhrases_.getUnigrams(keyString)) {
+      entry.excludedValues.push_back(unigram.value());
+    }
+    std::sort(entry.excludedValues.begin(), entry.excludedValues.end());
+  });
+
+  userPhrases_.forEachKey([this](std::string_view key) {
+    std::string keyString(key);
+    OverlayEntry& entry = overlay_[keyString];
+    for (const auto& unigram : userPhrases_.getUnigrams(keyString)) {
+      const std::string& rawValue = unigram.value();
+      if (std::binary_search(entry.excludedValues.begin(),
+                             entry.excludedValues.end(), rawValue)) {
+        continue;
+      }
+      std::string value = rawValue;
+      if (phraseReplacementEnabled_) {
+        auto it = replacements_.find(value);
+        if (it != replacements_.end()) {
+          value = it->second;
         }
       }
-    }
-    if (macroConverter_ != nullptr) {
-      std::string replacement = macroConverter_(value);
-      if (value != replacement) {
-        value = replacement;
+      bool duplicate = std::any_of(
+          entry.userUnigrams.begin(), entry.userUnigrams.end(),
+          [&value](const OverlayUnigram& u) { return u.value == value; });
+      if (!duplicate) {
+        entry.userUnigrams.push_back(
+            OverlayUnigram{std::move(value), rawValue});
       }
     }
+  });
 
-    // Check if the string is an unsupported macro
-    if (unigram.score() == kMacroScore && value.size() > kMacroPrefix.size() &&
-        value.compare(0, kMacroPrefix.size(), kMacroPrefix) == 0) {
-      continue;
+  for (const UserPhraseEdit& edit : userPhraseEdits_) {
+    applyUserPhraseEdit(edit);
+  }
+
+  if (keyFiltersEnabled_ && !overlay_.empty()) {
+    overlayFilter_.reset(overlay_.size());
+    for (const auto& [key, entry] : overlay_) {
+      overlayFilter_.add(key);
     }
+  }
+}
+
+void McBopomofoLM::applyUserPhraseEdit(const UserPhraseEdit& edit) {
+  OverlayEntry& entry = overlay_[edit.reading];
+  std::vector<std::string>& excluded = entry.excludedValues;
+  auto excludedIt =
+      std::lower_bound(excluded.begin(), excluded.end(), edit.value);
+  bool isExcluded = excludedIt != excluded.end() && *excludedIt == edit.value;
+  auto sameRawValue = [&edit](const OverlayUnigram& u) {
+    return u.rawValue == edit.value;
+  };
+
+  if (!edit.add) {
+    std::erase_if(entry.userUnigrams, sameRawValue);
+    if (!isExcluded) {
+      excluded.insert(excludedIt, edit.value);
+    }
+    return;
+  }
+
+  if (isExcluded) {
+    excluded.erase(excludedIt);
+  }
+  if (std::any_of(entry.userUnigrams.begin(), entry.userUnigrams.end(),
+                  sameRawValue)) {
+    return;
+  }
+  std::string value = edit.value;
+  if (phraseReplacementEnabled_) {
+    auto it = replacements_.find(value);
+    if (it != replacements_.end()) {
+      value = it->second;
+    }
+  }
+  bool duplicate = std::any_of(
+      entry.userUnigrams.begin(), entry.userUnigrams.end(),
+      [&value](const OverlayUnigram& u) { return u.value == value; });
+  if (!duplicate) {
+    entry.userUnigrams.push_back(OverlayUnigram{std::move(value), edit.value});
+  }
+}
+
+void McBopomofoLM::editUserPhrases(UserPhraseEdit edit) {
+  bool isNewKey = overlay_.find(edit.reading) == overlay_.end();
+  applyUserPhraseEdit(edit);
+  if (isNewKey) {
+    // The filter was sized for fewer keys, which only makes false positives
+    // a little more likely until the next rebuild.
+    overlayFilter_.add(edit.reading);
+  }
+  userPhraseEdits_.push_back(std::move(edit));
+  invalidateUnigramCache();
+}
+
+void McBopomofoLM::addUserPhrase(const std::string& reading,
+                                 const std::string& value) {
+  editUserPhrases(UserPhraseEdit{true, reading, value});
+}
+
+void McBopomofoLM::removeUserPhrase(const std::string& reading,
+                                    const std::string& value) {
+  editUserPhrases(UserPhraseEdit{false, reading, value});
+}
+
+bool McBopomofoLM::hasUserPhrase(const std::string& reading,
+                                 const std::string& value) const {
+  auto it = overlay_.find(reading);
+  if (it == overlay_.end()) {
+    return false;
+  }
+  const std::vector<OverlayUnigram>& unigrams = it->second.userUnigrams;
+  return std::any_of(
+      unigrams.begin(), unigrams.end(),
+      [&value](const OverlayUnigram& u) { return u.rawValue == value; });
+}
+
+bool McBopomofoLM::isPhraseExcluded(const std::string& reading,
+                                    const std::string& value) const {
+  auto it = overlay_.find(reading);
+  return it != overlay_.end() &&
+         std::binary_search(it->second.excludedValues.begin(),
+                            it->second.excludedValues.end(), value);
+}
 
-    if (externalConverterEnabled_ && externalConverter_ != nullptr) {
-      std::string replacement = externalConverter_(value);
-      if (value != replacement) {
-        value = replacement;
+const McBopomofoLM::OverlayEntry* McBopomofoLM::findOverlay(
+    const std::string& key) const {
+  if (!overlayFilter_.mayContain(key)) {
+    return nullptr;
+  }
+  auto it = overlay_.find(key);
+  if (it == overlay_.end()) {
+    if (!overlayFilter_.empty()) {
+      overlayFilter_.recordFalsePositive();
+    }
+    return nullptr;
+  }
+  return &it->second;
+}
+
+void McBopomofoLM::appendConverted(
+    std::string value, std::string_view rawValue, double score,
+    std::vector<Formosa::Gramambular2::LanguageModel::Unigram>& results) {
+  if (macroConverter_ != nullptr) {
+    std::string converted = macroConverter_(value);
+    if (converted != value) {
+      value = std::move(converted);
+      seenMacro_ = true;
+    }
+  }
+
+  // Check if the string is an unsupported macro
+  if (score == kMacroScore && value.size() > kMacroPrefix.size() &&
+      value.compare(0, kMacroPrefix.size(), kMacroPrefix) == 0) {
+    return;
+  }
+
+  if (externalConverterEnabled_ && externalConverter_ != nullptr) {
+    value = externalConverter_(value);
+  }
+
+  // Duplicates are detected with the converted value.
+  if (markSeen(results, value)) {
+    results.emplace_back(std::move(value), score, std::string(rawValue));
+  }
+}
+
+McBopomofoLM::CacheEntry* McBopomofoLM::findCached(const std::string& key) {
+  auto it = cacheIndex_.find(key);
+  if (it == cacheIndex_.end()) {
+    return nullptr;
+  }
+  auto entryIt = it->second;
+  if (entryIt->generation != unigramCacheGeneration_) {
+    cacheIndex_.erase(it);
+    cacheEntries_.erase(entryIt);
+    return nullptr;
+  }
+  cacheEntries_.splice(cacheEntries_.begin(), cacheEntries_, entryIt);
+  return &*entryIt;
+}
+
+McBopomofoLM::CacheEntry* McBopomofoLM::cacheEntryFor(const std::string& key) {
+  if (unigramCacheCapacity_ == 0) {
+    return nullptr;
+  }
+  if (CacheEntry* entry = findCached(key)) {
+    return entry;
+  }
+
+  while (cacheEntries_.size() >= unigramCacheCapacity_) {
+    cacheIndex_.erase(cacheEntries_.back().key);
+    cacheEntries_.pop_back();
+    ++unigramCacheStats_.evictions;
+  }
+  cacheEntries_.emplace_front();
+  CacheEntry& entry = cacheEntries_.front();
+  entry.key = key;
+  entry.generation = unigramCacheGeneration_;
+  cacheIndex_.emplace(entry.key, cacheEntries_.begin());
+  return &entry;
+}
+
+void McBopomofoLM::resetSeenValues() {
+  ++seenGeneration_;
+  if (seenGeneration_ == 0) {
+    // Wrapped around. Old slots could now look current, so clear them.
+    std::fill(seenSlots_.begin(), seenSlots_.end(), SeenSlot{});
+    seenGeneration_ = 1;
+  }
+}
+
+bool McBopomofoLM::markSeen(
+    const std::vector<Formosa::Gramambular2::LanguageModel::Unigram>& results,
+    std::string_view value) {
+  constexpr size_t kMinSlots = 64;
+  std::hash<std::string_view> hasher;
+
+  // Keep the table at most half full. When it grows, the values seen so far
+  // are exactly the values of the results, so they are simply reinserted.
+  if ((results.size() + 1) * 2 > seenSlots_.size()) {
+    size_t size = std::max(kMinSlots, seenSlots_.size() * 2);
+    seenSlots_.assign(size, SeenSlot{});
+    size_t mask = size - 1;
+    for (size_t i = 0; i < results.size(); ++i) {
+      size_t h = hasher(results[i].value()) & mask;
+      while (seenSlots_[h].generation == seenGeneration_) {
+        h = (h + 1) & mask;
       }
+      seenSlots_[h] = SeenSlot{seenGeneration_, static_cast<uint32_t>(i)};
+    }
+  }
+
+  size_t mask = seenSlots_.size() - 1;
+  for (size_t h = hasher(value) & mask;; h = (h + 1) & mask) {
+    SeenSlot& slot = seenSlots_[h];
+    if (slot.generation != seenGeneration_) {
+      slot = SeenSlot{seenGeneration_, static_cast<uint32_t>(results.size())};
+      return true;
     }
-    if (insertedValues.find(value) == insertedValues.end()) {
-      results.emplace_back(value, unigram.score(), rawValue);
-      insertedValues.insert(value);
+    if (results[slot.index].value() == value) {
+      return false;
     }
   }
-  return results;
 }
 
 void McBopomofoLM::loadLanguageModel(std::unique_ptr<ParselessPhraseDB> db) {
-  languageModel_.close();
-  languageModel_.open(std::move(db));
+  // An in-memory database replaces the active model.
+  residentLanguageModels_.front().path.clear();
+  languageModel_->close();
+  languageModel_->open(std::move(db));
+  invalidateUnigramCache();
 }
 
 void McBopomofoLM::loadAssociatedPhrasesV2(
@@ -348,16 +785,19 @@ void McBopomofoLM::loadAssociatedPhrasesV2(
 void McBopomofoLM::loadUserPhrases(const char* data, size_t length) {
   userPhrases_.close();
   userPhrases_.load(data, length);
+  rebuildOverlay();
 }
 
 void McBopomofoLM::loadExcludedPhrases(const char* data, size_t length) {
   excludedPhrases_.close();
   excludedPhrases_.load(data, length);
+  rebuildOverlay();
 }
 
 void McBopomofoLM::loadPhraseReplacementMap(const char* data, size_t length) {
   phraseReplacement_.close();
   phraseReplacement_.load(data, length);
+  rebuildOverlay();
 }
 
 }  // namespace McBopomofo
@@ -24,15 +24,20 @@
 #ifndef SRC_ENGINE_MCBOPOMOFOLM_H_
 #define SRC_ENGINE_MCBOPOMOFOLM_H_
 
+#include <cstdint>
 #include <filesystem>
 #include <functional>
+#include <list>
 #include <memory>
 #include <optional>
+#include <span>
 #include <string>
-#include <unordered_set>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include "AssociatedPhrasesV2.h"
+#include "BloomFilter.h"
 #include "ParselessLM.h"
 #include "PhraseReplacementMap.h"
 #include "UserPhrasesLM.h"
@@ -53,22 +58,51 @@ namespace McBopomofo {
 // 4. Transform the unigram values with an external converter, if supplied.
 // 5. Remove any duplicates.
 //
+// Steps 2 and 3 for the user phrases are done ahead of time: whenever the user
+// phrases, the excluded phrases, or the replacement map are (re)loaded, they
+// are compiled into an overlay that holds, for each reading they mention, the
+// sorted excluded values and the filtered user phrases. A lookup then probes
+// the overlay once and makes a single pass over the language model's rows.
+//
+// The results of getUnigrams() and hasUnigrams() are kept in a bounded LRU
+// cache keyed by reading, since the grid asks for the same readings on every
+// keystroke. Loading any of the models, or changing how the values are
+// converted, bumps a generation counter, and entries from an older
+// generation are treated as misses. The results that went through the macro
+// converter are not cached, because a macro such as the current date may
+// expand differently the next time.
+//
 // McBopomofoLM itself is not responsible for reloading custom models (user
 // phrases, excluded phrases, and replacement map). The LM's owner, usually the
 // input method controller, needs to take care of checking for updates and
 // telling McBopomofoLM to reload as needed.
 class McBopomofoLM : public Formosa::Gramambular2::LanguageModel {
  public:
-  McBopomofoLM() = default;
+  McBopomofoLM();
 
   McBopomofoLM(const McBopomofoLM&) = delete;
   McBopomofoLM(McBopomofoLM&&) = delete;
   McBopomofoLM& operator=(const McBopomofoLM&) = delete;
   McBopomofoLM& operator=(McBopomofoLM&&) = delete;
 
-  // Loads (or reloads, if already loaded) the primary language model data file.
+  // Up to this many primary language models stay open, so that switching
+  // between the input modes does not remap and rewarm the data files.
+  static constexpr size_t kMaxResidentLanguageModels = 2;
+
+  // Makes the primary language model data file the active one. If the file
+  // is already open and has not been modified since, this is only a pointer
+  // swap. Otherwise the file is (re)opened, replacing the least recently
+  // used model if kMaxResidentLanguageModels are open.
   void loadLanguageModel(const char* languageModelDataPath);
 
+  // Opens and warms up the primary language model data file without making
+  // it the active one, so that a later loadLanguageModel() with the same path
+  // is instant. The active model is never replaced by this.
+  void preloadLanguageModel(const char* languageModelDataPath);
+
+  // The number of primary language models that are open.
+  size_t residentLanguageModelCount() const;
+
   bool isDataModelLoaded() const;
 
   // Loads (or reloads if already loaded) the associated phrases data file.
@@ -90,7 +124,35 @@ class McBopomofoLM : public Formosa::Gramambular2::LanguageModel {
   std::vector<Formosa::Gramambular2::LanguageModel::Unigram> getUnigrams(
       const std::string& key) override;
 
+  // Hands out the cached unigrams without copying them.
+  std::shared_ptr<
+      const std::vector<Formosa::Gramambular2::LanguageModel::Unigram>>
+  getSharedUnigrams(const std::string& key) override;
   bool hasUnigrams(const std::string& key) override;
+  uint32_t hasUnigramsForPrefixes(std::span<const std::string> readings,
+                                  const std::string& separator) override;
+
+  // The number of getUnigrams(), hasUnigrams(), and hasUnigramsForPrefixes()
+  // calls made so far, for attributing the time spent on a keystroke.
+  uint64_t lookupCount() const { return lookupCount_; }
+
+  static constexpr size_t kDefaultUnigramCacheCapacity = 2048;
+
+  // Sets the maximum number of readings whose results are cached. 0 disables
+  // the cache.
+  void setUnigramCacheCapacity(size_t capacity);
+
+  struct UnigramCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+  };
+  const UnigramCacheStats& unigramCacheStats() const {
+    return unigramCacheStats_;
+  }
+
+  // Bumped whenever the cached results may have become stale.
+  uint64_t unigramCacheGeneration() const { return unigramCacheGeneration_; }
 
   std::string getReading(const std::string& value) const;
 
@@ -110,6 +172,16 @@ class McBopomofoLM : public Formosa::Gramambular2::LanguageModel {
       std::function<std::string(const std::string&)> macroConverter);
   std::string convertMacro(const std::string& input) const;
 
+  // Enables or disables the Bloom filters of the language model and the
+  // user overlay. The filters are (re)built as the data is (re)loaded.
+  void setKeyFiltersEnabled(bool enabled);
+
+  struct KeyFilterStats {
+    BloomFilter::Stats languageModel;
+    BloomFilter::Stats userOverlay;
+  };
+  KeyFilterStats keyFilterStats() const;
+
   // Methods to allow loading in-memory data for testing purposes.
   void loadLanguageModel(std::unique_ptr<ParselessPhraseDB> db);
   void loadAssociatedPhrasesV2(std::unique_ptr<ParselessPhraseDB> db);
@@ -117,6 +189,26 @@ class McBopomofoLM : public Formosa::Gramambular2::LanguageModel {
   void loadExcludedPhrases(const char* data, size_t length);
   void loadPhraseReplacementMap(const char* data, size_t length);
 
+  // Edits the user phrases in memory, without reparsing the files, with the
+  // same effect as LanguageModelLoader's edits of the files: adding a phrase
+  // also takes it off the excluded phrases, and removing a phrase also
+  // excludes it. The edits are applied in order on top of the files, also
+  // after the files are reloaded, until clearUserPhraseEdits() is called.
+  void addUserPhrase(const std::string& reading, const std::string& value);
+  void removeUserPhrase(const std::string& reading, const std::string& value);
+
+  // Drops the edits. Call this right before reloading files that already
+  // include them.
+  void clearUserPhraseEdits() { userPhraseEdits_.clear(); }
+  size_t userPhraseEditCount() const { return userPhraseEdits_.size(); }
+
+  // Whether the value is a user phrase of the reading, taking the excluded
+  // phrases and the edits into account.
+  bool hasUserPhrase(const std::string& reading,
+                     const std::string& value) const;
+  bool isPhraseExcluded(const std::string& reading,
+                        const std::string& value) const;
+
   enum class UserFileType {
     USER_PHRASES,
     EXCLUDED_PHRASES,
@@ -144,17 +236,110 @@ class McBopomofoLM : public Formosa::Gramambular2::LanguageModel {
   std::vector<UserFileIssue> getUserFileIssues() const;
 
  protected:
-  // Filters and converts the input unigrams and returns a new list of unigrams.
-  // Unigrams whose values are found in `excludedValues` are removed, and the
-  // kept values will be inserted to the `insertedValues` set.
-  std::vector<Formosa::Gramambular2::LanguageModel::Unigram>
-  filterAndTransformUnigrams(
+  struct OverlayUnigram {
+    // The value after the phrase replacement, if enabled.
+    std::string value;
+    std::string rawValue;
+  };
+
+  struct OverlayEntry {
+    // Sorted. There are usually only a few, so this beats a hash set.
+    std::vector<std::string> excludedValues;
+    // The user phrases that are not excluded, without duplicates, in the
+    // order of the file.
+    std::vector<OverlayUnigram> userUnigrams;
+  };
+
+  // Transparent, so that the maps can be probed with string views.
+  struct StringHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view s) const {
+      return std::hash<std::string_view>()(s);
+    }
+  };
+
+  // Compiles the user phrases, the excluded phrases, and the phrase
+  // replacements into the overlay, then applies the user phrase edits.
+  void rebuildOverlay();
+
+  struct UserPhraseEdit {
+    bool add = false;
+    std::string reading;
+    std::string value;
+  };
+
+  // Applies an edit to the overlay. The overlay filter is not updated.
+  void applyUserPhraseEdit(const UserPhraseEdit& edit);
+
+  // Applies an edit made after the overlay was built.
+  void editUserPhrases(UserPhraseEdit edit);
+
+  // Returns the overlay entry of the key, or null if the user files do not
+  // mention the key.
+  const OverlayEntry* findOverlay(const std::string& key) const;
+
+  // getUnigrams() without the special cases and the lookup count.
+  std::vector<Formosa::Gramambular2::LanguageModel::Unigram> collectUnigrams(
+      const std::string& key, const OverlayEntry* overlay);
+
+  // Applies the macro and external converters to the value and appends the
+  // unigram to the results, unless the converted value is already there.
+  void appendConverted(
+      std::string value, std::string_view rawValue, double score,
+      std::vector<Formosa::Gramambular2::LanguageModel::Unigram>& results);
+
+  struct CacheEntry {
+    std::string key;
+    uint64_t generation = 0;
+    bool hasUnigrams = false;
+    // If false, only hasUnigrams is known.
+    bool unigramsKnown = false;
+    // Shared with the callers of getSharedUnigrams(), so that a hit does not
+    // copy the unigrams.
+    std::shared_ptr<
+        const std::vector<Formosa::Gramambular2::LanguageModel::Unigram>>
+        unigrams;
+  };
+
+  void invalidateUnigramCache() { ++unigramCacheGeneration_; }
+
+  // Returns the current entry of the key and makes it the most recently
+  // used, or returns null. A stale entry is removed.
+  CacheEntry* findCached(const std::string& key);
+
+  // Returns the entry of the key, which is created if needed, evicting the
+  // least recently used entries, or returns null if the cache is disabled.
+  CacheEntry* cacheEntryFor(const std::string& key);
+
+  // Starts a new set of values seen for appendConverted().
+  void resetSeenValues();
+
+  // Returns false if the value is the value of one of the results. Otherwise
+  // records the value as that of results[results.size()], which the caller
+  // then appends.
+  bool markSeen(
       const std::vector<Formosa::Gramambular2::LanguageModel::Unigram>&
-          unigrams,
-      const std::unordered_set<std::string>& excludedValues,
-      std::unordered_set<std::string>& insertedValues) const;
+          results,
+      std::string_view value);
+
+  struct ResidentLanguageModel {
+    // Empty for a database loaded from memory.
+    std::string path;
+    std::filesystem::file_time_type modifiedTime;
+    std::unique_ptr<ParselessLM> model;
+  };
 
-  ParselessLM languageModel_;
+  // Returns the index of the resident model of the path, (re)opening it as
+  // needed. If keepActive is true, the active model is not replaced by
+  // another file, though it is reopened if its own file has been replaced.
+  // Returns residentLanguageModels_.size() if no slot can be used.
+  size_t residentSlotFor(const char* path, bool keepActive);
+
+  // The most recently used first. The first one is the active one, and there
+  // is always at least one, which may not be loaded.
+  std::vector<ResidentLanguageModel> residentLanguageModels_;
+  // Points to the model of the first resident one.
+  ParselessLM* languageModel_ = nullptr;
   UserPhrasesLM userPhrases_;
   UserPhrasesLM excludedPhrases_;
   PhraseReplacementMap phraseReplacement_;
@@ -170,6 +355,36 @@ class McBopomofoLM : public Formosa::Gramambular2::LanguageModel {
   std::function<std::string(const std::string&)> externalConverter_;
 
   std::function<std::string(const std::string&)> macroConverter_;
+
+  uint64_t lookupCount_ = 0;
+
+  std::unordered_map<std::string, OverlayEntry, StringHash, std::equal_to<>>
+      overlay_;
+  std::unordered_map<std::string, std::string, StringHash, std::equal_to<>>
+      replacements_;
+  bool keyFiltersEnabled_ = false;
+  BloomFilter overlayFilter_;
+  std::vector<UserPhraseEdit> userPhraseEdits_;
+
+  // An open-addressed set of the values of the unigrams being collected,
+  // reused across lookups. A slot is in the set if its generation is the
+  // current one, which saves clearing the slots for every lookup.
+  struct SeenSlot {
+    uint32_t generation = 0;
+    uint32_t index = 0;
+  };
+  std::vector<SeenSlot> seenSlots_;
+  uint32_t seenGeneration_ = 0;
+  // Set by appendConverted() if the macro converter changed a value.
+  bool seenMacro_ = false;
+
+  // Most recently used first. The index keys point into the entries.
+  std::list<CacheEntry> cacheEntries_;
+  std::unordered_map<std::string_view, std::list<CacheEntry>::iterator>
+      cacheIndex_;
+  size_t unigramCacheCapacity_ = kDefaultUnigramCacheCapacity;
+  uint64_t unigramCacheGeneration_ = 0;
+  UnigramCacheStats unigramCacheStats_;
 };
 
 }  // namespace McBopomofo
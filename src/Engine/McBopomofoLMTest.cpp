@@ -21,12 +21,17 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 // OTHER DEALINGS IN THE SOFTWARE.
 
+#include <chrono>
 #include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "McBopomofoLM.h"
+#include "TestTempDir.h"
 #include "gtest/gtest.h"
 
 namespace McBopomofo {
@@ -73,6 +78,27 @@ constexpr char kPhreaseReplacementMapData[] = R"(
 澀谷 渋谷
 )";
 
+namespace {
+
+// Writes a one-row database for ㄇㄚ by replacing the file, like a package
+// upgrade would, so that an open mapping of the old file stays valid.
+void WriteSingleRowDB(const std::string& path, const std::string& value) {
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary);
+    out << "# format org.openvanilla.mcbopomofo.sorted\n"
+        << "ㄇㄚ " << value << " -1\n";
+  }
+  std::filesystem::rename(tmp, path);
+}
+
+std::string TopValue(McBopomofoLM& lm) {
+  auto unigrams = lm.getUnigrams("ㄇㄚ");
+  return unigrams.empty() ? std::string() : unigrams[0].value();
+}
+
+}  // namespace
+
 TEST(McBopomofoLMTest, PrimaryLanguageModel) {
   McBopomofoLM lm;
   auto db = std::make_unique<ParselessPhraseDB>(kPrimaryLMData,
@@ -87,6 +113,59 @@ TEST(McBopomofoLMTest, PrimaryLanguageModel) {
   EXPECT_LT(unigrams[0].score(), 0);
 }
 
+TEST(McBopomofoLMTest, ResidentLanguageModels) {
+  TempDir dir;
+  std::string a = dir.file("a.txt");
+  std::string b = dir.file("b.txt");
+  std::string c = dir.file("c.txt");
+  WriteSingleRowDB(a, "媽");
+  WriteSingleRowDB(b, "麻");
+  WriteSingleRowDB(c, "馬");
+
+  McBopomofoLM lm;
+  lm.loadLanguageModel(a.c_str());
+  lm.preloadLanguageModel(b.c_str());
+  EXPECT_EQ(lm.residentLanguageModelCount(), 2);
+  EXPECT_EQ(TopValue(lm), "媽");
+
+  lm.loadLanguageModel(b.c_str());
+  EXPECT_EQ(TopValue(lm), "麻");
+
+  // Switching back is a swap: a file replaced without changing the
+  // modification time is not even reopened.
+  auto modifiedTime = std::filesystem::last_write_time(a);
+  WriteSingleRowDB(a, "嘛");
+  std::filesystem::last_write_time(a, modifiedTime);
+  lm.loadLanguageModel(a.c_str());
+  EXPECT_EQ(TopValue(lm), "媽");
+
+  // A newer file is reopened.
+  std::filesystem::last_write_time(a, modifiedTime + std::chrono::hours(1));
+  lm.loadLanguageModel(a.c_str());
+  EXPECT_EQ(TopValue(lm), "嘛");
+
+  // b is the least recently used, and is replaced.
+  lm.loadLanguageModel(c.c_str());
+  EXPECT_EQ(TopValue(lm), "馬");
+  EXPECT_EQ(lm.residentLanguageModelCount(), 2);
+  lm.loadLanguageModel(a.c_str());
+  EXPECT_EQ(TopValue(lm), "嘛");
+
+  // Preloading never replaces the active model.
+  lm.preloadLanguageModel(b.c_str());
+  EXPECT_EQ(TopValue(lm), "嘛");
+  lm.loadLanguageModel(b.c_str());
+  EXPECT_EQ(TopValue(lm), "麻");
+
+  // Preloading the active model after its file is replaced reopens it, and
+  // the cached results of the old file are not served any more.
+  WriteSingleRowDB(b, "痲");
+  std::filesystem::last_write_time(
+      b, std::filesystem::last_write_time(b) + std::chrono::hours(1));
+  lm.preloadLanguageModel(b.c_str());
+  EXPECT_EQ(TopValue(lm), "痲");
+}
+
 TEST(McBopomofoLMTest, AssociatedPhrasesV2) {
   McBopomofoLM lm;
   auto db = std::make_unique<ParselessPhraseDB>(
@@ -128,6 +207,139 @@ TEST(McBopomofoLMTest, ExcludedPhrases) {
   EXPECT_TRUE(unigrams.empty());
 }
 
+TEST(McBopomofoLMTest, KeyFilters) {
+  McBopomofoLM lm;
+  lm.setKeyFiltersEnabled(true);
+  auto db = std::make_unique<ParselessPhraseDB>(kPrimaryLMData,
+                                                sizeof(kPrimaryLMData));
+  lm.loadLanguageModel(std::move(db));
+  lm.loadUserPhrases(kUserPhrasesData, sizeof(kUserPhrasesData));
+  lm.loadExcludedPhrases(kExcludedPhrasesData, sizeof(kExcludedPhrasesData));
+
+  EXPECT_TRUE(lm.hasUnigrams("ㄇㄧㄥˊ-ㄘˊ"));
+  EXPECT_TRUE(lm.hasUnigrams("ㄇㄧㄥˊ-ㄘˋ"));
+  EXPECT_FALSE(lm.hasUnigrams("ㄉㄨㄥˋ-ㄗㄨㄛˋ"));
+  EXPECT_FALSE(lm.hasUnigrams("ㄘˋ-ㄇㄧㄥˊ"));
+
+  McBopomofoLM::KeyFilterStats stats = lm.keyFilterStats();
+  // Every key is checked against the user overlay exactly once.
+  EXPECT_EQ(stats.userOverlay.queries, 4);
+  EXPECT_GT(stats.userOverlay.rejections, 0);
+  EXPECT_GT(stats.languageModel.queries, 0);
+}
+
+TEST(McBopomofoLMTest, UnigramCache) {
+  McBopomofoLM lm;
+  auto db = std::make_unique<ParselessPhraseDB>(kPrimaryLMData,
+                                                sizeof(kPrimaryLMData));
+  lm.loadLanguageModel(std::move(db));
+
+  EXPECT_TRUE(lm.hasUnigrams("ㄇㄧㄥˊ"));
+  EXPECT_TRUE(lm.hasUnigrams("ㄇㄧㄥˊ"));
+  auto unigrams = lm.getUnigrams("ㄇㄧㄥˊ");
+  EXPECT_EQ(lm.getUnigrams("ㄇㄧㄥˊ").size(), unigrams.size());
+  // The first getUnigrams() misses, as hasUnigrams() only kept the answer.
+  EXPECT_EQ(lm.unigramCacheStats().hits, 2);
+  EXPECT_EQ(lm.unigramCacheStats().misses, 2);
+
+  // Hits hand out the cached vector itself rather than a copy.
+  auto shared = lm.getSharedUnigrams("ㄇㄧㄥˊ");
+  EXPECT_EQ(lm.getSharedUnigrams("ㄇㄧㄥˊ"), shared);
+  EXPECT_EQ(lm.unigramCacheStats().hits, 4);
+
+  // Loading the user phrases makes the cached results stale.
+  uint64_t generation = lm.unigramCacheGeneration();
+  lm.loadUserPhrases(kUserPhrasesData, sizeof(kUserPhrasesData));
+  EXPECT_GT(lm.unigramCacheGeneration(), generation);
+  unigrams = lm.getUnigrams("ㄇㄧㄥˊ");
+  ASSERT_FALSE(unigrams.empty());
+  EXPECT_EQ(unigrams[0].value(), "茗");
+  EXPECT_EQ(lm.unigramCacheStats().misses, 3);
+
+  lm.setExternalConverter([](const auto& value) { return value + "!"; });
+  lm.setExternalConverterEnabled(true);
+  unigrams = lm.getUnigrams("ㄇㄧㄥˊ");
+  ASSERT_FALSE(unigrams.empty());
+  EXPECT_EQ(unigrams[0].value(), "茗!");
+  EXPECT_EQ(lm.unigramCacheStats().misses, 4);
+}
+
+TEST(McBopomofoLMTest, UnigramCacheEvictsLeastRecentlyUsed) {
+  McBopomofoLM lm;
+  auto db = std::make_unique<ParselessPhraseDB>(kPrimaryLMData,
+                                                sizeof(kPrimaryLMData));
+  lm.loadLanguageModel(std::move(db));
+  lm.setUnigramCacheCapacity(2);
+
+  lm.getUnigrams("ㄇㄧㄥˊ");
+  lm.getUnigrams("ㄉㄨㄥˋ");
+  lm.getUnigrams("ㄇㄧㄥˊ");
+  lm.getUnigrams("ㄔㄥˊ-ㄕˋ");
+  EXPECT_EQ(lm.unigramCacheStats().evictions, 1);
+  EXPECT_EQ(lm.unigramCacheStats().hits, 1);
+
+  // ㄉㄨㄥˋ was the least recently used.
+  lm.getUnigrams("ㄇㄧㄥˊ");
+  EXPECT_EQ(lm.unigramCacheStats().hits, 2);
+  lm.getUnigrams("ㄉㄨㄥˋ");
+  EXPECT_EQ(lm.unigramCacheStats().hits, 2);
+
+  lm.setUnigramCacheCapacity(0);
+  lm.getUnigrams("ㄉㄨㄥˋ");
+  EXPECT_EQ(lm.unigramCacheStats().hits, 2);
+}
+
+TEST(McBopomofoLMTest, MacroResultsAreNotCached) {
+  McBopomofoLM lm;
+  auto db = std::make_unique<ParselessPhraseDB>(kPrimaryLMData,
+                                                sizeof(kPrimaryLMData));
+  lm.loadLanguageModel(std::move(db));
+  int day = 10;
+  lm.setMacroConverter([&day](const std::string& macro) {
+    if (macro == "MACRO@DATE_TODAY_SHORT") {
+      return "6/" + std::to_string(day) + "/21";
+    }
+    return macro;
+  });
+
+  auto unigrams = lm.getUnigrams("ㄐㄧㄣ-ㄊㄧㄢ");
+  ASSERT_EQ(unigrams.size(), 2);
+  EXPECT_EQ(unigrams[1].value(), "6/10/21");
+
+  day = 11;
+  unigrams = lm.getUnigrams("ㄐㄧㄣ-ㄊㄧㄢ");
+  ASSERT_EQ(unigrams.size(), 2);
+  EXPECT_EQ(unigrams[1].value(), "6/11/21");
+  EXPECT_EQ(lm.unigramCacheStats().hits, 0);
+}
+
+TEST(McBopomofoLMTest, HasUnigramsForPrefixes) {
+  McBopomofoLM lm;
+  auto db = std::make_unique<ParselessPhraseDB>(kPrimaryLMData,
+                                                sizeof(kPrimaryLMData));
+  lm.loadLanguageModel(std::move(db));
+
+  std::vector<std::string> readings = {"ㄉㄨㄥˋ", "ㄗㄨㄛˋ", "ㄘˋ"};
+  EXPECT_EQ(lm.hasUnigramsForPrefixes(readings, "-"), 0b011);
+
+  readings = {"ㄇㄧㄥˊ", "ㄘˋ"};
+  EXPECT_EQ(lm.hasUnigramsForPrefixes(readings, "-"), 0b11);
+  readings = {"ㄘˋ", "ㄇㄧㄥˊ"};
+  EXPECT_EQ(lm.hasUnigramsForPrefixes(readings, "-"), 0);
+
+  // User phrases add prefixes and excluded phrases remove them, just like
+  // they do for hasUnigrams().
+  lm.loadUserPhrases(kUserPhrasesData, sizeof(kUserPhrasesData));
+  lm.loadExcludedPhrases(kExcludedPhrasesData, sizeof(kExcludedPhrasesData));
+  readings = {"ㄉㄨㄥˋ", "ㄗㄨㄛˋ", "ㄘˋ"};
+  EXPECT_EQ(lm.hasUnigramsForPrefixes(readings, "-"), 0b001);
+  readings = {"ㄇㄧㄥˊ", "ㄘˋ"};
+  EXPECT_EQ(lm.hasUnigramsForPrefixes(readings, "-"), 0b11);
+
+  readings = {" "};
+  EXPECT_EQ(lm.hasUnigramsForPrefixes(readings, "-"), 0b1);
+}
+
 TEST(McBopomofoLMTest, PhraseReplacementMap) {
   McBopomofoLM lm;
   auto db = std::make_unique<ParselessPhraseDB>(kPrimaryLMData,
@@ -161,6 +373,123 @@ TEST(McBopomofoLMTest, PhraseReplacementMapDeduplicates) {
   EXPECT_EQ(unigrams[0].value(), "渋谷");
 }
 
+TEST(McBopomofoLMTest, PhraseReplacementAppliesToUserPhrases) {
+  constexpr char kUserData[] = "澀谷 ㄙㄜˋ-ㄍㄨˇ\n";
+  McBopomofoLM lm;
+  auto db = std::make_unique<ParselessPhraseDB>(kPrimaryLMData,
+                                                sizeof(kPrimaryLMData));
+  lm.loadLanguageModel(std::move(db));
+  lm.loadUserPhrases(kUserData, sizeof(kUserData));
+  lm.loadPhraseReplacementMap(kPhreaseReplacementMapData,
+                              sizeof(kPhreaseReplacementMapData));
+
+  lm.setPhraseReplacementEnabled(true);
+  auto unigrams = lm.getUnigrams("ㄙㄜˋ-ㄍㄨˇ");
+  ASSERT_EQ(unigrams.size(), 1);
+  EXPECT_EQ(unigrams[0].value(), "渋谷");
+  EXPECT_EQ(unigrams[0].score(), UserPhrasesLM::kUserUnigramScore);
+
+  lm.setPhraseReplacementEnabled(false);
+  unigrams = lm.getUnigrams("ㄙㄜˋ-ㄍㄨˇ");
+  ASSERT_EQ(unigrams.size(), 2);
+  EXPECT_EQ(unigrams[0].value(), "澀谷");
+  EXPECT_EQ(unigrams[0].score(), UserPhrasesLM::kUserUnigramScore);
+  EXPECT_EQ(unigrams[1].value(), "渋谷");
+}
+
+TEST(McBopomofoLMTest, ExcludedPhrasesApplyToUserPhrases) {
+  constexpr char kExcludedData[] = "名刺 ㄇㄧㄥˊ-ㄘˋ\n";
+  constexpr char kOtherExcludedData[] = "名次 ㄇㄧㄥˊ-ㄘˋ\n";
+  McBopomofoLM lm;
+  auto db = std::make_unique<ParselessPhraseDB>(kPrimaryLMData,
+                                                sizeof(kPrimaryLMData));
+  lm.loadLanguageModel(std::move(db));
+  lm.loadUserPhrases(kUserPhrasesData, sizeof(kUserPhrasesData));
+  lm.loadExcludedPhrases(kExcludedData, sizeof(kExcludedData));
+
+  EXPECT_TRUE(lm.hasUnigrams("ㄇㄧㄥˊ-ㄘˋ"));
+  auto unigrams = lm.getUnigrams("ㄇㄧㄥˊ-ㄘˋ");
+  ASSERT_EQ(unigrams.size(), 1);
+  EXPECT_EQ(unigrams[0].value(), "名次");
+
+  // Reloading the exclusions recompiles the overlay.
+  lm.loadExcludedPhrases(kOtherExcludedData, sizeof(kOtherExcludedData));
+  unigrams = lm.getUnigrams("ㄇㄧㄥˊ-ㄘˋ");
+  ASSERT_EQ(unigrams.size(), 1);
+  EXPECT_EQ(unigrams[0].value(), "名刺");
+}
+
+TEST(McBopomofoLMTest, ManyConvertedValuesAreDeduplicated) {
+  // More rows than the initial size of the table of seen values.
+  std::string data = "# format org.openvanilla.mcbopomofo.sorted\n";
+  for (int i = 0; i < 200; ++i) {
+    data += "ㄧˋ v" + std::to_string(i) + " -" + std::to_string(i + 1) + "\n";
+  }
+  McBopomofoLM lm;
+  lm.loadLanguageModel(
+      std::make_unique<ParselessPhraseDB>(data.c_str(), data.size()));
+  lm.setExternalConverterEnabled(true);
+  lm.setExternalConverter(
+      [](const std::string& value) { return value.substr(0, 3); });
+
+  // v100 ... v199 become v10 ... v19, which are already there.
+  auto unigrams = lm.getUnigrams("ㄧˋ");
+  ASSERT_EQ(unigrams.size(), 100);
+  for (size_t i = 0; i < unigrams.size(); ++i) {
+    EXPECT_EQ(unigrams[i].value(), "v" + std::to_string(i));
+  }
+}
+
+TEST(McBopomofoLMTest, UserPhraseEdits) {
+  McBopomofoLM lm;
+  lm.setKeyFiltersEnabled(true);
+  auto db = std::make_unique<ParselessPhraseDB>(kPrimaryLMData,
+                                                sizeof(kPrimaryLMData));
+  lm.loadLanguageModel(std::move(db));
+  lm.loadUserPhrases(kUserPhrasesData, sizeof(kUserPhrasesData));
+  lm.loadExcludedPhrases(kExcludedPhrasesData, sizeof(kExcludedPhrasesData));
+
+  // A reading that the user files do not mention yet.
+  EXPECT_FALSE(lm.hasUnigrams("ㄇㄧㄥˊ-ㄐㄧㄢˋ"));
+  lm.addUserPhrase("ㄇㄧㄥˊ-ㄐㄧㄢˋ", "名鑑");
+  EXPECT_TRUE(lm.hasUserPhrase("ㄇㄧㄥˊ-ㄐㄧㄢˋ", "名鑑"));
+  EXPECT_TRUE(lm.hasUnigrams("ㄇㄧㄥˊ-ㄐㄧㄢˋ"));
+  auto unigrams = lm.getUnigrams("ㄇㄧㄥˊ-ㄐㄧㄢˋ");
+  ASSERT_EQ(unigrams.size(), 1);
+  EXPECT_EQ(unigrams[0].value(), "名鑑");
+
+  // Adding an excluded phrase takes it off the excluded phrases.
+  EXPECT_TRUE(lm.isPhraseExcluded("ㄉㄨㄥˋ-ㄗㄨㄛˋ", "動作"));
+  lm.addUserPhrase("ㄉㄨㄥˋ-ㄗㄨㄛˋ", "動作");
+  EXPECT_FALSE(lm.isPhraseExcluded("ㄉㄨㄥˋ-ㄗㄨㄛˋ", "動作"));
+  unigrams = lm.getUnigrams("ㄉㄨㄥˋ-ㄗㄨㄛˋ");
+  ASSERT_EQ(unigrams.size(), 1);
+  EXPECT_EQ(unigrams[0].value(), "動作");
+  EXPECT_EQ(unigrams[0].score(), UserPhrasesLM::kUserUnigramScore);
+
+  // Removing a user phrase excludes it.
+  lm.removeUserPhrase("ㄇㄧㄥˊ-ㄘˋ", "名刺");
+  EXPECT_FALSE(lm.hasUserPhrase("ㄇㄧㄥˊ-ㄘˋ", "名刺"));
+  EXPECT_TRUE(lm.isPhraseExcluded("ㄇㄧㄥˊ-ㄘˋ", "名刺"));
+  unigrams = lm.getUnigrams("ㄇㄧㄥˊ-ㄘˋ");
+  ASSERT_EQ(unigrams.size(), 1);
+  EXPECT_EQ(unigrams[0].value(), "名次");
+  EXPECT_EQ(lm.userPhraseEditCount(), 3);
+
+  // The edits survive reloading the files.
+  lm.loadUserPhrases(kUserPhrasesData, sizeof(kUserPhrasesData));
+  EXPECT_TRUE(lm.hasUserPhrase("ㄇㄧㄥˊ-ㄐㄧㄢˋ", "名鑑"));
+  EXPECT_FALSE(lm.hasUserPhrase("ㄇㄧㄥˊ-ㄘˋ", "名刺"));
+  EXPECT_TRUE(lm.hasUserPhrase("ㄉㄨㄥˋ-ㄗㄨㄛˋ", "動作"));
+
+  // Until they are cleared.
+  lm.clearUserPhraseEdits();
+  lm.loadUserPhrases(kUserPhrasesData, sizeof(kUserPhrasesData));
+  EXPECT_FALSE(lm.hasUnigrams("ㄇㄧㄥˊ-ㄐㄧㄢˋ"));
+  EXPECT_TRUE(lm.hasUserPhrase("ㄇㄧㄥˊ-ㄘˋ", "名刺"));
+  EXPECT_TRUE(lm.isPhraseExcluded("ㄉㄨㄥˋ-ㄗㄨㄛˋ", "動作"));
+}
+
 TEST(McBopomofoLMTest, UserPhrasesOverrideDefaultLanguageModelPhrases) {
   McBopomofoLM lm;
   auto db = std::make_unique<ParselessPhraseDB>(kPrimaryLMData,
@@ -80,6 +80,13 @@ bool MemoryMappedFile::open(const char* path) {
   return true;
 }
 
+bool MemoryMappedFile::adviseWillNeed() const {
+  if (fd_ == -1) {
+    return false;
+  }
+  return madvise(data_, length_, MADV_WILLNEED) == 0;
+}
+
 void MemoryMappedFile::close() {
   if (fd_ == -1) {
     return;
@@ -57,6 +57,11 @@ class MemoryMappedFile {
   // Returns the length of the data, which is the length of the file upon open.
   [[nodiscard]] size_t length() const { return length_; }
 
+  // Asks the kernel to start reading the whole file into the page cache, so
+  // that the first accesses do not fault one page at a time. Returns false if
+  // the file is not open or the advice is rejected.
+  bool adviseWillNeed() const;
+
  private:
   int fd_ = -1;           // POSIX file descriptor used by the mmap call
   void* data_ = nullptr;  // actual mapped data
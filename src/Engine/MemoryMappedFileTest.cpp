@@ -30,6 +30,7 @@
 #include <utility>
 
 #include "MemoryMappedFile.h"
+#include "TestTempDir.h"
 #include "gtest/gtest.h"
 
 namespace McBopomofo {
@@ -64,35 +65,12 @@ class TempFile {
   std::string path_;
 };
 
-class TempDir {
- public:
-  TempDir() {
-    std::filesystem::path p = std::filesystem::temp_directory_path() /
-                              "org.openvanilla.mcbopomofo.XXXXXX";
-    path_ = p.native();
-    char* result = mkdtemp(path_.data());
-    assert(result != nullptr);
-    fprintf(stderr, "TEMPDIR: %s\n", result);
-  }
-
-  ~TempDir() {
-    std::error_code ec;
-    bool result = std::filesystem::remove(path_, ec);
-    assert(result);
-    (void)result;
-  }
-
-  const char* path() const { return path_.c_str(); }
-
- protected:
-  std::string path_;
-};
-
 TEST(MemoryMappedFileTest, UnopenedInstance) {
   MemoryMappedFile mf;
   EXPECT_FALSE(mf.isOpen());
   EXPECT_EQ(mf.length(), 0);
   EXPECT_EQ(mf.data(), nullptr);
+  EXPECT_FALSE(mf.adviseWillNeed());
 }
 
 TEST(MemoryMappedFileTest, BasicFunctionalities) {
@@ -121,6 +99,7 @@ TEST(MemoryMappedFileTest, BasicFunctionalities) {
   EXPECT_EQ(mf.length(), kBufSize);
   EXPECT_TRUE(mf.data() != nullptr);
   EXPECT_EQ(memcmp(mf.data(), buf, kBufSize), 0);
+  EXPECT_TRUE(mf.adviseWillNeed());
 
   mf.close();
   EXPECT_EQ(mf.length(), 0);
@@ -206,7 +185,7 @@ TEST(MemoryMappedFileTest, OpenFailureOnEmptyFile) {
 TEST(MemoryMappedFileTest, OpenFailureOnDirectory) {
   TempDir dir;
   MemoryMappedFile mf;
-  EXPECT_FALSE(mf.open(dir.path()));
+  EXPECT_FALSE(mf.open(dir.path().c_str()));
   EXPECT_FALSE(mf.isOpen());
   EXPECT_EQ(mf.length(), 0);
   EXPECT_EQ(mf.data(), nullptr);
@@ -28,6 +28,10 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <string_view>
@@ -36,135 +40,513 @@
 
 namespace McBopomofo {
 
-bool ParselessLM::isLoaded() const { return db_ != nullptr; }
+namespace {
+
+// Splits a text row "key value score" into its fields. The score is empty if
+// absent.
+struct RowFields {
+  std::string_view key;
+  std::string_view value;
+  std::string_view score;
+};
+
+RowFields SplitRow(const char* row, const char* end) {
+  const char* eol = static_cast<const char*>(memchr(row, '\n', end - row));
+  std::string_view line(row, (eol == nullptr ? end : eol) - row);
+
+  RowFields fields;
+  size_t keyEnd = line.find(' ');
+  fields.key = line.substr(0, keyEnd);
+  if (keyEnd == std::string_view::npos) {
+    return fields;
+  }
+
+  // Like reverseFindRows, tolerate more than one separator after the key.
+  size_t valueBegin = line.find_first_not_of(' ', keyEnd);
+  if (valueBegin == std::string_view::npos) {
+    return fields;
+  }
+  size_t valueEnd = line.find(' ', valueBegin);
+  fields.value = line.substr(valueBegin, valueEnd - valueBegin);
+  if (valueEnd != std::string_view::npos) {
+    fields.score = line.substr(valueEnd + 1);
+  }
+  return fields;
+}
+
+}  // namespace
+
+bool ParselessLM::isLoaded() const {
+  return db_ != nullptr || compiledDb_ != nullptr;
+}
 
 bool ParselessLM::open(const char* path) {
+  reverseIndex_.clear();
+  reverseIndexBuilt_ = false;
+  syllableIndex_.clear();
+  syllableIndexBuilt_ = false;
   if (!mmapedFile_.open(path)) {
     return false;
   }
+
+  if (CompiledPhraseDB::HasMagic(mmapedFile_.data(), mmapedFile_.length())) {
+    compiledDb_ = CompiledPhraseDB::CreateValidatedDB(mmapedFile_.data(),
+                                                      mmapedFile_.length());
+    if (compiledDb_ == nullptr) {
+      // A compiled database with a bad header is not usable at all.
+      mmapedFile_.close();
+      return false;
+    }
+    buildKeyFilter();
+    return true;
+  }
+
   db_ = std::unique_ptr<ParselessPhraseDB>(new ParselessPhraseDB(
       mmapedFile_.data(), mmapedFile_.length(), /*validate_pragma=*/true));
+  buildKeyFilter();
   return true;
 }
 
 void ParselessLM::close() {
   mmapedFile_.close();
   db_ = nullptr;
+  compiledDb_ = nullptr;
+  reverseIndex_.clear();
+  reverseIndex_.shrink_to_fit();
+  reverseIndexBuilt_ = false;
+  syllableIndex_.clear();
+  syllableIndexBuilt_ = false;
+  keyFilter_.clear();
 }
 
 bool ParselessLM::open(std::unique_ptr<ParselessPhraseDB> db) {
-  if (db_ != nullptr) {
+  if (isLoaded()) {
     return false;
   }
 
   db_ = std::move(db);
+  buildKeyFilter();
   return true;
 }
 
-std::vector<Formosa::Gramambular2::LanguageModel::Unigram>
-ParselessLM::getUnigrams(const std::string& key) {
-  if (db_ == nullptr) {
-    return {};
+bool ParselessLM::open(std::unique_ptr<CompiledPhraseDB> db) {
+  if (isLoaded()) {
+    return false;
   }
 
-  std::vector<Formosa::Gramambular2::LanguageModel::Unigram> results;
-  for (const auto& row : db_->findRows(key + " ")) {
-    std::string value;
-    double score = 0;
+  compiledDb_ = std::move(db);
+  buildKeyFilter();
+  return true;
+}
 
-    // Move ahead until we encounter the first space. This is the key.
-    const auto* it = row.begin();
-    while (it != row.end() && *it != ' ') {
-      ++it;
-    }
+void ParselessLM::warmUp() const {
+  if (!isLoaded()) {
+    return;
+  }
+  mmapedFile_.adviseWillNeed();
+  buildSyllableIndexIfNeeded();
+}
+
+void ParselessLM::setKeyFilterEnabled(bool enabled) {
+  keyFilterEnabled_ = enabled;
+  if (enabled) {
+    buildKeyFilter();
+  } else {
+    keyFilter_.clear();
+  }
+}
 
-    // The key is std::string(row.begin(), it), which we don't need.
+void ParselessLM::visitUnigrams(std::string_view key, UnigramCallback callback,
+                                void* context) const {
+  if (key.empty()) {
+    return;
+  }
 
-    // Read past the space.
-    if (it != row.end()) {
-      ++it;
+  if (compiledDb_ != nullptr) {
+    size_t keyIndex = compiledDb_->findKey(key);
+    if (keyIndex == compiledDb_->keyCount()) {
+      return;
     }
+    size_t end = compiledDb_->firstRowOf(keyIndex + 1);
+    for (size_t row = compiledDb_->firstRowOf(keyIndex); row < end; ++row) {
+      callback(context, UnigramView{compiledDb_->valueAt(row),
+                                    compiledDb_->scoreAt(row)});
+    }
+    return;
+  }
 
-    if (it != row.end()) {
-      // Now it is the start of the value portion.
-      const auto* value_begin = it;
+  if (db_ == nullptr) {
+    return;
+  }
 
-      // Move ahead until we encounter the second space. This is the
-      // value.
-      while (it != row.end() && *it != ' ') {
-        ++it;
-      }
-      value = std::string(value_begin, it);
+  // The rows of the key itself, "key value score", come before any other
+  // rows that share the prefix (such as "key-next ..."), since the space is
+  // less than any character used in keys. Therefore we can stop at the first
+  // row that does not have a space right after the key.
+  visitTextRows(db_->findFirstMatchingLine(key), key, callback, context);
+}
+
+void ParselessLM::visitTextRows(const char* ptr, std::string_view key,
+                                UnigramCallback callback,
+                                void* context) const {
+  const char* end = db_->rowsEnd();
+  while (ptr != nullptr && end - ptr > static_cast<ptrdiff_t>(key.length()) &&
+         memcmp(ptr, key.data(), key.length()) == 0 &&
+         ptr[key.length()] == ' ') {
+    const char* eol = static_cast<const char*>(memchr(ptr, '\n', end - ptr));
+    if (eol == nullptr) {
+      eol = end;
     }
 
-    // Read past the space. The remainder, if it exists, is the score.
-    if (it != row.end()) {
-      ++it;
+    // Skip the key and the space. The value lasts until the next space.
+    std::string_view rest(ptr + key.length() + 1,
+                          eol - (ptr + key.length() + 1));
+    size_t valueEnd = rest.find(' ');
+    UnigramView unigram{rest.substr(0, valueEnd)};
+
+    // The remainder, if it exists, is the score.
+    if (valueEnd != std::string_view::npos) {
+      const char* scoreBegin = rest.data() + valueEnd + 1;
+      std::from_chars(scoreBegin, eol, unigram.score);
     }
+    callback(context, unigram);
 
-    if (it != row.end()) {
-      score = std::stod(std::string(it, row.end()));
+    if (eol == end) {
+      break;
     }
-    results.emplace_back(std::move(value), score);
+    ptr = eol + 1;
   }
+}
+
+std::vector<Formosa::Gramambular2::LanguageModel::Unigram>
+ParselessLM::getUnigrams(const std::string& key) {
+  std::vector<Formosa::Gramambular2::LanguageModel::Unigram> results;
+  forEachUnigram(key, [&results](const UnigramView& unigram) {
+    results.emplace_back(std::string(unigram.value), unigram.score);
+  });
   return results;
 }
 
 bool ParselessLM::hasUnigrams(const std::string& key) {
+  if (key.empty() || !keyFilter_.mayContain(key)) {
+    return false;
+  }
+
+  bool found = findKey(key);
+  if (!found && !keyFilter_.empty()) {
+    keyFilter_.recordFalsePositive();
+  }
+  return found;
+}
+
+bool ParselessLM::findKey(const std::string& key) const {
+  if (compiledDb_ != nullptr) {
+    return compiledDb_->findKey(key) != compiledDb_->keyCount();
+  }
+
   if (db_ == nullptr) {
     return false;
   }
 
-  return db_->findFirstMatchingLine(key + " ") != nullptr;
+  // See visitUnigrams() on why checking the first matching row is enough.
+  const char* ptr = db_->findFirstMatchingLine(key);
+  return ptr != nullptr &&
+         db_->rowsEnd() - ptr > static_cast<ptrdiff_t>(key.length()) &&
+         ptr[key.length()] == ' ';
 }
 
-std::vector<ParselessLM::FoundReading> ParselessLM::getReadings(
-    const std::string& value) const {
+uint32_t ParselessLM::hasUnigramsForPrefixes(
+    std::span<const std::string> readings, const std::string& separator) {
+  uint32_t result = 0;
+  size_t count = std::min<size_t>(readings.size(), 32);
+
+  // Use the syllable index if all readings are syllables that it knows. A
+  // reading it does not know may still be a part of a key that is not made
+  // of syllables, so such readings take the string path below.
+  if (separator == kSyllableSeparator && count > 0) {
+    buildSyllableIndexIfNeeded();
+    SyllableKeyIndex::SyllableId syllables[32];
+    size_t encoded = 0;
+    while (encoded < count) {
+      syllables[encoded] = syllableIndex_.encode(readings[encoded]);
+      if (syllables[encoded] == SyllableKeyIndex::kInvalidSyllable) {
+        break;
+      }
+      ++encoded;
+    }
+    if (encoded == count) {
+      SyllableKeyIndex::Range range = syllableIndex_.all();
+      for (size_t n = 1; n <= count; ++n) {
+        range = syllableIndex_.narrow(range, syllables[n - 1]);
+        if (range.empty()) {
+          break;
+        }
+        if (syllableIndex_.hasExactKey(range)) {
+          result |= static_cast<uint32_t>(1) << (n - 1);
+        }
+      }
+      return result;
+    }
+  }
+
+  if (compiledDb_ != nullptr) {
+    CompiledPhraseDB::KeyRange range = compiledDb_->allKeys();
+    for (size_t n = 1; n <= count; ++n) {
+      if (n > 1) {
+        range = compiledDb_->narrow(range, separator);
+      }
+      range = compiledDb_->narrow(range, readings[n - 1]);
+      if (range.empty()) {
+        break;
+      }
+      if (compiledDb_->keyAt(range.begin).length() == range.prefixLength) {
+        result |= static_cast<uint32_t>(1) << (n - 1);
+      }
+    }
+    return result;
+  }
+
   if (db_ == nullptr) {
-    return {};
+    return result;
   }
 
-  std::vector<ParselessLM::FoundReading> results;
+  ParselessPhraseDB::PrefixCursor cursor(*db_);
+  for (size_t n = 1; n <= count; ++n) {
+    if (n > 1 && !cursor.append(separator)) {
+      break;
+    }
+    // Like hasUnigrams(), an empty key has no unigrams.
+    if ((n == 1 && readings[0].empty()) || !cursor.append(readings[n - 1])) {
+      break;
+    }
+    if (cursor.hasExactKey()) {
+      result |= static_cast<uint32_t>(1) << (n - 1);
+    }
+  }
+  return result;
+}
 
-  // We append a space so that we only find rows with the exact value. We
-  // are taking advantage of the fact that a well-form row in this LM must
-  // be in the format of "key value score".
-  std::string actualValue = value + " ";
+SyllableKeyIndex::SyllableId ParselessLM::encodeSyllable(
+    std::string_view reading) const {
+  buildSyllableIndexIfNeeded();
+  return syllableIndex_.encode(reading);
+}
 
-  for (const auto& row : db_->reverseFindRows(actualValue)) {
-    std::string key;
-    double score = 0;
+bool ParselessLM::hasUnigramsForSyllables(
+    std::span<const SyllableKeyIndex::SyllableId> syllables) const {
+  buildSyllableIndexIfNeeded();
+  return syllableIndex_.find(syllables) != syllableIndex_.size();
+}
+
+void ParselessLM::visitUnigramsForSyllables(
+    std::span<const SyllableKeyIndex::SyllableId> syllables,
+    UnigramCallback callback, void* context) const {
+  buildSyllableIndexIfNeeded();
+  size_t entry = syllableIndex_.find(syllables);
+  if (entry == syllableIndex_.size()) {
+    return;
+  }
+  uint32_t payload = syllableIndex_.payloadAt(entry);
+
+  if (compiledDb_ != nullptr) {
+    size_t end = compiledDb_->firstRowOf(payload + 1);
+    for (size_t row = compiledDb_->firstRowOf(payload); row < end; ++row) {
+      callback(context, UnigramView{compiledDb_->valueAt(row),
+                                    compiledDb_->scoreAt(row)});
+    }
+    return;
+  }
+
+  const char* row = db_->rowsBegin() + payload;
+  visitTextRows(row, SplitRow(row, db_->rowsEnd()).key, callback, context);
+}
+
+void ParselessLM::buildSyllableIndexIfNeeded() const {
+  if (syllableIndexBuilt_) {
+    return;
+  }
+  syllableIndexBuilt_ = true;
+
+  if (compiledDb_ != nullptr) {
+    size_t keyCount = compiledDb_->keyCount();
+    for (size_t i = 0; i < keyCount; ++i) {
+      syllableIndex_.add(compiledDb_->keyAt(i), kSyllableSeparator,
+                         static_cast<uint32_t>(i));
+    }
+    syllableIndex_.finish();
+    return;
+  }
+
+  if (db_ == nullptr) {
+    return;
+  }
+
+  // The payload is the offset of the first row of the key.
+  const char* begin = db_->rowsBegin();
+  const char* end = db_->rowsEnd();
+  const char* row = begin;
+  std::string_view lastKey;
+  while (row < end) {
+    const char* eol = static_cast<const char*>(memchr(row, '\n', end - row));
+    if (eol == nullptr) {
+      eol = end;
+    }
+    if (eol != row && *row != '#') {
+      std::string_view key = SplitRow(row, end).key;
+      if (key != lastKey) {
+        syllableIndex_.add(key, kSyllableSeparator,
+                           static_cast<uint32_t>(row - begin));
+        lastKey = key;
+      }
+    }
+    row = eol + 1;
+  }
+  syllableIndex_.finish();
+}
 
-    // Move ahead until we encounter the first space. This is the key.
-    auto it = row.begin();
-    while (it != row.end() && *it != ' ') {
-      ++it;
+void ParselessLM::buildKeyFilter() {
+  keyFilter_.clear();
+  if (!keyFilterEnabled_) {
+    return;
+  }
+
+  if (compiledDb_ != nullptr) {
+    size_t keyCount = compiledDb_->keyCount();
+    keyFilter_.reset(keyCount);
+    for (size_t i = 0; i < keyCount; ++i) {
+      keyFilter_.add(compiledDb_->keyAt(i));
+    }
+    return;
+  }
+
+  if (db_ == nullptr) {
+    return;
+  }
+
+  // The rows are sorted by key, so the distinct keys are the ones that differ
+  // from the key of the previous row. The first pass counts them so that the
+  // filter can be sized, and the second pass adds them.
+  auto forEachKey = [this](auto&& visitor) {
+    const char* end = db_->rowsEnd();
+    const char* row = db_->rowsBegin();
+    std::string_view lastKey;
+    while (row < end) {
+      const char* eol = static_cast<const char*>(memchr(row, '\n', end - row));
+      if (eol == nullptr) {
+        eol = end;
+      }
+      if (eol != row && *row != '#') {
+        std::string_view key = SplitRow(row, end).key;
+        if (key != lastKey) {
+          visitor(key);
+          lastKey = key;
+        }
+      }
+      row = eol + 1;
     }
+  };
+
+  size_t keyCount = 0;
+  forEachKey([&keyCount](std::string_view) { ++keyCount; });
+  keyFilter_.reset(keyCount);
+  forEachKey([this](std::string_view key) { keyFilter_.add(key); });
+}
 
-    key = std::string(row.begin(), it);
+void ParselessLM::buildReverseIndexIfNeeded() const {
+  if (reverseIndexBuilt_) {
+    return;
+  }
+  reverseIndexBuilt_ = true;
 
-    // Read past the space.
-    if (it != row.end()) {
-      ++it;
+  if (compiledDb_ != nullptr) {
+    size_t rowCount = compiledDb_->rowCount();
+    reverseIndex_.resize(rowCount);
+    for (size_t row = 0; row < rowCount; ++row) {
+      reverseIndex_[row] = static_cast<uint32_t>(row);
     }
+    std::stable_sort(reverseIndex_.begin(), reverseIndex_.end(),
+                     [this](uint32_t a, uint32_t b) {
+                       return compiledDb_->valueAt(a) < compiledDb_->valueAt(b);
+                     });
+    return;
+  }
+
+  if (db_ == nullptr) {
+    return;
+  }
 
-    if (it != row.end()) {
-      // Now it is the start of the value portion, but we move ahead
-      // until we encounter the second space to skip this part.
-      while (it != row.end() && *it != ' ') {
-        ++it;
+  // Collect the values first so that sorting does not need to re-split the
+  // rows. This is transient; only the offsets are kept.
+  const char* begin = db_->rowsBegin();
+  const char* end = db_->rowsEnd();
+  std::vector<std::pair<std::string_view, uint32_t>> entries;
+  const char* row = begin;
+  while (row < end) {
+    const char* eol = static_cast<const char*>(memchr(row, '\n', end - row));
+    if (eol == nullptr) {
+      eol = end;
+    }
+    if (eol != row && *row != '#') {
+      std::string_view value = SplitRow(row, end).value;
+      if (!value.empty()) {
+        entries.emplace_back(value, static_cast<uint32_t>(row - begin));
       }
     }
+    row = eol + 1;
+  }
+
+  // The offsets are unique, so this is in the order of the rows for each
+  // value.
+  std::sort(entries.begin(), entries.end());
+  reverseIndex_.reserve(entries.size());
+  for (const auto& entry : entries) {
+    reverseIndex_.push_back(entry.second);
+  }
+}
+
+std::vector<ParselessLM::FoundReading> ParselessLM::getReadings(
+    const std::string& value) const {
+  std::vector<ParselessLM::FoundReading> results;
+  buildReverseIndexIfNeeded();
 
-    // Read past the space. The remainder, if it exists, is the score.
-    if (it != row.end()) {
-      ++it;
+  if (compiledDb_ != nullptr) {
+    auto it = std::lower_bound(reverseIndex_.begin(), reverseIndex_.end(),
+                               value, [this](uint32_t row, const auto& v) {
+                                 return compiledDb_->valueAt(row) < v;
+                               });
+    for (; it != reverseIndex_.end() && compiledDb_->valueAt(*it) == value;
+         ++it) {
+      size_t keyIndex = compiledDb_->keyIndexOfRow(*it);
+      results.emplace_back(
+          ParselessLM::FoundReading{std::string(compiledDb_->keyAt(keyIndex)),
+                                    compiledDb_->scoreAt(*it)});
     }
+    return results;
+  }
+
+  if (db_ == nullptr) {
+    return results;
+  }
 
-    if (it != row.end()) {
-      score = std::stod(std::string(it, row.end()));
+  const char* begin = db_->rowsBegin();
+  const char* end = db_->rowsEnd();
+  auto valueOf = [begin, end](uint32_t offset) {
+    return SplitRow(begin + offset, end).value;
+  };
+  auto it = std::lower_bound(
+      reverseIndex_.begin(), reverseIndex_.end(), value,
+      [&](uint32_t offset, const auto& v) { return valueOf(offset) < v; });
+  for (; it != reverseIndex_.end(); ++it) {
+    RowFields fields = SplitRow(begin + *it, end);
+    if (fields.value != value) {
+      break;
+    }
+    double score = 0;
+    if (!fields.score.empty()) {
+      score = std::stod(std::string(fields.score));
     }
-    results.emplace_back(ParselessLM::FoundReading{key, score});
+    results.emplace_back(
+        ParselessLM::FoundReading{std::string(fields.key), score});
   }
   return results;
 }
@@ -24,12 +24,19 @@
 #ifndef SRC_ENGINE_PARSELESSLM_H_
 #define SRC_ENGINE_PARSELESSLM_H_
 
+#include <cstdint>
 #include <memory>
+#include <span>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
+#include "BloomFilter.h"
+#include "CompiledPhraseDB.h"
 #include "MemoryMappedFile.h"
 #include "ParselessPhraseDB.h"
+#include "SyllableKeyIndex.h"
 #include "gramambular2/language_model.h"
 
 namespace McBopomofo {
@@ -43,27 +50,125 @@ class ParselessLM : public Formosa::Gramambular2::LanguageModel {
   ParselessLM& operator=(ParselessLM&&) = delete;
 
   bool isLoaded() const;
+
+  // Opens either a sorted text database or a compiled database (see
+  // CompiledPhraseDB). The format is detected from the file header.
   bool open(const char* path);
   void close();
 
   // Allows the use of existing in-memory db.
   bool open(std::unique_ptr<ParselessPhraseDB> db);
+  bool open(std::unique_ptr<CompiledPhraseDB> db);
+
+  // Prefetches the mapped file and builds the syllable index, which is
+  // otherwise built by the first lookup that needs it. Call this when the
+  // model is about to be used, so that the first keystroke is not slow.
+  void warmUp() const;
+
+  // When enabled, a Bloom filter of all keys is built whenever a database is
+  // opened (or right away if one is already open), and hasUnigrams() consults
+  // it before searching the database. This costs about 10 bits per key.
+  void setKeyFilterEnabled(bool enabled);
+  [[nodiscard]] bool keyFilterEnabled() const { return keyFilterEnabled_; }
+  [[nodiscard]] const BloomFilter::Stats& keyFilterStats() const {
+    return keyFilter_.stats();
+  }
 
   std::vector<Formosa::Gramambular2::LanguageModel::Unigram> getUnigrams(
       const std::string& key) override;
   bool hasUnigrams(const std::string& key) override;
 
+  // Walks the prefixes with a narrowing cursor; see PrefixCursor.
+  uint32_t hasUnigramsForPrefixes(std::span<const std::string> readings,
+                                  const std::string& separator) override;
+
+  // A non-owning unigram. The value points into the database and is only
+  // valid while the database stays open.
+  struct UnigramView {
+    std::string_view value;
+    double score = 0;
+  };
+
+  // Calls visitor(const UnigramView&) for each unigram of the key, in the same
+  // order as getUnigrams(). This is the non-owning counterpart of
+  // getUnigrams() for the hot path: it does not allocate.
+  template <typename Visitor>
+  void forEachUnigram(std::string_view key, Visitor&& visitor) const {
+    visitUnigrams(
+        key,
+        [](void* context, const UnigramView& unigram) {
+          (*static_cast<std::remove_reference_t<Visitor>*>(context))(unigram);
+        },
+        &visitor);
+  }
+
+  // The separator of the syllables in the keys of the database.
+  static constexpr char kSyllableSeparator[] = "-";
+
+  // Lookups by syllable IDs (see SyllableKeyIndex), which compare integers
+  // instead of strings. Only the keys made of Bopomofo syllables, which are
+  // most of them, can be found this way. The first call builds the index,
+  // which takes 12 bytes per key plus 2 bytes per syllable.
+  // hasUnigramsForPrefixes() also uses
+  // the index when the separator is kSyllableSeparator.
+  [[nodiscard]] SyllableKeyIndex::SyllableId encodeSyllable(
+      std::string_view reading) const;
+  [[nodiscard]] bool hasUnigramsForSyllables(
+      std::span<const SyllableKeyIndex::SyllableId> syllables) const;
+
+  template <typename Visitor>
+  void forEachUnigramForSyllables(
+      std::span<const SyllableKeyIndex::SyllableId> syllables,
+      Visitor&& visitor) const {
+    visitUnigramsForSyllables(
+        syllables,
+        [](void* context, const UnigramView& unigram) {
+          (*static_cast<std::remove_reference_t<Visitor>*>(context))(unigram);
+        },
+        &visitor);
+  }
+
   struct FoundReading {
     std::string reading;
     double score = 0;
   };
 
-  // Look up reading by value. This is specific to ParselessLM only.
+  // Look up reading by value. This is specific to ParselessLM only. The
+  // results are in the order of the rows in the database. The first call
+  // builds a reverse index, which takes 4 bytes per row.
   std::vector<FoundReading> getReadings(const std::string& value) const;
 
  private:
+  using UnigramCallback = void (*)(void* context, const UnigramView& unigram);
+  void visitUnigrams(std::string_view key, UnigramCallback callback,
+                     void* context) const;
+  void visitTextRows(const char* row, std::string_view key,
+                     UnigramCallback callback, void* context) const;
+  void visitUnigramsForSyllables(
+      std::span<const SyllableKeyIndex::SyllableId> syllables,
+      UnigramCallback callback, void* context) const;
+  void buildSyllableIndexIfNeeded() const;
+
+  void buildReverseIndexIfNeeded() const;
+  void buildKeyFilter();
+  [[nodiscard]] bool findKey(const std::string& key) const;
+
   MemoryMappedFile mmapedFile_;
+  // At most one of the two is non-null.
   std::unique_ptr<ParselessPhraseDB> db_;
+  std::unique_ptr<CompiledPhraseDB> compiledDb_;
+
+  // Rows sorted by their values, then by their positions. For the text
+  // database, these are the offsets of the row starts from rowsBegin(); for
+  // the compiled database, these are the row indices.
+  mutable std::vector<uint32_t> reverseIndex_;
+  mutable bool reverseIndexBuilt_ = false;
+
+  mutable SyllableKeyIndex syllableIndex_;
+  mutable bool syllableIndexBuilt_ = false;
+
+  bool keyFilterEnabled_ = false;
+  BloomFilter keyFilter_;
 };
 
 }  // namespace McBopomofo
@@ -26,6 +26,7 @@
 #include <cassert>
 #include <filesystem>
 #include <fstream>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -92,6 +93,33 @@ static void BM_ParselessLMHasUnigramsRealKeys(benchmark::State& state) {
 }
 BENCHMARK(BM_ParselessLMHasUnigramsRealKeys);
 
+// Most of the multi-syllable keys probed by the grid do not exist. These are
+// made by joining two real keys in reverse order. The argument enables the key
+// filter.
+static void BM_ParselessLMHasUnigramsMissingKeys(benchmark::State& state) {
+  assert(std::filesystem::exists(kDataPath));
+  ParselessLM lm;
+  lm.setKeyFilterEnabled(state.range(0) != 0);
+  lm.open(kDataPath);
+  const std::vector<std::string> realKeys = LoadRealKeys();
+  std::vector<std::string> keys;
+  for (size_t i = 1; i < realKeys.size(); i += 7) {
+    keys.emplace_back(realKeys[i] + "-" + realKeys[i - 1]);
+  }
+  auto key = keys.begin();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lm.hasUnigrams(*key));
+    if (++key == keys.end()) {
+      key = keys.begin();
+    }
+  }
+  const auto& stats = lm.keyFilterStats();
+  state.counters["rejections"] = static_cast<double>(stats.rejections);
+  state.counters["falsePositives"] = static_cast<double>(stats.falsePositives);
+  lm.close();
+}
+BENCHMARK(BM_ParselessLMHasUnigramsMissingKeys)->Arg(0)->Arg(1);
+
 static void BM_ParselessLMFindUnigramsRealKeys(benchmark::State& state) {
   assert(std::filesystem::exists(kDataPath));
   ParselessLM lm;
@@ -108,6 +136,58 @@ static void BM_ParselessLMFindUnigramsRealKeys(benchmark::State& state) {
 }
 BENCHMARK(BM_ParselessLMFindUnigramsRealKeys);
 
+// The non-owning counterpart of BM_ParselessLMFindUnigramsRealKeys.
+static void BM_ParselessLMForEachUnigramRealKeys(benchmark::State& state) {
+  assert(std::filesystem::exists(kDataPath));
+  ParselessLM lm;
+  lm.open(kDataPath);
+  const std::vector<std::string> keys = LoadRealKeys();
+  auto key = keys.begin();
+  for (auto _ : state) {
+    double total = 0;
+    lm.forEachUnigram(*key, [&total](const ParselessLM::UnigramView& unigram) {
+      total += unigram.score;
+    });
+    benchmark::DoNotOptimize(total);
+    if (++key == keys.end()) {
+      key = keys.begin();
+    }
+  }
+  lm.close();
+}
+BENCHMARK(BM_ParselessLMForEachUnigramRealKeys);
+
+// What ReadingGrid::update() asks at each position: which of the next six
+// readings' prefixes have unigrams. The readings are the syllables of a real
+// key followed by those of the next keys.
+static void BM_ParselessLMHasUnigramsForPrefixes(benchmark::State& state) {
+  assert(std::filesystem::exists(kDataPath));
+  ParselessLM lm;
+  lm.open(kDataPath);
+  std::vector<std::string> syllables;
+  for (const std::string& key : LoadRealKeys()) {
+    size_t start = 0;
+    size_t next;
+    while ((next = key.find('-', start)) != std::string::npos) {
+      syllables.emplace_back(key.substr(start, next - start));
+      start = next + 1;
+    }
+    syllables.emplace_back(key.substr(start));
+  }
+  assert(syllables.size() > 6);
+  std::span<const std::string> all(syllables);
+  size_t pos = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        lm.hasUnigramsForPrefixes(all.subspan(pos, 6), "-"));
+    if (++pos == syllables.size() - 6) {
+      pos = 0;
+    }
+  }
+  lm.close();
+}
+BENCHMARK(BM_ParselessLMHasUnigramsForPrefixes);
+
 static void BM_ParselessLMGetReadingsMissingValue(benchmark::State& state) {
   assert(std::filesystem::exists(kDataPath));
   ParselessLM lm;
@@ -119,6 +199,17 @@ static void BM_ParselessLMGetReadingsMissingValue(benchmark::State& state) {
 }
 BENCHMARK(BM_ParselessLMGetReadingsMissingValue);
 
+static void BM_ParselessLMGetReadings(benchmark::State& state) {
+  assert(std::filesystem::exists(kDataPath));
+  ParselessLM lm;
+  lm.open(kDataPath);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(lm.getReadings("得"));
+  }
+  lm.close();
+}
+BENCHMARK(BM_ParselessLMGetReadings);
+
 };  // namespace
 
 BENCHMARK_MAIN();
@@ -24,6 +24,8 @@
 #include <filesystem>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -89,6 +91,203 @@ TEST(ParselessLMTest, ReturnsResults) {
   EXPECT_NEAR(readings[1].score, -3.59800309, 0.00000001);
 }
 
+TEST(ParselessLMTest, ReturnsResultsFromCompiledDB) {
+  std::string image;
+  ASSERT_TRUE(CompiledPhraseDB::Compile(kSample, sizeof(kSample) - 1, &image));
+
+  ParselessLM lm;
+  auto db = CompiledPhraseDB::CreateValidatedDB(image.data(), image.size());
+  ASSERT_NE(db, nullptr);
+  EXPECT_TRUE(lm.open(std::move(db)));
+
+  // Scores are stored as floats in the compiled format.
+  using Unigram = Formosa::Gramambular2::LanguageModel::Unigram;
+  std::vector<Unigram> unigrams = lm.getUnigrams("ㄅㄚ-ㄅㄞˇ");
+  ASSERT_EQ(unigrams.size(), 2);
+  EXPECT_EQ(unigrams[0].value(), "八百");
+  EXPECT_NEAR(unigrams[0].score(), -4.67026409, 0.000001);
+  EXPECT_EQ(unigrams[1].value(), "捌佰");
+  EXPECT_NEAR(unigrams[1].score(), -7.26686119, 0.000001);
+
+  EXPECT_TRUE(lm.hasUnigrams("ㄅㄚ˙"));
+  EXPECT_FALSE(lm.hasUnigrams("ㄅ"));
+
+  std::vector<ParselessLM::FoundReading> readings = lm.getReadings("吧");
+  ASSERT_EQ(readings.size(), 2);
+  EXPECT_EQ(readings[0].reading, "ㄅㄚ");
+  EXPECT_NEAR(readings[0].score, -3.59800309, 0.000001);
+  EXPECT_EQ(readings[1].reading, "ㄅㄚ˙");
+  EXPECT_NEAR(readings[1].score, -3.59800309, 0.000001);
+
+  auto db2 = std::make_unique<ParselessPhraseDB>(kSample, sizeof(kSample));
+  EXPECT_FALSE(lm.open(std::move(db2)));
+}
+
+TEST(ParselessLMTest, ForEachUnigram) {
+  ParselessLM lm;
+  auto db = std::make_unique<ParselessPhraseDB>(kSample, sizeof(kSample));
+  EXPECT_TRUE(lm.open(std::move(db)));
+
+  std::vector<std::string_view> values;
+  std::vector<double> scores;
+  auto visitor = [&](const ParselessLM::UnigramView& unigram) {
+    values.push_back(unigram.value);
+    scores.push_back(unigram.score);
+  };
+  lm.forEachUnigram("ㄅㄚ", visitor);
+  EXPECT_EQ(values, (std::vector<std::string_view>{"八", "吧", "巴"}));
+  ASSERT_EQ(scores.size(), 3);
+  EXPECT_NEAR(scores[2], -3.80233706, 0.00000001);
+
+  // Prefix rows such as ㄅㄚ-ㄅㄞˇ and ㄅㄚ˙ are not visited.
+  values.clear();
+  lm.forEachUnigram("ㄅ", visitor);
+  EXPECT_TRUE(values.empty());
+  lm.forEachUnigram("ㄅㄚ˙", visitor);
+  EXPECT_EQ(values, (std::vector<std::string_view>{"吧"}));
+  EXPECT_FALSE(lm.hasUnigrams("ㄅ"));
+  EXPECT_TRUE(lm.hasUnigrams("ㄅㄚ˙"));
+}
+
+TEST(ParselessLMTest, HasUnigramsForPrefixes) {
+  ParselessLM lm;
+  auto db = std::make_unique<ParselessPhraseDB>(kSample, sizeof(kSample));
+  EXPECT_TRUE(lm.open(std::move(db)));
+
+  std::vector<std::string> readings = {"ㄅㄚ", "ㄅㄞˇ", "ㄅㄚ"};
+  EXPECT_EQ(lm.hasUnigramsForPrefixes(readings, "-"), 0b011);
+  readings = {"ㄅㄚ˙", "ㄅㄞˇ"};
+  EXPECT_EQ(lm.hasUnigramsForPrefixes(readings, "-"), 0b01);
+  readings = {"ㄅ", "ㄅㄞˇ"};
+  EXPECT_EQ(lm.hasUnigramsForPrefixes(readings, "-"), 0);
+  readings = {"ㄅㄞˇ"};
+  EXPECT_EQ(lm.hasUnigramsForPrefixes(readings, "-"), 0);
+  readings = {""};
+  EXPECT_EQ(lm.hasUnigramsForPrefixes(readings, "-"), 0);
+  readings.clear();
+  EXPECT_EQ(lm.hasUnigramsForPrefixes(readings, "-"), 0);
+
+  // The compiled database gives the same answers.
+  std::string image;
+  ASSERT_TRUE(CompiledPhraseDB::Compile(kSample, sizeof(kSample) - 1, &image));
+  ParselessLM compiledLM;
+  EXPECT_TRUE(compiledLM.open(
+      CompiledPhraseDB::CreateValidatedDB(image.data(), image.size())));
+  readings = {"ㄅㄚ", "ㄅㄞˇ", "ㄅㄚ"};
+  EXPECT_EQ(compiledLM.hasUnigramsForPrefixes(readings, "-"), 0b011);
+  readings = {"ㄅㄚ˙", "ㄅㄞˇ"};
+  EXPECT_EQ(compiledLM.hasUnigramsForPrefixes(readings, "-"), 0b01);
+  readings = {"ㄅ", "ㄅㄞˇ"};
+  EXPECT_EQ(compiledLM.hasUnigramsForPrefixes(readings, "-"), 0);
+}
+
+TEST(ParselessLMTest, KeyFilter) {
+  ParselessLM lm;
+  lm.setKeyFilterEnabled(true);
+  auto db = std::make_unique<ParselessPhraseDB>(kSample, sizeof(kSample));
+  EXPECT_TRUE(lm.open(std::move(db)));
+
+  EXPECT_TRUE(lm.hasUnigrams("ㄅㄚ"));
+  EXPECT_TRUE(lm.hasUnigrams("ㄅㄚ-ㄅㄞˇ"));
+  EXPECT_TRUE(lm.hasUnigrams("ㄅㄚ˙"));
+  EXPECT_FALSE(lm.hasUnigrams("ㄅㄞˇ"));
+  EXPECT_FALSE(lm.hasUnigrams("ㄅㄞˇ-ㄅㄚ"));
+  EXPECT_EQ(lm.getUnigrams("ㄅㄚ").size(), 3);
+
+  const auto& stats = lm.keyFilterStats();
+  EXPECT_EQ(stats.queries, 5);
+  EXPECT_EQ(stats.rejections + stats.falsePositives, 2);
+
+  // Disabling the filter keeps the results the same.
+  lm.setKeyFilterEnabled(false);
+  EXPECT_TRUE(lm.hasUnigrams("ㄅㄚ-ㄅㄞˇ"));
+  EXPECT_FALSE(lm.hasUnigrams("ㄅㄞˇ"));
+  EXPECT_EQ(lm.keyFilterStats().queries, 5);
+
+  // The same for the compiled database.
+  std::string image;
+  ASSERT_TRUE(CompiledPhraseDB::Compile(kSample, sizeof(kSample) - 1, &image));
+  ParselessLM compiledLM;
+  EXPECT_TRUE(compiledLM.open(
+      CompiledPhraseDB::CreateValidatedDB(image.data(), image.size())));
+  compiledLM.setKeyFilterEnabled(true);
+  EXPECT_TRUE(compiledLM.hasUnigrams("ㄅㄚ-ㄅㄞˇ"));
+  EXPECT_FALSE(compiledLM.hasUnigrams("ㄅㄞˇ"));
+  EXPECT_EQ(compiledLM.keyFilterStats().queries, 2);
+}
+
+TEST(ParselessLMTest, LookUpBySyllables) {
+  auto db = std::make_unique<ParselessPhraseDB>(kSample, sizeof(kSample));
+  ParselessLM lm;
+  EXPECT_TRUE(lm.open(std::move(db)));
+
+  std::string image;
+  ASSERT_TRUE(CompiledPhraseDB::Compile(kSample, sizeof(kSample) - 1, &image));
+  ParselessLM compiledLM;
+  EXPECT_TRUE(compiledLM.open(
+      CompiledPhraseDB::CreateValidatedDB(image.data(), image.size())));
+
+  for (const ParselessLM* model : {&lm, &compiledLM}) {
+    std::vector<SyllableKeyIndex::SyllableId> key = {
+        model->encodeSyllable("ㄅㄚ"), model->encodeSyllable("ㄅㄞˇ")};
+    EXPECT_TRUE(model->hasUnigramsForSyllables(key));
+
+    std::vector<std::string> values;
+    model->forEachUnigramForSyllables(
+        key, [&values](const ParselessLM::UnigramView& unigram) {
+          values.emplace_back(unigram.value);
+        });
+    EXPECT_EQ(values, (std::vector<std::string>{"八百", "捌佰"}));
+
+    key = {model->encodeSyllable("ㄅㄚ˙")};
+    EXPECT_TRUE(model->hasUnigramsForSyllables(key));
+    key = {model->encodeSyllable("ㄅㄞˇ")};
+    EXPECT_FALSE(model->hasUnigramsForSyllables(key));
+    EXPECT_EQ(model->encodeSyllable("ㄅ"), SyllableKeyIndex::kInvalidSyllable);
+  }
+}
+
+TEST(ParselessLMTest, GetReadingsUsesReverseIndex) {
+  std::string data = std::string(SORTED_PRAGMA_HEADER) +
+                     "a x -1\n"
+                     "a y -2\n"
+                     "b x -3\n"
+                     "b xy -4\n"
+                     "c  x -5\n"
+                     "d x\n";
+  auto db = std::make_unique<ParselessPhraseDB>(data.data(), data.size(),
+                                                /*validate_pragma=*/true);
+
+  ParselessLM lm;
+  EXPECT_TRUE(lm.open(std::move(db)));
+  std::vector<ParselessLM::FoundReading> readings = lm.getReadings("x");
+  ASSERT_EQ(readings.size(), 4);
+  EXPECT_EQ(readings[0].reading, "a");
+  EXPECT_EQ(readings[0].score, -1);
+  EXPECT_EQ(readings[1].reading, "b");
+  EXPECT_EQ(readings[1].score, -3);
+  EXPECT_EQ(readings[2].reading, "c");
+  EXPECT_EQ(readings[2].score, -5);
+
+  // Rows without scores are found too, with a score of 0.
+  EXPECT_EQ(readings[3].reading, "d");
+  EXPECT_EQ(readings[3].score, 0);
+
+  EXPECT_EQ(lm.getReadings("xy").size(), 1);
+  EXPECT_TRUE(lm.getReadings("").empty());
+  EXPECT_TRUE(lm.getReadings("w").empty());
+  EXPECT_TRUE(lm.getReadings("z").empty());
+
+  // The index is rebuilt for another database.
+  lm.close();
+  std::string data2 = "e x -6\n";
+  EXPECT_TRUE(
+      lm.open(std::make_unique<ParselessPhraseDB>(data2.data(), data2.size())));
+  readings = lm.getReadings("x");
+  ASSERT_EQ(readings.size(), 1);
+  EXPECT_EQ(readings[0].reading, "e");
+}
+
 TEST(ParselessLMTest, SanityCheckTest) {
   constexpr const char* data_path = "data.txt";
   if (!std::filesystem::exists(data_path)) {
@@ -23,7 +23,9 @@
 
 #include "ParselessPhraseDB.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
 #include <cstring>
 #include <string>
 #include <vector>
@@ -38,10 +40,38 @@
 #endif
 #endif
 
+// The x86 kernels are compiled with function-level target attributes and are
+// selected at runtime, so no special compiler flags are needed.
+#if !defined(ENABLE_EXPERIMENTAL_SIMD_SUPPORT_NEON) && \
+    (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MCBOPOMOFO_X86_SCAN_KERNELS 1
+#include <immintrin.h>
+#endif
+
 namespace McBopomofo {
 
 namespace {
 
+const char* ScalarFindNextCharacter(const char* position, const char* end,
+                                    char character) {
+  const char* cursor = position;
+  while (cursor != end && *cursor != character) {
+    ++cursor;
+  }
+  return cursor;
+}
+
+const char* ScalarFindLineStart(const char* begin, const char* position) {
+  const char* cursor = position;
+  while (cursor != begin) {
+    --cursor;
+    if (*cursor == '\n') {
+      return cursor + 1;
+    }
+  }
+  return begin;
+}
+
 #ifdef ENABLE_EXPERIMENTAL_SIMD_SUPPORT_NEON
 
 int FirstNonZeroLane16(uint8x16_t value) {
@@ -67,13 +97,9 @@ int LastNonZeroLane16(uint8x16_t value) {
   return static_cast<int>(vmaxvq_u8(vandq_u8(value, laneIndices))) - 1;
 }
 
-#endif
-
-const char* FindNextCharacter(const char* position, const char* end,
-                              char character) {
+const char* NeonFindNextCharacter(const char* position, const char* end,
+                                  char character) {
   const char* cursor = position;
-
-#ifdef ENABLE_EXPERIMENTAL_SIMD_SUPPORT_NEON
   const uint8x16_t characters = vdupq_n_u8(static_cast<uint8_t>(character));
   while (end - cursor >= 16) {
     const uint8x16_t block = vld1q_u8(reinterpret_cast<const uint8_t*>(cursor));
@@ -83,18 +109,11 @@ const char* FindNextCharacter(const char* position, const char* end,
     }
     cursor += 16;
   }
-#endif
-
-  while (cursor != end && *cursor != character) {
-    ++cursor;
-  }
-  return cursor;
+  return ScalarFindNextCharacter(cursor, end, character);
 }
 
-const char* FindLineStart(const char* begin, const char* position) {
+const char* NeonFindLineStart(const char* begin, const char* position) {
   const char* cursor = position;
-
-#ifdef ENABLE_EXPERIMENTAL_SIMD_SUPPORT_NEON
   const uint8x16_t linefeeds = vdupq_n_u8(static_cast<uint8_t>('\n'));
   while (cursor - begin >= 16) {
     const char* blockStart = cursor - 16;
@@ -106,19 +125,201 @@ const char* FindLineStart(const char* begin, const char* position) {
     }
     cursor = blockStart;
   }
+  return ScalarFindLineStart(begin, cursor);
+}
+
 #endif
 
-  while (cursor != begin) {
-    --cursor;
-    if (*cursor == '\n') {
-      return cursor + 1;
+#ifdef MCBOPOMOFO_X86_SCAN_KERNELS
+
+__attribute__((target("sse2"))) const char* Sse2FindNextCharacter(
+    const char* position, const char* end, char character) {
+  const char* cursor = position;
+  const __m128i characters = _mm_set1_epi8(character);
+  while (end - cursor >= 16) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor));
+    const unsigned mask = static_cast<unsigned>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(block, characters)));
+    if (mask != 0) {
+      return cursor + __builtin_ctz(mask);
     }
+    cursor += 16;
   }
-  return begin;
+  return ScalarFindNextCharacter(cursor, end, character);
+}
+
+__attribute__((target("sse2"))) const char* Sse2FindLineStart(
+    const char* begin, const char* position) {
+  const char* cursor = position;
+  const __m128i linefeeds = _mm_set1_epi8('\n');
+  while (cursor - begin >= 16) {
+    const char* blockStart = cursor - 16;
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(blockStart));
+    const unsigned mask = static_cast<unsigned>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(block, linefeeds)));
+    if (mask != 0) {
+      return blockStart + (31 - __builtin_clz(mask)) + 1;
+    }
+    cursor = blockStart;
+  }
+  return ScalarFindLineStart(begin, cursor);
+}
+
+__attribute__((target("avx2"))) const char* Avx2FindNextCharacter(
+    const char* position, const char* end, char character) {
+  const char* cursor = position;
+  const __m256i characters = _mm256_set1_epi8(character);
+  while (end - cursor >= 32) {
+    const __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cursor));
+    const unsigned mask = static_cast<unsigned>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, characters)));
+    if (mask != 0) {
+      return cursor + __builtin_ctz(mask);
+    }
+    cursor += 32;
+  }
+  return Sse2FindNextCharacter(cursor, end, character);
+}
+
+__attribute__((target("avx2"))) const char* Avx2FindLineStart(
+    const char* begin, const char* position) {
+  const char* cursor = position;
+  const __m256i linefeeds = _mm256_set1_epi8('\n');
+  while (cursor - begin >= 32) {
+    const char* blockStart = cursor - 32;
+    const __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blockStart));
+    const unsigned mask = static_cast<unsigned>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, linefeeds)));
+    if (mask != 0) {
+      return blockStart + (31 - __builtin_clz(mask)) + 1;
+    }
+    cursor = blockStart;
+  }
+  return Sse2FindLineStart(begin, cursor);
+}
+
+#endif
+
+struct ScanKernelFunctions {
+  const char* (*findNextCharacter)(const char* position, const char* end,
+                                   char character);
+  const char* (*findLineStart)(const char* begin, const char* position);
+};
+
+bool IsSupported(ParselessPhraseDB::ScanKernel kernel) {
+  switch (kernel) {
+    case ParselessPhraseDB::ScanKernel::SCALAR:
+      return true;
+    case ParselessPhraseDB::ScanKernel::SSE2:
+#ifdef MCBOPOMOFO_X86_SCAN_KERNELS
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse2");
+#else
+      return false;
+#endif
+    case ParselessPhraseDB::ScanKernel::AVX2:
+#ifdef MCBOPOMOFO_X86_SCAN_KERNELS
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+#else
+      return false;
+#endif
+    case ParselessPhraseDB::ScanKernel::NEON:
+#ifdef ENABLE_EXPERIMENTAL_SIMD_SUPPORT_NEON
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+ScanKernelFunctions FunctionsOf(ParselessPhraseDB::ScanKernel kernel) {
+  switch (kernel) {
+#ifdef MCBOPOMOFO_X86_SCAN_KERNELS
+    case ParselessPhraseDB::ScanKernel::SSE2:
+      return {Sse2FindNextCharacter, Sse2FindLineStart};
+    case ParselessPhraseDB::ScanKernel::AVX2:
+      return {Avx2FindNextCharacter, Avx2FindLineStart};
+#endif
+#ifdef ENABLE_EXPERIMENTAL_SIMD_SUPPORT_NEON
+    case ParselessPhraseDB::ScanKernel::NEON:
+      return {NeonFindNextCharacter, NeonFindLineStart};
+#endif
+    default:
+      return {ScalarFindNextCharacter, ScalarFindLineStart};
+  }
+}
+
+ParselessPhraseDB::ScanKernel BestKernel() {
+  for (auto kernel : {ParselessPhraseDB::ScanKernel::NEON,
+                      ParselessPhraseDB::ScanKernel::AVX2,
+                      ParselessPhraseDB::ScanKernel::SSE2}) {
+    if (IsSupported(kernel)) {
+      return kernel;
+    }
+  }
+  return ParselessPhraseDB::ScanKernel::SCALAR;
+}
+
+struct ScanKernelState {
+  ParselessPhraseDB::ScanKernel kernel;
+  ScanKernelFunctions functions;
+};
+
+ScanKernelState& CurrentKernel() {
+  static ScanKernelState state = [] {
+    auto kernel = BestKernel();
+    return ScanKernelState{kernel, FunctionsOf(kernel)};
+  }();
+  return state;
+}
+
+// Compares the text at the offset of the row with the key. Rows that end
+// before the key does are less than the key.
+int CompareAt(const char* row, const char* end, size_t offset,
+              const std::string_view& key) {
+  const char* ptr = row + offset;
+  size_t available = ptr < end ? static_cast<size_t>(end - ptr) : 0;
+  size_t length = std::min(available, key.length());
+  int cmp = length == 0 ? 0 : memcmp(ptr, key.data(), length);
+  if (cmp == 0 && length < key.length()) {
+    return -1;
+  }
+  return cmp;
+}
+
+const char* FindNextCharacter(const char* position, const char* end,
+                              char character) {
+  return CurrentKernel().functions.findNextCharacter(position, end, character);
+}
+
+const char* FindLineStart(const char* begin, const char* position) {
+  return CurrentKernel().functions.findLineStart(begin, position);
 }
 
 }  // namespace
 
+bool ParselessPhraseDB::IsScanKernelSupported(ScanKernel kernel) {
+  return IsSupported(kernel);
+}
+
+ParselessPhraseDB::ScanKernel ParselessPhraseDB::GetScanKernel() {
+  return CurrentKernel().kernel;
+}
+
+bool ParselessPhraseDB::SetScanKernel(ScanKernel kernel) {
+  if (!IsSupported(kernel)) {
+    return false;
+  }
+  CurrentKernel() = ScanKernelState{kernel, FunctionsOf(kernel)};
+  return true;
+}
+
 bool ParselessPhraseDB::ValidatePragma(const char* buf, size_t length) {
   if (length < SORTED_PRAGMA_HEADER.length()) {
     return false;
@@ -245,6 +446,39 @@ const char* ParselessPhraseDB::findFirstMatchingLine(
   return nullptr;
 }
 
+bool ParselessPhraseDB::PrefixCursor::append(const std::string_view& text) {
+  // Both bounds are found with a binary search over the bytes of the range,
+  // backtracking to the row start, as findFirstMatchingLine() does. All rows
+  // in the range share the current prefix, so only the appended text needs
+  // to be compared.
+  auto bound = [&](const char* lo, const char* hi, bool upper) {
+    while (lo < hi) {
+      const char* mid = lo + (hi - lo) / 2;
+      const char* row = FindLineStart(lo, mid);
+      int cmp = CompareAt(row, dbEnd_, prefixLength_, text);
+      if (upper ? cmp <= 0 : cmp < 0) {
+        const char* eol = FindNextCharacter(row, hi, '\n');
+        lo = eol == hi ? hi : eol + 1;
+      } else {
+        hi = row;
+      }
+    }
+    return lo;
+  };
+
+  const char* newBegin = bound(begin_, end_, /*upper=*/false);
+  const char* newEnd = bound(newBegin, end_, /*upper=*/true);
+  begin_ = newBegin;
+  end_ = newEnd;
+  prefixLength_ += text.length();
+  return !empty();
+}
+
+bool ParselessPhraseDB::PrefixCursor::hasExactKey() const {
+  return !empty() && dbEnd_ - begin_ > static_cast<ptrdiff_t>(prefixLength_) &&
+         begin_[prefixLength_] == ' ';
+}
+
 std::vector<std::string> ParselessPhraseDB::reverseFindRows(
     const std::string_view& value) const {
   std::vector<std::string> rows;
@@ -265,7 +499,7 @@ std::vector<std::string> ParselessPhraseDB::reverseFindRows(
     // now walk to the end of this record
     const char* recordEnd = FindNextCharacter(ptr, end_, '\n');
 
-    if (ptr + value.length() < end_ &&
+    if (ptr + value.length() <= end_ &&
         memcmp(ptr, value.data(), value.length()) == 0) {
       // prefix match, add entire record to return value
       rows.emplace_back(recordBegin, recordEnd - recordBegin);
@@ -65,8 +65,65 @@ class ParselessPhraseDB {
   // the underlying data is sorted by keys.
   std::vector<std::string> reverseFindRows(const std::string_view& value) const;
 
+  // The rows of the database, past the pragma header if validated.
+  const char* rowsBegin() const { return begin_; }
+  const char* rowsEnd() const { return end_; }
+
+  // A cursor over the rows that start with a prefix, which grows as text is
+  // appended to it. Each append narrows the [begin, end) range of rows found
+  // so far, so a series of lookups that share a prefix, such as "ㄕˋ",
+  // "ㄕˋ-ㄕˊ", and "ㄕˋ-ㄕˊ-ㄕˋ", costs one binary search per append over an
+  // ever smaller range, instead of one over the whole database per lookup.
+  class PrefixCursor {
+   public:
+    explicit PrefixCursor(const ParselessPhraseDB& db)
+        : begin_(db.begin_), end_(db.end_), dbEnd_(db.end_) {}
+
+    // Appends the text to the prefix and narrows the range. Returns false if
+    // no row starts with the prefix anymore.
+    bool append(const std::string_view& text);
+
+    [[nodiscard]] bool empty() const { return begin_ == end_; }
+
+    // Returns true if there are rows whose key is exactly the prefix. Such
+    // rows come first in the range, since the field separator (a space) is
+    // less than any character used in keys.
+    [[nodiscard]] bool hasExactKey() const;
+
+    // The start of the first row in the range, or nullptr if empty.
+    [[nodiscard]] const char* firstRow() const {
+      return empty() ? nullptr : begin_;
+    }
+
+    [[nodiscard]] size_t prefixLength() const { return prefixLength_; }
+
+   private:
+    const char* begin_;
+    const char* end_;
+    const char* dbEnd_;
+    size_t prefixLength_ = 0;
+  };
+
   static bool ValidatePragma(const char* buf, size_t length);
 
+  // The kernels used to scan for line boundaries and field separators. The
+  // best kernel supported by the CPU is selected at runtime. NEON is only
+  // available when ENABLE_EXPERIMENTAL_SIMD_SUPPORT_NEON is on.
+  enum class ScanKernel {
+    SCALAR,
+    SSE2,
+    AVX2,
+    NEON,
+  };
+
+  static bool IsScanKernelSupported(ScanKernel kernel);
+  static ScanKernel GetScanKernel();
+
+  // Overrides the runtime selection; for tests and benchmarks only. This is
+  // process-wide and not thread-safe. Returns false if the kernel is not
+  // supported.
+  static bool SetScanKernel(ScanKernel kernel);
+
   // Convenient function for validating and returning a DB instance. nullptr if
   // the block is empty or is not valid.
   static std::unique_ptr<ParselessPhraseDB> CreateValidatedDB(const char* buf,
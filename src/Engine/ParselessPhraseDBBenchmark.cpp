@@ -23,6 +23,7 @@
 
 #include <benchmark/benchmark.h>
 
+#include <cstdint>
 #include <iomanip>
 #include <random>
 #include <sstream>
@@ -85,7 +86,45 @@ class BenchmarkDataset {
   std::vector<std::string> queryKeys_;
 };
 
+using ScanKernel = McBopomofo::ParselessPhraseDB::ScanKernel;
+
+// Selects the scan kernel given by the benchmark argument. Returns false, and
+// skips the benchmark, if the kernel is not supported on this machine.
+bool SelectScanKernel(benchmark::State& state) {
+  auto kernel = static_cast<ScanKernel>(state.range(0));
+  if (!McBopomofo::ParselessPhraseDB::SetScanKernel(kernel)) {
+    state.SkipWithError("scan kernel not supported");
+    return false;
+  }
+  switch (kernel) {
+    case ScanKernel::SCALAR:
+      state.SetLabel("scalar");
+      break;
+    case ScanKernel::SSE2:
+      state.SetLabel("sse2");
+      break;
+    case ScanKernel::AVX2:
+      state.SetLabel("avx2");
+      break;
+    case ScanKernel::NEON:
+      state.SetLabel("neon");
+      break;
+  }
+  return true;
+}
+
+// Runs a benchmark with each scan kernel, side by side.
+void ScanKernelArguments(benchmark::internal::Benchmark* benchmark) {
+  for (auto kernel : {ScanKernel::SCALAR, ScanKernel::SSE2, ScanKernel::AVX2,
+                      ScanKernel::NEON}) {
+    benchmark->Arg(static_cast<int64_t>(kernel));
+  }
+}
+
 void BM_ParselessPhraseDBFindFirstMatchingLine(benchmark::State& state) {
+  if (!SelectScanKernel(state)) {
+    return;
+  }
   const BenchmarkDataset dataset;
   const auto& database = dataset.database();
   const auto& queryKeys = dataset.queryKeys();
@@ -98,9 +137,31 @@ void BM_ParselessPhraseDBFindFirstMatchingLine(benchmark::State& state) {
     }
   }
 }
-BENCHMARK(BM_ParselessPhraseDBFindFirstMatchingLine);
+BENCHMARK(BM_ParselessPhraseDBFindFirstMatchingLine)
+    ->Apply(ScanKernelArguments);
+
+void BM_ParselessPhraseDBFindRows(benchmark::State& state) {
+  if (!SelectScanKernel(state)) {
+    return;
+  }
+  const BenchmarkDataset dataset;
+  const auto& database = dataset.database();
+  const auto& queryKeys = dataset.queryKeys();
+
+  auto queryKey = queryKeys.begin();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(database.findRows(*queryKey));
+    if (++queryKey == queryKeys.end()) {
+      queryKey = queryKeys.begin();
+    }
+  }
+}
+BENCHMARK(BM_ParselessPhraseDBFindRows)->Apply(ScanKernelArguments);
 
 void BM_ParselessPhraseDBReverseFindRows(benchmark::State& state) {
+  if (!SelectScanKernel(state)) {
+    return;
+  }
   const BenchmarkDataset dataset;
   const auto& database = dataset.database();
 
@@ -108,7 +169,7 @@ void BM_ParselessPhraseDBReverseFindRows(benchmark::State& state) {
     benchmark::DoNotOptimize(database.reverseFindRows("missing"));
   }
 }
-BENCHMARK(BM_ParselessPhraseDBReverseFindRows);
+BENCHMARK(BM_ParselessPhraseDBReverseFindRows)->Apply(ScanKernelArguments);
 
 }  // namespace
 
@@ -255,4 +255,91 @@ TEST(ParselessPhraseDBTest, LookUpByValueWithLongRows) {
   EXPECT_TRUE(db.reverseFindRows("missing").empty());
 }
 
+TEST(ParselessPhraseDBTest, PrefixCursor) {
+  std::string data =
+      "a 1\n"
+      "a-b 2\n"
+      "a-b 3\n"
+      "a-b-c 4\n"
+      "a-c 5\n"
+      "ab 6\n"
+      "b 7";
+  ParselessPhraseDB db(data.c_str(), data.length());
+
+  ParselessPhraseDB::PrefixCursor cursor(db);
+  EXPECT_EQ(cursor.firstRow(), data.data());
+  EXPECT_TRUE(cursor.append("a"));
+  EXPECT_TRUE(cursor.hasExactKey());
+  EXPECT_EQ(cursor.firstRow(), data.data());
+  EXPECT_TRUE(cursor.append("-"));
+  EXPECT_FALSE(cursor.hasExactKey());
+  EXPECT_TRUE(cursor.append("b"));
+  EXPECT_TRUE(cursor.hasExactKey());
+  EXPECT_EQ(cursor.firstRow(), data.data() + data.find("a-b 2"));
+  EXPECT_EQ(cursor.prefixLength(), 3);
+  EXPECT_TRUE(cursor.append("-c"));
+  EXPECT_TRUE(cursor.hasExactKey());
+  EXPECT_FALSE(cursor.append("-"));
+  EXPECT_TRUE(cursor.empty());
+  EXPECT_EQ(cursor.firstRow(), nullptr);
+  EXPECT_FALSE(cursor.hasExactKey());
+
+  // The last row has no trailing newline.
+  ParselessPhraseDB::PrefixCursor cursor2(db);
+  EXPECT_TRUE(cursor2.append("b"));
+  EXPECT_TRUE(cursor2.hasExactKey());
+  EXPECT_FALSE(cursor2.append("b"));
+
+  ParselessPhraseDB::PrefixCursor cursor3(db);
+  EXPECT_TRUE(cursor3.append("ab"));
+  EXPECT_TRUE(cursor3.hasExactKey());
+  EXPECT_EQ(cursor3.firstRow(), data.data() + data.find("ab 6"));
+
+  ParselessPhraseDB::PrefixCursor cursor4(db);
+  EXPECT_FALSE(cursor4.append("0"));
+  ParselessPhraseDB::PrefixCursor cursor5(db);
+  EXPECT_FALSE(cursor5.append("c"));
+}
+
+TEST(ParselessPhraseDBTest, ScanKernelsAgree) {
+  using ScanKernel = ParselessPhraseDB::ScanKernel;
+  ScanKernel defaultKernel = ParselessPhraseDB::GetScanKernel();
+  EXPECT_TRUE(ParselessPhraseDB::IsScanKernelSupported(defaultKernel));
+  EXPECT_TRUE(ParselessPhraseDB::IsScanKernelSupported(ScanKernel::SCALAR));
+
+  // Rows of varying lengths so that line boundaries fall at every offset of
+  // the 16- and 32-byte blocks.
+  std::string data;
+  for (size_t i = 0; i < 100; ++i) {
+    char key = static_cast<char>('a' + i / 4);
+    data += std::string(1, key) + " v" + std::string(i, 'x') + "\n";
+  }
+  data += "z target";
+
+  ASSERT_TRUE(ParselessPhraseDB::SetScanKernel(ScanKernel::SCALAR));
+  ParselessPhraseDB db(data.c_str(), data.length());
+  std::map<char, StringViews> expectedRows;
+  for (char key = 'a'; key <= 'z'; ++key) {
+    expectedRows[key] = db.findRows(std::string(1, key) + " ");
+  }
+  std::string value = "v" + std::string(30, 'x') + "\n";
+  auto expectedReverse = db.reverseFindRows(value);
+  ASSERT_EQ(expectedReverse.size(), 1);
+
+  for (auto kernel : {ScanKernel::SSE2, ScanKernel::AVX2, ScanKernel::NEON}) {
+    if (!ParselessPhraseDB::SetScanKernel(kernel)) {
+      continue;
+    }
+    for (char key = 'a'; key <= 'z'; ++key) {
+      EXPECT_EQ(db.findRows(std::string(1, key) + " "), expectedRows[key])
+          << static_cast<int>(kernel) << " " << key;
+    }
+    EXPECT_EQ(db.reverseFindRows(value), expectedReverse);
+    EXPECT_EQ(db.reverseFindRows("target"),
+              (std::vector<std::string>{"z target"}));
+  }
+
+  EXPECT_TRUE(ParselessPhraseDB::SetScanKernel(defaultKernel));
+}
+
 }  // namespace McBopomofo
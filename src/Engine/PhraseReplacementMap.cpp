@@ -29,6 +29,7 @@
 #include <unistd.h>
 
 #include <fstream>
+#include <span>
 #include <string>
 
 namespace McBopomofo {
@@ -55,7 +56,7 @@ bool PhraseReplacementMap::load(const char* data, size_t length) {
 }
 
 std::string PhraseReplacementMap::valueForKey(const std::string& key) const {
-  std::vector<std::string_view> values = dictionary_.getValues(key);
+  std::span<const std::string_view> values = dictionary_.findValues(key);
   if (!values.empty()) {
     return std::string(values[0]);
   }
@@ -26,6 +26,7 @@
 
 #include <map>
 #include <string>
+#include <utility>
 
 #include "ByteBlockBackedDictionary.h"
 #include "MemoryMappedFile.h"
@@ -51,6 +52,12 @@ class PhraseReplacementMap {
 
   std::vector<ByteBlockBackedDictionary::Issue> getParsingIssues() const;
 
+  // Calls the visitor with every key, as a std::string_view.
+  template <typename Visitor>
+  void forEachKey(Visitor&& visitor) const {
+    dictionary_.forEachKey(std::forward<Visitor>(visitor));
+  }
+
  protected:
   ByteBlockBackedDictionary dictionary_;
   MemoryMappedFile mmapedFile_;
@@ -0,0 +1,127 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ParselessLM.h"
+#include "gramambular2/reading_grid.h"
+
+namespace {
+
+using ParselessLM = McBopomofo::ParselessLM;
+using ReadingGrid = Formosa::Gramambular2::ReadingGrid;
+
+static const char* kDataPath = "data.txt";
+static const size_t kBufferLength = 50;
+
+// A grid that can be made to recompute all of its Viterbi states, so that
+// walk() can be compared with walkNBest(), which always does.
+class FullWalkReadingGrid : public ReadingGrid {
+ public:
+  using ReadingGrid::ReadingGrid;
+  WalkResult fullWalk() {
+    invalidateWalkFrom(0);
+    return walk();
+  }
+};
+
+// The syllables of every 997th multi-syllable key, so that the buffer has
+// words that span several readings.
+std::vector<std::string> LoadBuffer() {
+  std::ifstream input(kDataPath);
+  assert(input.is_open());
+
+  std::vector<std::string> syllables;
+  std::string line;
+  std::getline(input, line);
+  size_t multiSyllableKeys = 0;
+  while (syllables.size() < kBufferLength && std::getline(input, line)) {
+    const std::string key = line.substr(0, line.find(' '));
+    if (key.find('-') == std::string::npos || key[0] == '_') {
+      continue;
+    }
+    if (multiSyllableKeys++ % 997 != 0) {
+      continue;
+    }
+    size_t start = 0;
+    size_t next;
+    while ((next = key.find('-', start)) != std::string::npos) {
+      syllables.emplace_back(key.substr(start, next - start));
+      start = next + 1;
+    }
+    syllables.emplace_back(key.substr(start));
+  }
+  syllables.resize(std::min(syllables.size(), kBufferLength));
+  return syllables;
+}
+
+std::unique_ptr<FullWalkReadingGrid> MakeGrid(benchmark::State& state) {
+  auto lm = std::make_shared<ParselessLM>();
+  if (!std::filesystem::exists(kDataPath) || !lm->open(kDataPath)) {
+    state.SkipWithError("data.txt not found");
+    return nullptr;
+  }
+  auto grid = std::make_unique<FullWalkReadingGrid>(lm);
+  std::vector<std::string> syllables = LoadBuffer();
+  if (syllables.size() < kBufferLength ||
+      !grid->insertReadings(syllables)) {
+    state.SkipWithError("cannot build the buffer");
+    return nullptr;
+  }
+  return grid;
+}
+
+static void BM_ReadingGridWalk(benchmark::State& state) {
+  std::unique_ptr<FullWalkReadingGrid> grid = MakeGrid(state);
+  if (grid == nullptr) {
+    return;
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(grid->fullWalk());
+  }
+}
+BENCHMARK(BM_ReadingGridWalk);
+
+static void BM_ReadingGridWalkNBest(benchmark::State& state) {
+  std::unique_ptr<FullWalkReadingGrid> grid = MakeGrid(state);
+  if (grid == nullptr) {
+    return;
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        grid->walkNBest(static_cast<size_t>(state.range(0))));
+  }
+}
+BENCHMARK(BM_ReadingGridWalkNBest)->Arg(1)->Arg(5)->Arg(10);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,137 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "SyllableKeyIndex.h"
+
+#include <algorithm>
+#include <string>
+
+#include "Mandarin/Mandarin.h"
+
+namespace McBopomofo {
+
+void SyllableKeyIndex::clear() {
+  entries_.clear();
+  entries_.shrink_to_fit();
+  pool_.clear();
+  pool_.shrink_to_fit();
+  syllableIds_.clear();
+}
+
+bool SyllableKeyIndex::add(std::string_view key, std::string_view separator,
+                           uint32_t payload) {
+  if (key.empty() || separator.empty()) {
+    return false;
+  }
+
+  size_t offset = pool_.size();
+  size_t start = 0;
+  while (true) {
+    size_t next = key.find(separator, start);
+    std::string_view syllable = key.substr(start, next - start);
+
+    auto it = syllableIds_.find(syllable);
+    if (it == syllableIds_.end()) {
+      // Only syllables that survive a round trip are indexed, so that
+      // encoding a reading never maps two different strings to one ID.
+      Formosa::Mandarin::BopomofoSyllable parsed =
+          Formosa::Mandarin::BopomofoSyllable::FromComposedString(
+              std::string(syllable));
+      SyllableId id = kInvalidSyllable;
+      if (!parsed.isEmpty() && parsed.composedString() == syllable) {
+        id = parsed.value();
+      }
+      it = syllableIds_.emplace(syllable, id).first;
+    }
+    if (it->second == kInvalidSyllable) {
+      pool_.resize(offset);
+      return false;
+    }
+    pool_.push_back(it->second);
+
+    if (next == std::string_view::npos) {
+      break;
+    }
+    start = next + separator.length();
+  }
+
+  entries_.push_back(Entry{static_cast<uint32_t>(offset),
+                           static_cast<uint32_t>(pool_.size() - offset),
+                           payload});
+  return true;
+}
+
+void SyllableKeyIndex::finish() {
+  // A shorter key sorts before the longer keys it is a prefix of, which is
+  // what hasExactKey() relies on. Keys are unique, so this is stable enough.
+  std::sort(entries_.begin(), entries_.end(),
+            [this](const Entry& a, const Entry& b) {
+              auto sa = syllablesOf(a);
+              auto sb = syllablesOf(b);
+              return std::lexicographical_compare(sa.begin(), sa.end(),
+                                                  sb.begin(), sb.end());
+            });
+}
+
+SyllableKeyIndex::SyllableId SyllableKeyIndex::encode(
+    std::string_view syllable) const {
+  auto it = syllableIds_.find(syllable);
+  return it == syllableIds_.end() ? kInvalidSyllable : it->second;
+}
+
+SyllableKeyIndex::Range SyllableKeyIndex::narrow(const Range& range,
+                                                 SyllableId syllable) const {
+  // Within the range, the keys that end at the current depth come first, and
+  // then the rest are sorted by their syllables at the depth.
+  size_t depth = range.depth;
+  auto syllableAt = [this, depth](const Entry& entry) -> uint32_t {
+    // Keys that end here sort before any syllable.
+    return entry.length > depth ? pool_[entry.offset + depth] : 0;
+  };
+  auto first = entries_.begin() + static_cast<ptrdiff_t>(range.begin);
+  auto last = entries_.begin() + static_cast<ptrdiff_t>(range.end);
+  auto lower = std::partition_point(first, last, [&](const Entry& entry) {
+    return syllableAt(entry) < syllable;
+  });
+  auto upper = std::partition_point(lower, last, [&](const Entry& entry) {
+    return syllableAt(entry) == syllable;
+  });
+  return {static_cast<size_t>(lower - entries_.begin()),
+          static_cast<size_t>(upper - entries_.begin()), depth + 1};
+}
+
+size_t SyllableKeyIndex::find(std::span<const SyllableId> syllables) const {
+  if (syllables.empty()) {
+    return entries_.size();
+  }
+  Range range = all();
+  for (SyllableId syllable : syllables) {
+    range = narrow(range, syllable);
+    if (range.empty()) {
+      return entries_.size();
+    }
+  }
+  return hasExactKey(range) ? range.begin : entries_.size();
+}
+
+}  // namespace McBopomofo
@@ -0,0 +1,127 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_SYLLABLEKEYINDEX_H_
+#define SRC_ENGINE_SYLLABLEKEYINDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace McBopomofo {
+
+// An index of reading keys, such as "ㄕˋ-ㄕˊ", keyed by sequences of
+// syllable IDs instead of strings. A syllable ID is the 16-bit value of a
+// Formosa::Mandarin::BopomofoSyllable, and so the syllables of a combined
+// reading are compared with integer comparisons instead of memcmp over the
+// 3-byte UTF-8 Bopomofo characters.
+//
+// The index is a sorted table of keys over a flat pool of syllable IDs. Each
+// key carries a 32-bit payload given by the owner, such as the position of
+// its first row in the database. Keys that contain anything other than valid
+// Bopomofo syllables, such as "_punctuation_list", are not indexed; the owner
+// must look them up by their strings.
+//
+// Like the database it indexes, the index does not own the key strings. The
+// caller must keep them alive during the lifetime of the index, or until
+// clear() is called.
+class SyllableKeyIndex {
+ public:
+  using SyllableId = uint16_t;
+
+  // The ID of the empty syllable, which is never a valid syllable.
+  static constexpr SyllableId kInvalidSyllable = 0;
+
+  void clear();
+  [[nodiscard]] bool empty() const { return entries_.empty(); }
+  [[nodiscard]] size_t size() const { return entries_.size(); }
+
+  // Adds a key whose syllables are joined by the separator. Returns false, and
+  // adds nothing, if any of the syllables is not a valid Bopomofo syllable.
+  bool add(std::string_view key, std::string_view separator, uint32_t payload);
+
+  // Sorts the keys. This must be called after the keys are added and before
+  // any lookup.
+  void finish();
+
+  // Returns the ID of a syllable that has appeared in an added key, or
+  // kInvalidSyllable otherwise. Since no indexed key contains any other
+  // syllable, a reading that encodes to kInvalidSyllable matches nothing.
+  [[nodiscard]] SyllableId encode(std::string_view syllable) const;
+
+  // A [begin, end) range of entries whose keys share the first `depth`
+  // syllables. The entry whose key is exactly those syllables, if any, comes
+  // first.
+  struct Range {
+    size_t begin = 0;
+    size_t end = 0;
+    size_t depth = 0;
+
+    [[nodiscard]] bool empty() const { return begin == end; }
+  };
+
+  [[nodiscard]] Range all() const { return {0, entries_.size(), 0}; }
+
+  // Narrows the range to the keys whose next syllable is the given one.
+  [[nodiscard]] Range narrow(const Range& range, SyllableId syllable) const;
+
+  // Returns true if the first entry of the range is exactly the shared prefix.
+  [[nodiscard]] bool hasExactKey(const Range& range) const {
+    return !range.empty() && entries_[range.begin].length == range.depth;
+  }
+
+  // Returns the index of the entry that exactly matches the syllables, or
+  // size() if not found.
+  [[nodiscard]] size_t find(std::span<const SyllableId> syllables) const;
+
+  [[nodiscard]] uint32_t payloadAt(size_t entry) const {
+    return entries_[entry].payload;
+  }
+
+ private:
+  struct Entry {
+    uint32_t offset;
+    uint32_t length;
+    uint32_t payload;
+  };
+
+  [[nodiscard]] std::span<const SyllableId> syllablesOf(
+      const Entry& entry) const {
+    return {pool_.data() + entry.offset, entry.length};
+  }
+
+  std::vector<Entry> entries_;
+  std::vector<SyllableId> pool_;
+
+  // From the syllable strings found in the keys to their IDs; kInvalidSyllable
+  // for strings that are known not to be valid syllables.
+  std::unordered_map<std::string_view, SyllableId> syllableIds_;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_ENGINE_SYLLABLEKEYINDEX_H_
@@ -0,0 +1,110 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "SyllableKeyIndex.h"
+
+#include <vector>
+
+#include "Mandarin/Mandarin.h"
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+using SyllableId = SyllableKeyIndex::SyllableId;
+
+static SyllableId IdOf(const char* syllable) {
+  return Formosa::Mandarin::BopomofoSyllable::FromComposedString(syllable)
+      .value();
+}
+
+TEST(SyllableKeyIndexTest, AddAndFind) {
+  SyllableKeyIndex index;
+  EXPECT_TRUE(index.add("ㄅㄚ", "-", 1));
+  EXPECT_TRUE(index.add("ㄅㄚ-ㄅㄞˇ", "-", 2));
+  EXPECT_TRUE(index.add("ㄅㄚ˙", "-", 3));
+  EXPECT_TRUE(index.add("ㄕˋ-ㄕˊ-ㄕˋ", "-", 4));
+
+  // Not syllables, or not in the canonical order.
+  EXPECT_FALSE(index.add("_punctuation_list", "-", 5));
+  EXPECT_FALSE(index.add("ㄅㄚ-_x", "-", 6));
+  EXPECT_FALSE(index.add("ˇㄅㄞ", "-", 7));
+  EXPECT_FALSE(index.add("", "-", 8));
+  index.finish();
+  EXPECT_EQ(index.size(), 4);
+
+  EXPECT_EQ(index.encode("ㄅㄚ"), IdOf("ㄅㄚ"));
+  EXPECT_EQ(index.encode("ㄅㄞˇ"), IdOf("ㄅㄞˇ"));
+  EXPECT_EQ(index.encode("ˇㄅㄞ"), SyllableKeyIndex::kInvalidSyllable);
+  EXPECT_EQ(index.encode("_x"), SyllableKeyIndex::kInvalidSyllable);
+  // A valid syllable that no key has is unknown to the index.
+  EXPECT_EQ(index.encode("ㄇㄚ"), SyllableKeyIndex::kInvalidSyllable);
+
+  std::vector<SyllableId> key = {IdOf("ㄅㄚ"), IdOf("ㄅㄞˇ")};
+  size_t entry = index.find(key);
+  ASSERT_NE(entry, index.size());
+  EXPECT_EQ(index.payloadAt(entry), 2);
+
+  key = {IdOf("ㄕˋ"), IdOf("ㄕˊ"), IdOf("ㄕˋ")};
+  entry = index.find(key);
+  ASSERT_NE(entry, index.size());
+  EXPECT_EQ(index.payloadAt(entry), 4);
+
+  key = {IdOf("ㄕˋ"), IdOf("ㄕˊ")};
+  EXPECT_EQ(index.find(key), index.size());
+  key.clear();
+  EXPECT_EQ(index.find(key), index.size());
+
+  index.clear();
+  EXPECT_TRUE(index.empty());
+  EXPECT_EQ(index.encode("ㄅㄚ"), SyllableKeyIndex::kInvalidSyllable);
+}
+
+TEST(SyllableKeyIndexTest, NarrowRange) {
+  SyllableKeyIndex index;
+  index.add("ㄕˋ-ㄕˊ", "-", 0);
+  index.add("ㄕˋ", "-", 1);
+  index.add("ㄕˋ-ㄕˊ-ㄕˋ", "-", 2);
+  index.add("ㄕˋ-ㄕ", "-", 3);
+  index.add("ㄕ", "-", 4);
+  index.finish();
+
+  SyllableKeyIndex::Range range = index.narrow(index.all(), IdOf("ㄕˋ"));
+  EXPECT_EQ(range.end - range.begin, 4);
+  EXPECT_TRUE(index.hasExactKey(range));
+  EXPECT_EQ(index.payloadAt(range.begin), 1);
+
+  range = index.narrow(range, IdOf("ㄕˊ"));
+  EXPECT_EQ(range.end - range.begin, 2);
+  EXPECT_TRUE(index.hasExactKey(range));
+  EXPECT_EQ(index.payloadAt(range.begin), 0);
+
+  range = index.narrow(range, IdOf("ㄕˋ"));
+  EXPECT_TRUE(index.hasExactKey(range));
+  EXPECT_EQ(index.payloadAt(range.begin), 2);
+
+  range = index.narrow(range, IdOf("ㄕˋ"));
+  EXPECT_TRUE(range.empty());
+  EXPECT_FALSE(index.hasExactKey(range));
+}
+
+}  // namespace McBopomofo
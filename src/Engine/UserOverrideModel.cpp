@@ -26,8 +26,9 @@
 
 #include <cassert>
 #include <cmath>
-#include <list>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -45,18 +46,41 @@ static constexpr char kEmptyNodeString[] = "()";
 static double Score(size_t eventCount, size_t totalCount, double eventTimestamp,
                     double timestamp, double lambda);
 
-// Form the observation key from the nodes of a walk. This goes backward, but
-// we are using a const_iterator, the "end" here should be a .cbegin() of a
-// vector.
-static std::string FormObservationKey(
+// Hashes the observation key from the nodes of a walk. The key is never
+// built; the hash is the same as HashKey() of the key. This goes backward,
+// but we are using a const_iterator, the "end" here should be a .cbegin() of
+// a vector.
+static uint64_t HashObservationKey(
     std::vector<Formosa::Gramambular2::ReadingGrid::NodePtr>::const_iterator
         head,
     std::vector<Formosa::Gramambular2::ReadingGrid::NodePtr>::const_iterator
         end);
 
+namespace {
+
+// 64-bit FNV-1a, which can be fed the pieces of a key one by one.
+class KeyHasher {
+ public:
+  void add(std::string_view s) {
+    for (char c : s) {
+      hash_ ^= static_cast<uint8_t>(c);
+      hash_ *= 1099511628211ULL;
+    }
+  }
+
+  // 0 marks an empty bucket, and so is never returned.
+  [[nodiscard]] uint64_t hash() const { return hash_ == 0 ? 1 : hash_; }
+
+ private:
+  uint64_t hash_ = 14695981039346656037ULL;
+};
+
+}  // namespace
+
 UserOverrideModel::UserOverrideModel(size_t capacity, double decayConstant)
-    : capacity_(capacity) {
+    : capacity_(capacity), decayConstant_(decayConstant) {
   assert(capacity_ > 0);
+  assert(capacity_ < kNone);
   // NOLINTNEXTLINE(readability-magic-numbers)
   decayExponent_ = log(0.5) / decayConstant;
 }
@@ -142,8 +166,8 @@ void UserOverrideModel::observe(
   auto endPoint = breakingUp ? walkAfterUserOverride.nodes.begin()
                              : walkBeforeUserOverride.nodes.begin();
 
-  std::string key = FormObservationKey(nodeIter, endPoint);
-  observe(key, currentNode->currentUnigram().value(), timestamp,
+  uint64_t keyHash = HashObservationKey(nodeIter, endPoint);
+  observe(keyHash, currentNode->currentUnigram().value(), timestamp,
           forceHighScoreOverride);
 }
 
@@ -151,82 +175,275 @@ UserOverrideModel::Suggestion UserOverrideModel::suggest(
     const Formosa::Gramambular2::ReadingGrid::WalkResult& currentWalk,
     size_t cursor, double timestamp) {
   auto nodeIter = currentWalk.findNodeAt(cursor);
-  std::string key = FormObservationKey(nodeIter, currentWalk.nodes.begin());
-  return suggest(key, timestamp);
+  return suggest(HashObservationKey(nodeIter, currentWalk.nodes.begin()),
+                 timestamp);
 }
 
 void UserOverrideModel::observe(const std::string& key,
                                 const std::string& candidate, double timestamp,
                                 bool forceHighScoreOverride) {
-  auto mapIter = lruMap_.find(key);
-  if (mapIter == lruMap_.end()) {
-    auto keyValuePair = KeyObservationPair(key, Observation());
-    Observation& observation = keyValuePair.second;
-    observation.update(candidate, timestamp, forceHighScoreOverride);
-
-    lruList_.push_front(keyValuePair);
-    auto listIter = lruList_.begin();
-    auto lruKeyValue =
-        std::pair<std::string, std::list<KeyObservationPair>::iterator>(
-            key, listIter);
-    lruMap_.insert(lruKeyValue);
-
-    if (lruList_.size() > capacity_) {
-      auto lastKeyValuePair = lruList_.end();
-      --lastKeyValuePair;
-      lruMap_.erase(lastKeyValuePair->first);
-      lruList_.pop_back();
-    }
-  } else {
-    auto listIter = mapIter->second;
-    lruList_.splice(lruList_.begin(), lruList_, listIter);
+  observe(HashKey(key), candidate, timestamp, forceHighScoreOverride);
+}
+
+UserOverrideModel::Suggestion UserOverrideModel::suggest(const std::string& key,
+                                                         double timestamp) {
+  return suggest(HashKey(key), timestamp);
+}
 
-    auto& keyValuePair = *listIter;
-    Observation& observation = keyValuePair.second;
-    observation.update(candidate, timestamp, forceHighScoreOverride);
+void UserOverrideModel::observe(uint64_t keyHash, const std::string& candidate,
+                                double timestamp, bool forceHighScoreOverride) {
+  Entry& entry = touch(keyHash);
+  Override& o = overrideOf(entry, candidate);
+  entry.count++;
+  o.count++;
+  o.timestamp = timestamp;
+  o.forceHighScoreOverride = forceHighScoreOverride;
+  if (observationCallback_) {
+    observationCallback_(keyHash, candidate, timestamp, forceHighScoreOverride);
   }
 }
 
-UserOverrideModel::Suggestion UserOverrideModel::suggest(const std::string& key,
+UserOverrideModel::Suggestion UserOverrideModel::suggest(uint64_t keyHash,
                                                          double timestamp) {
-  auto mapIter = lruMap_.find(key);
-  if (mapIter == lruMap_.end()) {
+  uint32_t index = find(keyHash);
+  if (index == kNone) {
     return UserOverrideModel::Suggestion{};
   }
 
-  auto listIter = mapIter->second;
-  auto& keyValuePair = *listIter;
-  const Observation& observation = keyValuePair.second;
-
-  std::string candidate;
-  bool forceHighScoreOverride = false;
+  const Entry& entry = entries_[index];
+  const Override* best = nullptr;
   double score = 0;
-  for (auto i = observation.overrides.begin(); i != observation.overrides.end();
-       ++i) {
-    const Override& o = i->second;
-    double overrideScore = Score(o.count, observation.count, o.timestamp,
-                                 timestamp, decayExponent_);
+  for (uint32_t i = 0; i < entry.overrideCount; ++i) {
+    const Override& o = entry.overrides[i];
+    double overrideScore =
+        Score(o.count, entry.count, o.timestamp, timestamp, decayExponent_);
     if (overrideScore == 0.0) {
       continue;
     }
 
     if (overrideScore > score) {
-      candidate = i->first;
-      forceHighScoreOverride = o.forceHighScoreOverride;
+      best = &o;
       score = overrideScore;
     }
   }
-  return UserOverrideModel::Suggestion{candidate, forceHighScoreOverride};
+  if (best == nullptr) {
+    return UserOverrideModel::Suggestion{};
+  }
+  return UserOverrideModel::Suggestion{*candidates_[best->candidate],
+                                       best->forceHighScoreOverride};
 }
 
-void UserOverrideModel::Observation::update(const std::string& candidate,
-                                            double timestamp,
-                                            bool forceHighScoreOverride) {
-  count++;
-  auto& o = overrides[candidate];
-  o.timestamp = timestamp;
-  o.count++;
-  o.forceHighScoreOverride = forceHighScoreOverride;
+uint64_t UserOverrideModel::HashKey(std::string_view key) {
+  KeyHasher hasher;
+  hasher.add(key);
+  return hasher.hash();
+}
+
+std::vector<UserOverrideModel::Record> UserOverrideModel::records() const {
+  std::vector<Record> result;
+  for (uint32_t i = tail_; i != kNone; i = entries_[i].prev) {
+    const Entry& entry = entries_[i];
+    for (uint32_t j = 0; j < entry.overrideCount; ++j) {
+      const Override& o = entry.overrides[j];
+      result.push_back(Record{entry.keyHash, *candidates_[o.candidate],
+                              o.count, o.timestamp, o.forceHighScoreOverride});
+    }
+  }
+  return result;
+}
+
+void UserOverrideModel::restore(const Record& record) {
+  if (record.count == 0 || record.keyHash == 0) {
+    return;
+  }
+  Entry& entry = touch(record.keyHash);
+  Override& o = overrideOf(entry, record.candidate);
+  entry.count = entry.count - o.count + static_cast<uint32_t>(record.count);
+  o.count = static_cast<uint32_t>(record.count);
+  o.timestamp = record.timestamp;
+  o.forceHighScoreOverride = record.forceHighScoreOverride;
+}
+
+uint32_t UserOverrideModel::find(uint64_t keyHash) const {
+  if (buckets_.empty()) {
+    return kNone;
+  }
+  const size_t mask = buckets_.size() - 1;
+  for (size_t i = bucketOf(keyHash);; i = (i + 1) & mask) {
+    const Bucket& bucket = buckets_[i];
+    if (bucket.entry == kNone) {
+      return kNone;
+    }
+    if (bucket.keyHash == keyHash) {
+      return bucket.entry;
+    }
+  }
+}
+
+UserOverrideModel::Entry& UserOverrideModel::touch(uint64_t keyHash) {
+  uint32_t index = find(keyHash);
+  if (index != kNone) {
+    if (index != head_) {
+      unlink(index);
+      pushFront(index);
+    }
+    return entries_[index];
+  }
+
+  if (entries_.size() < capacity_) {
+    index = static_cast<uint32_t>(entries_.size());
+    entries_.emplace_back();
+  } else {
+    // Reuse the least recently used entry.
+    index = tail_;
+    unlink(index);
+    Entry& evicted = entries_[index];
+    eraseBucket(evicted.keyHash);
+    for (uint32_t i = 0; i < evicted.overrideCount; ++i) {
+      releaseCandidate(evicted.overrides[i].candidate);
+    }
+    evicted = Entry();
+  }
+
+  entries_[index].keyHash = keyHash;
+  insertBucket(keyHash, index);
+  pushFront(index);
+  return entries_[index];
+}
+
+UserOverrideModel::Override& UserOverrideModel::overrideOf(
+    Entry& entry, const std::string& candidate) {
+  auto it = candidateIds_.find(candidate);
+  if (it != candidateIds_.end()) {
+    for (uint32_t i = 0; i < entry.overrideCount; ++i) {
+      if (entry.overrides[i].candidate == it->second) {
+        return entry.overrides[i];
+      }
+    }
+  }
+
+  Override* o;
+  if (entry.overrideCount < kMaxOverridesPerKey) {
+    o = &entry.overrides[entry.overrideCount++];
+  } else {
+    o = &entry.overrides[0];
+    for (uint32_t i = 1; i < entry.overrideCount; ++i) {
+      if (entry.overrides[i].timestamp < o->timestamp) {
+        o = &entry.overrides[i];
+      }
+    }
+    entry.count -= o->count;
+    releaseCandidate(o->candidate);
+  }
+  *o = Override();
+  o->candidate = internCandidate(candidate);
+  return *o;
+}
+
+void UserOverrideModel::unlink(uint32_t index) {
+  Entry& entry = entries_[index];
+  if (entry.prev != kNone) {
+    entries_[entry.prev].next = entry.next;
+  } else {
+    head_ = entry.next;
+  }
+  if (entry.next != kNone) {
+    entries_[entry.next].prev = entry.prev;
+  } else {
+    tail_ = entry.prev;
+  }
+  entry.prev = kNone;
+  entry.next = kNone;
+}
+
+void UserOverrideModel::pushFront(uint32_t index) {
+  Entry& entry = entries_[index];
+  entry.prev = kNone;
+  entry.next = head_;
+  if (head_ != kNone) {
+    entries_[head_].prev = index;
+  }
+  head_ = index;
+  if (tail_ == kNone) {
+    tail_ = index;
+  }
+}
+
+size_t UserOverrideModel::bucketOf(uint64_t keyHash) const {
+  // Fibonacci hashing spreads the FNV hashes over the high bits.
+  return static_cast<size_t>((keyHash * 0x9E3779B97F4A7C15ULL) >>
+                             bucketShift_);
+}
+
+void UserOverrideModel::insertBucket(uint64_t keyHash, uint32_t entry) {
+  if ((entries_.size() + 1) * 2 > buckets_.size()) {
+    // Grow and rehash. This stops once the capacity is reached.
+    size_t bits = 4;
+    while ((size_t{1} << bits) < (entries_.size() + 1) * 2) {
+      ++bits;
+    }
+    std::vector<Bucket> old = std::move(buckets_);
+    buckets_.assign(size_t{1} << bits, Bucket());
+    bucketShift_ = 64 - bits;
+    for (const Bucket& bucket : old) {
+      if (bucket.entry != kNone) {
+        insertBucket(bucket.keyHash, bucket.entry);
+      }
+    }
+  }
+
+  const size_t mask = buckets_.size() - 1;
+  size_t i = bucketOf(keyHash);
+  while (buckets_[i].entry != kNone) {
+    i = (i + 1) & mask;
+  }
+  buckets_[i] = Bucket{keyHash, entry};
+}
+
+void UserOverrideModel::eraseBucket(uint64_t keyHash) {
+  const size_t mask = buckets_.size() - 1;
+  size_t i = bucketOf(keyHash);
+  while (buckets_[i].keyHash != keyHash) {
+    i = (i + 1) & mask;
+  }
+
+  // Backward-shift deletion: move up the following buckets that would no
+  // longer be reachable through the hole, so no tombstones are needed.
+  for (size_t j = (i + 1) & mask; buckets_[j].entry != kNone;
+       j = (j + 1) & mask) {
+    size_t home = bucketOf(buckets_[j].keyHash);
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      buckets_[i] = buckets_[j];
+      i = j;
+    }
+  }
+  buckets_[i] = Bucket();
+}
+
+uint32_t UserOverrideModel::internCandidate(const std::string& candidate) {
+  auto [it, inserted] = candidateIds_.try_emplace(candidate, kNone);
+  if (inserted) {
+    if (freeCandidates_.empty()) {
+      it->second = static_cast<uint32_t>(candidates_.size());
+      candidates_.push_back(&it->first);
+      candidateRefs_.push_back(0);
+    } else {
+      it->second = freeCandidates_.back();
+      freeCandidates_.pop_back();
+      candidates_[it->second] = &it->first;
+    }
+  }
+  candidateRefs_[it->second]++;
+  return it->second;
+}
+
+void UserOverrideModel::releaseCandidate(uint32_t id) {
+  if (--candidateRefs_[id] > 0) {
+    return;
+  }
+  candidateIds_.erase(*candidates_[id]);
+  candidates_[id] = nullptr;
+  freeCandidates_.push_back(id);
 }
 
 static double Score(size_t eventCount, size_t totalCount, double eventTimestamp,
@@ -241,9 +458,13 @@ static double Score(size_t eventCount, size_t totalCount, double eventTimestamp,
   return prob * decay;
 }
 
-static std::string CombineReadingValue(const std::string& reading,
-                                       const std::string& value) {
-  return std::string("(") + reading + "," + value + ")";
+static void AddNode(KeyHasher* hasher, const std::string& reading,
+                    const std::string& value) {
+  hasher->add("(");
+  hasher->add(reading);
+  hasher->add(",");
+  hasher->add(value);
+  hasher->add(")");
 }
 
 static bool IsPunctuation(
@@ -252,49 +473,51 @@ static bool IsPunctuation(
   return !reading.empty() && reading[0] == '_';
 }
 
-static std::string FormObservationKey(
+static uint64_t HashObservationKey(
     std::vector<Formosa::Gramambular2::ReadingGrid::NodePtr>::const_iterator
         head,
     std::vector<Formosa::Gramambular2::ReadingGrid::NodePtr>::const_iterator
         end) {
-  // Using the top unigram from the head node. Recall that this is an
-  // observation for *before* the user override, and when we provide
-  // a suggestion, this head node is never overridden yet.
-  std::string headStr =
-      CombineReadingValue((*head)->reading(), (*head)->unigrams()[0].value());
+  // The key is "anterior-prev-head", and so the nodes are found first and
+  // hashed in reverse. Null stands for the beginning of the sentence.
+  Formosa::Gramambular2::ReadingGrid::NodePtr headNode = *head;
 
-  // For the next two nodes, use their current unigram values. If it's a
+  // For the previous two nodes, use their current unigram values. If it's a
   // punctuation, we ignore the reading and the value altogether and treat
   // it as if it's like the beginning of the sentence.
-  std::string prevStr;
+  Formosa::Gramambular2::ReadingGrid::NodePtr prevNode = nullptr;
   bool prevIsPunctuation = false;
   if (head != end) {
     --head;
     prevIsPunctuation = IsPunctuation(*head);
-    if (prevIsPunctuation) {
-      prevStr = kEmptyNodeString;
-    } else {
-      prevStr = CombineReadingValue((*head)->reading(),
-                                    (*head)->currentUnigram().value());
+    if (!prevIsPunctuation) {
+      prevNode = *head;
     }
-  } else {
-    prevStr = kEmptyNodeString;
   }
 
-  std::string anteriorStr;
+  Formosa::Gramambular2::ReadingGrid::NodePtr anteriorNode = nullptr;
   if (head != end && !prevIsPunctuation) {
     --head;
-    if (IsPunctuation((*head))) {
-      anteriorStr = kEmptyNodeString;
+    if (!IsPunctuation(*head)) {
+      anteriorNode = *head;
+    }
+  }
+
+  KeyHasher hasher;
+  for (const auto& node : {anteriorNode, prevNode}) {
+    if (node != nullptr) {
+      AddNode(&hasher, node->reading(), node->currentUnigram().value());
     } else {
-      anteriorStr = CombineReadingValue((*head)->reading(),
-                                        (*head)->currentUnigram().value());
+      hasher.add(kEmptyNodeString);
     }
-  } else {
-    anteriorStr = kEmptyNodeString;
+    hasher.add("-");
   }
 
-  return anteriorStr + "-" + prevStr + "-" + headStr;
+  // Using the top unigram from the head node. Recall that this is an
+  // observation for *before* the user override, and when we provide
+  // a suggestion, this head node is never overridden yet.
+  AddNode(&hasher, headNode->reading(), headNode->unigrams()[0].value());
+  return hasher.hash();
 }
 
 }  // namespace McBopomofo
@@ -24,19 +24,45 @@
 #ifndef SRC_ENGINE_USEROVERRIDEMODEL_H_
 #define SRC_ENGINE_USEROVERRIDEMODEL_H_
 
-#include <list>
-#include <map>
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "gramambular2/reading_grid.h"
 
 namespace McBopomofo {
 
+// Learns the candidates that the user picks over the ones that the walk
+// chooses, keyed by the context in which the override happens, and suggests
+// them later.
+//
+// The observations are kept in a fixed-capacity LRU. A key is not stored as
+// a string but as a 64-bit hash, which suggest() computes from the walk
+// without building the key. The entries live in a contiguous array, linked
+// by indices into an intrusive LRU list, and an open-addressed table maps the
+// hashes to them. Each entry holds up to kMaxOverridesPerKey overrides, whose
+// candidates are interned and reference-counted. Memory therefore grows with
+// the number of entries used, up to the capacity, and not with the length of
+// the keys.
 class UserOverrideModel {
  public:
   UserOverrideModel(size_t capacity, double decayConstant);
 
+  // The interned candidates are referred to by pointers, which survive a move
+  // but not a copy.
+  UserOverrideModel(const UserOverrideModel&) = delete;
+  UserOverrideModel& operator=(const UserOverrideModel&) = delete;
+  UserOverrideModel(UserOverrideModel&&) = default;
+  UserOverrideModel& operator=(UserOverrideModel&&) = default;
+
+  // When an entry already has this many overrides, a new candidate replaces
+  // the least recently observed one.
+  static constexpr size_t kMaxOverridesPerKey = 4;
+
   struct Suggestion {
     Suggestion() = default;
     Suggestion(std::string c, bool f)
@@ -62,28 +88,111 @@ class UserOverrideModel {
 
   Suggestion suggest(const std::string& key, double timestamp);
 
+  void observe(uint64_t keyHash, const std::string& candidate,
+               double timestamp, bool forceHighScoreOverride = false);
+
+  Suggestion suggest(uint64_t keyHash, double timestamp);
+
+  // The hash used in place of an observation key. Never 0.
+  static uint64_t HashKey(std::string_view key);
+
+  // The number of keys observed, up to the capacity.
+  [[nodiscard]] size_t size() const { return entries_.size(); }
+
+  [[nodiscard]] size_t capacity() const { return capacity_; }
+  [[nodiscard]] double decayConstant() const { return decayConstant_; }
+
+  // An override of an observation, flattened for persisting the model.
+  struct Record {
+    uint64_t keyHash = 0;
+    std::string candidate;
+    size_t count = 0;
+    double timestamp = 0;
+    bool forceHighScoreOverride = false;
+  };
+
+  // Returns the overrides of all observations, from the least recently
+  // observed key to the most recently observed one.
+  [[nodiscard]] std::vector<Record> records() const;
+
+  // Puts back an override returned by records(), making its key the most
+  // recently observed one. Restoring the records in their order rebuilds the
+  // model. The observation callback is not invoked.
+  void restore(const Record& record);
+
+  // Invoked by observe() with the arguments of every observation made, after
+  // the model is updated.
+  using ObservationCallback =
+      std::function<void(uint64_t keyHash, const std::string& candidate,
+                         double timestamp, bool forceHighScoreOverride)>;
+  void setObservationCallback(ObservationCallback callback) {
+    observationCallback_ = std::move(callback);
+  }
+
  private:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
   struct Override {
-    size_t count = 0;
+    uint32_t candidate = kNone;
+    uint32_t count = 0;
     double timestamp = 0;
     bool forceHighScoreOverride = false;
   };
 
-  struct Observation {
-    size_t count;
-    std::map<std::string, Override> overrides;
+  struct Entry {
+    uint64_t keyHash = 0;
+    // The neighbors in the LRU list; prev is the more recently used one.
+    uint32_t prev = kNone;
+    uint32_t next = kNone;
+    // The sum of the counts of the overrides.
+    uint32_t count = 0;
+    uint32_t overrideCount = 0;
+    Override overrides[kMaxOverridesPerKey];
+  };
 
-    Observation() : count(0) {}
-    void update(const std::string& candidate, double timestamp,
-                bool forceHighScoreOverride);
+  struct Bucket {
+    uint64_t keyHash = 0;
+    uint32_t entry = kNone;
   };
 
-  typedef std::pair<std::string, Observation> KeyObservationPair;
+  // Returns the index of the entry of the key, or kNone.
+  [[nodiscard]] uint32_t find(uint64_t keyHash) const;
+
+  // Finds or inserts the entry of the key, and makes it the most recently
+  // used one, evicting the least recently used one if needed.
+  Entry& touch(uint64_t keyHash);
+
+  // Returns the override of the candidate in the entry, adding it if needed.
+  Override& overrideOf(Entry& entry, const std::string& candidate);
+
+  void unlink(uint32_t index);
+  void pushFront(uint32_t index);
+  void insertBucket(uint64_t keyHash, uint32_t entry);
+  void eraseBucket(uint64_t keyHash);
+  [[nodiscard]] size_t bucketOf(uint64_t keyHash) const;
+
+  uint32_t internCandidate(const std::string& candidate);
+  void releaseCandidate(uint32_t id);
 
   size_t capacity_;
+  double decayConstant_;
   double decayExponent_;
-  std::list<KeyObservationPair> lruList_;
-  std::map<std::string, std::list<KeyObservationPair>::iterator> lruMap_;
+
+  std::vector<Entry> entries_;
+  uint32_t head_ = kNone;
+  uint32_t tail_ = kNone;
+
+  // Linear probing, kept at most half full. The size is a power of two.
+  std::vector<Bucket> buckets_;
+  size_t bucketShift_ = 0;
+
+  std::unordered_map<std::string, uint32_t> candidateIds_;
+  // Points to the keys of candidateIds_, which are stable.
+  std::vector<const std::string*> candidates_;
+  std::vector<uint32_t> candidateRefs_;
+  std::vector<uint32_t> freeCandidates_;
+
+  ObservationCallback observationCallback_;
 };
 
 }  // namespace McBopomofo
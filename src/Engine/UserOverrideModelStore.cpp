@@ -0,0 +1,479 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "UserOverrideModelStore.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "CompiledPhraseDB.h"
+#include "MemoryMappedFile.h"
+
+namespace McBopomofo {
+
+namespace {
+
+static_assert(std::endian::native == std::endian::little,
+              "UserOverrideModelStore assumes a little-endian host");
+
+using Record = UserOverrideModel::Record;
+
+constexpr std::string_view kSnapshotMagic = "McBpUOMS";
+constexpr std::string_view kLogMagic = "McBpUOML";
+constexpr uint32_t kVersion = 2;
+
+// Snapshot header: magic, version, checksum, record count, log generation.
+// The checksum covers everything after the checksum field itself.
+constexpr size_t kSnapshotVersionOffset = 8;
+constexpr size_t kSnapshotChecksumOffset = 12;
+constexpr size_t kSnapshotChecksumStart = 16;
+constexpr size_t kSnapshotHeaderSize = 28;
+
+// Log header: magic, version, generation. Each log record is then prefixed
+// by the length and the checksum of its encoded Record.
+constexpr size_t kLogGenerationOffset = 12;
+constexpr size_t kLogHeaderSize = 20;
+constexpr size_t kLogRecordHeaderSize = 8;
+
+// An encoded Record: key hash, candidate length, count, flags, timestamp, and
+// candidate.
+constexpr size_t kRecordFixedSize = 25;
+
+template <typename T>
+void Append(std::string* output, T value) {
+  output->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendRecord(std::string* output, const Record& record) {
+  Append(output, record.keyHash);
+  Append(output, static_cast<uint32_t>(record.candidate.size()));
+  Append(output, static_cast<uint32_t>(record.count));
+  Append(output, static_cast<uint8_t>(record.forceHighScoreOverride ? 1 : 0));
+  Append(output, record.timestamp);
+  output->append(record.candidate);
+}
+
+// Reads the fields of the formats above, failing once the data runs out.
+class Reader {
+ public:
+  Reader(const char* data, size_t length) : ptr_(data), end_(data + length) {}
+
+  template <typename T>
+  bool read(T* value) {
+    if (remaining() < sizeof(T)) {
+      return false;
+    }
+    memcpy(value, ptr_, sizeof(T));
+    ptr_ += sizeof(T);
+    return true;
+  }
+
+  bool readString(size_t length, std::string* value) {
+    if (remaining() < length) {
+      return false;
+    }
+    value->assign(ptr_, length);
+    ptr_ += length;
+    return true;
+  }
+
+  bool skip(size_t length) {
+    if (remaining() < length) {
+      return false;
+    }
+    ptr_ += length;
+    return true;
+  }
+
+  bool readRecord(Record* record) {
+    uint32_t candidateLength;
+    uint32_t count;
+    uint8_t flags;
+    if (!read(&record->keyHash) || !read(&candidateLength) || !read(&count) ||
+        !read(&flags) || !read(&record->timestamp) ||
+        !readString(candidateLength, &record->candidate)) {
+      return false;
+    }
+    record->count = count;
+    record->forceHighScoreOverride = (flags & 1) != 0;
+    return true;
+  }
+
+  [[nodiscard]] size_t remaining() const { return end_ - ptr_; }
+  [[nodiscard]] const char* position() const { return ptr_; }
+
+ private:
+  const char* ptr_;
+  const char* end_;
+};
+
+bool WriteAll(int fd, const char* data, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    length -= static_cast<size_t>(written);
+  }
+  return true;
+}
+
+}  // namespace
+
+UserOverrideModelStore::UserOverrideModelStore(std::string directory,
+                                               size_t compactionThreshold)
+    : directory_(std::move(directory)),
+      compactionThreshold_(compactionThreshold > 0 ? compactionThreshold : 1) {}
+
+UserOverrideModelStore::~UserOverrideModelStore() {
+  if (model_ != nullptr) {
+    model_->setObservationCallback(nullptr);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  if (writer_.joinable()) {
+    writer_.join();
+  }
+  closeLog();
+}
+
+void UserOverrideModelStore::attach(UserOverrideModel* model) {
+  if (model_ != nullptr || model == nullptr) {
+    return;
+  }
+  model_ = model;
+
+  std::error_code ec;
+  std::filesystem::create_directories(directory_, ec);
+
+  bool hasSnapshot = false;
+  {
+    MemoryMappedFile snapshot;
+    std::vector<Record> records;
+    if (snapshot.open(snapshotPath().c_str()) &&
+        DecodeSnapshot(snapshot.data(), snapshot.length(), &records,
+                       &logGeneration_)) {
+      hasSnapshot = true;
+      for (const Record& record : records) {
+        model_->restore(record);
+      }
+      loadStats_.snapshotRecords = records.size();
+    }
+  }
+
+  // Replay the log if it follows the snapshot. Without a snapshot, any log is
+  // taken as it is.
+  bool logUsable = false;
+  size_t validLogLength = 0;
+  {
+    MemoryMappedFile log;
+    uint32_t version = 0;
+    uint64_t generation = 0;
+    if (log.open(logPath().c_str()) && log.length() >= kLogHeaderSize &&
+        std::string_view(log.data(), kLogMagic.size()) == kLogMagic) {
+      memcpy(&version, log.data() + kLogMagic.size(), sizeof(version));
+      memcpy(&generation, log.data() + kLogGenerationOffset,
+             sizeof(generation));
+      logUsable = version == kVersion &&
+                  (!hasSnapshot || generation == logGeneration_);
+    }
+    if (logUsable) {
+      logGeneration_ = generation;
+      Reader reader(log.data() + kLogHeaderSize,
+                    log.length() - kLogHeaderSize);
+      validLogLength = kLogHeaderSize;
+      while (reader.remaining() > 0) {
+        uint32_t length;
+        uint32_t checksum;
+        Record record;
+        if (!reader.read(&length) || !reader.read(&checksum) ||
+            reader.remaining() < length ||
+            CompiledPhraseDB::Checksum(reader.position(), length) !=
+                checksum ||
+            !Reader(reader.position(), length).readRecord(&record)) {
+          loadStats_.logTruncated = true;
+          break;
+        }
+        reader.skip(length);
+        model_->observe(record.keyHash, record.candidate, record.timestamp,
+                        record.forceHighScoreOverride);
+        ++loadStats_.logRecords;
+        validLogLength = log.length() - reader.remaining();
+      }
+    }
+  }
+
+  if (logUsable) {
+    logUsable = openLog(logGeneration_, /*create=*/false) &&
+                ftruncate(logFd_, static_cast<off_t>(validLogLength)) == 0;
+  }
+  if (!logUsable) {
+    openLog(logGeneration_, /*create=*/true);
+  }
+  recordsSinceSnapshot_ = loadStats_.logRecords;
+
+  // The one full copy of the model, made before any keystroke.
+  mirror_ = std::make_unique<UserOverrideModel>(model_->capacity(),
+                                                model_->decayConstant());
+  for (const Record& record : model_->records()) {
+    mirror_->restore(record);
+  }
+
+  model_->setObservationCallback(
+      [this](uint64_t keyHash, const std::string& candidate, double timestamp,
+             bool forceHighScoreOverride) {
+        append(keyHash, candidate, timestamp, forceHighScoreOverride);
+      });
+  writer_ = std::thread(&UserOverrideModelStore::run, this);
+}
+
+void UserOverrideModelStore::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return queue_.empty() && !busy_; });
+}
+
+size_t UserOverrideModelStore::compactionCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return compactionCount_;
+}
+
+std::string UserOverrideModelStore::EncodeSnapshot(
+    const std::vector<Record>& records, uint64_t logGeneration) {
+  std::string output(kSnapshotMagic);
+  Append(&output, kVersion);
+  Append(&output, uint32_t{0});  // Checksum, filled in below.
+  Append(&output, static_cast<uint32_t>(records.size()));
+  Append(&output, logGeneration);
+  for (const Record& record : records) {
+    AppendRecord(&output, record);
+  }
+  uint32_t checksum =
+      CompiledPhraseDB::Checksum(output.data() + kSnapshotChecksumStart,
+                                 output.size() - kSnapshotChecksumStart);
+  memcpy(output.data() + kSnapshotChecksumOffset, &checksum, sizeof(checksum));
+  return output;
+}
+
+bool UserOverrideModelStore::DecodeSnapshot(const char* data, size_t length,
+                                            std::vector<Record>* records,
+                                            uint64_t* logGeneration) {
+  if (length < kSnapshotHeaderSize ||
+      std::string_view(data, kSnapshotMagic.size()) != kSnapshotMagic) {
+    return false;
+  }
+
+  Reader reader(data + kSnapshotVersionOffset,
+                length - kSnapshotVersionOffset);
+  uint32_t version;
+  uint32_t checksum;
+  uint32_t count;
+  uint64_t generation;
+  reader.read(&version);
+  reader.read(&checksum);
+  reader.read(&count);
+  reader.read(&generation);
+  if (version != kVersion ||
+      checksum != CompiledPhraseDB::Checksum(data + kSnapshotChecksumStart,
+                                             length - kSnapshotChecksumStart) ||
+      reader.remaining() < static_cast<size_t>(count) * kRecordFixedSize) {
+    return false;
+  }
+
+  std::vector<Record> result(count);
+  for (Record& record : result) {
+    if (!reader.readRecord(&record)) {
+      return false;
+    }
+  }
+  if (reader.remaining() != 0) {
+    return false;
+  }
+  *records = std::move(result);
+  *logGeneration = generation;
+  return true;
+}
+
+void UserOverrideModelStore::append(uint64_t keyHash,
+                                    const std::string& candidate,
+                                    double timestamp,
+                                    bool forceHighScoreOverride) {
+  Job job;
+  job.record =
+      Record{keyHash, candidate, 1, timestamp, forceHighScoreOverride};
+  enqueue(std::move(job));
+
+  if (++recordsSinceSnapshot_ < compactionThreshold_) {
+    return;
+  }
+  recordsSinceSnapshot_ = 0;
+  Job snapshot;
+  snapshot.type = Job::Type::kSnapshot;
+  snapshot.logGeneration = ++logGeneration_;
+  enqueue(std::move(snapshot));
+}
+
+void UserOverrideModelStore::enqueue(Job job) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(job));
+  }
+  cv_.notify_all();
+}
+
+void UserOverrideModelStore::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      break;
+    }
+    std::vector<Job> jobs(std::make_move_iterator(queue_.begin()),
+                          std::make_move_iterator(queue_.end()));
+    queue_.clear();
+    busy_ = true;
+    lock.unlock();
+
+    // Consecutive observations are written, and synced, together.
+    size_t snapshots = 0;
+    size_t begin = 0;
+    for (size_t i = 0; i <= jobs.size(); ++i) {
+      if (i < jobs.size() && jobs[i].type == Job::Type::kAppend) {
+        const Record& record = jobs[i].record;
+        mirror_->observe(record.keyHash, record.candidate, record.timestamp,
+                         record.forceHighScoreOverride);
+        continue;
+      }
+      if (begin < i) {
+        appendToLog(jobs, begin, i);
+      }
+      if (i < jobs.size() && writeSnapshot(jobs[i])) {
+        ++snapshots;
+      }
+      begin = i + 1;
+    }
+
+    lock.lock();
+    busy_ = false;
+    compactionCount_ += snapshots;
+    cv_.notify_all();
+  }
+}
+
+bool UserOverrideModelStore::appendToLog(const std::vector<Job>& jobs,
+                                         size_t begin, size_t end) {
+  if (logFd_ == -1) {
+    return false;
+  }
+  std::string buffer;
+  std::string payload;
+  for (size_t i = begin; i < end; ++i) {
+    payload.clear();
+    AppendRecord(&payload, jobs[i].record);
+    Append(&buffer, static_cast<uint32_t>(payload.size()));
+    Append(&buffer, CompiledPhraseDB::Checksum(payload.data(), payload.size()));
+    buffer.append(payload);
+  }
+  if (!WriteAll(logFd_, buffer.data(), buffer.size())) {
+    return false;
+  }
+  return fdatasync(logFd_) == 0;
+}
+
+bool UserOverrideModelStore::writeSnapshot(const Job& job) {
+  // The mirror has seen every observation queued before the job.
+  std::string snapshot = EncodeSnapshot(mirror_->records(), job.logGeneration);
+  std::string tempPath = snapshotPath() + ".tmp";
+  int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd == -1) {
+    return false;
+  }
+  bool written = WriteAll(fd, snapshot.data(), snapshot.size()) &&
+                 fsync(fd) == 0;
+  close(fd);
+  if (!written || std::rename(tempPath.c_str(), snapshotPath().c_str()) != 0) {
+    std::remove(tempPath.c_str());
+    return false;
+  }
+
+  // The old log is now folded into the snapshot. If this fails, the old log
+  // is kept, but it will not be replayed since its generation is older.
+  closeLog();
+  return openLog(job.logGeneration, /*create=*/true);
+}
+
+bool UserOverrideModelStore::openLog(uint64_t generation, bool create) {
+  closeLog();
+  int flags = O_WRONLY | O_APPEND | (create ? O_CREAT | O_TRUNC : 0);
+  logFd_ = open(logPath().c_str(), flags, 0600);
+  if (logFd_ == -1) {
+    return false;
+  }
+  if (!create) {
+    return true;
+  }
+  std::string header(kLogMagic);
+  Append(&header, kVersion);
+  Append(&header, generation);
+  if (!WriteAll(logFd_, header.data(), header.size()) ||
+      fdatasync(logFd_) != 0) {
+    closeLog();
+    return false;
+  }
+  return true;
+}
+
+void UserOverrideModelStore::closeLog() {
+  if (logFd_ != -1) {
+    close(logFd_);
+    logFd_ = -1;
+  }
+}
+
+std::string UserOverrideModelStore::snapshotPath() const {
+  return (std::filesystem::path(directory_) / kSnapshotFilename).string();
+}
+
+std::string UserOverrideModelStore::logPath() const {
+  return (std::filesystem::path(directory_) / kLogFilename).string();
+}
+
+}  // namespace McBopomofo
@@ -0,0 +1,160 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_ENGINE_USEROVERRIDEMODELSTORE_H_
+#define SRC_ENGINE_USEROVERRIDEMODELSTORE_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "UserOverrideModel.h"
+
+namespace McBopomofo {
+
+// Keeps a UserOverrideModel on disk, so that what the model learns survives
+// restarts.
+//
+// The store is made of two files in a directory: a snapshot of the whole
+// model, and a log of the observations made since the snapshot. Loading maps
+// the snapshot and replays the log. After that, every observation of the
+// model is queued and appended to the log by a writer thread, so observe()
+// and suggest() never wait for the disk. The writer also replays the
+// observations into a mirror of the model, which it owns. Once the log has
+// enough records, the writer replaces the snapshot with the mirror's records
+// and starts a new log, so compaction costs the model's thread nothing but
+// queueing a job.
+//
+// The snapshot is written to a temporary file and renamed into place. A new
+// log is started by truncating the log file and writing a header that
+// carries the log's generation. The log is synced after each batch of
+// records. Every log record has a checksum, and a torn or corrupt tail is
+// dropped on load, so a crash loses at most the observations that have not
+// been written yet. The snapshot records the generation of the log that
+// follows it, so a log left behind by a crash during compaction is not
+// replayed twice.
+//
+// The store is used from the input method's thread; only the queue is
+// shared with the writer.
+class UserOverrideModelStore {
+ public:
+  static constexpr char kSnapshotFilename[] = "user-override-model.db";
+  static constexpr char kLogFilename[] = "user-override-model.log";
+  static constexpr size_t kDefaultCompactionThreshold = 256;
+
+  explicit UserOverrideModelStore(
+      std::string directory,
+      size_t compactionThreshold = kDefaultCompactionThreshold);
+
+  // Writes the queued records before returning.
+  ~UserOverrideModelStore();
+
+  UserOverrideModelStore(const UserOverrideModelStore&) = delete;
+  UserOverrideModelStore& operator=(const UserOverrideModelStore&) = delete;
+
+  // Restores the snapshot and replays the log into the model, then starts
+  // recording the model's observations. The model must outlive the store.
+  // Missing files are treated as empty ones. Can only be called once.
+  void attach(UserOverrideModel* model);
+
+  // Blocks until the queued records and snapshots are written. For testing.
+  void flush();
+
+  struct LoadStats {
+    size_t snapshotRecords = 0;
+    size_t logRecords = 0;
+    // Whether a torn or corrupt log tail was dropped.
+    bool logTruncated = false;
+  };
+  [[nodiscard]] const LoadStats& loadStats() const { return loadStats_; }
+
+  // The number of snapshots written by the writer so far.
+  [[nodiscard]] size_t compactionCount() const;
+
+  // Encodes the model's records as a snapshot. Exposed for testing.
+  static std::string EncodeSnapshot(
+      const std::vector<UserOverrideModel::Record>& records,
+      uint64_t logGeneration);
+
+  // Decodes a snapshot. Returns false if the data is not a valid snapshot.
+  static bool DecodeSnapshot(const char* data, size_t length,
+                             std::vector<UserOverrideModel::Record>* records,
+                             uint64_t* logGeneration);
+
+ private:
+  struct Job {
+    enum class Type { kAppend, kSnapshot };
+    Type type = Type::kAppend;
+    // The observation to append, with a count of 1.
+    UserOverrideModel::Record record;
+    // The generation of the log that follows the snapshot.
+    uint64_t logGeneration = 0;
+  };
+
+  void append(uint64_t keyHash, const std::string& candidate,
+              double timestamp, bool forceHighScoreOverride);
+  void enqueue(Job job);
+  void run();
+
+  // The following are only called on the writer thread.
+  bool appendToLog(const std::vector<Job>& jobs, size_t begin, size_t end);
+  bool writeSnapshot(const Job& job);
+  bool openLog(uint64_t generation, bool create);
+  void closeLog();
+
+  std::string snapshotPath() const;
+  std::string logPath() const;
+
+  const std::string directory_;
+  const size_t compactionThreshold_;
+  UserOverrideModel* model_ = nullptr;
+  LoadStats loadStats_;
+
+  // Only used on the model's thread.
+  size_t recordsSinceSnapshot_ = 0;
+  uint64_t logGeneration_ = 0;
+
+  // Only used on the writer thread, or before it starts.
+  int logFd_ = -1;
+  // Kept in step with the model by replaying the queued observations; the
+  // snapshots are taken from it.
+  std::unique_ptr<UserOverrideModel> mirror_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Job> queue_;
+  bool busy_ = false;
+  bool stopping_ = false;
+  size_t compactionCount_ = 0;
+  std::thread writer_;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_ENGINE_USEROVERRIDEMODELSTORE_H_
@@ -0,0 +1,228 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "TestTempDir.h"
+#include "UserOverrideModel.h"
+#include "UserOverrideModelStore.h"
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+namespace {
+constexpr double kFakeNow = 1657772432;
+constexpr int kCapacity = 5;
+constexpr double kHalflife = 5400.0;  // 1.5 hr.
+
+// Observes the keys "k0", "k1", and so on, each with its own candidate.
+void ObserveKeys(UserOverrideModel* uom, int begin, int end) {
+  for (int i = begin; i < end; i++) {
+    std::string n = std::to_string(i);
+    uom->observe("k" + n, "v" + n, kFakeNow + i);
+  }
+}
+
+std::string SuggestionOf(UserOverrideModel* uom, int i) {
+  return uom->suggest("k" + std::to_string(i), kFakeNow + kHalflife)
+      .candidate;
+}
+}  // namespace
+
+TEST(UserOverrideModelStoreTest, SnapshotRoundTrip) {
+  std::vector<UserOverrideModel::Record> records = {
+      {UserOverrideModel::HashKey("abc"), "x", 3, kFakeNow, false},
+      {UserOverrideModel::HashKey("def"), "y", 1, kFakeNow + 1, true},
+  };
+  std::string snapshot = UserOverrideModelStore::EncodeSnapshot(records, 42);
+
+  std::vector<UserOverrideModel::Record> decoded;
+  uint64_t generation = 0;
+  ASSERT_TRUE(UserOverrideModelStore::DecodeSnapshot(
+      snapshot.data(), snapshot.size(), &decoded, &generation));
+  EXPECT_EQ(generation, 42);
+  ASSERT_EQ(decoded.size(), 2);
+  EXPECT_EQ(decoded[0].keyHash, UserOverrideModel::HashKey("abc"));
+  EXPECT_EQ(decoded[0].count, 3);
+  EXPECT_EQ(decoded[1].candidate, "y");
+  EXPECT_EQ(decoded[1].timestamp, kFakeNow + 1);
+  EXPECT_TRUE(decoded[1].forceHighScoreOverride);
+
+  snapshot[snapshot.size() - 1] ^= 1;
+  EXPECT_FALSE(UserOverrideModelStore::DecodeSnapshot(
+      snapshot.data(), snapshot.size(), &decoded, &generation));
+  EXPECT_FALSE(UserOverrideModelStore::DecodeSnapshot(
+      snapshot.data(), snapshot.size() - 1, &decoded, &generation));
+}
+
+TEST(UserOverrideModelStoreTest, ObservationsSurviveRestart) {
+  TempDir dir;
+  {
+    UserOverrideModel uom(kCapacity, kHalflife);
+    UserOverrideModelStore store(dir.path());
+    store.attach(&uom);
+    EXPECT_EQ(store.loadStats().logRecords, 0);
+    ObserveKeys(&uom, 0, 3);
+  }
+
+  UserOverrideModel uom(kCapacity, kHalflife);
+  UserOverrideModelStore store(dir.path());
+  store.attach(&uom);
+  EXPECT_EQ(store.loadStats().snapshotRecords, 0);
+  EXPECT_EQ(store.loadStats().logRecords, 3);
+  EXPECT_FALSE(store.loadStats().logTruncated);
+  EXPECT_EQ(SuggestionOf(&uom, 0), "v0");
+  EXPECT_EQ(SuggestionOf(&uom, 2), "v2");
+}
+
+TEST(UserOverrideModelStoreTest, LogIsCompactedIntoSnapshot) {
+  TempDir dir;
+  {
+    UserOverrideModel uom(kCapacity, kHalflife);
+    UserOverrideModelStore store(dir.path(), /*compactionThreshold=*/3);
+    store.attach(&uom);
+    ObserveKeys(&uom, 0, 7);
+    store.flush();
+    EXPECT_EQ(store.compactionCount(), 2);
+  }
+
+  UserOverrideModel uom(kCapacity, kHalflife);
+  UserOverrideModelStore store(dir.path(), /*compactionThreshold=*/3);
+  store.attach(&uom);
+  EXPECT_EQ(store.loadStats().snapshotRecords, kCapacity);
+  EXPECT_EQ(store.loadStats().logRecords, 1);
+
+  // k0 and k1 were evicted before the snapshots were taken.
+  EXPECT_TRUE(SuggestionOf(&uom, 1).empty());
+  for (int i = 2; i < 7; i++) {
+    EXPECT_EQ(SuggestionOf(&uom, i), "v" + std::to_string(i));
+  }
+}
+
+TEST(UserOverrideModelStoreTest, SnapshotMatchesModel) {
+  TempDir dir;
+  {
+    UserOverrideModel uom(kCapacity, kHalflife);
+    UserOverrideModelStore store(dir.path());
+    store.attach(&uom);
+    ObserveKeys(&uom, 0, 2);
+  }
+
+  // The two records in the log, plus one, then three more, make two
+  // snapshots; the last one is taken right after the last observation.
+  UserOverrideModel uom(kCapacity, kHalflife);
+  UserOverrideModelStore store(dir.path(), /*compactionThreshold=*/3);
+  store.attach(&uom);
+  ObserveKeys(&uom, 2, 5);
+  uom.observe("k0", "w0", kFakeNow + 5, /*forceHighScoreOverride=*/true);
+  store.flush();
+  EXPECT_EQ(store.compactionCount(), 2);
+
+  std::ifstream file(dir.file(UserOverrideModelStore::kSnapshotFilename),
+                     std::ios::binary);
+  std::string data((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+  std::vector<UserOverrideModel::Record> snapshot;
+  uint64_t logGeneration = 0;
+  ASSERT_TRUE(UserOverrideModelStore::DecodeSnapshot(
+      data.data(), data.size(), &snapshot, &logGeneration));
+
+  auto records = uom.records();
+  ASSERT_EQ(snapshot.size(), records.size());
+  for (size_t i = 0; i < records.size(); i++) {
+    EXPECT_EQ(snapshot[i].keyHash, records[i].keyHash);
+    EXPECT_EQ(snapshot[i].candidate, records[i].candidate);
+    EXPECT_EQ(snapshot[i].count, records[i].count);
+    EXPECT_EQ(snapshot[i].timestamp, records[i].timestamp);
+    EXPECT_EQ(snapshot[i].forceHighScoreOverride,
+              records[i].forceHighScoreOverride);
+  }
+}
+
+TEST(UserOverrideModelStoreTest, TornLogTailIsDropped) {
+  TempDir dir;
+  {
+    UserOverrideModel uom(kCapacity, kHalflife);
+    UserOverrideModelStore store(dir.path());
+    store.attach(&uom);
+    ObserveKeys(&uom, 0, 2);
+  }
+  {
+    std::ofstream log(dir.file(UserOverrideModelStore::kLogFilename),
+                      std::ios::binary | std::ios::app);
+    log << "\x30\x00\x00\x00garbage";
+  }
+  {
+    UserOverrideModel uom(kCapacity, kHalflife);
+    UserOverrideModelStore store(dir.path());
+    store.attach(&uom);
+    EXPECT_EQ(store.loadStats().logRecords, 2);
+    EXPECT_TRUE(store.loadStats().logTruncated);
+    ObserveKeys(&uom, 2, 3);
+  }
+
+  // The record written after the torn tail was dropped is readable.
+  UserOverrideModel uom(kCapacity, kHalflife);
+  UserOverrideModelStore store(dir.path());
+  store.attach(&uom);
+  EXPECT_EQ(store.loadStats().logRecords, 3);
+  EXPECT_FALSE(store.loadStats().logTruncated);
+  EXPECT_EQ(SuggestionOf(&uom, 2), "v2");
+}
+
+TEST(UserOverrideModelStoreTest, LogOlderThanSnapshotIsNotReplayed) {
+  TempDir dir;
+  {
+    UserOverrideModel uom(kCapacity, kHalflife);
+    UserOverrideModelStore store(dir.path());
+    store.attach(&uom);
+    ObserveKeys(&uom, 0, 2);
+  }
+
+  // As if the process died after the snapshot was renamed into place but
+  // before a new log was started.
+  UserOverrideModel snapshotted(kCapacity, kHalflife);
+  ObserveKeys(&snapshotted, 0, 2);
+  {
+    std::string snapshot = UserOverrideModelStore::EncodeSnapshot(
+        snapshotted.records(), /*logGeneration=*/1);
+    std::ofstream file(dir.file(UserOverrideModelStore::kSnapshotFilename),
+                       std::ios::binary);
+    file << snapshot;
+  }
+
+  UserOverrideModel uom(kCapacity, kHalflife);
+  UserOverrideModelStore store(dir.path());
+  store.attach(&uom);
+  EXPECT_EQ(store.loadStats().snapshotRecords, 2);
+  EXPECT_EQ(store.loadStats().logRecords, 0);
+  auto records = uom.records();
+  ASSERT_EQ(records.size(), 2);
+  EXPECT_EQ(records[0].count, 1);
+}
+
+}  // namespace McBopomofo
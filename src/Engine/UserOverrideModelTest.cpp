@@ -21,9 +21,14 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 // OTHER DEALINGS IN THE SOFTWARE.
 
+#include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "UserOverrideModel.h"
+#include "gramambular2/language_model.h"
+#include "gramambular2/reading_grid.h"
 #include "gtest/gtest.h"
 
 namespace McBopomofo {
@@ -32,6 +37,28 @@ namespace {
 constexpr double kFakeNow = 1657772432;
 constexpr int kCapacity = 5;
 constexpr double kHalflife = 5400.0;  // 1.5 hr.
+
+using Formosa::Gramambular2::LanguageModel;
+using Formosa::Gramambular2::ReadingGrid;
+
+class SingleCharLM : public LanguageModel {
+ public:
+  std::vector<Unigram> getUnigrams(const std::string& reading) override {
+    auto it = values_.find(reading);
+    if (it == values_.end()) {
+      return {};
+    }
+    return {Unigram(it->second, -1.0)};
+  }
+
+  bool hasUnigrams(const std::string& reading) override {
+    return values_.count(reading) > 0;
+  }
+
+ private:
+  std::map<std::string, std::string> values_ = {
+      {"a", "A"}, {"b", "B"}, {"c", "C"}, {"_,", ","}};
+};
 }  // namespace
 
 TEST(UserOverrideModelTest, BasicOperation) {
@@ -119,4 +146,95 @@ TEST(UserOverrideModelTest, LRUBehavior) {
   ASSERT_TRUE(v.empty());
 }
 
+TEST(UserOverrideModelTest, RecordsRestoreTheModel) {
+  UserOverrideModel uom(2, kHalflife);
+  uom.observe("abc", "x", kFakeNow);
+  uom.observe("def", "y", kFakeNow, /*forceHighScoreOverride=*/true);
+  uom.observe("def", "y", kFakeNow + kHalflife);
+  uom.observe("def", "z", kFakeNow + kHalflife * 2);
+
+  auto records = uom.records();
+  ASSERT_EQ(records.size(), 3);
+  EXPECT_EQ(records[0].keyHash, UserOverrideModel::HashKey("abc"));
+  EXPECT_EQ(records[1].keyHash, UserOverrideModel::HashKey("def"));
+  EXPECT_EQ(records[1].candidate, "y");
+  EXPECT_EQ(records[1].count, 2);
+  EXPECT_EQ(records[1].timestamp, kFakeNow + kHalflife);
+  EXPECT_FALSE(records[1].forceHighScoreOverride);
+
+  UserOverrideModel restored(2, kHalflife);
+  for (const auto& record : records) {
+    restored.restore(record);
+  }
+  double later = kFakeNow + kHalflife * 3;
+  EXPECT_EQ(restored.suggest("abc", later).candidate,
+            uom.suggest("abc", later).candidate);
+  EXPECT_EQ(restored.suggest("def", later).candidate,
+            uom.suggest("def", later).candidate);
+
+  // The order of the keys is kept: abc is still the first to be evicted.
+  restored.observe("ghi", "p", later);
+  EXPECT_TRUE(restored.suggest("abc", later).empty());
+  EXPECT_FALSE(restored.suggest("def", later).empty());
+}
+
+TEST(UserOverrideModelTest, OldestOverrideIsReplacedWhenEntryIsFull) {
+  UserOverrideModel uom(kCapacity, kHalflife);
+  size_t n = UserOverrideModel::kMaxOverridesPerKey;
+  for (size_t i = 0; i < n; i++) {
+    uom.observe("abc", "v" + std::to_string(i), kFakeNow + i);
+  }
+  uom.observe("abc", "v0", kFakeNow + n);
+  uom.observe("abc", "new", kFakeNow + n + 1);
+
+  auto records = uom.records();
+  ASSERT_EQ(records.size(), n);
+  for (const auto& record : records) {
+    // v1 was the least recently observed one.
+    EXPECT_NE(record.candidate, "v1");
+  }
+  // v0 has 2 of the n + 1 remaining observations.
+  EXPECT_EQ(uom.suggest("abc", kFakeNow + n + 1).candidate, "v0");
+}
+
+TEST(UserOverrideModelTest, LargeCapacity) {
+  constexpr int kLargeCapacity = 100000;
+  UserOverrideModel uom(kLargeCapacity, kHalflife);
+  for (int i = 0; i < kLargeCapacity + 10; i++) {
+    uom.observe("k" + std::to_string(i), i % 2 ? "odd" : "even", kFakeNow);
+  }
+  EXPECT_EQ(uom.size(), kLargeCapacity);
+
+  // The first ten keys were evicted.
+  for (int i = 0; i < 10; i++) {
+    EXPECT_TRUE(uom.suggest("k" + std::to_string(i), kFakeNow).empty());
+  }
+  for (int i = 10; i < kLargeCapacity + 10; i += 997) {
+    EXPECT_EQ(uom.suggest("k" + std::to_string(i), kFakeNow).candidate,
+              i % 2 ? "odd" : "even");
+  }
+}
+
+TEST(UserOverrideModelTest, WalkKeysMatchStringKeys) {
+  ReadingGrid grid(std::make_shared<SingleCharLM>());
+  grid.insertReading("a");
+  grid.insertReading("b");
+  grid.insertReading("c");
+  auto walk = grid.walk();
+
+  UserOverrideModel uom(kCapacity, kHalflife);
+  uom.observe("(a,A)-(b,B)-(c,C)", "x", kFakeNow);
+  uom.observe("()-(a,A)-(b,B)", "y", kFakeNow);
+  uom.observe("()-()-(a,A)", "z", kFakeNow);
+  EXPECT_EQ(uom.suggest(walk, 3, kFakeNow).candidate, "x");
+  EXPECT_EQ(uom.suggest(walk, 1, kFakeNow).candidate, "y");
+  EXPECT_EQ(uom.suggest(walk, 0, kFakeNow).candidate, "z");
+
+  // A punctuation is treated as the beginning of the sentence.
+  grid.insertReading("_,");
+  grid.insertReading("a");
+  walk = grid.walk();
+  EXPECT_EQ(uom.suggest(walk, 5, kFakeNow).candidate, "z");
+}
+
 }  // namespace McBopomofo
@@ -29,6 +29,7 @@
 #include <unistd.h>
 
 #include <fstream>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -45,6 +46,7 @@ bool UserPhrasesLM::open(const char* path) {
 
 void UserPhrasesLM::close() {
   dictionary_.clear();
+  keyFilter_.clear();
   mmapedFile_.close();
 }
 
@@ -53,14 +55,18 @@ bool UserPhrasesLM::load(const char* data, size_t length) {
     return false;
   }
 
-  return dictionary_.parse(
+  bool result = dictionary_.parse(
       data, length, ByteBlockBackedDictionary::ColumnOrder::VALUE_THEN_KEY);
+  buildKeyFilter();
+  return result;
 }
+
 std::vector<Formosa::Gramambular2::LanguageModel::Unigram>
 UserPhrasesLM::getUnigrams(const std::string& key) {
   std::vector<Formosa::Gramambular2::LanguageModel::Unigram> v;
 
-  std::vector<std::string_view> values = dictionary_.getValues(key);
+  std::span<const std::string_view> values = dictionary_.findValues(key);
+  v.reserve(values.size());
   for (const auto& value : values) {
     v.emplace_back(std::string(value), kUserUnigramScore);
   }
@@ -69,7 +75,15 @@ UserPhrasesLM::getUnigrams(const std::string& key) {
 }
 
 bool UserPhrasesLM::hasUnigrams(const std::string& key) {
-  return dictionary_.hasKey(key);
+  if (!keyFilter_.mayContain(key)) {
+    return false;
+  }
+
+  bool found = dictionary_.hasKey(key);
+  if (!found && !keyFilter_.empty()) {
+    keyFilter_.recordFalsePositive();
+  }
+  return found;
 }
 
 std::vector<ByteBlockBackedDictionary::Issue> UserPhrasesLM::getParsingIssues()
@@ -77,4 +91,19 @@ std::vector<ByteBlockBackedDictionary::Issue> UserPhrasesLM::getParsingIssues()
   return dictionary_.issues();
 }
 
+void UserPhrasesLM::setKeyFilterEnabled(bool enabled) {
+  keyFilterEnabled_ = enabled;
+  buildKeyFilter();
+}
+
+void UserPhrasesLM::buildKeyFilter() {
+  keyFilter_.clear();
+  if (!keyFilterEnabled_ || dictionary_.keyCount() == 0) {
+    return;
+  }
+
+  keyFilter_.reset(dictionary_.keyCount());
+  dictionary_.forEachKey([this](std::string_view key) { keyFilter_.add(key); });
+}
+
 }  // namespace McBopomofo
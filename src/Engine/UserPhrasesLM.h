@@ -26,8 +26,10 @@
 
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "BloomFilter.h"
 #include "ByteBlockBackedDictionary.h"
 #include "MemoryMappedFile.h"
 #include "gramambular2/language_model.h"
@@ -55,11 +57,29 @@ class UserPhrasesLM : public Formosa::Gramambular2::LanguageModel {
 
   std::vector<ByteBlockBackedDictionary::Issue> getParsingIssues() const;
 
+  // Calls the visitor with every key, as a std::string_view.
+  template <typename Visitor>
+  void forEachKey(Visitor&& visitor) const {
+    dictionary_.forEachKey(std::forward<Visitor>(visitor));
+  }
+
+  // When enabled, a Bloom filter of all keys is built whenever data is loaded,
+  // and hasUnigrams() consults it first. See ParselessLM::setKeyFilterEnabled.
+  void setKeyFilterEnabled(bool enabled);
+  [[nodiscard]] bool keyFilterEnabled() const { return keyFilterEnabled_; }
+  [[nodiscard]] const BloomFilter::Stats& keyFilterStats() const {
+    return keyFilter_.stats();
+  }
+
   static constexpr double kUserUnigramScore = 0;
 
  protected:
+  void buildKeyFilter();
+
   MemoryMappedFile mmapedFile_;
   ByteBlockBackedDictionary dictionary_;
+  bool keyFilterEnabled_ = false;
+  BloomFilter keyFilter_;
 };
 
 }  // namespace McBopomofo
@@ -59,4 +59,24 @@ TEST(UserPhrasesLMTest, ValuesContainingSpaces) {
   EXPECT_EQ(results[0].score(), UserPhrasesLM::kUserUnigramScore);
 }
 
+TEST(UserPhrasesLMTest, KeyFilter) {
+  constexpr char kTestData[] = "value1 reading1\nvalue2 reading2";
+
+  UserPhrasesLM lm;
+  lm.setKeyFilterEnabled(true);
+  ASSERT_TRUE(lm.load(kTestData, sizeof(kTestData)));
+  EXPECT_TRUE(lm.hasUnigrams("reading1"));
+  EXPECT_TRUE(lm.hasUnigrams("reading2"));
+  EXPECT_FALSE(lm.hasUnigrams("reading3"));
+  EXPECT_EQ(lm.keyFilterStats().queries, 3);
+  EXPECT_EQ(
+      lm.keyFilterStats().rejections + lm.keyFilterStats().falsePositives, 1);
+
+  // The filter is rebuilt on reload.
+  constexpr char kNewData[] = "value3 reading3";
+  ASSERT_TRUE(lm.load(kNewData, sizeof(kNewData)));
+  EXPECT_TRUE(lm.hasUnigrams("reading3"));
+  EXPECT_FALSE(lm.hasUnigrams("reading1"));
+}
+
 }  // namespace McBopomofo
@@ -24,6 +24,9 @@
 #ifndef SRC_ENGINE_GRAMAMBULAR2_LANGUAGE_MODEL_H_
 #define SRC_ENGINE_GRAMAMBULAR2_LANGUAGE_MODEL_H_
 
+#include <cstdint>
+#include <memory>
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
@@ -39,8 +42,36 @@ class LanguageModel {
 
   // Returns unigrams matching the reading, or an empty vector if none is found.
   virtual std::vector<Unigram> getUnigrams(const std::string& reading) = 0;
+
+  // Same as getUnigrams(), but the result may be shared with the model, so
+  // that a model that caches its results does not have to copy them. The
+  // default implementation wraps getUnigrams().
+  virtual std::shared_ptr<const std::vector<Unigram>> getSharedUnigrams(
+      const std::string& reading);
   virtual bool hasUnigrams(const std::string& reading) = 0;
 
+  // Returns a bitmask in which bit (n - 1) is set if the reading made of the
+  // first n readings, joined by the separator, has unigrams. At most the first
+  // 32 readings are considered. The default implementation calls
+  // hasUnigrams() for each n. Models backed by a sorted database should
+  // override this to share one prefix walk among all n, stopping as soon as
+  // no longer reading can possibly match.
+  virtual uint32_t hasUnigramsForPrefixes(
+      std::span<const std::string> readings, const std::string& separator) {
+    uint32_t result = 0;
+    std::string reading;
+    for (size_t n = 1; n <= readings.size() && n <= 32; ++n) {
+      if (n > 1) {
+        reading += separator;
+      }
+      reading += readings[n - 1];
+      if (hasUnigrams(reading)) {
+        result |= static_cast<uint32_t>(1) << (n - 1);
+      }
+    }
+    return result;
+  }
+
   // An immutable unigram with an actual value, along with a score, which is
   // usually a log probability from a language model.
   class Unigram {
@@ -60,6 +91,11 @@ class LanguageModel {
   };
 };
 
+inline std::shared_ptr<const std::vector<LanguageModel::Unigram>>
+LanguageModel::getSharedUnigrams(const std::string& reading) {
+  return std::make_shared<const std::vector<Unigram>>(getUnigrams(reading));
+}
+
 }  // namespace Formosa::Gramambular2
 
 #endif  // SRC_ENGINE_GRAMAMBULAR2_LANGUAGE_MODEL_H_
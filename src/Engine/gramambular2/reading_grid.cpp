@@ -27,6 +27,7 @@
 #include <chrono>
 #include <limits>
 #include <memory>
+#include <span>
 #include <stack>
 #include <string>
 #include <utility>
@@ -35,13 +36,23 @@
 namespace Formosa::Gramambular2 {
 
 void ReadingGrid::clear() {
+  discardUndoPoints();
   cursor_ = 0;
   readings_.clear();
+  for (const Span& span : spans_) {
+    retireNodesOf(span);
+  }
   spans_.clear();
+  viterbi_.clear();
+  walkValidUntil_ = 0;
 }
 
 void ReadingGrid::setCursor(size_t cursor) {
   assert(cursor <= readings_.size());
+  limitUndoJournal();
+  if (recording_ && cursor != cursor_) {
+    recordCursor();
+  }
   cursor_ = cursor;
 }
 
@@ -50,21 +61,32 @@ void ReadingGrid::setReadingSeparator(const std::string& separator) {
 }
 
 bool ReadingGrid::insertReading(const std::string& reading) {
-  if (reading.empty() || reading == separator_) {
-    return false;
-  }
+  return insertReadings(std::span<const std::string>(&reading, 1));
+}
 
-  if (!lm_.hasUnigrams(reading)) {
+bool ReadingGrid::insertReadings(std::span<const std::string> readings) {
+  if (readings.empty()) {
     return false;
   }
+  for (const std::string& reading : readings) {
+    if (reading.empty() || reading == separator_ ||
+        !lm_.hasUnigrams(reading)) {
+      return false;
+    }
+  }
 
+  limitUndoJournal();
+  if (recording_) {
+    recordCursor();
+    record(Change::Type::kReadingsInserted, cursor_).count = readings.size();
+  }
   readings_.insert(readings_.begin() + static_cast<ptrdiff_t>(cursor_),
-                   reading);
-  expandGridAt(cursor_);
-  update();
+                   readings.begin(), readings.end());
+  expandGridAt(cursor_, readings.size());
+  update(readings.size());
 
   // Cursor must only move after update().
-  ++cursor_;
+  cursor_ += readings.size();
   return true;
 }
 
@@ -73,6 +95,12 @@ bool ReadingGrid::deleteReadingBeforeCursor() {
     return false;
   }
 
+  limitUndoJournal();
+  if (recording_) {
+    recordCursor();
+    record(Change::Type::kReadingsErased, cursor_ - 1)
+        .readings.push_back(readings_[cursor_ - 1]);
+  }
   readings_.erase(readings_.begin() + static_cast<ptrdiff_t>(cursor_ - 1),
                   readings_.begin() + static_cast<ptrdiff_t>(cursor_));
   // Cursor must decrement for grid-shrinking and update to work.
@@ -87,6 +115,11 @@ bool ReadingGrid::deleteReadingAfterCursor() {
     return false;
   }
 
+  limitUndoJournal();
+  if (recording_) {
+    record(Change::Type::kReadingsErased, cursor_)
+        .readings.push_back(readings_[cursor_]);
+  }
   readings_.erase(readings_.begin() + static_cast<ptrdiff_t>(cursor_),
                   readings_.begin() + static_cast<ptrdiff_t>(cursor_ + 1));
   shrinkGridAt(cursor_);
@@ -94,6 +127,24 @@ bool ReadingGrid::deleteReadingAfterCursor() {
   return true;
 }
 
+void ReadingGrid::removeLeadingReadings(size_t count) {
+  assert(count <= readings_.size());
+  if (count == 0) {
+    return;
+  }
+  discardUndoPoints();
+  for (size_t i = 0; i < count; ++i) {
+    retireNodesOf(spans_[i]);
+  }
+  readings_.erase(readings_.begin(),
+                  readings_.begin() + static_cast<ptrdiff_t>(count));
+  spans_.erase(spans_.begin(), spans_.begin() + static_cast<ptrdiff_t>(count));
+  cursor_ = cursor_ > count ? cursor_ - count : 0;
+  // The states are relative to the front of the grid. The remaining buffer
+  // is short in the intended use, so they are simply recomputed.
+  invalidateWalkFrom(0);
+}
+
 std::optional<ReadingGrid::NodePtr> ReadingGrid::findInSpan(
     size_t cursor, const std::function<bool(const NodePtr&)>& predicate) const {
   assert(cursor <= readings_.size());
@@ -111,8 +162,9 @@ std::optional<ReadingGrid::NodePtr> ReadingGrid::findInSpan(
 
 namespace {
 
-int64_t GetEpochNowInMicroseconds() {
-  auto now = std::chrono::system_clock::now();
+// A steady clock, since the time is only used for measuring durations.
+int64_t GetNowInMicroseconds() {
+  auto now = std::chrono::steady_clock::now();
   int64_t timestamp =
       std::chrono::time_point_cast<std::chrono::microseconds>(now)
           .time_since_epoch()
@@ -120,6 +172,15 @@ int64_t GetEpochNowInMicroseconds() {
   return timestamp;
 }
 
+// One of the k best partial paths that end at a position, and where it comes
+// from: the fromRank-th best path at fromIndex, followed by fromNode.
+struct RankedState {
+  double score = -std::numeric_limits<double>::infinity();
+  size_t fromIndex = 0;
+  size_t fromRank = 0;
+  ReadingGrid::NodePtr fromNode = nullptr;
+};
+
 }  // namespace
 
 // Find the weightiest path in the grid graph. The path represents the most
@@ -130,39 +191,58 @@ int64_t GetEpochNowInMicroseconds() {
 // probability a larger value means a larger probability. The algorithm runs in
 // O(|V| + |E|) time for G = (V, E) where G is a DAG. This means the walk is
 // fairly economical even when the grid is large.
+//
+// The table is kept between walks. Since edges only point forward, the state
+// at index i only depends on the nodes in the spans before i, and so a change
+// to the span at d leaves the states up to d intact. Only the states past d
+// are recomputed, from the edges that land on them.
 ReadingGrid::WalkResult ReadingGrid::walk() {
   WalkResult result;
   if (spans_.empty()) {
     return result;
   }
-  int64_t start = GetEpochNowInMicroseconds();
+  int64_t start = GetNowInMicroseconds();
 
-  // Defines a state in the DP table. This structure tracks the maximum
-  // accumulated score and the back-pointer required for path reconstruction in
-  // the Viterbi algorithm.
-  struct State {
-    size_t fromIndex = 0;
-    ReadingGrid::NodePtr fromNode = nullptr;
-    double maxScore = -std::numeric_limits<double>::infinity();
-  };
+  // The nodes removed before the last walk are no longer in any result that
+  // the caller should still hold.
+  freeNodes_.insert(freeNodes_.end(), retiredBeforeLastWalk_.begin(),
+                    retiredBeforeLastWalk_.end());
+  retiredBeforeLastWalk_.clear();
+  retiredBeforeLastWalk_.swap(retiredNodes_);
 
   const size_t readingLen = readings_.size();
-  std::vector<State> viterbi(readingLen + 1);
-  viterbi[0].maxScore = 0.0;
+  const size_t validUntil = std::min(walkValidUntil_, readingLen);
+  viterbi_.resize(readingLen + 1);
+  if (validUntil == 0) {
+    viterbi_[0] = ViterbiState();
+    viterbi_[0].maxScore = 0.0;
+  }
+  for (size_t i = validUntil + 1; i <= readingLen; ++i) {
+    viterbi_[i] = ViterbiState();
+  }
+  result.reusedStates = validUntil;
 
   // Iterate through the grid and compute the maximum accumulated score for each
   // reachable position. Since the grid is a lattice where edges only point
   // forward, processing nodes in index order is equivalent to processing them
-  // in topological order.
+  // in topological order. The edges that land on the recomputed states may
+  // start as far as (kMaximumSpanLength - 1) spans before them, and are relaxed
+  // in the same order as in a full walk.
   size_t reachableStates = 0;
   size_t evaluatedEdges = 0;
-  for (size_t i = 0; i < readingLen; ++i) {
-    ++reachableStates;
+  size_t first = validUntil - std::min(validUntil, kMaximumSpanLength - 1);
+  for (size_t i = first; i < readingLen; ++i) {
+    if (i >= validUntil) {
+      ++reachableStates;
+    }
 
     const ReadingGrid::Span& span = spans_[i];
     const size_t maxSpanLen = span.maxLength();
 
     for (size_t spanLen = 1; spanLen <= maxSpanLen; ++spanLen) {
+      if (i + spanLen <= validUntil) {
+        continue;
+      }
       const ReadingGrid::NodePtr& node = span.nodeOf(spanLen);
       if (node == nullptr) {
         continue;
@@ -173,8 +253,8 @@ ReadingGrid::WalkResult ReadingGrid::walk() {
       // state if the path through the current node yields a higher score than
       // the previously known best path. This is the core operation of the
       // Viterbi algorithm, adapted for finding the maximum likelihood path.
-      double score = viterbi[i].maxScore + node->score();
-      State& target = viterbi[i + spanLen];
+      double score = viterbi_[i].maxScore + node->score();
+      ViterbiState& target = viterbi_[i + spanLen];
       if (score > target.maxScore) {
         target.maxScore = score;
         target.fromNode = node;
@@ -186,25 +266,146 @@ ReadingGrid::WalkResult ReadingGrid::walk() {
   // Edges are the candidate word transitions
   result.vertices = reachableStates;
   result.edges = evaluatedEdges;
+  walkValidUntil_ = readingLen;
 
   // Reconstruct the most likely path by tracing back from the end of the grid
   // to the root using the back-pointers
   size_t totalReadingLen = 0;
-  for (size_t curr = readingLen; curr > 0; curr = viterbi[curr].fromIndex) {
-    assert(viterbi[curr].fromNode != nullptr);
-    totalReadingLen += viterbi[curr].fromNode->spanningLength();
-    result.nodes.emplace_back(std::move(viterbi[curr].fromNode));
+  for (size_t curr = readingLen; curr > 0; curr = viterbi_[curr].fromIndex) {
+    assert(viterbi_[curr].fromNode != nullptr);
+    totalReadingLen += viterbi_[curr].fromNode->spanningLength();
+    result.nodes.emplace_back(viterbi_[curr].fromNode);
   }
   std::reverse(result.nodes.begin(), result.nodes.end());
   assert(totalReadingLen == readingLen);
   result.totalReadings = totalReadingLen;
+  result.score = viterbi_[readingLen].maxScore;
 
-  result.elapsedMicroseconds = GetEpochNowInMicroseconds() - start;
+  result.elapsedMicroseconds = GetNowInMicroseconds() - start;
   return result;
 }
 
+// A k-best variant of the walk above. Each position keeps up to k best
+// partial paths, sorted by score, instead of one. An edge is relaxed against
+// each of the paths of its source, and the ones that beat the worst path at
+// the destination are inserted there. Since the paths at the source are
+// sorted, the relaxation stops at the first one that does not. This runs in
+// O(k * (|V| + |E|)) time. Ties are broken like in walk(): a path that comes
+// later never displaces an earlier one with the same score, which is why the
+// best path found here is the same as the one walk() finds.
+std::vector<ReadingGrid::WalkResult> ReadingGrid::walkNBest(size_t k) {
+  std::vector<WalkResult> results;
+  if (spans_.empty() || k == 0) {
+    return results;
+  }
+  int64_t start = GetNowInMicroseconds();
+
+  const size_t readingLen = readings_.size();
+  std::vector<RankedState> states((readingLen + 1) * k);
+  std::vector<size_t> counts(readingLen + 1, 0);
+  states[0].score = 0.0;
+  counts[0] = 1;
+
+  size_t reachableStates = 0;
+  size_t evaluatedEdges = 0;
+  for (size_t i = 0; i < readingLen; ++i) {
+    if (counts[i] == 0) {
+      continue;
+    }
+    ++reachableStates;
+    const RankedState* sources = &states[i * k];
+
+    const ReadingGrid::Span& span = spans_[i];
+    for (size_t spanLen = 1; spanLen <= span.maxLength(); ++spanLen) {
+      const ReadingGrid::NodePtr& node = span.nodeOf(spanLen);
+      if (node == nullptr) {
+        continue;
+      }
+      ++evaluatedEdges;
+
+      const double nodeScore = node->score();
+      RankedState* targets = &states[(i + spanLen) * k];
+      size_t& targetCount = counts[i + spanLen];
+      for (size_t rank = 0; rank < counts[i]; ++rank) {
+        double score = sources[rank].score + nodeScore;
+        if (targetCount == k && score <= targets[k - 1].score) {
+          break;
+        }
+        // Insert after the paths with the same or a higher score.
+        size_t pos = targetCount < k ? targetCount : k - 1;
+        while (pos > 0 && targets[pos - 1].score < score) {
+          targets[pos] = targets[pos - 1];
+          --pos;
+        }
+        targets[pos] = {score, i, rank, node};
+        targetCount = std::min(targetCount + 1, k);
+      }
+    }
+  }
+
+  const uint64_t elapsed = GetNowInMicroseconds() - start;
+  for (size_t rank = 0; rank < counts[readingLen]; ++rank) {
+    WalkResult& result = results.emplace_back();
+    result.score = states[readingLen * k + rank].score;
+    size_t curr = readingLen;
+    size_t currRank = rank;
+    while (curr > 0) {
+      const RankedState& state = states[curr * k + currRank];
+      result.nodes.emplace_back(state.fromNode);
+      curr = state.fromIndex;
+      currRank = state.fromRank;
+    }
+    std::reverse(result.nodes.begin(), result.nodes.end());
+    result.totalReadings = readingLen;
+    result.vertices = reachableStates;
+    result.edges = evaluatedEdges;
+    result.elapsedMicroseconds = elapsed;
+  }
+  return results;
+}
+
+size_t ReadingGrid::settledPrefixLength(size_t loc) const {
+  assert(walkValidUntil_ == readings_.size());
+  if (loc > readings_.size() || viterbi_.size() != readings_.size() + 1) {
+    return 0;
+  }
+
+  // Trace back from all the states in the window at once, always moving the
+  // ones furthest ahead, until they meet.
+  std::array<size_t, kMaximumSpanLength> positions{};
+  size_t count = 0;
+  for (size_t i = loc - std::min(loc, kMaximumSpanLength - 1); i <= loc; ++i) {
+    positions[count++] = i;
+  }
+  while (true) {
+    size_t front =
+        *std::max_element(positions.begin(), positions.begin() + count);
+    size_t back =
+        *std::min_element(positions.begin(), positions.begin() + count);
+    if (front == back) {
+      return front;
+    }
+    for (size_t j = 0; j < count; ++j) {
+      if (positions[j] == front) {
+        positions[j] = viterbi_[front].fromIndex;
+      }
+    }
+  }
+}
+
 std::vector<ReadingGrid::Candidate> ReadingGrid::candidatesAt(size_t loc) {
   std::vector<ReadingGrid::Candidate> result;
+  for (const NodePtr& node : candidateNodesAt(loc)) {
+    for (const LanguageModel::Unigram& unigram : node->unigrams()) {
+      result.emplace_back(node->reading(), unigram.value(), unigram.rawValue());
+    }
+  }
+  return result;
+}
+
+std::vector<ReadingGrid::NodePtr> ReadingGrid::candidateNodesAt(
+    size_t loc) const {
+  std::vector<NodePtr> result;
   if (readings_.empty()) {
     return result;
   }
@@ -222,11 +423,9 @@ std::vector<ReadingGrid::Candidate> ReadingGrid::candidatesAt(size_t loc) {
         return n1.node->spanningLength() > n2.node->spanningLength();
       });
 
+  result.reserve(nodes.size());
   for (const NodeInSpan& nodeInSpan : nodes) {
-    for (const LanguageModel::Unigram& unigram : nodeInSpan.node->unigrams()) {
-      result.emplace_back(nodeInSpan.node->reading(), unigram.value(),
-                          unigram.rawValue());
-    }
+    result.push_back(nodeInSpan.node);
   }
   return result;
 }
@@ -244,19 +443,29 @@ bool ReadingGrid::overrideCandidate(
   return overrideCandidate(loc, nullptr, candidate, overrideType);
 }
 
-void ReadingGrid::expandGridAt(size_t loc) {
+void ReadingGrid::expandGridAt(size_t loc, size_t count) {
+  // The states past loc now stand for different positions.
+  invalidateWalkFrom(loc);
+  if (recording_) {
+    record(Change::Type::kSpansInserted, loc).count = count;
+  }
   if (!loc || loc == spans_.size()) {
-    spans_.insert(spans_.begin() + static_cast<ptrdiff_t>(loc), Span());
+    spans_.insert(spans_.begin() + static_cast<ptrdiff_t>(loc), count, Span());
     return;
   }
-  spans_.insert(spans_.begin() + static_cast<ptrdiff_t>(loc), Span());
+  spans_.insert(spans_.begin() + static_cast<ptrdiff_t>(loc), count, Span());
   removeAffectedNodes(loc);
 }
 
 void ReadingGrid::shrinkGridAt(size_t loc) {
+  invalidateWalkFrom(loc);
   if (loc == spans_.size()) {
     return;
   }
+  retireNodesOf(spans_[loc]);
+  if (recording_) {
+    record(Change::Type::kSpanErased, loc).span = spans_[loc];
+  }
   spans_.erase(spans_.begin() + static_cast<ptrdiff_t>(loc));
   removeAffectedNodes(loc);
 }
@@ -298,19 +507,33 @@ void ReadingGrid::removeAffectedNodes(size_t loc) {
   size_t begin = loc <= affectedLength ? 0 : loc - affectedLength;
   size_t end = loc >= 1 ? loc - 1 : 0;
   for (size_t i = begin; i <= end; ++i) {
+    if (recording_ && spans_[i].maxLength() >= loc - i + 1) {
+      recordSpan(i);
+    }
+    retireNodesOf(spans_[i], loc - i + 1);
     spans_[i].removeNodesOfOrLongerThan(loc - i + 1);
   }
 }
 
 void ReadingGrid::insert(size_t loc, const ReadingGrid::NodePtr& node) {
   assert(loc < spans_.size());
+  if (recording_) {
+    recordSpan(loc);
+  }
+  retireNode(spans_[loc].nodeOf(node->spanningLength()));
   spans_[loc].add(node);
+  invalidateWalkFrom(loc);
 }
 
 std::string ReadingGrid::combineReading(
     std::vector<std::string>::const_iterator begin,
     std::vector<std::string>::const_iterator end) {
   std::string result;
+  size_t length = 0;
+  for (auto iter = begin; iter != end; ++iter) {
+    length += iter->length() + separator_.length();
+  }
+  result.reserve(length);
   for (auto iter = begin; iter != end;) {
     result += *iter;
     ++iter;
@@ -333,25 +556,37 @@ bool ReadingGrid::hasNodeAt(size_t loc, size_t readingLen,
   return reading == n->reading();
 }
 
-void ReadingGrid::update() {
+void ReadingGrid::update(size_t count) {
   size_t begin =
       (cursor_ <= kMaximumSpanLength) ? 0 : cursor_ - kMaximumSpanLength;
-  size_t end = cursor_ + kMaximumSpanLength;
+  size_t end = cursor_ + (count > 0 ? count - 1 : 0) + kMaximumSpanLength;
   end = std::min(end, readings_.size());
 
   for (size_t pos = begin; pos < end; pos++) {
-    for (size_t len = 1; len <= kMaximumSpanLength && pos + len <= end; len++) {
+    // Find out which span lengths have unigrams in one pass, so that lengths
+    // without any are skipped without a lookup each.
+    size_t maxLen = std::min(kMaximumSpanLength, end - pos);
+    uint32_t lengths = lm_.hasUnigramsForPrefixes(
+        std::span<const std::string>(readings_).subspan(pos, maxLen),
+        separator_);
+
+    for (size_t len = 1; len <= maxLen; len++) {
+      if ((lengths & (static_cast<uint32_t>(1) << (len - 1))) == 0) {
+        continue;
+      }
+
       std::string combinedReading =
           combineReading(readings_.begin() + static_cast<ptrdiff_t>(pos),
                          readings_.begin() + static_cast<ptrdiff_t>(pos + len));
 
       if (!hasNodeAt(pos, len, combinedReading)) {
-        auto unigrams = lm_.getUnigrams(combinedReading);
-        if (unigrams.empty()) {
+        auto unigrams = lm_.getSharedUnigrams(combinedReading);
+        if (unigrams->empty()) {
           continue;
         }
 
-        insert(pos, std::make_shared<Node>(combinedReading, len, unigrams));
+        insert(pos, makeNode(std::move(combinedReading), len,
+                             std::move(unigrams)));
       }
     }
   }
@@ -363,6 +598,7 @@ bool ReadingGrid::overrideCandidate(
   if (loc > readings_.size()) {
     return false;
   }
+  limitUndoJournal();
 
   std::vector<NodeInSpan> overlappingNodes =
       overlappingNodesAt(loc == readings_.size() ? loc - 1 : loc);
@@ -372,16 +608,24 @@ bool ReadingGrid::overrideCandidate(
       continue;
     }
 
+    if (recording_) {
+      recordOverride(nis.node, nis.spanIndex);
+    }
     if (nis.node->selectOverrideUnigram(value, overrideType)) {
       overridden = nis;
       break;
     }
+    // The node is unchanged, so there is nothing to undo.
+    if (recording_) {
+      changes_.pop_back();
+    }
   }
 
   if (overridden.node == nullptr) {
     // Nothing gets overridden.
     return false;
   }
+  invalidateWalkFrom(overridden.spanIndex);
 
   for (size_t i = overridden.spanIndex;
        i < overridden.spanIndex + overridden.node->spanningLength() &&
@@ -395,13 +639,190 @@ bool ReadingGrid::overrideCandidate(
     std::vector<NodeInSpan> nodes = overlappingNodesAt(i);
     for (NodeInSpan& nis : nodes) {
       if (nis.node != overridden.node) {
+        if (recording_) {
+          recordOverride(nis.node, nis.spanIndex);
+        }
         nis.node->reset();
+        invalidateWalkFrom(nis.spanIndex);
       }
     }
   }
   return true;
 }
 
+ReadingGrid::NodePtr ReadingGrid::makeNode(
+    std::string reading, size_t spanningLength,
+    std::shared_ptr<const std::vector<LanguageModel::Unigram>> unigrams) {
+  NodePtr node;
+  if (freeNodes_.empty()) {
+    node = &nodeArena_.emplace_back(std::move(reading), spanningLength,
+                                    std::move(unigrams));
+  } else {
+    node = freeNodes_.back();
+    freeNodes_.pop_back();
+    node->assign(std::move(reading), spanningLength, std::move(unigrams));
+  }
+  if (recording_) {
+    record(Change::Type::kNodeMade).node = node;
+  }
+  return node;
+}
+
+void ReadingGrid::retireNode(NodePtr node) {
+  if (node == nullptr) {
+    return;
+  }
+  if (recording_) {
+    record(Change::Type::kNodeRetired).node = node;
+    return;
+  }
+  retiredNodes_.push_back(node);
+}
+
+void ReadingGrid::retireNodesOf(const Span& span, size_t fromLength) {
+  for (size_t len = fromLength; len <= span.maxLength(); ++len) {
+    retireNode(span.nodeOf(len));
+  }
+}
+
+ReadingGrid::UndoPoint& ReadingGrid::UndoPoint::operator=(
+    UndoPoint&& other) noexcept {
+  if (this != &other) {
+    release();
+    grid_ = std::exchange(other.grid_, nullptr);
+    generation_ = other.generation_;
+    position_ = other.position_;
+    lastSerial_ = other.lastSerial_;
+  }
+  return *this;
+}
+
+void ReadingGrid::UndoPoint::release() {
+  ReadingGrid* grid = std::exchange(grid_, nullptr);
+  if (grid == nullptr || grid->generation_ != generation_) {
+    return;
+  }
+  assert(grid->liveUndoPoints_ > 0);
+  if (--grid->liveUndoPoints_ == 0) {
+    grid->discardUndoPoints();
+  }
+}
+
+ReadingGrid::UndoPoint ReadingGrid::markUndoPoint() {
+  recording_ = true;
+  ++liveUndoPoints_;
+  UndoPoint point;
+  point.grid_ = this;
+  point.generation_ = generation_;
+  point.position_ = changes_.size();
+  point.lastSerial_ = changes_.empty() ? 0 : changes_.back().serial;
+  return point;
+}
+
+bool ReadingGrid::undoTo(const UndoPoint& point) {
+  if (point.grid_ != this || !recording_ ||
+      point.generation_ != generation_ || point.position_ > changes_.size()) {
+    return false;
+  }
+  // The change before the point is replaced if an earlier point has been
+  // undone to and the grid has changed since.
+  if (point.position_ > 0 &&
+      changes_[point.position_ - 1].serial != point.lastSerial_) {
+    return false;
+  }
+  while (changes_.size() > point.position_) {
+    undo(changes_.back());
+    changes_.pop_back();
+  }
+  return true;
+}
+
+void ReadingGrid::discardUndoPoints() {
+  for (const Change& change : changes_) {
+    if (change.type == Change::Type::kNodeRetired) {
+      retiredNodes_.push_back(change.node);
+    }
+  }
+  changes_.clear();
+  recording_ = false;
+  liveUndoPoints_ = 0;
+  ++generation_;
+}
+
+void ReadingGrid::limitUndoJournal() {
+  if (recording_ && changes_.size() >= kMaxUndoChanges) {
+    discardUndoPoints();
+  }
+}
+
+ReadingGrid::Change& ReadingGrid::record(Change::Type type, size_t index) {
+  assert(recording_);
+  Change& change = changes_.emplace_back();
+  change.type = type;
+  change.serial = nextSerial_++;
+  change.index = index;
+  return change;
+}
+
+void ReadingGrid::recordCursor() {
+  record(Change::Type::kCursorMoved, cursor_);
+}
+
+void ReadingGrid::recordSpan(size_t loc) {
+  record(Change::Type::kSpanChanged, loc).span = spans_[loc];
+}
+
+void ReadingGrid::recordOverride(NodePtr node, size_t spanIndex) {
+  Change& change = record(Change::Type::kNodeOverridden, spanIndex);
+  change.node = node;
+  change.overrideType = node->overrideType_;
+  change.unigramIndex = node->unigramIter_ - node->unigrams_->begin();
+}
+
+void ReadingGrid::undo(const Change& change) {
+  const auto index = static_cast<ptrdiff_t>(change.index);
+  switch (change.type) {
+    case Change::Type::kCursorMoved:
+      cursor_ = change.index;
+      return;
+    case Change::Type::kReadingsInserted:
+      readings_.erase(readings_.begin() + index,
+                      readings_.begin() + index +
+                          static_cast<ptrdiff_t>(change.count));
+      return;
+    case Change::Type::kReadingsErased:
+      readings_.insert(readings_.begin() + index, change.readings.begin(),
+                       change.readings.end());
+      return;
+    case Change::Type::kSpansInserted:
+      spans_.erase(spans_.begin() + index,
+                   spans_.begin() + index +
+                       static_cast<ptrdiff_t>(change.count));
+      break;
+    case Change::Type::kSpanErased:
+      spans_.insert(spans_.begin() + index, change.span);
+      break;
+    case Change::Type::kSpanChanged:
+      spans_[change.index] = change.span;
+      break;
+    case Change::Type::kNodeMade:
+      // The node did not exist at the undo point. It may still be in a walk
+      // result, so it goes through the usual retirement.
+      retiredNodes_.push_back(change.node);
+      return;
+    case Change::Type::kNodeRetired:
+      // The node is put back by the span change recorded with it.
+      return;
+    case Change::Type::kNodeOverridden:
+      change.node->overrideType_ = change.overrideType;
+      change.node->unigramIter_ =
+          change.node->unigrams_->begin() +
+          static_cast<ptrdiff_t>(change.unigramIndex);
+      break;
+  }
+  invalidateWalkFrom(change.index);
+}
+
 std::vector<ReadingGrid::NodeInSpan> ReadingGrid::overlappingNodesAt(
     size_t loc) const {
   std::vector<ReadingGrid::NodeInSpan> results;
@@ -435,16 +856,26 @@ std::vector<ReadingGrid::NodeInSpan> ReadingGrid::overlappingNodesAt(
   return results;
 }
 
+void ReadingGrid::Node::assign(
+    std::string reading, size_t spanningLength,
+    std::shared_ptr<const std::vector<LanguageModel::Unigram>> unigrams) {
+  reading_ = std::move(reading);
+  spanningLength_ = spanningLength;
+  unigrams_ = std::move(unigrams);
+  unigramIter_ = unigrams_->begin();
+  overrideType_ = OverrideType::kNone;
+}
+
 LanguageModel::Unigram ReadingGrid::Node::currentUnigram() const {
-  return unigrams_.empty() ? LanguageModel::Unigram{} : *unigramIter_;
+  return unigrams_->empty() ? LanguageModel::Unigram{} : *unigramIter_;
 }
 
 std::string ReadingGrid::Node::value() const {
-  return unigrams_.empty() ? "" : unigramIter_->value();
+  return unigrams_->empty() ? "" : unigramIter_->value();
 }
 
 double ReadingGrid::Node::score() const {
-  if (unigrams_.empty()) {
+  if (unigrams_->empty()) {
     return 0;
   }
 
@@ -452,7 +883,7 @@ double ReadingGrid::Node::score() const {
     case OverrideType::kOverrideValueWithHighScore:
       return kOverridingScore;
     case OverrideType::kOverrideValueWithScoreFromTopUnigram:
-      return unigrams_[0].score();
+      return (*unigrams_)[0].score();
     case OverrideType::kNone:
     default:
       return unigramIter_->score();
@@ -464,14 +895,14 @@ bool ReadingGrid::Node::isOverridden() const {
 }
 
 void ReadingGrid::Node::reset() {
-  unigramIter_ = unigrams_.begin();
+  unigramIter_ = unigrams_->begin();
   overrideType_ = OverrideType::kNone;
 }
 
 bool ReadingGrid::Node::selectOverrideUnigram(
     const std::string& value, ReadingGrid::Node::OverrideType type) {
   assert(type != ReadingGrid::Node::OverrideType::kNone);
-  for (auto it = unigrams_.begin(), end = unigrams_.end(); it != end; ++it) {
+  for (auto it = unigrams_->begin(), end = unigrams_->end(); it != end; ++it) {
     if (value == it->value()) {
       unigramIter_ = it;
       overrideType_ = type;
@@ -591,9 +1022,29 @@ ReadingGrid::ScoreRankedLanguageModel::getUnigrams(const std::string& reading) {
   return unigrams;
 }
 
+std::shared_ptr<const std::vector<LanguageModel::Unigram>>
+ReadingGrid::ScoreRankedLanguageModel::getSharedUnigrams(
+    const std::string& reading) {
+  auto byScore = [](const auto& u1, const auto& u2) {
+    return u1.score() > u2.score();
+  };
+  auto unigrams = lm_->getSharedUnigrams(reading);
+  if (std::is_sorted(unigrams->begin(), unigrams->end(), byScore)) {
+    return unigrams;
+  }
+  auto ranked = *unigrams;
+  std::stable_sort(ranked.begin(), ranked.end(), byScore);
+  return std::make_shared<const std::vector<Unigram>>(std::move(ranked));
+}
+
 bool ReadingGrid::ScoreRankedLanguageModel::hasUnigrams(
     const std::string& reading) {
   return lm_->hasUnigrams(reading);
 }
 
+uint32_t ReadingGrid::ScoreRankedLanguageModel::hasUnigramsForPrefixes(
+    std::span<const std::string> readings, const std::string& separator) {
+  return lm_->hasUnigramsForPrefixes(readings, separator);
+}
+
 }  // namespace Formosa::Gramambular2
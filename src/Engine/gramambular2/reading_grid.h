@@ -24,12 +24,16 @@
 #ifndef SRC_ENGINE_GRAMAMBULAR2_READING_GRID_H_
 #define SRC_ENGINE_GRAMAMBULAR2_READING_GRID_H_
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstdint>
+#include <deque>
 #include <functional>
+#include <limits>
 #include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
@@ -54,6 +58,10 @@ class ReadingGrid {
   explicit ReadingGrid(std::shared_ptr<LanguageModel> lm)
       : lm_(std::move(lm)) {}
 
+  // The nodes are owned by the grid, and the spans point into them.
+  ReadingGrid(const ReadingGrid&) = delete;
+  ReadingGrid& operator=(const ReadingGrid&) = delete;
+
   void clear();
 
   [[nodiscard]] size_t length() const { return readings_.size(); }
@@ -68,6 +76,13 @@ class ReadingGrid {
 
   bool insertReading(const std::string& reading);
 
+  // Inserts a sequence of readings at the cursor, as if each were inserted by
+  // insertReading(), and moves the cursor past them. The spans are expanded
+  // once and the nodes are built in one pass over the affected window, so
+  // this is linear in the number of readings. Either all readings are
+  // inserted, or, if any of them would be rejected by insertReading(), none.
+  bool insertReadings(std::span<const std::string> readings);
+
   // Delete the reading before the cursor, like Backspace. Cursor will decrement
   // by one.
   bool deleteReadingBeforeCursor();
@@ -75,6 +90,61 @@ class ReadingGrid {
   // Delete the reading after the cursor, like Del. Cursor is unmoved.
   bool deleteReadingAfterCursor();
 
+  // Removes the first count readings, and moves the cursor back by as many.
+  // The nodes that span across count are removed as well. This is for
+  // committing the front of a long buffer; see settledPrefixLength().
+  void removeLeadingReadings(size_t count);
+
+  // The grid keeps an undo journal while there are undo points. Marking an
+  // undo point is O(1): it only starts recording the changes made to the grid
+  // from then on. Undoing to a point reverts those changes in reverse, so it
+  // takes time in proportion to the changes and not to the grid. Nothing is
+  // copied, and a point cannot be read; it can only be returned to. While
+  // recording, a node removed from the grid is kept, along with its override,
+  // until the journal is discarded.
+  //
+  // The journal is discarded, and recording stops, when the last undo point
+  // is released, when discardUndoPoints() is called, and when it grows past
+  // kMaxUndoChanges changes. An undo point must not outlive its grid.
+  class UndoPoint {
+   public:
+    UndoPoint() = default;
+    UndoPoint(UndoPoint&& other) noexcept { *this = std::move(other); }
+    UndoPoint& operator=(UndoPoint&& other) noexcept;
+    UndoPoint(const UndoPoint&) = delete;
+    UndoPoint& operator=(const UndoPoint&) = delete;
+    ~UndoPoint() { release(); }
+
+    // Gives up the point. The grid stops recording once no point is left.
+    void release();
+
+   private:
+    friend class ReadingGrid;
+    ReadingGrid* grid_ = nullptr;
+    uint64_t generation_ = 0;
+    size_t position_ = 0;
+    uint64_t lastSerial_ = 0;
+  };
+
+  static constexpr size_t kMaxUndoChanges = 4096;
+
+  UndoPoint markUndoPoint();
+
+  // Reverts the readings, the nodes, their overrides, and the cursor to what
+  // they were when the point was marked. Returns false if the point is no
+  // longer valid: when it has been released, when the journal has been
+  // discarded, or when an earlier point has been undone to and the grid has
+  // changed since. The points marked before the one undone to stay valid.
+  bool undoTo(const UndoPoint& point);
+
+  // Invalidates all undo points, stops recording, and releases the nodes kept
+  // for the journal. clear() and removeLeadingReadings() also do this, since
+  // what they remove cannot be brought back.
+  void discardUndoPoints();
+
+  // The number of changes in the undo journal. For testing.
+  [[nodiscard]] size_t undoJournalSize() const { return changes_.size(); }
+
   static constexpr size_t kMaximumSpanLength = 8;
   static constexpr char kDefaultSeparator[] = "-";
 
@@ -105,17 +175,36 @@ class ReadingGrid {
 
     Node(std::string reading, size_t spanningLength,
          std::vector<LanguageModel::Unigram> unigrams)
+        : Node(std::move(reading), spanningLength,
+               std::make_shared<const std::vector<LanguageModel::Unigram>>(
+                   std::move(unigrams))) {}
+
+    // The unigrams may be shared with the language model's cache.
+    Node(std::string reading, size_t spanningLength,
+         std::shared_ptr<const std::vector<LanguageModel::Unigram>> unigrams)
         : reading_(std::move(reading)),
           spanningLength_(spanningLength),
           unigrams_(std::move(unigrams)),
-          unigramIter_(unigrams_.begin()),
+          unigramIter_(unigrams_->begin()),
           overrideType_(OverrideType::kNone) {}
 
+    // The unigram iterator points into the node's own unigrams, so a node
+    // cannot be copied; the grid reuses its nodes instead.
+    Node(const Node&) = delete;
+    Node& operator=(const Node&) = delete;
+
     [[nodiscard]] const std::string& reading() const { return reading_; }
 
     [[nodiscard]] size_t spanningLength() const { return spanningLength_; }
 
     [[nodiscard]] const std::vector<LanguageModel::Unigram>& unigrams() const {
+      return *unigrams_;
+    }
+
+    // The unigrams, for holding on to them after the node is removed from the
+    // grid or recycled.
+    [[nodiscard]] std::shared_ptr<const std::vector<LanguageModel::Unigram>>
+    sharedUnigrams() const {
       return unigrams_;
     }
 
@@ -128,10 +217,6 @@ class ReadingGrid {
 
     [[nodiscard]] bool isOverridden() const;
 
-    void reset();
-
-    bool selectOverrideUnigram(const std::string& value, OverrideType type);
-
     // A sufficiently high score to cause the walk to go through an overriding
     // node. Although this can be 0, setting it to a positive value has the
     // desirable side effect that it reduces the competition of "free-floating"
@@ -145,15 +230,34 @@ class ReadingGrid {
     // A->B, which gives "c" a better chance.
     static constexpr double kOverridingScore = 42;
 
-   protected:
-    const std::string reading_;
-    const size_t spanningLength_;
-    const std::vector<LanguageModel::Unigram> unigrams_;
+   private:
+    friend class ReadingGrid;
+
+    // Only the grid may change the override of a node, through
+    // ReadingGrid::overrideCandidate(), as it has to know which parts of the
+    // walk to redo.
+    void reset();
+
+    bool selectOverrideUnigram(const std::string& value, OverrideType type);
+
+    // Turns a recycled node into a new one.
+    void assign(
+        std::string reading, size_t spanningLength,
+        std::shared_ptr<const std::vector<LanguageModel::Unigram>> unigrams);
+
+    std::string reading_;
+    size_t spanningLength_;
+    std::shared_ptr<const std::vector<LanguageModel::Unigram>> unigrams_;
     std::vector<LanguageModel::Unigram>::const_iterator unigramIter_;
     OverrideType overrideType_;
   };
 
-  using NodePtr = std::shared_ptr<Node>;
+  // A non-owning pointer to a node in the grid's node arena. A node removed
+  // from the grid, by a reading change nearby or by clear(), is only recycled
+  // at the second walk() after its removal, so a WalkResult stays valid
+  // through the next walk(). This allows comparing a walk with the one before
+  // it, which is what the user override model does.
+  using NodePtr = Node*;
 
   // Find, in a span at the cursor, the first node satisfying the predicate.
   // Returns std::nullopt if not found.
@@ -164,9 +268,14 @@ class ReadingGrid {
   struct WalkResult {
     std::vector<NodePtr> nodes;
     size_t totalReadings = 0;
+    // The states computed and the edges relaxed by this walk.
     size_t vertices = 0;
     size_t edges = 0;
+    // The states carried over from the previous walk. See walk().
+    size_t reusedStates = 0;
     uint64_t elapsedMicroseconds = 0;
+    // The accumulated score of the nodes on the path.
+    double score = 0;
 
     // Convenient method for finding the node at the cursor. Returns
     // nodes.cend() if the value of cursor argument doesn't make sense. An
@@ -180,8 +289,29 @@ class ReadingGrid {
     std::vector<std::string> readingsAsStrings() const;
   };
 
+  // Walks the grid. The Viterbi states are kept between walks, and only the
+  // states past the earliest span changed since the last walk (by inserting
+  // or deleting readings, or by overriding candidates) are recomputed. Typing
+  // at the end of a long buffer therefore only recomputes a window of about
+  // kMaximumSpanLength states.
   WalkResult walk();
 
+  // Returns up to k distinct paths through the grid, best first. The first
+  // path is the one walk() returns. Different paths may still have the same
+  // values, for example "高科" + "技" and "高" + "科技". The vertices, edges
+  // and elapsed time of every result describe the whole enumeration. This
+  // does not use or update the states kept by walk().
+  std::vector<WalkResult> walkNBest(size_t k);
+
+  // Returns the number of readings at the front that the last walk has
+  // settled: no edit at or after loc can change the nodes the walk chose for
+  // them. Any path through the grid passes through one of the states in the
+  // kMaximumSpanLength positions up to loc, and those states only depend on
+  // the readings before loc, so the result is where the best paths to all of
+  // those states merge. It is always at a node boundary of the last walk.
+  // Must be called right after walk().
+  [[nodiscard]] size_t settledPrefixLength(size_t loc) const;
+
   struct Candidate {
     Candidate(std::string r, std::string v, std::string rv = "")
         : reading(std::move(r)), value(std::move(v)), rawValue(std::move(rv)) {}
@@ -195,6 +325,10 @@ class ReadingGrid {
   // not have to care about this boundary condition.
   std::vector<Candidate> candidatesAt(size_t loc);
 
+  // Returns the nodes whose unigrams candidatesAt() lists, in the same order,
+  // so that the caller can make the candidates only as they are needed.
+  [[nodiscard]] std::vector<NodePtr> candidateNodesAt(size_t loc) const;
+
   // Adds weight to the node with the unigram that has the designated candidate
   // value and applies the desired override type, essentially resulting in user
   // override. An overridden node would influence the grid walk to favor walking
@@ -220,7 +354,7 @@ class ReadingGrid {
     [[nodiscard]] size_t maxLength() const { return maxLength_; }
 
    protected:
-    std::array<NodePtr, kMaximumSpanLength> nodes_;
+    std::array<NodePtr, kMaximumSpanLength> nodes_{};
     size_t maxLength_ = 0;
   };
 
@@ -232,7 +366,12 @@ class ReadingGrid {
       assert(lm_ != nullptr);
     }
     std::vector<Unigram> getUnigrams(const std::string& reading) override;
+    // Passes the wrapped model's result through if it is already ranked.
+    std::shared_ptr<const std::vector<Unigram>> getSharedUnigrams(
+        const std::string& reading) override;
     bool hasUnigrams(const std::string& reading) override;
+    uint32_t hasUnigramsForPrefixes(std::span<const std::string> readings,
+                                    const std::string& separator) override;
 
    protected:
     std::shared_ptr<LanguageModel> lm_;
@@ -251,16 +390,94 @@ class ReadingGrid {
   std::vector<Span> spans_;
   ScoreRankedLanguageModel lm_;
 
+  // A state in the Viterbi table. This tracks the maximum accumulated score
+  // and the back-pointer required for path reconstruction.
+  struct ViterbiState {
+    size_t fromIndex = 0;
+    NodePtr fromNode = nullptr;
+    double maxScore = -std::numeric_limits<double>::infinity();
+  };
+
+  // The Viterbi table of the last walk. Entries up to and including
+  // walkValidUntil_ are still valid: the state at index i only depends on the
+  // nodes in the spans before i.
+  std::vector<ViterbiState> viterbi_;
+  size_t walkValidUntil_ = 0;
+
+  // Marks the states past the span at loc as needing recomputation.
+  void invalidateWalkFrom(size_t loc) {
+    walkValidUntil_ = std::min(walkValidUntil_, loc);
+  }
+
+  // The node arena. A deque does not move its elements as it grows. Removed
+  // nodes go to retiredNodes_, then to retiredBeforeLastWalk_ at the next
+  // walk(), and then to freeNodes_ at the walk after, from which makeNode()
+  // takes them. In a steady typing session, no node is allocated.
+  std::deque<Node> nodeArena_;
+  std::vector<NodePtr> freeNodes_;
+  std::vector<NodePtr> retiredNodes_;
+  std::vector<NodePtr> retiredBeforeLastWalk_;
+
+  NodePtr makeNode(
+      std::string reading, size_t spanningLength,
+      std::shared_ptr<const std::vector<LanguageModel::Unigram>> unigrams);
+  void retireNode(NodePtr node);
+  void retireNodesOf(const Span& span, size_t fromLength = 1);
+
+  // A change to the grid, recorded while there are undo points. Undoing the
+  // changes in reverse brings back the state at an undo point.
+  struct Change {
+    enum class Type {
+      kCursorMoved,       // index is the old cursor.
+      kReadingsInserted,  // count readings at index.
+      kReadingsErased,    // readings at index.
+      kSpansInserted,     // count spans at index.
+      kSpanErased,        // span at index.
+      kSpanChanged,       // span at index was span.
+      kNodeMade,          // node.
+      kNodeRetired,       // node, kept for the journal.
+      kNodeOverridden,    // node in the span at index had the old override.
+    };
+
+    Type type;
+    uint64_t serial = 0;
+    size_t index = 0;
+    size_t count = 0;
+    NodePtr node = nullptr;
+    Span span;
+    std::vector<std::string> readings;
+    Node::OverrideType overrideType = Node::OverrideType::kNone;
+    size_t unigramIndex = 0;
+  };
+
+  bool recording_ = false;
+  size_t liveUndoPoints_ = 0;
+  uint64_t generation_ = 0;
+  uint64_t nextSerial_ = 1;
+  std::vector<Change> changes_;
+
+  // Called before an edit; discards the journal if it has grown too long.
+  void limitUndoJournal();
+  // Must only be called if recording_ is true.
+  Change& record(Change::Type type, size_t index = 0);
+  void recordCursor();
+  void recordSpan(size_t loc);
+  void recordOverride(NodePtr node, size_t spanIndex);
+  void undo(const Change& change);
+
   // Internal methods for maintaining the grid.
 
-  void expandGridAt(size_t loc);
+  void expandGridAt(size_t loc, size_t count = 1);
   void shrinkGridAt(size_t loc);
   void removeAffectedNodes(size_t loc);
   void insert(size_t loc, const NodePtr& node);
   std::string combineReading(std::vector<std::string>::const_iterator begin,
                              std::vector<std::string>::const_iterator end);
   bool hasNodeAt(size_t loc, size_t readingLen, const std::string& reading);
-  void update();
+
+  // Builds the missing nodes around the `count` readings that start at the
+  // cursor.
+  void update(size_t count = 1);
 
   // Internal implementation of overrideCandidate, with an optional reading.
   bool overrideCandidate(size_t loc, const std::string* reading,
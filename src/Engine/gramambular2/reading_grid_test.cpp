@@ -24,9 +24,13 @@
 #include "reading_grid.h"
 
 #include <algorithm>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <random>
+#include <set>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -176,10 +180,10 @@ TEST(ReadingGridTest, Span) {
   SimpleLM lm(kSampleData);
   ReadingGrid::Span span;
 
-  auto n1 =
-      std::make_shared<ReadingGrid::Node>("ㄍㄠ", 1, lm.getUnigrams("ㄍㄠ"));
-  auto n3 = std::make_shared<ReadingGrid::Node>(
-      "ㄍㄠㄎㄜㄐㄧˋ", 3, lm.getUnigrams("ㄍㄠㄎㄜㄐㄧˋ"));
+  ReadingGrid::Node node1("ㄍㄠ", 1, lm.getUnigrams("ㄍㄠ"));
+  ReadingGrid::Node node3("ㄍㄠㄎㄜㄐㄧˋ", 3, lm.getUnigrams("ㄍㄠㄎㄜㄐㄧˋ"));
+  ReadingGrid::NodePtr n1 = &node1;
+  ReadingGrid::NodePtr n3 = &node3;
 
   ASSERT_EQ(span.maxLength(), 0);
   span.add(n1);
@@ -209,8 +213,8 @@ TEST(ReadingGridTest, Span) {
   ASSERT_EQ(span.nodeOf(1), nullptr);
 
 #ifndef NDEBUG
-  auto n10 = std::make_shared<ReadingGrid::Node>("", 10, lm.getUnigrams(""));
-  ASSERT_DEATH({ (void)span.add(n10); }, "Assertion");
+  ReadingGrid::Node n10("", 10, lm.getUnigrams(""));
+  ASSERT_DEATH({ (void)span.add(&n10); }, "Assertion");
   ASSERT_DEATH({ (void)span.nodeOf(0); }, "Assertion");
   ASSERT_DEATH(
       { (void)span.nodeOf(ReadingGrid::kMaximumSpanLength + 1); }, "Assertion");
@@ -473,62 +477,62 @@ TEST(ReadingGridTest, FindNodeInSpans) {
           .has_value());
   ASSERT_EQ(
       grid.findInSpan(0, [](const auto& n) { return n->spanningLength() == 1; })
-          ->get()
+          .value()
           ->reading(),
       "a");
   ASSERT_EQ(
       grid.findInSpan(1, [](const auto& n) { return n->spanningLength() == 1; })
-          ->get()
+          .value()
           ->reading(),
       "b");
   ASSERT_EQ(
       grid.findInSpan(2, [](const auto& n) { return n->spanningLength() == 1; })
-          ->get()
+          .value()
           ->reading(),
       "c");
   ASSERT_EQ(
       grid.findInSpan(3, [](const auto& n) { return n->spanningLength() == 1; })
-          ->get()
+          .value()
           ->reading(),
       "c");
   ASSERT_EQ(
       grid.findInSpan(0, [](const auto& n) { return n->spanningLength() == 2; })
-          ->get()
+          .value()
           ->reading(),
       "a;b");
   ASSERT_EQ(
       grid.findInSpan(1, [](const auto& n) { return n->spanningLength() == 2; })
-          ->get()
+          .value()
           ->reading(),
       "b;c");
   ASSERT_EQ(
       grid.findInSpan(2, [](const auto& n) { return n->spanningLength() == 2; })
-          ->get()
+          .value()
           ->reading(),
       "b;c");
   ASSERT_EQ(
       grid.findInSpan(3, [](const auto& n) { return n->spanningLength() == 2; })
-          ->get()
+          .value()
           ->reading(),
       "b;c");
   ASSERT_EQ(
       grid.findInSpan(0, [](const auto& n) { return n->spanningLength() == 3; })
-          ->get()
+          .value()
           ->reading(),
       "a;b;c");
   ASSERT_EQ(
       grid.findInSpan(1, [](const auto& n) { return n->spanningLength() == 3; })
-          ->get()
+          .value()
           ->reading(),
       "a;b;c");
   ASSERT_EQ(
       grid.findInSpan(2, [](const auto& n) { return n->spanningLength() == 3; })
-          ->get()
+          .value()
           ->reading(),
       "a;b;c");
   ASSERT_EQ(
       grid.findInSpan(3, [](const auto& n) { return n->spanningLength() == 3; })
-          ->get()
+          .value()
           ->reading(),
       "a;b;c");
 }
@@ -549,6 +553,542 @@ TEST(ReadingGridTest, StressTest) {
             << ", edges: " << result.edges << "\n";
 }
 
+// Exposes a way to discard the Viterbi states kept between walks.
+class FullWalkReadingGrid : public ReadingGrid {
+ public:
+  using ReadingGrid::ReadingGrid;
+  WalkResult fullWalk() {
+    invalidateWalkFrom(0);
+    return walk();
+  }
+};
+
+TEST(ReadingGridTest, IncrementalWalkMatchesFullWalk) {
+  const std::vector<std::string> readings = {
+      "ㄉㄜ˙", "ㄉㄧˊ", "ㄉㄧˋ", "ㄋㄧㄢˊ", "ㄍㄠ", "ㄍㄨㄥ", "ㄎㄜ",
+      "ㄐㄧˋ", "ㄐㄧㄣ", "ㄐㄧㄤˇ", "ㄓㄨㄥ", "ㄙ"};
+  FullWalkReadingGrid grid(std::make_shared<SimpleLM>(kSampleData));
+  grid.setReadingSeparator("");
+
+  std::mt19937 random(42);
+  for (int i = 0; i < 2000; i++) {
+    size_t op = random() % 10;
+    if (op < 6 || grid.length() == 0) {
+      grid.setCursor(random() % (grid.length() + 1));
+      grid.insertReading(readings[random() % readings.size()]);
+    } else if (op == 6) {
+      grid.setCursor(random() % (grid.length() + 1));
+      grid.deleteReadingBeforeCursor();
+    } else if (op == 7) {
+      grid.setCursor(random() % (grid.length() + 1));
+      grid.deleteReadingAfterCursor();
+    } else {
+      size_t loc = random() % grid.length();
+      auto candidates = grid.candidatesAt(loc);
+      ASSERT_FALSE(candidates.empty());
+      using OverrideType = ReadingGrid::Node::OverrideType;
+      OverrideType type =
+          op == 8 ? OverrideType::kOverrideValueWithHighScore
+                  : OverrideType::kOverrideValueWithScoreFromTopUnigram;
+      grid.overrideCandidate(loc, candidates[random() % candidates.size()],
+                             type);
+    }
+
+    ReadingGrid::WalkResult incremental = grid.walk();
+    ReadingGrid::WalkResult full = grid.fullWalk();
+    ASSERT_EQ(full.reusedStates, 0);
+    ASSERT_EQ(incremental.valuesAsStrings(), full.valuesAsStrings());
+    ASSERT_EQ(incremental.readingsAsStrings(), full.readingsAsStrings());
+  }
+}
+
+TEST(ReadingGridTest, WalkReusesStatesWhenTypingAtTheEnd) {
+  ReadingGrid grid(std::make_shared<SimpleLM>(kSampleData));
+  grid.setReadingSeparator("");
+  for (int i = 0; i < 40; i++) {
+    grid.insertReading("ㄍㄠ");
+    grid.insertReading("ㄎㄜ");
+    grid.insertReading("ㄐㄧˋ");
+  }
+  ReadingGrid::WalkResult result = grid.walk();
+  EXPECT_EQ(result.reusedStates, 0);
+  EXPECT_EQ(result.vertices, 120);
+
+  // Nothing has changed.
+  result = grid.walk();
+  EXPECT_EQ(result.reusedStates, 120);
+  EXPECT_EQ(result.vertices, 0);
+  EXPECT_EQ(result.valuesAsStrings().size(), 40);
+
+  grid.insertReading("ㄍㄨㄥ");
+  result = grid.walk();
+  EXPECT_GE(result.reusedStates, 120 - ReadingGrid::kMaximumSpanLength);
+  EXPECT_LE(result.vertices, ReadingGrid::kMaximumSpanLength + 1);
+  EXPECT_EQ(result.totalReadings, 121);
+
+  // Overriding a candidate at the front recomputes everything after it.
+  grid.overrideCandidate(0, "膏");
+  result = grid.walk();
+  EXPECT_EQ(result.reusedStates, 0);
+  EXPECT_EQ(result.valuesAsStrings()[0], "膏");
+}
+
+TEST(ReadingGridTest, InsertReadings) {
+  const std::vector<std::string> readings = {
+      "ㄉㄜ˙", "ㄉㄧˊ", "ㄉㄧˋ", "ㄋㄧㄢˊ", "ㄍㄠ", "ㄍㄨㄥ", "ㄎㄜ",
+      "ㄐㄧˋ", "ㄐㄧㄣ", "ㄐㄧㄤˇ", "ㄓㄨㄥ", "ㄙ"};
+  auto lm = std::make_shared<SimpleLM>(kSampleData);
+
+  std::mt19937 random(7);
+  for (int i = 0; i < 200; i++) {
+    std::vector<std::string> prefix;
+    std::vector<std::string> inserted;
+    for (size_t j = 0, n = random() % 12; j < n; j++) {
+      prefix.push_back(readings[random() % readings.size()]);
+    }
+    for (size_t j = 0, n = 1 + random() % 12; j < n; j++) {
+      inserted.push_back(readings[random() % readings.size()]);
+    }
+    size_t cursor = prefix.empty() ? 0 : random() % (prefix.size() + 1);
+
+    ReadingGrid bulk(lm);
+    ReadingGrid oneByOne(lm);
+    for (ReadingGrid* grid : {&bulk, &oneByOne}) {
+      grid->setReadingSeparator("");
+      ASSERT_TRUE(grid->insertReadings(prefix) || prefix.empty());
+      grid->setCursor(cursor);
+    }
+    ASSERT_TRUE(bulk.insertReadings(inserted));
+    for (const std::string& reading : inserted) {
+      ASSERT_TRUE(oneByOne.insertReading(reading));
+    }
+
+    ASSERT_EQ(bulk.readings(), oneByOne.readings());
+    ASSERT_EQ(bulk.cursor(), oneByOne.cursor());
+    for (size_t loc = 0; loc < bulk.length(); loc++) {
+      for (size_t len = 1; len <= ReadingGrid::kMaximumSpanLength; len++) {
+        const auto& a = bulk.spans()[loc].nodeOf(len);
+        const auto& b = oneByOne.spans()[loc].nodeOf(len);
+        ASSERT_EQ(a == nullptr, b == nullptr);
+        if (a != nullptr) {
+          ASSERT_EQ(a->reading(), b->reading());
+        }
+      }
+    }
+    ASSERT_EQ(bulk.walk().valuesAsStrings(),
+              oneByOne.walk().valuesAsStrings());
+  }
+}
+
+TEST(ReadingGridTest, InsertReadingsIsAllOrNothing) {
+  ReadingGrid grid(std::make_shared<SimpleLM>(kSampleData));
+  grid.setReadingSeparator("");
+  std::vector<std::string> readings = {"ㄍㄠ", "ㄎㄜ", "ㄅ", "ㄐㄧˋ"};
+  EXPECT_FALSE(grid.insertReadings(readings));
+  readings = {"ㄍㄠ", ""};
+  EXPECT_FALSE(grid.insertReadings(readings));
+  readings.clear();
+  EXPECT_FALSE(grid.insertReadings(readings));
+  EXPECT_EQ(grid.length(), 0);
+  EXPECT_EQ(grid.cursor(), 0);
+
+  readings = {"ㄍㄠ", "ㄎㄜ", "ㄐㄧˋ"};
+  EXPECT_TRUE(grid.insertReadings(readings));
+  EXPECT_EQ(grid.length(), 3);
+  EXPECT_EQ(grid.cursor(), 3);
+  EXPECT_EQ(grid.walk().valuesAsStrings(), std::vector<std::string>{"高科技"});
+}
+
+class ArenaReadingGrid : public ReadingGrid {
+ public:
+  using ReadingGrid::ReadingGrid;
+  [[nodiscard]] size_t allocatedNodes() const { return nodeArena_.size(); }
+};
+
+TEST(ReadingGridTest, NodesAreRecycled) {
+  ArenaReadingGrid grid(std::make_shared<SimpleLM>(kSampleData));
+  grid.setReadingSeparator("");
+  grid.insertReading("ㄍㄠ");
+  grid.insertReading("ㄎㄜ");
+  grid.insertReading("ㄐㄧˋ");
+  ReadingGrid::WalkResult previous = grid.walk();
+  ASSERT_EQ(previous.valuesAsStrings(), std::vector<std::string>{"高科技"});
+
+  // A node removed from the grid is still valid through the next walk.
+  grid.deleteReadingBeforeCursor();
+  grid.insertReading("ㄐㄧㄣ");
+  ReadingGrid::WalkResult current = grid.walk();
+  EXPECT_EQ(previous.valuesAsStrings(), std::vector<std::string>{"高科技"});
+  EXPECT_EQ(previous.nodes[0]->reading(), "ㄍㄠㄎㄜㄐㄧˋ");
+  EXPECT_NE(current.valuesAsStrings(), previous.valuesAsStrings());
+
+  // Retyping the same readings reuses the removed nodes.
+  size_t allocated = 0;
+  for (int i = 0; i < 100; i++) {
+    grid.deleteReadingBeforeCursor();
+    grid.insertReading(i % 2 ? "ㄐㄧㄣ" : "ㄐㄧˋ");
+    (void)grid.walk();
+    if (i == 3) {
+      allocated = grid.allocatedNodes();
+    }
+  }
+  EXPECT_EQ(grid.allocatedNodes(), allocated);
+
+  grid.clear();
+  grid.insertReading("ㄍㄠ");
+  (void)grid.walk();
+  (void)grid.walk();
+  grid.insertReading("ㄎㄜ");
+  EXPECT_EQ(grid.allocatedNodes(), allocated);
+}
+
+TEST(ReadingGridTest, WalkNBest) {
+  ReadingGrid grid(std::make_shared<SimpleLM>(kSampleData));
+  grid.setReadingSeparator("");
+  EXPECT_TRUE(grid.walkNBest(5).empty());
+
+  grid.insertReading("ㄍㄠ");
+  grid.insertReading("ㄎㄜ");
+  grid.insertReading("ㄐㄧˋ");
+  EXPECT_TRUE(grid.walkNBest(0).empty());
+
+  std::vector<ReadingGrid::WalkResult> results = grid.walkNBest(10);
+  ReadingGrid::WalkResult best = grid.walk();
+  ASSERT_FALSE(results.empty());
+  EXPECT_EQ(results[0].nodes, best.nodes);
+  EXPECT_DOUBLE_EQ(results[0].score, best.score);
+  for (const auto& result : results) {
+    EXPECT_EQ(result.totalReadings, 3);
+  }
+
+  // There is no ㄍㄠㄎㄜ, so the paths are ㄍㄠ-ㄎㄜ-ㄐㄧˋ, ㄍㄠ-ㄎㄜㄐㄧˋ and
+  // ㄍㄠㄎㄜㄐㄧˋ. Asking for more returns them all.
+  EXPECT_EQ(results.size(), 3);
+  EXPECT_EQ(grid.walkNBest(2).size(), 2);
+}
+
+TEST(ReadingGridTest, WalkNBestMatchesAllPaths) {
+  const std::vector<std::string> readings = {
+      "ㄉㄜ˙", "ㄉㄧˊ", "ㄉㄧˋ", "ㄋㄧㄢˊ", "ㄍㄠ", "ㄍㄨㄥ", "ㄎㄜ",
+      "ㄐㄧˋ", "ㄐㄧㄣ", "ㄐㄧㄤˇ", "ㄓㄨㄥ", "ㄙ"};
+  ReadingGrid grid(std::make_shared<SimpleLM>(kSampleData));
+  grid.setReadingSeparator("");
+
+  std::mt19937 random(11);
+  for (int i = 0; i < 50; i++) {
+    grid.clear();
+    size_t length = 1 + random() % 8;
+    for (size_t j = 0; j < length; j++) {
+      grid.insertReading(readings[random() % readings.size()]);
+    }
+
+    // Enumerate the scores of all paths.
+    std::vector<double> allScores;
+    std::function<void(size_t, double)> visit = [&](size_t loc, double score) {
+      if (loc == length) {
+        allScores.push_back(score);
+        return;
+      }
+      const ReadingGrid::Span& span = grid.spans()[loc];
+      for (size_t len = 1; len <= span.maxLength(); len++) {
+        if (span.nodeOf(len) != nullptr) {
+          visit(loc + len, score + span.nodeOf(len)->score());
+        }
+      }
+    };
+    visit(0, 0);
+    std::sort(allScores.begin(), allScores.end(), std::greater<>());
+
+    std::vector<ReadingGrid::WalkResult> results = grid.walkNBest(5);
+    ASSERT_EQ(results.size(), std::min<size_t>(5, allScores.size()));
+    std::set<std::vector<ReadingGrid::NodePtr>> distinctPaths;
+    for (size_t j = 0; j < results.size(); j++) {
+      EXPECT_NEAR(results[j].score, allScores[j], 1e-9);
+      double score = 0;
+      for (const auto& node : results[j].nodes) {
+        score += node->score();
+      }
+      EXPECT_NEAR(results[j].score, score, 1e-9);
+      EXPECT_EQ(results[j].totalReadings, length);
+      distinctPaths.insert(results[j].nodes);
+    }
+    EXPECT_EQ(distinctPaths.size(), results.size());
+    EXPECT_EQ(results[0].nodes, grid.walk().nodes);
+  }
+}
+
+TEST(ReadingGridTest, SettledPrefixLength) {
+  ReadingGrid grid(std::make_shared<SimpleLM>(kSampleData));
+  grid.setReadingSeparator("");
+  for (int i = 0; i < 4; i++) {
+    grid.insertReading("ㄍㄠ");
+    grid.insertReading("ㄎㄜ");
+    grid.insertReading("ㄐㄧˋ");
+  }
+  ReadingGrid::WalkResult result = grid.walk();
+  ASSERT_EQ(result.valuesAsStrings(),
+            (std::vector<std::string>{"高科技", "高科技", "高科技", "高科技"}));
+
+  // The window before the 8th reading includes the start of the grid.
+  EXPECT_EQ(grid.settledPrefixLength(7), 0);
+  // The best path to the state after ㄍㄠ-ㄎㄜ at 5 goes through 3.
+  EXPECT_EQ(grid.settledPrefixLength(12), 3);
+
+  grid.removeLeadingReadings(3);
+  EXPECT_EQ(grid.length(), 9);
+  EXPECT_EQ(grid.cursor(), 9);
+  EXPECT_EQ(grid.walk().valuesAsStrings(),
+            (std::vector<std::string>{"高科技", "高科技", "高科技"}));
+}
+
+TEST(ReadingGridTest, SettledPrefixIsNotChangedByLaterEdits) {
+  const std::vector<std::string> readings = {
+      "ㄉㄜ˙", "ㄉㄧˊ", "ㄉㄧˋ", "ㄋㄧㄢˊ", "ㄍㄠ", "ㄍㄨㄥ", "ㄎㄜ",
+      "ㄐㄧˋ", "ㄐㄧㄣ", "ㄐㄧㄤˇ", "ㄓㄨㄥ", "ㄙ"};
+  ReadingGrid grid(std::make_shared<SimpleLM>(kSampleData));
+  grid.setReadingSeparator("");
+
+  std::mt19937 random(13);
+  for (int i = 0; i < 200; i++) {
+    grid.clear();
+    size_t length = 1 + random() % 30;
+    for (size_t j = 0; j < length; j++) {
+      grid.insertReading(readings[random() % readings.size()]);
+    }
+    ReadingGrid::WalkResult before = grid.walk();
+    size_t loc = random() % (length + 1);
+    size_t settled = grid.settledPrefixLength(loc);
+    ASSERT_LE(settled, loc);
+
+    // Edit the grid at or after loc.
+    for (int j = 0; j < 5; j++) {
+      size_t cursor = loc + random() % (grid.length() - loc + 1);
+      grid.setCursor(cursor);
+      if (random() % 2 == 0) {
+        grid.insertReading(readings[random() % readings.size()]);
+      } else if (cursor > loc) {
+        grid.deleteReadingBeforeCursor();
+      } else {
+        grid.deleteReadingAfterCursor();
+      }
+    }
+    ReadingGrid::WalkResult after = grid.walk();
+
+    size_t covered = 0;
+    for (size_t j = 0; covered < settled; j++) {
+      ASSERT_LT(j, after.nodes.size());
+      EXPECT_EQ(after.nodes[j]->reading(), before.nodes[j]->reading());
+      EXPECT_EQ(after.nodes[j]->value(), before.nodes[j]->value());
+      covered += before.nodes[j]->spanningLength();
+    }
+    EXPECT_EQ(covered, settled);
+  }
+}
+
+// The readings, the cursor, and the nodes in the spans with their values.
+struct GridState {
+  std::vector<std::string> readings;
+  size_t cursor = 0;
+  std::vector<std::pair<ReadingGrid::NodePtr, std::string>> nodes;
+  bool operator==(const GridState&) const = default;
+};
+
+GridState StateOf(const ReadingGrid& grid) {
+  GridState state{grid.readings(), grid.cursor(), {}};
+  for (const ReadingGrid::Span& span : grid.spans()) {
+    for (size_t len = 1; len <= span.maxLength(); ++len) {
+      ReadingGrid::NodePtr node = span.nodeOf(len);
+      if (node != nullptr) {
+        state.nodes.emplace_back(node, node->value());
+      }
+    }
+  }
+  return state;
+}
+
+TEST(ReadingGridTest, UndoToRevertsEdits) {
+  ArenaReadingGrid grid(std::make_shared<SimpleLM>(kSampleData));
+  grid.setReadingSeparator("");
+  grid.insertReading("ㄍㄠ");
+  grid.insertReading("ㄎㄜ");
+  grid.insertReading("ㄐㄧˋ");
+  ASSERT_EQ(grid.walk().valuesAsStrings(), std::vector<std::string>{"高科技"});
+  GridState before = StateOf(grid);
+  ReadingGrid::UndoPoint point = grid.markUndoPoint();
+
+  // Overrides alone.
+  ASSERT_TRUE(grid.overrideCandidate(0, "膏"));
+  ASSERT_EQ(grid.walk().valuesAsStrings(),
+            (std::vector<std::string>{"膏", "科技"}));
+  GridState overridden = StateOf(grid);
+  ReadingGrid::UndoPoint afterOverride = grid.markUndoPoint();
+  ASSERT_TRUE(grid.undoTo(point));
+  EXPECT_EQ(StateOf(grid), before);
+  EXPECT_EQ(grid.walk().valuesAsStrings(), std::vector<std::string>{"高科技"});
+
+  // The point marked after the override is ahead of the one undone to, and
+  // can no longer be reached.
+  EXPECT_FALSE(grid.undoTo(afterOverride));
+
+  // Edits that remove the nodes bring back the very same nodes.
+  ASSERT_TRUE(grid.overrideCandidate(0, "膏"));
+  afterOverride = grid.markUndoPoint();
+  grid.setCursor(1);
+  grid.deleteReadingBeforeCursor();
+  grid.insertReading("ㄍㄨㄥ");
+  grid.setCursor(grid.length());
+  grid.insertReading("ㄙ");
+  ASSERT_EQ(grid.walk().valuesAsStrings(),
+            (std::vector<std::string>{"工", "科技", "斯"}));
+  size_t allocated = grid.allocatedNodes();
+  ASSERT_TRUE(grid.undoTo(afterOverride));
+  EXPECT_EQ(StateOf(grid), overridden);
+  EXPECT_EQ(grid.walk().valuesAsStrings(),
+            (std::vector<std::string>{"膏", "科技"}));
+  ASSERT_TRUE(grid.undoTo(point));
+  EXPECT_EQ(StateOf(grid), before);
+  EXPECT_EQ(grid.walk().valuesAsStrings(), std::vector<std::string>{"高科技"});
+  EXPECT_EQ(grid.allocatedNodes(), allocated);
+
+  // Undoing to the same point again is a no-op.
+  EXPECT_TRUE(grid.undoTo(point));
+  EXPECT_EQ(StateOf(grid), before);
+
+  grid.discardUndoPoints();
+  EXPECT_FALSE(grid.undoTo(point));
+  grid.insertReading("ㄙ");
+  EXPECT_FALSE(grid.undoTo(point));
+}
+
+TEST(ReadingGridTest, UndoPointsMatchRecordedStates) {
+  const std::vector<std::string> readings = {
+      "ㄉㄜ˙", "ㄉㄧˊ", "ㄉㄧˋ", "ㄋㄧㄢˊ", "ㄍㄠ", "ㄍㄨㄥ", "ㄎㄜ",
+      "ㄐㄧˋ", "ㄐㄧㄣ", "ㄐㄧㄤˇ", "ㄓㄨㄥ", "ㄙ"};
+  FullWalkReadingGrid grid(std::make_shared<SimpleLM>(kSampleData));
+  grid.setReadingSeparator("");
+
+  std::vector<std::pair<ReadingGrid::UndoPoint, GridState>> points;
+  std::mt19937 random(42);
+  for (int i = 0; i < 2000; i++) {
+    size_t op = random() % 12;
+    if (op < 5 || grid.length() == 0) {
+      grid.setCursor(random() % (grid.length() + 1));
+      grid.insertReading(readings[random() % readings.size()]);
+    } else if (op == 5) {
+      grid.setCursor(random() % (grid.length() + 1));
+      grid.deleteReadingBeforeCursor();
+    } else if (op == 6) {
+      grid.setCursor(random() % (grid.length() + 1));
+      grid.deleteReadingAfterCursor();
+    } else if (op == 7) {
+      size_t loc = random() % grid.length();
+      auto candidates = grid.candidatesAt(loc);
+      ASSERT_FALSE(candidates.empty());
+      grid.overrideCandidate(loc, candidates[random() % candidates.size()]);
+    } else if (op == 8 || op == 9) {
+      points.emplace_back(grid.markUndoPoint(), StateOf(grid));
+    } else if (op == 10 && !points.empty()) {
+      points.resize(random() % points.size() + 1);
+      ASSERT_TRUE(grid.undoTo(points.back().first));
+      ASSERT_EQ(StateOf(grid), points.back().second);
+    } else if (op == 11 && random() % 8 == 0) {
+      grid.discardUndoPoints();
+      points.clear();
+    }
+
+    ReadingGrid::WalkResult incremental = grid.walk();
+    ReadingGrid::WalkResult full = grid.fullWalk();
+    ASSERT_EQ(incremental.valuesAsStrings(), full.valuesAsStrings());
+  }
+}
+
+TEST(ReadingGridTest, ReleasingTheLastUndoPointStopsRecording) {
+  ArenaReadingGrid grid(std::make_shared<SimpleLM>(kSampleData));
+  grid.setReadingSeparator("");
+  grid.insertReading("ㄍㄠ");
+  ReadingGrid::UndoPoint first = grid.markUndoPoint();
+  grid.insertReading("ㄎㄜ");
+  ReadingGrid::UndoPoint second = grid.markUndoPoint();
+  grid.insertReading("ㄐㄧˋ");
+  size_t journalSize = grid.undoJournalSize();
+  EXPECT_GT(journalSize, 0);
+
+  // One point is still alive, so the journal is kept.
+  second.release();
+  EXPECT_EQ(grid.undoJournalSize(), journalSize);
+  EXPECT_FALSE(grid.undoTo(second));
+
+  // A moved point is the same point.
+  ReadingGrid::UndoPoint moved = std::move(first);
+  ASSERT_TRUE(grid.undoTo(moved));
+  EXPECT_EQ(grid.readings(), std::vector<std::string>{"ㄍㄠ"});
+
+  {
+    ReadingGrid::UndoPoint dropped = std::move(moved);
+  }
+  EXPECT_EQ(grid.undoJournalSize(), 0);
+  grid.insertReading("ㄎㄜ");
+  EXPECT_EQ(grid.undoJournalSize(), 0);
+}
+
+TEST(ReadingGridTest, UndoJournalIsBounded) {
+  ArenaReadingGrid grid(std::make_shared<SimpleLM>(kSampleData));
+  grid.setReadingSeparator("");
+  grid.insertReading("ㄍㄠ");
+  ReadingGrid::UndoPoint point = grid.markUndoPoint();
+  for (size_t i = 0; i < ReadingGrid::kMaxUndoChanges; i++) {
+    grid.insertReading("ㄎㄜ");
+    grid.deleteReadingBeforeCursor();
+    ASSERT_LE(grid.undoJournalSize(), ReadingGrid::kMaxUndoChanges + 64);
+  }
+  // The journal was discarded along the way, and the point with it.
+  EXPECT_FALSE(grid.undoTo(point));
+  grid.insertReading("ㄎㄜ");
+  EXPECT_EQ(grid.undoJournalSize(), 0);
+}
+
+TEST(ReadingGridTest, UpdateOnlyLooksUpPrefixesWithUnigrams) {
+  // An LM that answers the prefix query itself and counts the lookups.
+  class CountingLM : public SimpleLM {
+   public:
+    using SimpleLM::SimpleLM;
+
+    std::vector<Unigram> getUnigrams(const std::string& key) override {
+      ++unigramLookups;
+      return SimpleLM::getUnigrams(key);
+    }
+
+    uint32_t hasUnigramsForPrefixes(std::span<const std::string> readings,
+                                    const std::string& separator) override {
+      ++prefixLookups;
+      return LanguageModel::hasUnigramsForPrefixes(readings, separator);
+    }
+
+    size_t unigramLookups = 0;
+    size_t prefixLookups = 0;
+  };
+
+  auto lm = std::make_shared<CountingLM>(kSampleData);
+  ReadingGrid grid(lm);
+  grid.setReadingSeparator("");
+  grid.insertReading("ㄍㄠ");
+  grid.insertReading("ㄎㄜ");
+  grid.insertReading("ㄐㄧˋ");
+  grid.insertReading("ㄍㄨㄥ");
+
+  // Of all the spans that end with the new reading, only ㄙ and ㄍㄨㄥㄙ exist,
+  // and only those are looked up.
+  lm->unigramLookups = 0;
+  lm->prefixLookups = 0;
+  grid.insertReading("ㄙ");
+  EXPECT_GT(lm->prefixLookups, 0);
+  EXPECT_EQ(lm->unigramLookups, 2);
+
+  ReadingGrid::WalkResult result = grid.walk();
+  ASSERT_EQ(result.valuesAsStrings(),
+            (std::vector<std::string>{"高科技", "公司"}));
+}
+
 TEST(ReadingGridTest, LongGridInsertion) {
   ReadingGrid grid(std::make_shared<MockLM>());
   grid.setReadingSeparator("");
@@ -643,6 +1183,40 @@ TEST(ReadingGridTest, InputTest) {
             (std::vector<std::string>{"高科技", "公司", "的", "年終", "獎金"}));
 }
 
+TEST(ReadingGridTest, CandidateNodesAt) {
+  std::shared_ptr<const std::vector<LanguageModel::Unigram>> unigrams;
+  {
+    ReadingGrid grid(std::make_shared<SimpleLM>(kSampleData));
+    grid.setReadingSeparator("");
+    grid.insertReading("ㄋㄧㄢˊ");
+    grid.insertReading("ㄓㄨㄥ");
+    grid.insertReading("ㄐㄧㄤˇ");
+
+    std::vector<ReadingGrid::NodePtr> nodes = grid.candidateNodesAt(1);
+    ASSERT_FALSE(nodes.empty());
+    for (size_t i = 1; i < nodes.size(); ++i) {
+      ASSERT_GE(nodes[i - 1]->spanningLength(), nodes[i]->spanningLength());
+    }
+
+    std::vector<std::string> values;
+    for (const auto& node : nodes) {
+      for (const auto& unigram : node->unigrams()) {
+        values.push_back(unigram.value());
+      }
+    }
+    std::vector<ReadingGrid::Candidate> candidates = grid.candidatesAt(1);
+    ASSERT_EQ(values.size(), candidates.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+      ASSERT_EQ(values[i], candidates[i].value);
+    }
+
+    unigrams = nodes.back()->sharedUnigrams();
+  }
+
+  // The unigrams outlive the grid and its nodes.
+  ASSERT_EQ(unigrams->front().value(), "中");
+}
+
 TEST(ReadingGridTest, OverrideResetOverlappingNodes) {
   ReadingGrid grid(std::make_shared<SimpleLM>(kSampleData));
   grid.setReadingSeparator("");
@@ -779,9 +1353,9 @@ TEST(ReadingGridTest, FindInSpan1) {
       0, [](const Formosa::Gramambular2::ReadingGrid::NodePtr& node) {
         return node->spanningLength() == 1;
       });
-  ASSERT_EQ(result->get()->spanningLength(), 1);
-  ASSERT_EQ(result->get()->reading(), "ㄍㄠ");
-  ASSERT_EQ(result->get()->value(), "高");
+  ASSERT_EQ(result.value()->spanningLength(), 1);
+  ASSERT_EQ(result.value()->reading(), "ㄍㄠ");
+  ASSERT_EQ(result.value()->value(), "高");
 }
 
 TEST(ReadingGridTest, FindInSpan2) {
@@ -812,9 +1386,9 @@ TEST(ReadingGridTest, FindInSpan2) {
       0, [](const Formosa::Gramambular2::ReadingGrid::NodePtr& node) {
         return node->spanningLength() == 2;
       });
-  ASSERT_EQ(result->get()->spanningLength(), 2);
-  ASSERT_EQ(result->get()->reading(), "ㄍㄠㄖㄜˋ");
-  ASSERT_EQ(result->get()->value(), "高熱");
+  ASSERT_EQ(result.value()->spanningLength(), 2);
+  ASSERT_EQ(result.value()->reading(), "ㄍㄠㄖㄜˋ");
+  ASSERT_EQ(result.value()->value(), "高熱");
 }
 
 }  // namespace Formosa::Gramambular2
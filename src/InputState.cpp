@@ -23,10 +23,66 @@
 
 #include "InputState.h"
 
+#include <algorithm>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace McBopomofo {
 
+struct InputStates::ChoosingCandidate::CandidateList::Storage {
+  // Null if the list is made from a vector, in which case all candidates are
+  // in the first page.
+  std::shared_ptr<const Source> source;
+  std::vector<std::unique_ptr<const std::vector<Candidate>>> pages;
+};
+
+InputStates::ChoosingCandidate::CandidateList::CandidateList(
+    std::vector<Candidate> candidates)
+    : storage_(std::make_shared<Storage>()) {
+  storage_->pages.emplace_back(
+      std::make_unique<const std::vector<Candidate>>(std::move(candidates)));
+}
+
+InputStates::ChoosingCandidate::CandidateList::CandidateList(
+    std::shared_ptr<const Source> source)
+    : storage_(std::make_shared<Storage>()) {
+  storage_->pages.resize((source->size() + kPageSize - 1) / kPageSize);
+  storage_->source = std::move(source);
+}
+
+size_t InputStates::ChoosingCandidate::CandidateList::size() const {
+  return storage_->source != nullptr ? storage_->source->size()
+                                     : storage_->pages[0]->size();
+}
+
+const InputStates::ChoosingCandidate::Candidate&
+InputStates::ChoosingCandidate::CandidateList::operator[](size_t index) const {
+  if (storage_->source == nullptr) {
+    return (*storage_->pages[0])[index];
+  }
+  auto& page = storage_->pages[index / kPageSize];
+  if (page == nullptr) {
+    auto candidates = std::make_unique<std::vector<Candidate>>();
+    size_t begin = index - index % kPageSize;
+    size_t end = std::min(begin + kPageSize, storage_->source->size());
+    candidates->reserve(end - begin);
+    for (size_t i = begin; i < end; ++i) {
+      candidates->push_back(storage_->source->candidateAt(i));
+    }
+    page = std::move(candidates);
+  }
+  return (*page)[index % kPageSize];
+}
+
+std::string_view InputStates::ChoosingCandidate::CandidateList::valueAt(
+    size_t index) const {
+  if (storage_->source == nullptr) {
+    return (*storage_->pages[0])[index].value;
+  }
+  return storage_->source->valueAt(index);
+}
+
 InputStates::SelectingDateMacro::SelectingDateMacro(
     const std::function<std::string(std::string)>& converter) {
   std::string DateMacros[] = {"MACRO@DATE_TODAY_SHORT",
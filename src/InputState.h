@@ -24,7 +24,9 @@
 #ifndef SRC_INPUTSTATE_H_
 #define SRC_INPUTSTATE_H_
 
+#include <cstddef>
 #include <functional>
+#include <iterator>
 #include <memory>
 #include <string>
 #include <string_view>
@@ -105,10 +107,84 @@ struct Inputting : NotEmpty {
 
 // Candidate selecting state with a non-empty composing buffer.
 struct ChoosingCandidate : NotEmpty {
-  struct Candidate;
+  struct Candidate {
+    Candidate(std::string r, std::string v, std::string rawValue)
+        : reading(std::move(r)),
+          value(std::move(v)),
+          rawValue(std::move(rawValue)) {}
+    const std::string reading;
+    const std::string value;
+    const std::string rawValue;
+  };
+
+  // The candidates of the state. A common syllable can have hundreds of
+  // candidates, of which only a page is shown at a time, so a list made from
+  // a Source only makes the Candidate objects of a page when one of them is
+  // first accessed. Copies of a list, and so copies of a state, share the
+  // source and the pages made so far.
+  class CandidateList {
+   public:
+    // Knows how many candidates there are, and how to make each of them.
+    class Source {
+     public:
+      virtual ~Source() = default;
+      [[nodiscard]] virtual size_t size() const = 0;
+      // Returns the value of a candidate without making the candidate.
+      [[nodiscard]] virtual std::string_view valueAt(size_t index) const = 0;
+      [[nodiscard]] virtual Candidate candidateAt(size_t index) const = 0;
+    };
+
+    static constexpr size_t kPageSize = 16;
+
+    // Not explicit, so that a list can still be made from a vector.
+    CandidateList(std::vector<Candidate> candidates);  // NOLINT
+    explicit CandidateList(std::shared_ptr<const Source> source);
+
+    [[nodiscard]] size_t size() const;
+    [[nodiscard]] bool empty() const { return size() == 0; }
+    const Candidate& operator[](size_t index) const;
+    [[nodiscard]] std::string_view valueAt(size_t index) const;
+
+    class const_iterator {
+     public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = Candidate;
+      using difference_type = std::ptrdiff_t;
+      using pointer = const Candidate*;
+      using reference = const Candidate&;
+
+      const_iterator(const CandidateList* list, size_t index)
+          : list_(list), index_(index) {}
+      reference operator*() const { return (*list_)[index_]; }
+      pointer operator->() const { return &(*list_)[index_]; }
+      const_iterator& operator++() {
+        ++index_;
+        return *this;
+      }
+      bool operator==(const const_iterator& other) const {
+        return index_ == other.index_;
+      }
+      bool operator!=(const const_iterator& other) const {
+        return index_ != other.index_;
+      }
+
+     private:
+      const CandidateList* list_;
+      size_t index_;
+    };
+    using iterator = const_iterator;
+    using value_type = Candidate;
+
+    [[nodiscard]] const_iterator begin() const { return {this, 0}; }
+    [[nodiscard]] const_iterator end() const { return {this, size()}; }
+
+   private:
+    struct Storage;
+    std::shared_ptr<Storage> storage_;
+  };
 
   ChoosingCandidate(const std::string& buf, const size_t index,
-                    const size_t originalIndex, std::vector<Candidate> cs)
+                    const size_t originalIndex, CandidateList cs)
       : NotEmpty(buf, index),
         candidates(std::move(cs)),
         originalCursor(originalIndex) {}
@@ -118,18 +194,8 @@ struct ChoosingCandidate : NotEmpty {
         candidates(state.candidates),
         originalCursor(state.originalCursor) {}
 
-  const std::vector<Candidate> candidates;
+  const CandidateList candidates;
   size_t originalCursor;
-
-  struct Candidate {
-    Candidate(std::string r, std::string v, std::string rawValue)
-        : reading(std::move(r)),
-          value(std::move(v)),
-          rawValue(std::move(rawValue)) {}
-    const std::string reading;
-    const std::string value;
-    const std::string rawValue;
-  };
 };
 
 inline bool operator==(const ChoosingCandidate::Candidate& a,
@@ -139,7 +205,7 @@ inline bool operator==(const ChoosingCandidate::Candidate& a,
 
 struct ChoosingPunctuationList : ChoosingCandidate {
   ChoosingPunctuationList(const std::string& buf, const size_t index,
-                          const size_t originalIndex, std::vector<Candidate> cs)
+                          const size_t originalIndex, CandidateList cs)
       : ChoosingCandidate(buf, index, originalIndex, std::move(cs)) {}
 
   ChoosingPunctuationList(const ChoosingCandidate& state)
@@ -51,7 +51,7 @@ constexpr size_t kMaxValidMarkingReadingCount = 8;
 constexpr size_t kMaxChineseNumberConversionDigits = 20;
 constexpr size_t kMaxRomanNumberConversionDigits = 4;
 
-constexpr int kUserOverrideModelCapacity = 500;
+constexpr int kUserOverrideModelCapacity = 100000;
 constexpr double kObservedOverrideHalfLife = 5400.0;  // 1.5 hr.
 // Unigram whose score is below this shouldn't be put into user override model.
 constexpr double kNoOverrideThreshold = -8.0;
@@ -97,6 +97,64 @@ static double GetEpochNowInSeconds() {
   return static_cast<double>(timestamp);
 }
 
+namespace {
+
+// The candidates at a grid location, made from the unigrams of the nodes there.
+// The unigrams are shared with the nodes, so the source stays valid after the
+// grid changes.
+class GridCandidateSource
+    : public InputStates::ChoosingCandidate::CandidateList::Source {
+ public:
+  explicit GridCandidateSource(
+      const std::vector<Formosa::Gramambular2::ReadingGrid::NodePtr>& nodes) {
+    for (const auto& node : nodes) {
+      auto unigrams = node->sharedUnigrams();
+      if (unigrams->empty()) {
+        continue;
+      }
+      size_ += unigrams->size();
+      groups_.push_back({node->reading(), std::move(unigrams), size_});
+    }
+  }
+
+  [[nodiscard]] size_t size() const override { return size_; }
+
+  [[nodiscard]] std::string_view valueAt(size_t index) const override {
+    const Group& group = groupOf(index);
+    return (*group.unigrams)[index - group.begin()].value();
+  }
+
+  [[nodiscard]] InputStates::ChoosingCandidate::Candidate candidateAt(
+      size_t index) const override {
+    const Group& group = groupOf(index);
+    const auto& unigram = (*group.unigrams)[index - group.begin()];
+    return {group.reading, unigram.value(), unigram.rawValue()};
+  }
+
+ private:
+  struct Group {
+    std::string reading;
+    std::shared_ptr<
+        const std::vector<Formosa::Gramambular2::LanguageModel::Unigram>>
+        unigrams;
+    // The index past the last candidate of the group.
+    size_t end;
+
+    [[nodiscard]] size_t begin() const { return end - unigrams->size(); }
+  };
+
+  [[nodiscard]] const Group& groupOf(size_t index) const {
+    return *std::upper_bound(
+        groups_.begin(), groups_.end(), index,
+        [](size_t i, const Group& group) { return i < group.end; });
+  }
+
+  std::vector<Group> groups_;
+  size_t size_ = 0;
+};
+
+}  // namespace
+
 KeyHandler::KeyHandler(
     std::shared_ptr<Formosa::Gramambular2::LanguageModel> languageModel,
     std::shared_ptr<VariantAnnotator> variantAnnotator,
@@ -181,7 +239,11 @@ bool KeyHandler::handle(Key key, McBopomofo::InputState* state,
       return true;
     }
 
-    grid_.insertReading(syllable);
+    {
+      LatencyTracer::Scope scope(latencyTracer_.get(),
+                                 LatencyTracer::Stage::kGridUpdate);
+      grid_.insertReading(syllable);
+    }
     walk();
 
     if (inputMode_ != McBopomofo::InputMode::PlainBopomofo) {
@@ -200,6 +262,13 @@ bool KeyHandler::handle(Key key, McBopomofo::InputState* state,
         walk();
       }
     }
+    if (inputMode_ == McBopomofo::InputMode::McBopomofo) {
+      std::string settledText = popSettledText();
+      if (!settledText.empty()) {
+        stateCallback(
+            std::make_unique<InputStates::Committing>(std::move(settledText)));
+      }
+    }
     if (inputMode_ == McBopomofo::InputMode::McBopomofo &&
         associatedPhrasesEnabled_) {
       auto inputting = buildInputtingState();
@@ -794,6 +863,25 @@ void KeyHandler::setBopomofoFontAnnotationSupportEnabled(bool enabled) {
   bopomofoFontAnnotationSupportEnabled_ = enabled;
 }
 
+void KeyHandler::setAutoCommitDistance(size_t distance) {
+  autoCommitDistance_ = distance;
+}
+
+void KeyHandler::setLatencyTracer(std::shared_ptr<LatencyTracer> tracer) {
+  latencyTracer_ = std::move(tracer);
+}
+
+void KeyHandler::setUserOverrideModelDirectory(const std::string& directory) {
+  userOverrideModelStore_.reset();
+  userOverrideModel_ =
+      UserOverrideModel(kUserOverrideModelCapacity, kObservedOverrideHalfLife);
+  if (!directory.empty()) {
+    userOverrideModelStore_ =
+        std::make_unique<UserOverrideModelStore>(directory);
+    userOverrideModelStore_->attach(&userOverrideModel_);
+  }
+}
+
 #pragma endregion Settings
 
 #pragma region Key_Handling
@@ -1072,12 +1160,17 @@ bool KeyHandler::handleDeleteKeys(Key key, McBopomofo::InputState* state,
   } else if (reading_.isEmpty()) {
     bool isValidDelete = false;
 
-    if (key.ascii == Key::BACKSPACE && grid_.cursor() > 0) {
-      grid_.deleteReadingBeforeCursor();
-      isValidDelete = true;
-    } else if (key.ascii == Key::DELETE && grid_.cursor() < grid_.length()) {
-      grid_.deleteReadingAfterCursor();
-      isValidDelete = true;
+    {
+      LatencyTracer::Scope scope(latencyTracer_.get(),
+                                 LatencyTracer::Stage::kGridUpdate);
+      if (key.ascii == Key::BACKSPACE && grid_.cursor() > 0) {
+        grid_.deleteReadingBeforeCursor();
+        isValidDelete = true;
+      } else if (key.ascii == Key::DELETE &&
+                 grid_.cursor() < grid_.length()) {
+        grid_.deleteReadingAfterCursor();
+        isValidDelete = true;
+      }
     }
     if (!isValidDelete) {
       errorCallback();
@@ -1428,6 +1521,8 @@ std::string KeyHandler::getTaiwanBraille(BrailleType type) {
 }
 
 KeyHandler::ComposedString KeyHandler::getComposedString(size_t builderCursor) {
+  LatencyTracer::Scope scope(latencyTracer_.get(),
+                             LatencyTracer::Stage::kGetComposedString);
   // To construct an Inputting state, we need to first retrieve the entire
   // composing buffer from the current grid, then split the composed string
   // into head and tail, so that we can insert the current reading (if
@@ -1578,15 +1673,12 @@ std::unique_ptr<InputStates::Inputting> KeyHandler::buildInputtingState() {
 std::unique_ptr<InputStates::ChoosingCandidate>
 KeyHandler::buildChoosingCandidateState(InputStates::NotEmpty* nonEmptyState,
                                         size_t originalCursor) {
-  auto candidates = grid_.candidatesAt(actualCandidateCursorIndex());
-  std::vector<InputStates::ChoosingCandidate::Candidate> stateCandidates;
-  for (const auto& c : candidates) {
-    stateCandidates.emplace_back(c.reading, c.value, c.rawValue);
-  }
-
+  InputStates::ChoosingCandidate::CandidateList candidates(
+      std::make_shared<GridCandidateSource>(
+          grid_.candidateNodesAt(actualCandidateCursorIndex())));
   return std::make_unique<InputStates::ChoosingCandidate>(
       nonEmptyState->composingBuffer, nonEmptyState->cursorIndex,
-      originalCursor, std::move(stateCandidates));
+      originalCursor, std::move(candidates));
 }
 
 std::unique_ptr<InputStates::Marking> KeyHandler::buildMarkingState(
@@ -1804,7 +1896,8 @@ void KeyHandler::pinNode(
     return;
   }
 
-  Formosa::Gramambular2::ReadingGrid::WalkResult prevWalk = latestWalk_;
+  Formosa::Gramambular2::ReadingGrid::WalkResult prevWalk =
+      std::move(latestWalk_);
   walk();
 
   // Update the user override model if warranted.
@@ -1924,6 +2017,24 @@ void KeyHandler::pinNodeWithAssociatedPhrase(
   // Cursor is already at accumulatedCursor, so no more work here.
 }
 
-void KeyHandler::walk() { latestWalk_ = grid_.walk(); }
+void KeyHandler::walk() {
+  LatencyTracer::Scope scope(latencyTracer_.get(), LatencyTracer::Stage::kWalk);
+  latestWalk_ = grid_.walk();
+}
+
+std::string KeyHandler::popSettledText() {
+  if (autoCommitDistance_ == 0 || grid_.cursor() < autoCommitDistance_) {
+    return {};
+  }
+  size_t settled =
+      grid_.settledPrefixLength(grid_.cursor() - autoCommitDistance_);
+  if (settled == 0) {
+    return {};
+  }
+  std::string text = getComposedString(settled).head;
+  grid_.removeLeadingReadings(settled);
+  walk();
+  return text;
+}
 
 }  // namespace McBopomofo
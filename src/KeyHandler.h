@@ -29,8 +29,10 @@
 #include <string>
 
 #include "DictionaryService.h"
+#include "Engine/LatencyTracer.h"
 #include "Engine/Mandarin/Mandarin.h"
 #include "Engine/UserOverrideModel.h"
+#include "Engine/UserOverrideModelStore.h"
 #include "Engine/gramambular2/language_model.h"
 #include "Engine/gramambular2/reading_grid.h"
 #include "InputMode.h"
@@ -185,6 +187,21 @@ class KeyHandler {
     return bopomofoFontAnnotationSupportEnabled_;
   }
 
+  // Sets how many readings behind the cursor the text settled by the walk is
+  // committed while typing, which keeps a long composing buffer short. 0
+  // disables auto-committing.
+  void setAutoCommitDistance(size_t distance);
+
+  // Sets the tracer that times the grid updates, the walks, and the composed
+  // strings. Null, the default, disables the timing.
+  void setLatencyTracer(std::shared_ptr<LatencyTracer> tracer);
+
+  // Keeps the user override model in the directory, so that what it learned
+  // before is loaded and what it learns from now on is saved. The model is
+  // reset first. An empty directory keeps the model in memory only, which is
+  // the default.
+  void setUserOverrideModelDirectory(const std::string& directory);
+
   // Compute the actual candidate cursor index based on the current index.
   size_t actualCandidateCursorIndex();
   // Compute the actual candidate cursor index.
@@ -300,6 +317,11 @@ class KeyHandler {
 
   void walk();
 
+  // Removes the readings settled by the walk that are at least
+  // autoCommitDistance_ behind the cursor, walks again, and returns their
+  // composed text. Returns an empty string if nothing is removed.
+  std::string popSettledText();
+
   std::shared_ptr<Formosa::Gramambular2::LanguageModel> lm_;
   std::shared_ptr<VariantAnnotator> variantAnnotator_;
   Formosa::Gramambular2::ReadingGrid grid_;
@@ -307,6 +329,8 @@ class KeyHandler {
   std::unique_ptr<LocalizedStrings> localizedStrings_;
 
   UserOverrideModel userOverrideModel_;
+  // Declared after the model, which it records, so that it is destroyed first.
+  std::unique_ptr<UserOverrideModelStore> userOverrideModelStore_;
   Formosa::Mandarin::BopomofoReadingBuffer reading_;
   Formosa::Gramambular2::ReadingGrid::WalkResult latestWalk_;
   std::shared_ptr<DictionaryServices> dictionaryServices_;
@@ -324,8 +348,10 @@ class KeyHandler {
   bool repeatedPunctuationToSelectCandidateEnabled_ = false;
   bool chooseCandidateUsingSpace_ = true;
   bool bopomofoFontAnnotationSupportEnabled_ = false;
+  size_t autoCommitDistance_ = 0;
   KeyHandlerCtrlEnter ctrlEnterKey_ = KeyHandlerCtrlEnter::Disabled;
   std::function<void(const std::string&)> onAddNewPhrase_;
+  std::shared_ptr<LatencyTracer> latencyTracer_;
 
 #pragma endregion Settings
 
@@ -0,0 +1,309 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+// Replays recorded key sequences through KeyHandler, without fcitx, and
+// reports the per-key latency percentiles, the allocations made per key, and
+// the walk statistics of each scenario. The real data.txt is required.
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Engine/LatencyTracer.h"
+#include "Engine/McBopomofoLM.h"
+#include "KeyHandler.h"
+#include "KeyHandlerTestFakes.h"
+
+namespace {
+
+std::atomic<uint64_t> allocationCount{0};
+
+}  // namespace
+
+// Counts every allocation made by the process. Only the differences taken
+// around KeyHandler::handle() are reported.
+void* operator new(size_t size) {
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+using McBopomofo::InputState;
+using McBopomofo::Key;
+using McBopomofo::KeyHandler;
+using McBopomofo::LatencyHistogram;
+using McBopomofo::LatencyTracer;
+namespace InputStates = McBopomofo::InputStates;
+
+static const char* kDataPath = "mcbopomofo-test-data.txt";
+static const char* kAssociatedPhrasesPath =
+    "mcbopomofo-test-associated-phrases.txt";
+
+// 今天天氣很好我們去公園散步
+static const char* kSentence = "rup wu0 wu0 fu4cp3cl3ji3ap7fm4ej/ m06n041j4";
+static constexpr int kSentenceRepeats = 4;
+
+std::vector<Key> AsciiKeys(const std::string& keyString, int repeats = 1) {
+  std::vector<Key> keys;
+  for (int i = 0; i < repeats; i++) {
+    for (const char chr : keyString) {
+      keys.emplace_back(Key::asciiKey(chr));
+    }
+  }
+  return keys;
+}
+
+std::vector<Key> LongSentenceKeys() {
+  std::vector<Key> keys = AsciiKeys(kSentence, kSentenceRepeats);
+  keys.emplace_back(Key::asciiKey(Key::RETURN));
+  return keys;
+}
+
+// Drives a KeyHandler the way McBopomofoEngine does, timing each key.
+class Replayer {
+ public:
+  Replayer()
+      : languageModel_(std::make_shared<McBopomofo::McBopomofoLM>()),
+        tracer_(std::make_shared<LatencyTracer>()) {
+    languageModel_->loadLanguageModel(kDataPath);
+    if (std::filesystem::exists(kAssociatedPhrasesPath)) {
+      languageModel_->loadAssociatedPhrasesV2(kAssociatedPhrasesPath);
+    }
+    keyHandler_ = std::make_unique<KeyHandler>(
+        languageModel_, McBopomofo::CreateLoadedAnnotator(),
+        std::make_shared<McBopomofo::MockUserPhraseAdder>(),
+        std::make_unique<McBopomofo::MockLocalizedString>());
+    tracer_->setEnabled(true);
+    tracer_->setLookupCounter([lm = languageModel_.get()]() {
+      return lm->lookupCount();
+    });
+    tracer_->setCacheCounter([lm = languageModel_.get()]() {
+      const auto& stats = lm->unigramCacheStats();
+      return LatencyTracer::CacheCounts{stats.hits, stats.misses};
+    });
+    keyHandler_->setLatencyTracer(tracer_);
+    reset();
+  }
+
+  KeyHandler* keyHandler() { return keyHandler_.get(); }
+
+  void reset() {
+    keyHandler_->reset();
+    state_ = std::make_unique<InputStates::Empty>();
+  }
+
+  void handle(const Key& key) {
+    // An auto-triggered associated phrase list does not take the key, and the
+    // engine goes back to the inputting state first.
+    auto* associatedPhrases =
+        dynamic_cast<InputStates::AssociatedPhrases*>(state_.get());
+    if (associatedPhrases != nullptr && associatedPhrases->autoTriggered) {
+      state_ = keyHandler_->buildInputtingState();
+    }
+
+    uint64_t allocations = allocationCount.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    {
+      LatencyTracer::KeystrokeScope keystroke(tracer_.get());
+      keyHandler_->handle(
+          key, state_.get(),
+          [this](std::unique_ptr<InputState> next) {
+            setState(std::move(next));
+          },
+          [] {});
+    }
+    keyLatencies_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start)
+                             .count());
+    allocations_ +=
+        allocationCount.load(std::memory_order_relaxed) - allocations;
+  }
+
+  // Picks the second candidate (or the only one) of the choosing state, if
+  // the current state is one.
+  void selectCandidate() {
+    auto* choosing =
+        dynamic_cast<InputStates::ChoosingCandidate*>(state_.get());
+    if (choosing == nullptr || choosing->candidates.size() == 0) {
+      return;
+    }
+    uint64_t allocations = allocationCount.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    {
+      LatencyTracer::KeystrokeScope keystroke(tracer_.get());
+      const size_t index = 1 % choosing->candidates.size();
+      keyHandler_->candidateSelected(
+          choosing->candidates[index], choosing->originalCursor,
+          [this](std::unique_ptr<InputState> next) {
+            setState(std::move(next));
+          });
+    }
+    keyLatencies_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start)
+                             .count());
+    allocations_ +=
+        allocationCount.load(std::memory_order_relaxed) - allocations;
+  }
+
+  // Reports the statistics of all the keys replayed so far.
+  void report(benchmark::State& state) const {
+    const uint64_t keys = keyLatencies_.count();
+    if (keys == 0) {
+      return;
+    }
+    const auto& walks = tracer_->histogram(LatencyTracer::Stage::kWalk);
+    state.counters["p50_us"] = keyLatencies_.valueAtPercentile(50) / 1000.0;
+    state.counters["p90_us"] = keyLatencies_.valueAtPercentile(90) / 1000.0;
+    state.counters["p99_us"] = keyLatencies_.valueAtPercentile(99) / 1000.0;
+    state.counters["max_us"] = keyLatencies_.max() / 1000.0;
+    state.counters["allocs_per_key"] =
+        static_cast<double>(allocations_) / static_cast<double>(keys);
+    state.counters["walks_per_key"] =
+        static_cast<double>(walks.count()) / static_cast<double>(keys);
+    state.counters["walk_p99_us"] = walks.valueAtPercentile(99) / 1000.0;
+    state.counters["lookups_per_key"] = tracer_->lookups().mean();
+    state.counters["cache_hit_rate"] = tracer_->cacheHitRate();
+  }
+
+ private:
+  void setState(std::unique_ptr<InputState> next) {
+    if (auto* seq = dynamic_cast<InputStates::StateSequence*>(next.get())) {
+      for (auto& s : seq->states) {
+        setState(std::move(s));
+      }
+      return;
+    }
+    if (dynamic_cast<InputStates::EmptyIgnoringPrevious*>(next.get()) !=
+        nullptr) {
+      // Transition required by the contract of EmptyIgnoringPrevious.
+      state_ = std::make_unique<InputStates::Empty>();
+      return;
+    }
+    state_ = std::move(next);
+  }
+
+  std::shared_ptr<McBopomofo::McBopomofoLM> languageModel_;
+  std::shared_ptr<LatencyTracer> tracer_;
+  std::unique_ptr<KeyHandler> keyHandler_;
+  std::unique_ptr<InputState> state_;
+  LatencyHistogram keyLatencies_;
+  uint64_t allocations_ = 0;
+};
+
+bool CheckDataFile(benchmark::State& state) {
+  if (!std::filesystem::exists(kDataPath)) {
+    state.SkipWithError("mcbopomofo-test-data.txt not found");
+    return false;
+  }
+  return true;
+}
+
+void ReplayLongSentence(benchmark::State& state, Replayer& replayer) {
+  const auto keys = LongSentenceKeys();
+  for (auto _ : state) {
+    for (const Key& key : keys) {
+      replayer.handle(key);
+    }
+    replayer.reset();
+  }
+  replayer.report(state);
+}
+
+static void BM_KeyHandlerLongSentence(benchmark::State& state) {
+  if (!CheckDataFile(state)) {
+    return;
+  }
+  Replayer replayer;
+  ReplayLongSentence(state, replayer);
+}
+BENCHMARK(BM_KeyHandlerLongSentence);
+
+// Types the sentence, then goes back to the start and picks a different
+// candidate at every position.
+static void BM_KeyHandlerCandidateSelection(benchmark::State& state) {
+  if (!CheckDataFile(state)) {
+    return;
+  }
+  Replayer replayer;
+  const auto keys = AsciiKeys(kSentence);
+  const size_t syllables = 13;
+  for (auto _ : state) {
+    for (const Key& key : keys) {
+      replayer.handle(key);
+    }
+    replayer.handle(Key::namedKey(Key::KeyName::HOME));
+    for (size_t i = 0; i < syllables; i++) {
+      replayer.handle(Key::asciiKey(Key::SPACE));
+      replayer.selectCandidate();
+      replayer.handle(Key::namedKey(Key::KeyName::RIGHT));
+    }
+    replayer.handle(Key::asciiKey(Key::RETURN));
+    replayer.reset();
+  }
+  replayer.report(state);
+}
+BENCHMARK(BM_KeyHandlerCandidateSelection);
+
+// Each syllable typed brings up the associated phrases of the phrase before
+// the cursor.
+static void BM_KeyHandlerAssociatedPhrases(benchmark::State& state) {
+  if (!CheckDataFile(state)) {
+    return;
+  }
+  Replayer replayer;
+  replayer.keyHandler()->setAssociatedPhrasesEnabled(true);
+  ReplayLongSentence(state, replayer);
+}
+BENCHMARK(BM_KeyHandlerAssociatedPhrases);
+
+// Every composed string is annotated with the variants of the readings.
+static void BM_KeyHandlerFontAnnotation(benchmark::State& state) {
+  if (!CheckDataFile(state)) {
+    return;
+  }
+  Replayer replayer;
+  replayer.keyHandler()->setBopomofoFontAnnotationSupportEnabled(true);
+  ReplayLongSentence(state, replayer);
+}
+BENCHMARK(BM_KeyHandlerFontAnnotation);
+
+}  // namespace
+
+BENCHMARK_MAIN();
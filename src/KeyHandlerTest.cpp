@@ -27,6 +27,7 @@
 #include <vector>
 
 #include "KeyHandler.h"
+#include "KeyHandlerTestFakes.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -34,80 +35,6 @@ namespace McBopomofo {
 
 constexpr char kTestDataPath[] = "mcbopomofo-test-data.txt";
 
-constexpr char kTestVariantsData[] =
-    u8"# format org.openvanilla.mcbopomofo.sorted\n"
-    u8"一-na 一\U000E01E0\n"
-    u8"一-ㄧ 一\n"
-    u8"一-ㄧˊ 一\U000E01E1\n"
-    u8"一-ㄧˋ 一\U000E01E2\n"
-    u8"個-na 個\U000E01E0\n"
-    u8"個-ㄍㄜˇ 個\U000E01E2\n"
-    u8"個-ㄍㄜˋ 個\n"
-    u8"個-ㄍㄜ˙ 個\U000E01E1";
-
-constexpr char kTestPUAData[] =
-    u8"# format org.openvanilla.mcbopomofo.sorted\n"
-    u8"ㄍㄚˋ \uF145\n"
-    u8"ㄧㄚˊ \uF4BB";
-
-static std::shared_ptr<VariantAnnotator> CreateLoadedAnnotator() {
-  auto annotator = std::make_shared<VariantAnnotator>();
-  annotator->loadVariantsMap(ParselessPhraseDB::CreateValidatedDB(
-      kTestVariantsData, strlen(kTestVariantsData)));
-  annotator->loadPUAMap(
-      ParselessPhraseDB::CreateValidatedDB(kTestPUAData, strlen(kTestPUAData)));
-  EXPECT_TRUE(annotator->loaded());
-  return annotator;
-}
-
-class MockUserPhraseAdder : public UserPhraseAdder {
- public:
-  void addUserPhrase(const std::string_view&,
-                     const std::string_view&) override {}
-  void removeUserPhrase(const std::string_view&,
-                        const std::string_view&) override {}
-};
-
-class MockLocalizedString : public KeyHandler::LocalizedStrings {
- public:
-  std::string cursorIsBetweenSyllables(
-      const std::string& prevReading, const std::string& nextReading) override {
-    return std::string("between ") + prevReading + " and " + nextReading;
-  }
-
-  std::string syllablesRequired(size_t syllables) override {
-    return std::to_string(syllables) + " syllables required";
-  }
-
-  std::string syllablesMaximum(size_t syllables) override {
-    return std::to_string(syllables) + " syllables maximum";
-  }
-
-  std::string phraseAlreadyExists() override { return "phrase already exists"; }
-
-  std::string pressEnterToAddThePhrase() override {
-    return "press Enter to add the phrase";
-  }
-
-  std::string markedWithSyllablesAndStatus(const std::string& marked,
-                                           const std::string& readingUiText,
-                                           const std::string& status) override {
-    return std::string("Marked: ") + marked + ", syllables: " + readingUiText +
-           ", " + status;
-  }
-
-  std::string bopomofoFontAnnotationModeTooltip(bool hasUnicodeVariantSelectors,
-                                                bool hasPUABlocks) override {
-    return std::string("Bopomofo font annotation mode, has variants: ") +
-           (hasUnicodeVariantSelectors ? "yes" : "no") +
-           ", has PUA: " + (hasPUABlocks ? "yes" : "no");
-  }
-
-  std::string markingNotAvailableInFontAnnotationMode() override {
-    return "Cannot add new phrases when Bopomofo annotation is on";
-  }
-};
-
 class KeyHandlerTest : public ::testing::Test {
  protected:
   void SetUp() override {
@@ -116,6 +43,7 @@ class KeyHandlerTest : public ::testing::Test {
     ASSERT_TRUE(result);
     userPhraseAdder_ = std::make_shared<MockUserPhraseAdder>();
     variantAnnotator_ = CreateLoadedAnnotator();
+    EXPECT_TRUE(variantAnnotator_->loaded());
 
     keyHandler_ = std::make_unique<KeyHandler>(
         languageModel_, variantAnnotator_, userPhraseAdder_,
@@ -143,9 +71,13 @@ class KeyHandlerTest : public ::testing::Test {
       errorCallbackInvoked = false;
       handled = keyHandler_->handle(
           key, state.get(),
-          [&state](std::unique_ptr<McBopomofo::InputState> newState) {
+          [this, &state](std::unique_ptr<McBopomofo::InputState> newState) {
             auto processState =
-                [&state](std::unique_ptr<McBopomofo::InputState> s) {
+                [this, &state](std::unique_ptr<McBopomofo::InputState> s) {
+                  if (auto* committing =
+                          dynamic_cast<InputStates::Committing*>(s.get())) {
+                    committedText_ += committing->text;
+                  }
                   if (dynamic_cast<InputStates::EmptyIgnoringPrevious*>(
                           s.get()) != nullptr) {
                     // Transition required by the contract of
@@ -172,6 +104,9 @@ class KeyHandlerTest : public ::testing::Test {
     return state;
   }
 
+  // The text of all the Committing states seen by handleKeySequence().
+  std::string committedText_;
+
   std::shared_ptr<ParselessLM> languageModel_;
   std::shared_ptr<UserPhraseAdder> userPhraseAdder_;
   std::unique_ptr<KeyHandler> keyHandler_;
@@ -451,4 +386,42 @@ TEST_F(KeyHandlerTest, BopomofoAnnotation) {
   keyHandler_->setBopomofoFontAnnotationSupportEnabled(false);
 }
 
+TEST_F(KeyHandlerTest, NoAutoCommitByDefault) {
+  std::string keys;
+  std::string expected;
+  for (int i = 0; i < 10; i++) {
+    keys += "5j/ jp6";
+    expected += "中文";
+  }
+  auto endState = handleKeySequence(asciiKeys(keys));
+  auto inputtingState = dynamic_cast<InputStates::Inputting*>(endState.get());
+  ASSERT_TRUE(inputtingState != nullptr);
+  EXPECT_EQ(committedText_, "");
+  EXPECT_EQ(inputtingState->composingBuffer, expected);
+}
+
+TEST_F(KeyHandlerTest, AutoCommitSettledText) {
+  keyHandler_->setAutoCommitDistance(2);
+  std::string keys;
+  std::string expected;
+  for (int i = 0; i < 20; i++) {
+    keys += "5j/ jp6";
+    expected += "中文";
+  }
+  auto endState = handleKeySequence(asciiKeys(keys));
+  auto inputtingState = dynamic_cast<InputStates::Inputting*>(endState.get());
+  ASSERT_TRUE(inputtingState != nullptr);
+
+  // Nothing is lost or repeated, and the buffer is no longer than the
+  // distance plus the window that the walk may still change.
+  EXPECT_FALSE(committedText_.empty());
+  EXPECT_EQ(committedText_ + inputtingState->composingBuffer, expected);
+  EXPECT_LE(inputtingState->composingBuffer.length(),
+            (2 + Formosa::Gramambular2::ReadingGrid::kMaximumSpanLength) *
+                strlen("中"));
+  EXPECT_EQ(inputtingState->cursorIndex,
+            inputtingState->composingBuffer.length());
+  keyHandler_->setAutoCommitDistance(0);
+}
+
 }  // namespace McBopomofo
@@ -0,0 +1,116 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_KEYHANDLERTESTFAKES_H_
+#define SRC_KEYHANDLERTESTFAKES_H_
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "Engine/ParselessPhraseDB.h"
+#include "Engine/VariantAnnotator.h"
+#include "KeyHandler.h"
+
+// The fakes for running KeyHandler without fcitx, shared by KeyHandlerTest
+// and KeyHandlerBenchmark.
+
+namespace McBopomofo {
+
+constexpr char kTestVariantsData[] =
+    u8"# format org.openvanilla.mcbopomofo.sorted\n"
+    u8"一-na 一\U000E01E0\n"
+    u8"一-ㄧ 一\n"
+    u8"一-ㄧˊ 一\U000E01E1\n"
+    u8"一-ㄧˋ 一\U000E01E2\n"
+    u8"個-na 個\U000E01E0\n"
+    u8"個-ㄍㄜˇ 個\U000E01E2\n"
+    u8"個-ㄍㄜˋ 個\n"
+    u8"個-ㄍㄜ˙ 個\U000E01E1";
+
+constexpr char kTestPUAData[] =
+    u8"# format org.openvanilla.mcbopomofo.sorted\n"
+    u8"ㄍㄚˋ \uF145\n"
+    u8"ㄧㄚˊ \uF4BB";
+
+inline std::shared_ptr<VariantAnnotator> CreateLoadedAnnotator() {
+  auto annotator = std::make_shared<VariantAnnotator>();
+  annotator->loadVariantsMap(ParselessPhraseDB::CreateValidatedDB(
+      kTestVariantsData, strlen(kTestVariantsData)));
+  annotator->loadPUAMap(
+      ParselessPhraseDB::CreateValidatedDB(kTestPUAData, strlen(kTestPUAData)));
+  return annotator;
+}
+
+class MockUserPhraseAdder : public UserPhraseAdder {
+ public:
+  void addUserPhrase(const std::string_view&,
+                     const std::string_view&) override {}
+  void removeUserPhrase(const std::string_view&,
+                        const std::string_view&) override {}
+};
+
+class MockLocalizedString : public KeyHandler::LocalizedStrings {
+ public:
+  std::string cursorIsBetweenSyllables(
+      const std::string& prevReading, const std::string& nextReading) override {
+    return std::string("between ") + prevReading + " and " + nextReading;
+  }
+
+  std::string syllablesRequired(size_t syllables) override {
+    return std::to_string(syllables) + " syllables required";
+  }
+
+  std::string syllablesMaximum(size_t syllables) override {
+    return std::to_string(syllables) + " syllables maximum";
+  }
+
+  std::string phraseAlreadyExists() override { return "phrase already exists"; }
+
+  std::string pressEnterToAddThePhrase() override {
+    return "press Enter to add the phrase";
+  }
+
+  std::string markedWithSyllablesAndStatus(const std::string& marked,
+                                           const std::string& readingUiText,
+                                           const std::string& status) override {
+    return std::string("Marked: ") + marked + ", syllables: " + readingUiText +
+           ", " + status;
+  }
+
+  std::string bopomofoFontAnnotationModeTooltip(bool hasUnicodeVariantSelectors,
+                                                bool hasPUABlocks) override {
+    return std::string("Bopomofo font annotation mode, has variants: ") +
+           (hasUnicodeVariantSelectors ? "yes" : "no") +
+           ", has PUA: " + (hasPUABlocks ? "yes" : "no");
+  }
+
+  std::string markingNotAvailableInFontAnnotationMode() override {
+    return "Cannot add new phrases when Bopomofo annotation is on";
+  }
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_KEYHANDLERTESTFAKES_H_
@@ -38,26 +38,49 @@ namespace McBopomofo {
 
 constexpr char kDataPath[] = "data/mcbopomofo-data.txt";
 constexpr char kDataPathPlainBPMF[] = "data/mcbopomofo-data-plain-bpmf.txt";
+constexpr char kCompiledDataPath[] = "data/mcbopomofo-data.bin";
+constexpr char kCompiledDataPathPlainBPMF[] =
+    "data/mcbopomofo-data-plain-bpmf.bin";
 constexpr char kUserPhraseFilename[] = "data.txt";  // same as macOS version
 constexpr char kExcludedPhraseFilename[] = "exclude-phrases.txt";  // ditto
 constexpr char kAssociatedPhrasesV2Path[] =
     "data/mcbopomofo-associated-phrases-v2.txt";
 constexpr char kPhrasesReplacementFilename[] = "phrases-replacement.txt";
+constexpr char kUserPhraseJournalFilename[] = "user-phrases.journal";
 constexpr char kBpmfvPUAFilename[] = "data/mcbopomofo-bpmfvs-pua.txt";
 constexpr char kBpmfvVariantsFilename[] = "data/mcbopomofo-bpmfvs-variants.txt";
 
+// Prefers the compiled LM (see mcbopomofo-compile-db) and falls back to the
+// text LM if the compiled one is not installed.
+static std::string LocateBuiltInLM(const char* compiledPath,
+                                   const char* textPath) {
+  std::string path = McBopomofo::fcitx5_compat::locate(compiledPath);
+  if (!path.empty()) {
+    return path;
+  }
+  return McBopomofo::fcitx5_compat::locate(textPath);
+}
+
 LanguageModelLoader::LanguageModelLoader(
     std::unique_ptr<LocalizedStrings> localizedStrings)
     : localizedStrings_(std::move(localizedStrings)),
       lm_(std::make_shared<McBopomofoLM>()),
       variantAnnotator_(std::make_shared<VariantAnnotator>()) {
-  std::string buildInLMPath = McBopomofo::fcitx5_compat::locate(kDataPath);
+  std::string buildInLMPath = LocateBuiltInLM(kCompiledDataPath, kDataPath);
   FCITX_MCBOPOMOFO_INFO() << "Built-in LM: " << buildInLMPath;
+  lm_->setKeyFiltersEnabled(true);
   lm_->loadLanguageModel(buildInLMPath.c_str());
   if (!lm_->isDataModelLoaded()) {
     FCITX_MCBOPOMOFO_INFO() << "Failed to open built-in LM";
   }
 
+  // Keep the Plain Bopomofo LM open and warm as well, so that switching the
+  // input mode in loadModelForMode() is only a swap.
+  std::string plainBPMFLMPath =
+      LocateBuiltInLM(kCompiledDataPathPlainBPMF, kDataPathPlainBPMF);
+  FCITX_MCBOPOMOFO_INFO() << "Preloading built-in LM: " << plainBPMFLMPath;
+  lm_->preloadLanguageModel(plainBPMFLMPath.c_str());
+
   std::string puaFilePath =
       McBopomofo::fcitx5_compat::locate(kBpmfvPUAFilename);
   std::string variantsFilePath =
@@ -101,6 +124,7 @@ LanguageModelLoader::LanguageModelLoader(
     }
   }
 
+  std::string userStatePath = userDataPath + "/mcbopomofo-state";
   userDataPath += "/mcbopomofo";
   if (!std::filesystem::exists(userDataPath, err)) {
     bool result = std::filesystem::create_directory(userDataPath, err);
@@ -115,6 +139,22 @@ LanguageModelLoader::LanguageModelLoader(
     }
   }
 
+  // The files that record what the user types are kept out of the user data
+  // directory, which the add phrase hook commits and pushes.
+  if (!std::filesystem::exists(userStatePath, err)) {
+    bool result = std::filesystem::create_directory(userStatePath, err);
+    if (result) {
+      FCITX_MCBOPOMOFO_INFO()
+          << "Created mcbopomofo user state directory: " << userStatePath;
+    } else {
+      FCITX_MCBOPOMOFO_WARN()
+          << "Failed to create mcbopomofo user state directory: "
+          << userStatePath;
+      userStatePath.clear();
+    }
+  }
+  userStatePath_ = userStatePath;
+
   // We just use very simple file handling routines.
   userDataPath_ = userDataPath;
   userPhrasesPath_ = TimestampedPath(userDataPath + "/" + kUserPhraseFilename);
@@ -124,15 +164,24 @@ LanguageModelLoader::LanguageModelLoader(
       TimestampedPath(userDataPath + "/" + kPhrasesReplacementFilename);
   populateUserDataFilesIfNeeded();
   reloadUserModelsIfNeeded();
+
+  // Apply the edits that were not compacted last time. The journal is not a
+  // user file, so it goes in the state directory, unless there is none.
+  std::string journalDirectory =
+      userStatePath_.empty() ? userDataPath : userStatePath_;
+  userPhraseJournal_ =
+      UserPhraseJournal(journalDirectory + "/" + kUserPhraseJournalFilename);
+  compactUserPhrases();
 }
 
 void LanguageModelLoader::loadModelForMode(McBopomofo::InputMode mode) {
-  const char* path = mode == McBopomofo::InputMode::PlainBopomofo
-                         ? kDataPathPlainBPMF
-                         : kDataPath;
-
-  std::string buildInLMPath = McBopomofo::fcitx5_compat::locate(path);
+  bool plain = mode == McBopomofo::InputMode::PlainBopomofo;
+  std::string buildInLMPath =
+      plain ? LocateBuiltInLM(kCompiledDataPathPlainBPMF, kDataPathPlainBPMF)
+            : LocateBuiltInLM(kCompiledDataPath, kDataPath);
 
+  // Both LMs are resident (see the constructor), so unless the file has been
+  // replaced, this only makes the LM of the mode the active one.
   FCITX_MCBOPOMOFO_INFO() << "Built-in LM: " << buildInLMPath;
   lm_->loadLanguageModel(buildInLMPath.c_str());
   if (!lm_->isDataModelLoaded()) {
@@ -150,20 +199,22 @@ void LanguageModelLoader::addUserPhrase(const std::string_view& reading,
         << "Not writing user phrases: data file does not exist";
     return;
   }
-  removePhraseFromFile(excludedPhrasesPath_.path(), readingStr, phraseStr);
-  if (checkIfPhraseExists(userPhrasesPath_.path(), readingStr, phraseStr)) {
+  if (lm_->hasUserPhrase(readingStr, phraseStr)) {
     FCITX_MCBOPOMOFO_INFO()
         << "Phrase already exists: " << phrase << ", reading: " << reading;
     return;
   }
-  if (!addPhraseToEndOfFile(userPhrasesPath_.path(), readingStr, phraseStr)) {
+  // Journal first; the append is synced, so the edit survives a crash or a
+  // power loss before compaction.
+  if (!userPhraseJournal_.append({true, readingStr, phraseStr})) {
     FCITX_MCBOPOMOFO_WARN()
         << "Failed to add user phrase: " << phrase << ", reading: " << reading;
     return;
   }
+  lm_->addUserPhrase(readingStr, phraseStr);
   FCITX_MCBOPOMOFO_INFO() << "Added user phrase: " << phrase
                           << ", reading: " << reading;
-  reloadUserModelsIfNeeded();
+  userPhrasesEdited();
 }
 
 void LanguageModelLoader::removeUserPhrase(const std::string_view& reading,
@@ -175,21 +226,52 @@ void LanguageModelLoader::removeUserPhrase(const std::string_view& reading,
         << "Not writing excluded phrases: data file does not exist";
     return;
   }
-  removePhraseFromFile(userPhrasesPath_.path(), readingStr, phraseStr);
-  if (checkIfPhraseExists(excludedPhrasesPath_.path(), readingStr, phraseStr)) {
+  if (!lm_->hasUserPhrase(readingStr, phraseStr) &&
+      lm_->isPhraseExcluded(readingStr, phraseStr)) {
     FCITX_MCBOPOMOFO_INFO()
         << "Phrase already excluded: " << phrase << ", reading: " << reading;
     return;
   }
-  if (!addPhraseToEndOfFile(excludedPhrasesPath_.path(), readingStr,
-                            phraseStr)) {
+  if (!userPhraseJournal_.append({false, readingStr, phraseStr})) {
     FCITX_MCBOPOMOFO_WARN()
         << "Failed to exclude phrase: " << phrase << ", reading: " << reading;
     return;
   }
+  lm_->removeUserPhrase(readingStr, phraseStr);
   FCITX_MCBOPOMOFO_INFO() << "Excluded phrase: " << phrase
                           << ", reading: " << reading;
-  reloadUserModelsIfNeeded();
+  userPhrasesEdited();
+}
+
+void LanguageModelLoader::userPhrasesEdited() {
+  if (userPhraseJournal_.size() >= kMaxUserPhraseJournalSize) {
+    compactUserPhrases();
+    return;
+  }
+  if (onUserPhrasesEdited_) {
+    onUserPhrasesEdited_();
+  }
+}
+
+bool LanguageModelLoader::compactUserPhrases() {
+  if (userPhraseJournal_.size() == 0) {
+    return false;
+  }
+  if (!userPhraseJournal_.compactInto(userPhrasesPath_.path(),
+                                      excludedPhrasesPath_.path())) {
+    FCITX_MCBOPOMOFO_WARN() << "Failed to compact user phrase journal: "
+                            << userPhraseJournal_.path();
+    return false;
+  }
+  FCITX_MCBOPOMOFO_INFO() << "Compacted user phrase journal";
+
+  // The files now include the edits.
+  lm_->clearUserPhraseEdits();
+  lm_->loadUserPhrases(userPhrasesPath_.path().c_str(),
+                       excludedPhrasesPath_.path().c_str());
+  userPhrasesPath_.checkTimestamp();
+  excludedPhrasesPath_.checkTimestamp();
+  return true;
 }
 
 bool LanguageModelLoader::reloadUserModelsIfNeeded() {
@@ -255,6 +337,15 @@ bool LanguageModelLoader::reloadUserModelsIfNeeded() {
   return shouldReloadUserPhrases || shouldReloadPhrasesReplacement;
 }
 
+std::vector<std::filesystem::path> LanguageModelLoader::userDataFilePaths()
+    const {
+  if (userDataPath_.empty()) {
+    return {};
+  }
+  return {userPhrasesPath_.path(), excludedPhrasesPath_.path(),
+          phrasesReplacementPath_.path()};
+}
+
 std::vector<McBopomofoLM::UserFileIssue>
 LanguageModelLoader::getUserFileIssues() const {
   return lm_->getUserFileIssues();
@@ -281,162 +372,4 @@ void LanguageModelLoader::populateUserDataFilesIfNeeded() {
   }
 }
 
-bool LanguageModelLoader::checkIfPhraseExists(const std::filesystem::path& path,
-                                              const std::string& reading,
-                                              const std::string& value) const {
-  std::string joined = std::string(value) + " " + std::string(reading);
-  std::ifstream file(path);
-  if (!file.is_open()) {
-    FCITX_MCBOPOMOFO_WARN() << "Failed to open file: " << path;
-    return false;
-  }
-
-  std::string line;
-  while (std::getline(file, line)) {
-    // Skip comments and empty lines
-    if (line.empty() || line[0] == '#') {
-      continue;
-    }
-
-    // Remove trailing whitespace
-    size_t end = line.find_last_not_of(" \t\r\n");
-    if (end != std::string::npos) {
-      line = line.substr(0, end + 1);
-    }
-
-    if (line == joined) {
-      return true;
-    }
-  }
-  return false;
-}
-
-bool LanguageModelLoader::addPhraseToEndOfFile(
-    const std::filesystem::path& path, const std::string& reading,
-    const std::string& value) const {
-  // First check if file exists
-  if (!std::filesystem::exists(path)) {
-    FCITX_MCBOPOMOFO_WARN() << "File does not exist: " << path;
-    return false;
-  }
-
-  // Check if file is readable
-  std::ifstream fileCheck(path);
-  if (!fileCheck.is_open()) {
-    FCITX_MCBOPOMOFO_WARN() << "Failed to open file for reading: " << path;
-    return false;
-  }
-
-  // Check if file ends with a newline
-  bool needsNewline = false;
-  fileCheck.seekg(0, std::ios::end);
-  std::streampos fileSize = fileCheck.tellg();
-
-  if (fileSize > 0) {
-    fileCheck.seekg(-1, std::ios::end);
-    char lastChar;
-    if (fileCheck.get(lastChar)) {
-      needsNewline = (lastChar != '\n');
-    }
-  }
-  fileCheck.close();
-
-  // Open file for appending
-  std::ofstream file(path, std::ios::app);
-  if (!file.is_open()) {
-    FCITX_MCBOPOMOFO_WARN() << "Failed to open file for writing: " << path;
-    return false;
-  }
-
-  // Add newline if needed, then add the new phrase
-  if (needsNewline) {
-    file << '\n';
-  }
-
-  // Write the phrase and reading to the file
-  file << value << " " << reading << '\n';
-
-  if (!file) {
-    FCITX_MCBOPOMOFO_WARN() << "Failed to write to file: " << path;
-    return false;
-  }
-
-  file.close();
-
-  FCITX_MCBOPOMOFO_INFO() << "Added phrase to file: " << value
-                          << ", reading: " << reading;
-  return true;
-}
-
-bool LanguageModelLoader::removePhraseFromFile(
-    const std::filesystem::path& path, const std::string& reading,
-    const std::string& value) const {
-  if (!std::filesystem::exists(path)) {
-    FCITX_MCBOPOMOFO_WARN() << "File does not exist: " << path;
-    return false;
-  }
-
-  std::string joined = value + " " + reading;
-  std::ifstream inFile(path);
-  if (!inFile.is_open()) {
-    FCITX_MCBOPOMOFO_WARN() << "Failed to open file for reading: " << path;
-    return false;
-  }
-
-  // Create a temporary file
-  std::string tempPath = path.string() + ".tmp";
-  std::ofstream outFile(tempPath);
-  if (!outFile.is_open()) {
-    FCITX_MCBOPOMOFO_WARN() << "Failed to create temporary file: " << tempPath;
-    return false;
-  }
-
-  std::string line;
-  bool removed = false;
-  while (std::getline(inFile, line)) {
-    // Preserve comments and empty lines
-    if (line.empty() || line[0] == '#') {
-      outFile << line << '\n';
-      continue;
-    }
-
-    // Trim trailing whitespace for comparison
-    std::string trimmedLine = line;
-    size_t end = trimmedLine.find_last_not_of(" \t\r\n");
-    if (end != std::string::npos) {
-      trimmedLine = trimmedLine.substr(0, end + 1);
-    }
-
-    // Skip the line if it matches what we want to remove
-    if (trimmedLine == joined) {
-      removed = true;
-      continue;
-    }
-
-    outFile << line << '\n';
-  }
-
-  inFile.close();
-  outFile.close();
-
-  // Replace the original file with the temporary one if something was removed
-  if (removed) {
-    std::error_code ec;
-    std::filesystem::rename(tempPath, path, ec);
-    if (ec) {
-      FCITX_MCBOPOMOFO_WARN()
-          << "Failed to rename temporary file: " << ec.message();
-      std::filesystem::remove(tempPath, ec);
-      return false;
-    }
-    FCITX_MCBOPOMOFO_INFO()
-        << "Removed phrase from file: " << value << ", reading: " << reading;
-    return true;
-  }
-
-  // If nothing was removed, delete the temp file
-  std::filesystem::remove(tempPath);
-  return false;
-}
-
 }  // namespace McBopomofo
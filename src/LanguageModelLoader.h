@@ -24,14 +24,20 @@
 #ifndef SRC_LANGUAGEMODELLOADER_H_
 #define SRC_LANGUAGEMODELLOADER_H_
 
+#include <cstddef>
+#include <filesystem>
+#include <functional>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 #include "Engine/McBopomofoLM.h"
 #include "InputMacro.h"
 #include "InputMode.h"
 #include "TimestampedPath.h"
+#include "UserPhraseJournal.h"
 #include "VariantAnnotator.h"
 
 namespace McBopomofo {
@@ -68,8 +74,35 @@ class LanguageModelLoader : public UserPhraseAdder {
 
   bool reloadUserModelsIfNeeded();
 
+  // The user phrase edits are journaled and applied to the LM right away;
+  // the files are only rewritten by compactUserPhrases(), which happens
+  // upon startup, when this many edits have been journaled, or whenever the
+  // owner calls it, preferably when the user is idle.
+  static constexpr size_t kMaxUserPhraseJournalSize = 1024;
+
+  // Rewrites the user phrase and excluded phrase files with the journaled
+  // edits and reloads them. Returns false if there was nothing to do or the
+  // files could not be written.
+  bool compactUserPhrases();
+
+  // Called after each journaled edit, so that the owner can schedule a
+  // compaction.
+  void setOnUserPhrasesEdited(std::function<void()> onUserPhrasesEdited) {
+    onUserPhrasesEdited_ = std::move(onUserPhrasesEdited);
+  }
+
+  // The user phrases, excluded phrases, and phrase replacement files, which
+  // are all in userDataPath(), or an empty list if there is no user data
+  // directory.
+  std::vector<std::filesystem::path> userDataFilePaths() const;
+
   std::string userDataPath() const { return userDataPath_; }
 
+  // The directory for the files the engine keeps for itself, such as the
+  // user override model, which are not meant to be edited or shared like
+  // the files in userDataPath(). Empty if it cannot be created.
+  std::string userStatePath() const { return userStatePath_; }
+
   std::string userPhrasesPath() const { return userPhrasesPath_.path(); }
 
   std::string excludedPhrasesPath() const {
@@ -80,15 +113,7 @@ class LanguageModelLoader : public UserPhraseAdder {
 
  private:
   void populateUserDataFilesIfNeeded();
-  bool checkIfPhraseExists(const std::filesystem::path& path,
-                           const std::string& reading,
-                           const std::string& value) const;
-  bool addPhraseToEndOfFile(const std::filesystem::path& path,
-                            const std::string& reading,
-                            const std::string& value) const;
-  bool removePhraseFromFile(const std::filesystem::path& path,
-                            const std::string& reading,
-                            const std::string& value) const;
+  void userPhrasesEdited();
 
   std::unique_ptr<LocalizedStrings> localizedStrings_;
 
@@ -96,9 +121,12 @@ class LanguageModelLoader : public UserPhraseAdder {
   std::shared_ptr<VariantAnnotator> variantAnnotator_;
 
   std::string userDataPath_;
+  std::string userStatePath_;
   TimestampedPath userPhrasesPath_;
   TimestampedPath excludedPhrasesPath_;
   TimestampedPath phrasesReplacementPath_;
+  UserPhraseJournal userPhraseJournal_;
+  std::function<void()> onUserPhrasesEdited_;
   InputMacroController inputMacroController_;
 
  public:
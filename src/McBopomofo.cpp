@@ -31,9 +31,12 @@
 #include <fmt/format.h>
 #include <notifications_public.h>  // from fcitx-module/notifications
 
+#include <ctime>
+#include <filesystem>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -47,6 +50,9 @@ namespace McBopomofo {
 
 constexpr char kConfigPath[] = "conf/mcbopomofo.conf";
 
+// Saved in the user data directory.
+constexpr char kLatencyFilename[] = "keystroke-latency.tsv";
+
 // These two are used to determine whether Shift-[1-9] is pressed.
 constexpr int kFcitxRawKeycode_1 = 10;
 constexpr int kFcitxRawKeycode_9 = 18;
@@ -195,26 +201,31 @@ static Key MapFcitxKey(const fcitx::Key& key, const fcitx::Key& origKey) {
   return Key{};
 }
 
-// The candidate word for the standard candidates.
+// The candidate word for the standard candidates. The word refers to the
+// candidate by its index in the shared list, so that the candidate is only
+// made when its page is shown or when it is selected.
 class McBopomofoCandidateWord : public fcitx::CandidateWord {
  public:
-  McBopomofoCandidateWord(fcitx::Text displayText,
-                          InputStates::ChoosingCandidate::Candidate candidate,
-                          size_t originalCursor,
-                          std::shared_ptr<KeyHandler> keyHandler,
-                          KeyHandler::StateCallback callback)
+  McBopomofoCandidateWord(
+      fcitx::Text displayText,
+      InputStates::ChoosingCandidate::CandidateList candidates, size_t index,
+      size_t originalCursor, std::shared_ptr<KeyHandler> keyHandler,
+      KeyHandler::StateCallback callback)
       : fcitx::CandidateWord(std::move(displayText)),
-        candidate_(std::move(candidate)),
+        candidates_(std::move(candidates)),
+        index_(index),
         originalCursor_(originalCursor),
         keyHandler_(std::move(keyHandler)),
         stateCallback_(std::move(callback)) {}
 
   void select(fcitx::InputContext* /*unused*/) const override {
-    keyHandler_->candidateSelected(candidate_, originalCursor_, stateCallback_);
+    keyHandler_->candidateSelected(candidates_[index_], originalCursor_,
+                                   stateCallback_);
   }
 
  private:
-  InputStates::ChoosingCandidate::Candidate candidate_;
+  InputStates::ChoosingCandidate::CandidateList candidates_;
+  size_t index_;
   size_t originalCursor_;
   std::shared_ptr<KeyHandler> keyHandler_;
   KeyHandler::StateCallback stateCallback_;
@@ -470,6 +481,19 @@ McBopomofoEngine::McBopomofoEngine(fcitx::Instance* instance)
       languageModelLoader_->getLM(),
       languageModelLoader_->getVariantAnnotator(), languageModelLoader_,
       std::make_unique<KeyHandlerLocalizedString>());
+  latencyTracer_ = std::make_shared<LatencyTracer>();
+  latencyTracer_->setLookupCounter(
+      [this]() { return languageModelLoader_->getLM()->lookupCount(); });
+  latencyTracer_->setCacheCounter([this]() {
+    const auto& stats = languageModelLoader_->getLM()->unigramCacheStats();
+    return LatencyTracer::CacheCounts{stats.hits, stats.misses};
+  });
+  keyHandler_->setLatencyTracer(latencyTracer_);
+  keyHandler_->setUserOverrideModelDirectory(
+      languageModelLoader_->userStatePath());
+  setUpUserDataWatcher();
+  languageModelLoader_->setOnUserPhrasesEdited(
+      [this]() { scheduleUserPhraseCompaction(); });
   keyHandler_->setOnAddNewPhrase([this](std::string newPhrase) {
     auto addScriptHookEnabled = config_.addScriptHookEnabled.value();
     if (!addScriptHookEnabled) {
@@ -480,6 +504,9 @@ McBopomofoEngine::McBopomofoEngine(fcitx::Instance* instance)
       scriptPath = kDefaultAddPhraseHookPath;
     }
 
+    // The hook commits the phrase files, so the journaled edit has to be in
+    // them first rather than waiting for the scheduled compaction.
+    languageModelLoader_->compactUserPhrases();
     auto userDataPath = languageModelLoader_->userDataPath();
     fcitx::startProcess({"/bin/sh", scriptPath, std::move(newPhrase)},
                         userDataPath);
@@ -580,6 +607,8 @@ McBopomofoEngine::McBopomofoEngine(fcitx::Instance* instance)
   editUserPhrasesAction_->setShortText(_("Edit User Phrases"));
   editUserPhrasesAction_->connect<fcitx::SimpleAction::Activated>(
       [this](fcitx::InputContext*) {
+        // The editor should see the journaled edits, too.
+        languageModelLoader_->compactUserPhrases();
         fcitx::startProcess({GetOpenFileWith(config_),
                              languageModelLoader_->userPhrasesPath()});
       });
@@ -590,12 +619,39 @@ McBopomofoEngine::McBopomofoEngine(fcitx::Instance* instance)
   excludedPhrasesAction_->setShortText(_("Edit Excluded Phrases"));
   excludedPhrasesAction_->connect<fcitx::SimpleAction::Activated>(
       [this](fcitx::InputContext*) {
+        // The editor should see the journaled edits, too.
+        languageModelLoader_->compactUserPhrases();
         fcitx::startProcess({GetOpenFileWith(config_),
                              languageModelLoader_->excludedPhrasesPath()});
       });
   instance_->userInterfaceManager().registerAction(
       "mcbopomofo-user-excluded-phrases-edit", excludedPhrasesAction_.get());
 
+  saveLatencyAction_ = std::make_unique<fcitx::SimpleAction>();
+  saveLatencyAction_->setShortText(_("Save Keystroke Latency"));
+  saveLatencyAction_->connect<fcitx::SimpleAction::Activated>(
+      [this](fcitx::InputContext*) {
+        // Not in the user data directory, which the add phrase hook pushes.
+        std::string directory = languageModelLoader_->userStatePath();
+        std::string path = directory + "/" + kLatencyFilename;
+        bool saved = !directory.empty() && latencyTracer_->dumpToFile(path);
+        std::string message =
+            saved ? fmt::format(FmtRuntime(_("Saved to {0}")), path)
+                  : fmt::format(FmtRuntime(_("Failed to save to {0}")), path);
+        if (notifications()) {
+          notifications()->call<fcitx::INotifications::showTip>(
+              "mcbopomofo-save-keystroke-latency", _("McBopomofo"),
+              "fcitx_mcbopomofo", _("Keystroke Latency"), message,
+              kFcitx5NotificationTimeoutInMs);
+        } else if (saved) {
+          FCITX_MCBOPOMOFO_INFO() << message;
+        } else {
+          FCITX_MCBOPOMOFO_ERROR() << message;
+        }
+      });
+  instance_->userInterfaceManager().registerAction(
+      "mcbopomofo-save-keystroke-latency", saveLatencyAction_.get());
+
   // Required by convention of fcitx5 modules to load config on its own.
   // NOLINTNEXTLINE(clang-analyzer-optin.cplusplus.VirtualCall)
   reloadConfig();
@@ -672,6 +728,11 @@ void McBopomofoEngine::activate(const fcitx::InputMethodEntry& entry,
                                          excludedPhrasesAction_.get());
   }
 
+  if (config_.latencyTracingEnabled.value()) {
+    inputContext->statusArea().addAction(fcitx::StatusGroup::InputMethod,
+                                         saveLatencyAction_.get());
+  }
+
   keyHandler_->setInputMode(mode);
 
   // NOLINTNEXTLINE(clang-analyzer-deadcode.DeadStores)
@@ -717,6 +778,9 @@ void McBopomofoEngine::activate(const fcitx::InputMethodEntry& entry,
       config_.repeatedPunctuationToSelectCandidateEnabled.value());
   keyHandler_->setChooseCandidateUsingSpace(
       config_.chooseCandidateUsingSpace.value());
+  keyHandler_->setAutoCommitDistance(
+      static_cast<size_t>(config_.autoCommitDistance.value()));
+  latencyTracer_->setEnabled(config_.latencyTracingEnabled.value());
 
   if (mode == McBopomofo::InputMode::McBopomofo) {
     // Font annotation is only supported in McBopomofo, not Plain McBopomofo.
@@ -726,9 +790,9 @@ void McBopomofoEngine::activate(const fcitx::InputMethodEntry& entry,
     keyHandler_->setBopomofoFontAnnotationSupportEnabled(false);
   }
 
-  bool didReload = languageModelLoader_->reloadUserModelsIfNeeded();
-  if (didReload) {
-    userFileIssues_ = languageModelLoader_->getUserFileIssues();
+  // When the files are watched, they have been reloaded as they changed.
+  if (!userDataWatcher_.isWatching()) {
+    reloadUserModels();
   }
 
   if (!userFileIssues_.empty()) {
@@ -788,6 +852,7 @@ void McBopomofoEngine::keyEvent(const fcitx::InputMethodEntry& /*unused*/,
     return;
   }
 
+  LatencyTracer::KeystrokeScope keystrokeScope(latencyTracer_.get());
   fcitx::InputContext* context = keyEvent.inputContext();
   fcitx::Key key = keyEvent.key();
   fcitx::Key origKey = keyEvent.rawKey();
@@ -824,18 +889,28 @@ void McBopomofoEngine::keyEvent(const fcitx::InputMethodEntry& /*unused*/,
     }
   }
 
-  if (dynamic_cast<InputStates::ChoosingCandidate*>(state_.get()) != nullptr ||
-      dynamic_cast<InputStates::SelectingDictionary*>(state_.get()) !=
-          nullptr ||
-      dynamic_cast<InputStates::ShowingCharInfo*>(state_.get()) != nullptr ||
-      dynamic_cast<InputStates::AssociatedPhrases*>(state_.get()) != nullptr ||
-      dynamic_cast<InputStates::AssociatedPhrasesPlain*>(state_.get()) !=
-          nullptr ||
-      dynamic_cast<InputStates::SelectingFeature*>(state_.get()) != nullptr ||
-      dynamic_cast<InputStates::SelectingDateMacro*>(state_.get()) != nullptr ||
-      dynamic_cast<InputStates::CustomMenu*>(state_.get()) != nullptr ||
-      dynamic_cast<InputStates::NumberInput*>(state_.get()) != nullptr ||
-      dynamic_cast<InputStates::IrohaCandidate*>(state_.get()) != nullptr) {
+  bool isCandidatePanelOn = false;
+  {
+    LatencyTracer::Scope scope(latencyTracer_.get(),
+                               LatencyTracer::Stage::kDispatch);
+    isCandidatePanelOn =
+        dynamic_cast<InputStates::ChoosingCandidate*>(state_.get()) !=
+            nullptr ||
+        dynamic_cast<InputStates::SelectingDictionary*>(state_.get()) !=
+            nullptr ||
+        dynamic_cast<InputStates::ShowingCharInfo*>(state_.get()) != nullptr ||
+        dynamic_cast<InputStates::AssociatedPhrases*>(state_.get()) !=
+            nullptr ||
+        dynamic_cast<InputStates::AssociatedPhrasesPlain*>(state_.get()) !=
+            nullptr ||
+        dynamic_cast<InputStates::SelectingFeature*>(state_.get()) != nullptr ||
+        dynamic_cast<InputStates::SelectingDateMacro*>(state_.get()) !=
+            nullptr ||
+        dynamic_cast<InputStates::CustomMenu*>(state_.get()) != nullptr ||
+        dynamic_cast<InputStates::NumberInput*>(state_.get()) != nullptr ||
+        dynamic_cast<InputStates::IrohaCandidate*>(state_.get()) != nullptr;
+  }
+  if (isCandidatePanelOn) {
     // Absorb all keys when the candidate panel is on.
     keyEvent.filterAndAccept();
 
@@ -881,14 +956,19 @@ void McBopomofoEngine::keyEvent(const fcitx::InputMethodEntry& /*unused*/,
     }
   }
 
-  bool accepted = keyHandler_->handle(
-      MapFcitxKey(key, origKey), state_.get(),
-      [this, context](std::unique_ptr<InputState> next) {
-        handleStateOrSequence(context, std::move(next));
-      },
-      []() {
-        // TODO(unassigned): beep?
-      });
+  bool accepted = false;
+  {
+    LatencyTracer::Scope scope(latencyTracer_.get(),
+                               LatencyTracer::Stage::kKeyHandlerHandle);
+    accepted = keyHandler_->handle(
+        MapFcitxKey(key, origKey), state_.get(),
+        [this, context](std::unique_ptr<InputState> next) {
+          handleStateOrSequence(context, std::move(next));
+        },
+        []() {
+          // TODO(unassigned): beep?
+        });
+  }
 
   if (accepted) {
     keyEvent.filterAndAccept();
@@ -1613,6 +1693,8 @@ void McBopomofoEngine::handleInputtingState(fcitx::InputContext* context,
 void McBopomofoEngine::handleCandidatesState(fcitx::InputContext* context,
                                              InputState* /*unused*/,
                                              InputState* current) {
+  LatencyTracer::Scope scope(latencyTracer_.get(),
+                             LatencyTracer::Stage::kCandidateList);
   std::unique_ptr<fcitx::CommonCandidateList> candidateList =
       std::make_unique<fcitx::CommonCandidateList>();
 
@@ -1695,18 +1777,24 @@ void McBopomofoEngine::handleCandidatesState(fcitx::InputContext* context,
     // the same values. The display text of such a candidate will be in the
     // form of "value (reading)" to help user disambiguate those candidates.
 
-    std::unordered_map<std::string, size_t> valueCountMap;
+    // The values are looked up without making the candidates, which is only
+    // needed for the readings of the duplicates.
+    const InputStates::ChoosingCandidate::CandidateList& candidates =
+        choosing->candidates;
+    std::unordered_map<std::string_view, size_t> valueCountMap;
+    valueCountMap.reserve(candidates.size());
 
-    for (const auto& c : choosing->candidates) {
-      ++valueCountMap[c.value];
+    for (size_t i = 0, size = candidates.size(); i < size; ++i) {
+      ++valueCountMap[candidates.valueAt(i)];
     }
 
-    for (const auto& c : choosing->candidates) {
-      std::string displayText = c.value;
+    for (size_t i = 0, size = candidates.size(); i < size; ++i) {
+      std::string_view value = candidates.valueAt(i);
+      std::string displayText(value);
 
-      if (valueCountMap[displayText] > 1) {
+      if (valueCountMap[value] > 1) {
         displayText += " (";
-        std::string reading = c.reading;
+        std::string reading = candidates[i].reading;
         std::replace(reading.begin(), reading.end(),
                      KeyHandler::kJoinSeparator[0], ' ');
         displayText += reading;
@@ -1714,9 +1802,9 @@ void McBopomofoEngine::handleCandidatesState(fcitx::InputContext* context,
       }
 
       std::unique_ptr<fcitx::CandidateWord> candidate =
-          std::make_unique<McBopomofoCandidateWord>(fcitx::Text(displayText), c,
-                                                    choosing->originalCursor,
-                                                    keyHandler_, callback);
+          std::make_unique<McBopomofoCandidateWord>(
+              fcitx::Text(displayText), candidates, i, choosing->originalCursor,
+              keyHandler_, callback);
       candidateList->append(std::move(candidate));
     }
   } else if (selectingDictionary != nullptr) {
@@ -1774,12 +1862,13 @@ void McBopomofoEngine::handleCandidatesState(fcitx::InputContext* context,
       }
     }
   } else if (associatedPhrasesPlain != nullptr) {
-    std::vector<InputStates::ChoosingCandidate::Candidate> candidates =
-        associatedPhrasesPlain->candidates;
-    for (const auto& c : candidates) {
+    InputStates::ChoosingCandidate::CandidateList candidates(
+        associatedPhrasesPlain->candidates);
+    for (size_t i = 0, size = candidates.size(); i < size; ++i) {
       std::unique_ptr<fcitx::CandidateWord> candidate =
-          std::make_unique<McBopomofoCandidateWord>(fcitx::Text(c.value), c, 0,
-                                                    keyHandler_, callback);
+          std::make_unique<McBopomofoCandidateWord>(
+              fcitx::Text(candidates[i].value), candidates, i, 0, keyHandler_,
+              callback);
       candidateList->append(std::move(candidate));
     }
   } else if (selectingFeature != nullptr) {
@@ -1883,10 +1972,9 @@ fcitx::CandidateLayoutHint McBopomofoEngine::getCandidateLayoutHint() const {
   auto* choosingCandidate =
       dynamic_cast<InputStates::ChoosingCandidate*>(state_.get());
   if (choosingCandidate != nullptr) {
-    auto candidates = choosingCandidate->candidates;
-    for (const InputStates::ChoosingCandidate::Candidate& candidate :
-         candidates) {
-      std::string value = candidate.value;
+    const auto& candidates = choosingCandidate->candidates;
+    for (size_t i = 0, size = candidates.size(); i < size; ++i) {
+      std::string value(candidates.valueAt(i));
       if (McBopomofo::CodePointCount(value) >
           kForceVerticalCandidateThreshold) {
         return fcitx::CandidateLayoutHint::Vertical;
@@ -1939,6 +2027,73 @@ void McBopomofoEngine::updatePreedit(fcitx::InputContext* context,
   context->updatePreedit();
 }
 
+void McBopomofoEngine::setUpUserDataWatcher() {
+  std::vector<std::filesystem::path> paths =
+      languageModelLoader_->userDataFilePaths();
+  if (paths.empty() || !userDataWatcher_.watch(paths)) {
+    FCITX_MCBOPOMOFO_INFO()
+        << "Not watching user data files; will check them upon activation";
+    return;
+  }
+
+  userDataWatcherEvent_ = instance_->eventLoop().addIOEvent(
+      userDataWatcher_.fd(), fcitx::IOEventFlag::In,
+      [this](fcitx::EventSourceIO* /*unused*/, int /*unused*/,
+             fcitx::IOEventFlags /*unused*/) {
+        if (userDataWatcher_.readEvents()) {
+          scheduleUserModelReload();
+        }
+        if (!userDataWatcher_.isWatching()) {
+          // The directory is gone. activate() falls back to the timestamps.
+          FCITX_MCBOPOMOFO_WARN() << "Lost the watch on user data files";
+          userDataWatcherEvent_->setEnabled(false);
+        }
+        return true;
+      });
+}
+
+void McBopomofoEngine::scheduleUserModelReload() {
+  // Editors may write a file in several steps; wait until they are done.
+  constexpr uint64_t kReloadDelayUsec = 200000;
+  uint64_t time = fcitx::now(CLOCK_MONOTONIC) + kReloadDelayUsec;
+  if (userModelReloadTimer_ == nullptr) {
+    userModelReloadTimer_ = instance_->eventLoop().addTimeEvent(
+        CLOCK_MONOTONIC, time, 0,
+        [this](fcitx::EventSourceTime* /*unused*/, uint64_t /*unused*/) {
+          reloadUserModels();
+          return true;
+        });
+  } else {
+    userModelReloadTimer_->setTime(time);
+  }
+  userModelReloadTimer_->setOneShot();
+}
+
+void McBopomofoEngine::scheduleUserPhraseCompaction() {
+  // Each edit pushes the compaction back, so that the files are rewritten
+  // only once the user has stopped adding phrases for a while.
+  constexpr uint64_t kCompactionDelayUsec = 30000000;
+  uint64_t time = fcitx::now(CLOCK_MONOTONIC) + kCompactionDelayUsec;
+  if (userPhraseCompactionTimer_ == nullptr) {
+    userPhraseCompactionTimer_ = instance_->eventLoop().addTimeEvent(
+        CLOCK_MONOTONIC, time, 0,
+        [this](fcitx::EventSourceTime* /*unused*/, uint64_t /*unused*/) {
+          languageModelLoader_->compactUserPhrases();
+          return true;
+        });
+  } else {
+    userPhraseCompactionTimer_->setTime(time);
+  }
+  userPhraseCompactionTimer_->setOneShot();
+}
+
+void McBopomofoEngine::reloadUserModels() {
+  bool didReload = languageModelLoader_->reloadUserModelsIfNeeded();
+  if (didReload) {
+    userFileIssues_ = languageModelLoader_->getUserFileIssues();
+  }
+}
+
 void McBopomofoEngine::showAndClearUserFileIssues() {
   size_t numIssues = 0;
   const size_t MAX_ISSUES = 3;
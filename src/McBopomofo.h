@@ -27,6 +27,7 @@
 #include <fcitx-config/configuration.h>
 #include <fcitx-config/enum.h>
 #include <fcitx-config/iniparser.h>
+#include <fcitx-utils/event.h>
 #include <fcitx-utils/i18n.h>
 #include <fcitx-utils/standardpath.h>
 #include <fcitx/action.h>
@@ -40,10 +41,12 @@
 #include <string>
 #include <type_traits>
 
+#include "Engine/LatencyTracer.h"
 #include "InputState.h"
 #include "KeyHandler.h"
 #include "LanguageModelLoader.h"
 #include "PathCompat.h"
+#include "UserDataWatcher.h"
 
 namespace McBopomofo {
 
@@ -152,6 +155,18 @@ FCITX_CONFIGURATION(
         this, "EscKeyClearsEntireComposingBuffer",
         _("ESC key clears entire composing buffer"), false};
 
+    // Commit the settled text this many syllables behind the cursor while
+    // typing, so that a very long composing buffer stays short. 0 disables it.
+    fcitx::Option<int, fcitx::IntConstrain> autoCommitDistance{
+        this, "AutoCommitDistance",
+        _("Commit settled text this many syllables behind cursor (0: off)"),
+        0, fcitx::IntConstrain(0, 100)};
+
+    // Time each keystroke and its stages, so that slow keystrokes can be
+    // reported with the histograms from "Save Keystroke Latency".
+    fcitx::Option<bool> latencyTracingEnabled{
+        this, "LatencyTracingEnabled", _("Record keystroke latency"), false};
+
     // Allow inputting Chinese when Caps Lock is on.
     fcitx::Option<bool> capsLockAllowChineseInput{
         this, "capsLockAllowChineseInput",
@@ -305,11 +320,23 @@ class McBopomofoEngine : public fcitx::InputMethodEngine {
 
   void showAndClearUserFileIssues();
 
+  // Watches the user data files so that they are reloaded as soon as they
+  // change, instead of checking their timestamps upon every activation.
+  void setUpUserDataWatcher();
+  // Reloads the user data files after a short delay, so that a burst of
+  // writes leads to only one reload.
+  void scheduleUserModelReload();
+  void reloadUserModels();
+  // Folds the user phrase journal into the user data files once the user
+  // has been idle for a while.
+  void scheduleUserPhraseCompaction();
+
   fcitx::CandidateLayoutHint getCandidateLayoutHint() const;
 
   std::shared_ptr<LanguageModelLoader> languageModelLoader_;
   std::vector<McBopomofoLM::UserFileIssue> userFileIssues_;
   std::shared_ptr<KeyHandler> keyHandler_;
+  std::shared_ptr<LatencyTracer> latencyTracer_;
   std::unique_ptr<InputState> state_;
   McBopomofoConfig config_;
   fcitx::KeyList selectionKeys_;
@@ -320,6 +347,14 @@ class McBopomofoEngine : public fcitx::InputMethodEngine {
   std::unique_ptr<fcitx::SimpleAction> bopomofoFontAnnotationSupportAction_;
   std::unique_ptr<fcitx::SimpleAction> editUserPhrasesAction_;
   std::unique_ptr<fcitx::SimpleAction> excludedPhrasesAction_;
+  std::unique_ptr<fcitx::SimpleAction> saveLatencyAction_;
+
+  // The event sources are declared after the watcher so that they go away
+  // before the watcher closes its fd.
+  UserDataWatcher userDataWatcher_;
+  std::unique_ptr<fcitx::EventSourceIO> userDataWatcherEvent_;
+  std::unique_ptr<fcitx::EventSourceTime> userModelReloadTimer_;
+  std::unique_ptr<fcitx::EventSourceTime> userPhraseCompactionTimer_;
 };
 
 class McBopomofoEngineFactory : public fcitx::AddonFactory {
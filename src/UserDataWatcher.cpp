@@ -0,0 +1,128 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "UserDataWatcher.h"
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace McBopomofo {
+
+// Writes show up as IN_CLOSE_WRITE (and a burst of IN_MODIFY before that),
+// while replacing, creating, or removing a file shows up as the rest.
+static constexpr uint32_t kWatchMask = IN_CLOSE_WRITE | IN_MODIFY |
+                                       IN_MOVED_TO | IN_MOVED_FROM |
+                                       IN_CREATE | IN_DELETE;
+
+UserDataWatcher::~UserDataWatcher() { stop(); }
+
+bool UserDataWatcher::watch(const std::vector<std::filesystem::path>& paths) {
+  stop();
+  if (paths.empty()) {
+    return false;
+  }
+
+  std::filesystem::path directory = paths.front().parent_path();
+  for (const auto& path : paths) {
+    if (path.parent_path() != directory) {
+      return false;
+    }
+    fileNames_.push_back(path.filename().string());
+  }
+
+  fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd_ == -1) {
+    fileNames_.clear();
+    return false;
+  }
+
+  watchDescriptor_ = inotify_add_watch(fd_, directory.c_str(), kWatchMask);
+  if (watchDescriptor_ == -1) {
+    stop();
+    return false;
+  }
+  return true;
+}
+
+void UserDataWatcher::stop() {
+  if (fd_ != -1) {
+    // Closing the fd also removes the watch.
+    close(fd_);
+  }
+  fd_ = -1;
+  watchDescriptor_ = -1;
+  fileNames_.clear();
+}
+
+bool UserDataWatcher::readEvents() {
+  if (fd_ == -1) {
+    return false;
+  }
+
+  bool relevant = false;
+  alignas(struct inotify_event) char buffer[4096];
+  while (true) {
+    ssize_t length = read(fd_, buffer, sizeof(buffer));
+    if (length == -1 && errno == EINTR) {
+      continue;
+    }
+    if (length <= 0) {
+      // EAGAIN: all events have been read.
+      break;
+    }
+
+    for (char* p = buffer; p < buffer + length;) {
+      struct inotify_event event;
+      memcpy(&event, p, sizeof(event));
+      const char* name = p + sizeof(struct inotify_event);
+      p += sizeof(struct inotify_event) + event.len;
+
+      if (event.mask & IN_Q_OVERFLOW) {
+        // Some events were dropped, so any of the files may have changed.
+        relevant = true;
+        continue;
+      }
+      if (event.mask & IN_IGNORED) {
+        // The directory was removed or unmounted. The owner falls back to
+        // checking the timestamps.
+        watchDescriptor_ = -1;
+        relevant = true;
+        continue;
+      }
+      if (event.len == 0) {
+        continue;
+      }
+      if (std::find(fileNames_.begin(), fileNames_.end(), name) !=
+          fileNames_.end()) {
+        relevant = true;
+      }
+    }
+  }
+  return relevant;
+}
+
+}  // namespace McBopomofo
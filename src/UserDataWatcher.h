@@ -0,0 +1,73 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_USERDATAWATCHER_H_
+#define SRC_USERDATAWATCHER_H_
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace McBopomofo {
+
+// Watches the user data files (the user phrases, the excluded phrases, and
+// the phrase replacement map) with inotify. The watch is placed on their
+// directory, so that a file replaced by a rename, which is how most editors
+// save, or created later, is noticed as well.
+//
+// The watcher has no event loop of its own. Its owner polls fd() for input
+// and calls readEvents() when the fd becomes readable.
+class UserDataWatcher {
+ public:
+  UserDataWatcher() = default;
+  ~UserDataWatcher();
+
+  UserDataWatcher(const UserDataWatcher&) = delete;
+  UserDataWatcher& operator=(const UserDataWatcher&) = delete;
+
+  // Starts watching the files, which must all be in the same, existing
+  // directory. Returns false if inotify is not available, in which case the
+  // owner should check the files' timestamps itself.
+  bool watch(const std::vector<std::filesystem::path>& paths);
+  void stop();
+
+  // False if watch() failed or was never called, or if the directory has
+  // gone away since.
+  [[nodiscard]] bool isWatching() const { return watchDescriptor_ != -1; }
+
+  [[nodiscard]] int fd() const { return fd_; }
+
+  // Drains the pending events without blocking. Returns true if any of them
+  // may concern one of the files, including when the kernel's event queue
+  // overflowed or the watch was lost.
+  bool readEvents();
+
+ private:
+  int fd_ = -1;
+  int watchDescriptor_ = -1;
+  std::vector<std::string> fileNames_;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_USERDATAWATCHER_H_
@@ -0,0 +1,100 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <filesystem>
+
+#include "Engine/TestTempDir.h"
+#include "UserDataWatcher.h"
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+TEST(UserDataWatcherTest, NotWatchingByDefault) {
+  UserDataWatcher watcher;
+  EXPECT_FALSE(watcher.isWatching());
+  EXPECT_FALSE(watcher.readEvents());
+  EXPECT_FALSE(watcher.watch({}));
+}
+
+TEST(UserDataWatcherTest, MissingDirectory) {
+  TempDir dir;
+  UserDataWatcher watcher;
+  EXPECT_FALSE(watcher.watch({dir.file("nonexistent") / "data.txt"}));
+  EXPECT_FALSE(watcher.isWatching());
+}
+
+TEST(UserDataWatcherTest, FilesMustShareTheDirectory) {
+  TempDir dir;
+  TempDir otherDir;
+  UserDataWatcher watcher;
+  EXPECT_FALSE(
+      watcher.watch({dir.file("data.txt"), otherDir.file("data.txt")}));
+}
+
+TEST(UserDataWatcherTest, ReportsChangesToWatchedFiles) {
+  TempDir dir;
+  Write(dir.file("data.txt"), "");
+  UserDataWatcher watcher;
+  ASSERT_TRUE(watcher.watch(
+      {dir.file("data.txt"), dir.file("exclude-phrases.txt")}));
+  EXPECT_TRUE(watcher.isWatching());
+  EXPECT_FALSE(watcher.readEvents());
+
+  // A burst of writes is drained at once.
+  Write(dir.file("data.txt"), "小 ㄒㄧㄠˇ\n");
+  Write(dir.file("data.txt"), "大 ㄉㄚˋ\n");
+  EXPECT_TRUE(watcher.readEvents());
+  EXPECT_FALSE(watcher.readEvents());
+
+  // Other files in the directory are ignored.
+  Write(dir.file("other.txt"), "");
+  EXPECT_FALSE(watcher.readEvents());
+
+  // A file created later, the way editors save: write, then rename.
+  Write(dir.file("exclude-phrases.txt.tmp"), "");
+  std::filesystem::rename(dir.file("exclude-phrases.txt.tmp"),
+                          dir.file("exclude-phrases.txt"));
+  EXPECT_TRUE(watcher.readEvents());
+
+  std::filesystem::remove(dir.file("data.txt"));
+  EXPECT_TRUE(watcher.readEvents());
+
+  watcher.stop();
+  EXPECT_FALSE(watcher.isWatching());
+  Write(dir.file("data.txt"), "");
+  EXPECT_FALSE(watcher.readEvents());
+}
+
+TEST(UserDataWatcherTest, LosingTheDirectoryStopsTheWatch) {
+  TempDir dir;
+  std::filesystem::path subdir = dir.file("mcbopomofo");
+  std::filesystem::create_directory(subdir);
+  UserDataWatcher watcher;
+  ASSERT_TRUE(watcher.watch({subdir / "data.txt"}));
+
+  std::filesystem::remove_all(subdir);
+  EXPECT_TRUE(watcher.readEvents());
+  EXPECT_FALSE(watcher.isWatching());
+}
+
+}  // namespace McBopomofo
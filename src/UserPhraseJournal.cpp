@@ -0,0 +1,285 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include "UserPhraseJournal.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace McBopomofo {
+
+namespace {
+
+// The lines of a user file. Comments and empty lines are kept as they are.
+struct TextFile {
+  std::vector<std::string> lines;
+  bool changed = false;
+};
+
+bool ReadTextFile(const std::filesystem::path& path, TextFile* file) {
+  std::ifstream in(path);
+  if (!in.is_open()) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    file->lines.push_back(std::move(line));
+  }
+  return true;
+}
+
+bool IsPhraseLine(const std::string& line, const std::string& joined) {
+  if (line.empty() || line[0] == '#') {
+    return false;
+  }
+  // Ignore trailing whitespace.
+  size_t end = line.find_last_not_of(" \t\r\n");
+  return end != std::string::npos &&
+         std::string_view(line).substr(0, end + 1) == joined;
+}
+
+// Removes the lines of the phrase. Returns true if there were any.
+bool RemovePhrase(TextFile* file, const std::string& joined) {
+  size_t removed = std::erase_if(file->lines, [&joined](const auto& line) {
+    return IsPhraseLine(line, joined);
+  });
+  if (removed > 0) {
+    file->changed = true;
+  }
+  return removed > 0;
+}
+
+void AddPhraseIfAbsent(TextFile* file, const std::string& joined) {
+  if (std::none_of(
+          file->lines.begin(), file->lines.end(),
+          [&joined](const auto& line) { return IsPhraseLine(line, joined); })) {
+    file->lines.push_back(joined);
+    file->changed = true;
+  }
+}
+
+bool WriteFully(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t written = write(fd, data.data(), data.size());
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data.remove_prefix(static_cast<size_t>(written));
+  }
+  return true;
+}
+
+// Makes a rename or a truncation in the directory durable.
+bool SyncDirectory(const std::filesystem::path& path) {
+  std::filesystem::path dir = path.empty() ? "." : path;
+  int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  bool result = fsync(fd) == 0;
+  close(fd);
+  return result;
+}
+
+// Replaces the file through a synced temporary file, so that after a crash
+// the file has either the old or the new content, and never less.
+bool WriteTextFileIfChanged(const std::filesystem::path& path,
+                            const TextFile& file) {
+  if (!file.changed) {
+    return true;
+  }
+  std::filesystem::path tmpPath = path;
+  tmpPath += ".tmp";
+  int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0644);
+  if (fd < 0) {
+    return false;
+  }
+  std::string content;
+  for (const std::string& line : file.lines) {
+    content += line;
+    content += '\n';
+  }
+  bool written = WriteFully(fd, content) && fsync(fd) == 0;
+  if (close(fd) != 0 || !written) {
+    return false;
+  }
+
+  std::error_code err;
+  std::filesystem::rename(tmpPath, path, err);
+  return !err && SyncDirectory(path.parent_path());
+}
+
+// Cuts off a last line that has no newline, which a crash left behind, so
+// that the next line does not get glued to it.
+bool DropTornTail(int fd) {
+  struct stat st {};
+  if (fstat(fd, &st) != 0) {
+    return false;
+  }
+  if (st.st_size == 0) {
+    return true;
+  }
+
+  char last = 0;
+  if (pread(fd, &last, 1, st.st_size - 1) != 1) {
+    return false;
+  }
+  if (last == '\n') {
+    return true;
+  }
+
+  std::string content(static_cast<size_t>(st.st_size), '\0');
+  if (pread(fd, content.data(), content.size(), 0) != st.st_size) {
+    return false;
+  }
+  size_t newline = content.rfind('\n');
+  off_t length = newline == std::string::npos ? 0 : newline + 1;
+  return ftruncate(fd, length) == 0;
+}
+
+}  // namespace
+
+UserPhraseJournal::UserPhraseJournal(std::filesystem::path path)
+    : path_(std::move(path)) {
+  size_ = read().size();
+}
+
+bool UserPhraseJournal::append(const Entry& entry) {
+  if (path_.empty()) {
+    return false;
+  }
+  int fd = open(path_.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+
+  std::string line;
+  line += entry.add ? '+' : '-';
+  line += ' ';
+  line += entry.value;
+  line += ' ';
+  line += entry.reading;
+  line += '\n';
+
+  // Sync the data, so that an entry survives a power loss, too, once the
+  // edit has been applied.
+  bool result =
+      DropTornTail(fd) && WriteFully(fd, line) && fdatasync(fd) == 0;
+  close(fd);
+  if (result) {
+    ++size_;
+  }
+  return result;
+}
+
+std::vector<UserPhraseJournal::Entry> UserPhraseJournal::read() const {
+  std::vector<Entry> entries;
+  std::ifstream in(path_, std::ios::binary);
+  if (!in.is_open()) {
+    return entries;
+  }
+  std::stringstream buffer;
+  buffer << in.rdbuf();
+  std::string content = buffer.str();
+
+  // Only complete lines count; a last line without a newline is torn.
+  size_t start = 0;
+  size_t newline;
+  while ((newline = content.find('\n', start)) != std::string::npos) {
+    std::istringstream line(content.substr(start, newline - start));
+    start = newline + 1;
+    std::string op;
+    std::string extra;
+    Entry entry;
+    if (!(line >> op >> entry.value >> entry.reading) || (line >> extra) ||
+        (op != "+" && op != "-")) {
+      continue;
+    }
+    entry.add = op == "+";
+    entries.push_back(std::move(entry));
+  }
+  return entries;
+}
+
+bool UserPhraseJournal::compactInto(
+    const std::filesystem::path& userPhrasesPath,
+    const std::filesystem::path& excludedPhrasesPath) {
+  if (path_.empty()) {
+    return false;
+  }
+  std::vector<Entry> entries = read();
+  if (!entries.empty()) {
+    TextFile userPhrases;
+    TextFile excludedPhrases;
+    if (!ReadTextFile(userPhrasesPath, &userPhrases) ||
+        !ReadTextFile(excludedPhrasesPath, &excludedPhrases)) {
+      return false;
+    }
+
+    for (const Entry& entry : entries) {
+      std::string joined = entry.value + " " + entry.reading;
+      if (entry.add) {
+        RemovePhrase(&excludedPhrases, joined);
+        AddPhraseIfAbsent(&userPhrases, joined);
+      } else {
+        RemovePhrase(&userPhrases, joined);
+        AddPhraseIfAbsent(&excludedPhrases, joined);
+      }
+    }
+
+    if (!WriteTextFileIfChanged(userPhrasesPath, userPhrases) ||
+        !WriteTextFileIfChanged(excludedPhrasesPath, excludedPhrases)) {
+      return false;
+    }
+  }
+
+  // The files have been synced, and replaying the entries again would not
+  // change them, so a crash before this point is harmless.
+  int fd = open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  bool truncated = fdatasync(fd) == 0;
+  if (close(fd) != 0 || !truncated) {
+    return false;
+  }
+  size_ = 0;
+  return true;
+}
+
+}  // namespace McBopomofo
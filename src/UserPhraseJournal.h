@@ -0,0 +1,82 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#ifndef SRC_USERPHRASEJOURNAL_H_
+#define SRC_USERPHRASEJOURNAL_H_
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace McBopomofo {
+
+// A write-ahead journal of the edits to the user phrase and excluded phrase
+// files. Adding or removing a phrase only appends a line to the journal, so
+// that it costs the same no matter how large the files are; the files are
+// rewritten later by compactInto(), all edits at once. A journal that was
+// not compacted, for example because the input method was killed, is simply
+// compacted the next time.
+//
+// Each line is "+ value reading" or "- value reading"; other lines are
+// skipped. A last line without a newline was torn by a crash: read() ignores
+// it, and append() cuts it off before writing. Appends are synced to disk.
+class UserPhraseJournal {
+ public:
+  struct Entry {
+    // True for adding the phrase, false for removing (excluding) it.
+    bool add = false;
+    std::string reading;
+    std::string value;
+  };
+
+  UserPhraseJournal() = default;
+  explicit UserPhraseJournal(std::filesystem::path path);
+
+  [[nodiscard]] const std::filesystem::path& path() const { return path_; }
+
+  // The number of entries in the journal.
+  [[nodiscard]] size_t size() const { return size_; }
+
+  bool append(const Entry& entry);
+
+  [[nodiscard]] std::vector<Entry> read() const;
+
+  // Applies the entries in order to the files, the same way
+  // LanguageModelLoader used to edit them one phrase at a time: adding a
+  // phrase also removes it from the excluded phrases, and removing a phrase
+  // also adds it to the excluded phrases. A file is replaced, by a rename,
+  // only if it changes. The journal is emptied only after the new files and
+  // their directory have been synced to disk. Returns false, keeping the
+  // journal, if a file cannot be read or written.
+  bool compactInto(const std::filesystem::path& userPhrasesPath,
+                   const std::filesystem::path& excludedPhrasesPath);
+
+ private:
+  std::filesystem::path path_;
+  size_t size_ = 0;
+};
+
+}  // namespace McBopomofo
+
+#endif  // SRC_USERPHRASEJOURNAL_H_
@@ -0,0 +1,155 @@
+// Copyright (c) 2026 and onwards The McBopomofo Authors.
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use,
+// copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following
+// conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+// OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+// HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+// OTHER DEALINGS IN THE SOFTWARE.
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "Engine/TestTempDir.h"
+#include "UserPhraseJournal.h"
+#include "gtest/gtest.h"
+
+namespace McBopomofo {
+
+namespace {
+
+std::string Read(const std::filesystem::path& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::stringstream buffer;
+  buffer << in.rdbuf();
+  return buffer.str();
+}
+
+}  // namespace
+
+TEST(UserPhraseJournalTest, AppendAndRead) {
+  TempDir dir;
+  UserPhraseJournal journal(dir.file("user-phrases.journal"));
+  EXPECT_EQ(journal.size(), 0);
+  EXPECT_TRUE(journal.read().empty());
+
+  ASSERT_TRUE(journal.append({true, "ㄇㄧㄥˊ-ㄐㄧㄢˋ", "名鑑"}));
+  ASSERT_TRUE(journal.append({false, "ㄉㄨㄥˋ", "丼"}));
+  EXPECT_EQ(journal.size(), 2);
+
+  auto entries = journal.read();
+  ASSERT_EQ(entries.size(), 2);
+  EXPECT_TRUE(entries[0].add);
+  EXPECT_EQ(entries[0].reading, "ㄇㄧㄥˊ-ㄐㄧㄢˋ");
+  EXPECT_EQ(entries[0].value, "名鑑");
+  EXPECT_FALSE(entries[1].add);
+
+  // Reopening counts the entries.
+  UserPhraseJournal reopened(dir.file("user-phrases.journal"));
+  EXPECT_EQ(reopened.size(), 2);
+}
+
+TEST(UserPhraseJournalTest, TornLastLineIsIgnored) {
+  TempDir dir;
+  Write(dir.file("user-phrases.journal"),
+        "+ 名鑑 ㄇㄧㄥˊ-ㄐㄧㄢˋ\n- 丼 ㄉㄨㄥˋ");
+  UserPhraseJournal journal(dir.file("user-phrases.journal"));
+  EXPECT_EQ(journal.size(), 1);
+}
+
+TEST(UserPhraseJournalTest, AppendAfterTornLastLine) {
+  TempDir dir;
+  std::filesystem::path userPhrases = dir.file("data.txt");
+  std::filesystem::path excludedPhrases = dir.file("exclude-phrases.txt");
+  Write(userPhrases, "");
+  Write(excludedPhrases, "");
+  Write(dir.file("user-phrases.journal"), "+ 測試 ㄘㄜˋ");
+
+  UserPhraseJournal journal(dir.file("user-phrases.journal"));
+  EXPECT_EQ(journal.size(), 0);
+  ASSERT_TRUE(journal.append({true, "ㄏㄠˇ", "好"}));
+  EXPECT_EQ(Read(dir.file("user-phrases.journal")), "+ 好 ㄏㄠˇ\n");
+
+  auto entries = journal.read();
+  ASSERT_EQ(entries.size(), 1);
+  EXPECT_EQ(entries[0].value, "好");
+  EXPECT_EQ(entries[0].reading, "ㄏㄠˇ");
+
+  ASSERT_TRUE(journal.compactInto(userPhrases, excludedPhrases));
+  EXPECT_EQ(Read(userPhrases), "好 ㄏㄠˇ\n");
+}
+
+TEST(UserPhraseJournalTest, MalformedLinesAreSkipped) {
+  TempDir dir;
+  Write(dir.file("user-phrases.journal"),
+        "+ 測試 ㄘㄜˋ+ 好 ㄏㄠˇ\n"
+        "* 好 ㄏㄠˇ\n"
+        "+ 好\n"
+        "- 丼 ㄉㄨㄥˋ\n");
+  UserPhraseJournal journal(dir.file("user-phrases.journal"));
+  auto entries = journal.read();
+  ASSERT_EQ(entries.size(), 1);
+  EXPECT_FALSE(entries[0].add);
+  EXPECT_EQ(entries[0].value, "丼");
+}
+
+TEST(UserPhraseJournalTest, CompactInto) {
+  TempDir dir;
+  std::filesystem::path userPhrases = dir.file("data.txt");
+  std::filesystem::path excludedPhrases = dir.file("exclude-phrases.txt");
+  Write(userPhrases, "# user phrases\n丼 ㄉㄨㄥˋ\n名刺 ㄇㄧㄥˊ-ㄘˋ");
+  Write(excludedPhrases, "# excluded phrases\n動作 ㄉㄨㄥˋ-ㄗㄨㄛˋ  \n");
+
+  UserPhraseJournal journal(dir.file("user-phrases.journal"));
+  journal.append({true, "ㄇㄧㄥˊ-ㄐㄧㄢˋ", "名鑑"});
+  journal.append({true, "ㄉㄨㄥˋ-ㄗㄨㄛˋ", "動作"});
+  journal.append({false, "ㄉㄨㄥˋ", "丼"});
+  // Already a user phrase.
+  journal.append({true, "ㄇㄧㄥˊ-ㄘˋ", "名刺"});
+
+  ASSERT_TRUE(journal.compactInto(userPhrases, excludedPhrases));
+  EXPECT_EQ(journal.size(), 0);
+  EXPECT_TRUE(journal.read().empty());
+  EXPECT_EQ(Read(userPhrases),
+            "# user phrases\n名刺 ㄇㄧㄥˊ-ㄘˋ\n名鑑 ㄇㄧㄥˊ-ㄐㄧㄢˋ\n"
+            "動作 ㄉㄨㄥˋ-ㄗㄨㄛˋ\n");
+  EXPECT_EQ(Read(excludedPhrases), "# excluded phrases\n丼 ㄉㄨㄥˋ\n");
+
+  // Replaying the same entries, as after a crash before the journal was
+  // emptied, changes nothing.
+  journal.append({true, "ㄇㄧㄥˊ-ㄐㄧㄢˋ", "名鑑"});
+  journal.append({true, "ㄉㄨㄥˋ-ㄗㄨㄛˋ", "動作"});
+  journal.append({false, "ㄉㄨㄥˋ", "丼"});
+  auto modifiedTime = std::filesystem::last_write_time(userPhrases);
+  ASSERT_TRUE(journal.compactInto(userPhrases, excludedPhrases));
+  EXPECT_EQ(std::filesystem::last_write_time(userPhrases), modifiedTime);
+  EXPECT_EQ(Read(excludedPhrases), "# excluded phrases\n丼 ㄉㄨㄥˋ\n");
+}
+
+TEST(UserPhraseJournalTest, CompactionKeepsTheJournalOnFailure) {
+  TempDir dir;
+  UserPhraseJournal journal(dir.file("user-phrases.journal"));
+  journal.append({true, "ㄇㄧㄥˊ-ㄐㄧㄢˋ", "名鑑"});
+  EXPECT_FALSE(journal.compactInto(dir.file("missing.txt"),
+                                   dir.file("also-missing.txt")));
+  EXPECT_EQ(journal.size(), 1);
+  EXPECT_EQ(journal.read().size(), 1);
+}
+
+}  // namespace McBopomofo